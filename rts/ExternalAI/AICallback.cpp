@@ -10,6 +10,7 @@
 #include "Game/GameSetup.h"
 #include "Game/PlayerHandler.h"
 #include "Game/SelectedUnits.h"
+#include "Sim/Misc/Team.h"
 #include "Sim/Misc/TeamHandler.h"
 #include "Game/UI/MiniMap.h"
 #include "Game/UI/MouseHandler.h"
@@ -44,6 +45,7 @@
 #include "AICheats.h"
 #include "ExternalAI/GlobalAICallback.h"
 #include "ExternalAI/SkirmishAIHandler.h"
+#include "ExternalAI/SkirmishAIWorker.h"
 #include "ExternalAI/SkirmishAIWrapper.h"
 #include "ExternalAI/EngineOutHandler.h"
 #include "Sim/Units/Groups/Group.h"
@@ -64,6 +66,7 @@ CAICallback::CAICallback(int Team, CGroupHandler* ghandler)
 	: team(Team)
 	, noMessages(false)
 	, gh(ghandler)
+	, queueCommands(false)
 {}
 
 CAICallback::~CAICallback(void)
@@ -333,11 +336,26 @@ int CAICallback::GiveOrder(int unitId, Command* c)
 		return -5;
 	}
 
-	net->Send(CBaseNetProtocol::Get().SendAICommand(gu->myPlayerNum, unitId, c->id, c->options, c->params));
+	if (queueCommands) {
+		queuedCommands.push_back(std::make_pair(unitId, *c));
+		return 0;
+	}
+
+	net->Send(CBaseNetProtocol::Get().SendAICommand(gu->myPlayerNum, unitId, c->id, c->options, c->params.begin(), c->params.size()));
 
 	return 0;
 }
 
+void CAICallback::FlushQueuedCommands()
+{
+	std::vector< std::pair<int, Command> >::const_iterator qc;
+	for (qc = queuedCommands.begin(); qc != queuedCommands.end(); ++qc) {
+		const Command& c = qc->second;
+		net->Send(CBaseNetProtocol::Get().SendAICommand(gu->myPlayerNum, qc->first, c.id, c.options, c.params.begin(), c.params.size()));
+	}
+	queuedCommands.clear();
+}
+
 const std::vector<CommandDescription>* CAICallback::GetUnitCommands(int unitId)
 {
 	const std::vector<CommandDescription>* unitCommands = NULL;
@@ -684,23 +702,31 @@ bool CAICallback::IsUnitNeutral(int unitId) {
 	return isNeutral;
 }
 
+// Path requests and QuadField queries (which mark visited objects through
+// gs->tempNum) change shared state, so AIs updating on worker threads
+// have to take turns in the callbacks below that use them.
+
 int CAICallback::InitPath(float3 start, float3 end, int pathType)
 {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	return pathManager->RequestPath(moveinfo->moveData.at(pathType), start, end);
 }
 
 float3 CAICallback::GetNextWaypoint(int pathId)
 {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	return pathManager->NextWaypoint(pathId, ZeroVector);
 }
 
 void CAICallback::FreePath(int pathId)
 {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	pathManager->DeletePath(pathId);
 }
 
 float CAICallback::GetPathLength(float3 start, float3 end, int pathType)
 {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	const int pathID  = InitPath(start, end, pathType);
 	float     pathLen = -1.0f;
 
@@ -766,24 +792,37 @@ float CAICallback::GetPathLength(float3 start, float3 end, int pathType)
 
 
 
+// the per-allyteam visible unit sets are maintained by the CEngineOutHandler,
+// the losStatus checks weed out stale entries
+static inline const CUnit* GetVisibleEnemy(int unitId, int allyTeam, unsigned short losMask)
+{
+	const CUnit* u = uh->units[unitId];
+
+	if ((u == NULL) || u->isDead) {
+		return NULL;
+	}
+	if (teamHandler->Ally(u->allyteam, allyTeam)) {
+		return NULL;
+	}
+	if (!(u->losStatus[allyTeam] & losMask)) {
+		return NULL;
+	}
+	return u;
+}
+
 int CAICallback::GetEnemyUnits(int* unitIds, int unitIds_max)
 {
 	verify();
-	std::list<CUnit*>::iterator ui;
+	const int allyTeam = teamHandler->AllyTeam(team);
+	const std::set<int>& losUnits = eoh->GetLosUnitIds(allyTeam);
 	int a = 0;
 
-	for (std::list<CUnit*>::const_iterator ui = uh->activeUnits.begin();
-			ui != uh->activeUnits.end(); ++ui) {
-		const CUnit* u = *ui;
+	for (std::set<int>::const_iterator ui = losUnits.begin();
+			(ui != losUnits.end()) && (a < unitIds_max); ++ui) {
+		const CUnit* u = GetVisibleEnemy(*ui, allyTeam, LOS_INLOS);
 
-		if (!teamHandler->Ally(u->allyteam, teamHandler->AllyTeam(team)) &&
-		    (u->losStatus[teamHandler->AllyTeam(team)] & LOS_INLOS)) {
-			if (!IsUnitNeutral(u->id)) {
-				unitIds[a++] = u->id;
-				if (a >= unitIds_max) {
-					break;
-				}
-			}
+		if ((u != NULL) && !u->IsNeutral()) {
+			unitIds[a++] = u->id;
 		}
 	}
 
@@ -793,21 +832,27 @@ int CAICallback::GetEnemyUnits(int* unitIds, int unitIds_max)
 int CAICallback::GetEnemyUnitsInRadarAndLos(int* unitIds, int unitIds_max)
 {
 	verify();
-	std::list<CUnit*>::iterator ui;
+	const int allyTeam = teamHandler->AllyTeam(team);
+	const std::set<int>& losUnits   = eoh->GetLosUnitIds(allyTeam);
+	const std::set<int>& radarUnits = eoh->GetRadarUnitIds(allyTeam);
 	int a = 0;
 
-	for (std::list<CUnit*>::const_iterator ui = uh->activeUnits.begin();
-			ui != uh->activeUnits.end(); ++ui) {
-		const CUnit* u = *ui;
+	// neutral units are only recognized as such when in LOS
+	for (std::set<int>::const_iterator ui = radarUnits.begin();
+			(ui != radarUnits.end()) && (a < unitIds_max); ++ui) {
+		const CUnit* u = GetVisibleEnemy(*ui, allyTeam, LOS_INRADAR);
 
-		if (!teamHandler->Ally(u->allyteam, teamHandler->AllyTeam(team))
-				&& (u->losStatus[teamHandler->AllyTeam(team)] & (LOS_INLOS | LOS_INRADAR))) {
-			if (!IsUnitNeutral(u->id)) {
-				unitIds[a++] = u->id;
-				if (a >= unitIds_max) {
-					break;
-				}
-			}
+		if ((u != NULL) && !((u->losStatus[allyTeam] & LOS_INLOS) && u->IsNeutral())) {
+			unitIds[a++] = u->id;
+		}
+	}
+	// units in LOS but not in radar (eg. stealthy ones)
+	for (std::set<int>::const_iterator ui = losUnits.begin();
+			(ui != losUnits.end()) && (a < unitIds_max); ++ui) {
+		const CUnit* u = GetVisibleEnemy(*ui, allyTeam, LOS_INLOS);
+
+		if ((u != NULL) && !(u->losStatus[allyTeam] & LOS_INRADAR) && !u->IsNeutral()) {
+			unitIds[a++] = u->id;
 		}
 	}
 
@@ -818,6 +863,7 @@ int CAICallback::GetEnemyUnits(int* unitIds, const float3& pos, float radius,
 		int unitIds_max)
 {
 	verify();
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	std::vector<CUnit*> unit = qf->GetUnitsExact(pos, radius);
 	std::vector<CUnit*>::const_iterator ui;
 	int a = 0;
@@ -843,20 +889,22 @@ int CAICallback::GetEnemyUnits(int* unitIds, const float3& pos, float radius,
 int CAICallback::GetFriendlyUnits(int *unitIds, int unitIds_max)
 {
 	verify();
+	const int allyTeam = teamHandler->AllyTeam(team);
 	int a = 0;
 
-	for (std::list<CUnit*>::const_iterator ui = uh->activeUnits.begin();
-			ui != uh->activeUnits.end(); ++ui) {
-		const CUnit* u = *ui;
+	// walk the unit sets of the allied teams only
+	for (int t = 0; (t < teamHandler->ActiveTeams()) && (a < unitIds_max); ++t) {
+		if (!teamHandler->Ally(teamHandler->AllyTeam(t), allyTeam)) {
+			continue;
+		}
+		const CUnitSet& units = teamHandler->Team(t)->units;
+		for (CUnitSet::const_iterator ui = units.begin();
+				(ui != units.end()) && (a < unitIds_max); ++ui) {
+			const CUnit* u = *ui;
 
-		if (teamHandler->Ally(u->allyteam, teamHandler->AllyTeam(team))) {
-			// IsUnitNeutral does a LOS check, but inconsequential
-			// since we can always see friendly units anyway
-			if (!IsUnitNeutral(u->id)) {
+			// we can always see friendly units, so no LOS check
+			if (!u->IsNeutral()) {
 				unitIds[a++] = u->id;
-				if (a >= unitIds_max) {
-					break;
-				}
 			}
 		}
 	}
@@ -868,6 +916,7 @@ int CAICallback::GetFriendlyUnits(int *unitIds, const float3& pos, float radius,
 		int unitIds_max)
 {
 	verify();
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	std::vector<CUnit*> unit = qf->GetUnitsExact(pos, radius);
 	std::vector<CUnit*>::const_iterator ui;
 	int a = 0;
@@ -894,17 +943,30 @@ int CAICallback::GetFriendlyUnits(int *unitIds, const float3& pos, float radius,
 int CAICallback::GetNeutralUnits(int* unitIds, int unitIds_max)
 {
 	verify();
+	const int allyTeam = teamHandler->AllyTeam(team);
+	const std::set<int>& losUnits = eoh->GetLosUnitIds(allyTeam);
 	int a = 0;
 
-	for (std::list<CUnit*>::const_iterator ui = uh->activeUnits.begin(); ui != uh->activeUnits.end(); ++ui) {
-		const CUnit* u = *ui;
+	// allied neutrals (always in LOS)
+	for (int t = 0; (t < teamHandler->ActiveTeams()) && (a < unitIds_max); ++t) {
+		if (!teamHandler->Ally(teamHandler->AllyTeam(t), allyTeam)) {
+			continue;
+		}
+		const CUnitSet& units = teamHandler->Team(t)->units;
+		for (CUnitSet::const_iterator ui = units.begin();
+				(ui != units.end()) && (a < unitIds_max); ++ui) {
+			if ((*ui)->IsNeutral()) {
+				unitIds[a++] = (*ui)->id;
+			}
+		}
+	}
+	// non-allied neutrals in LOS
+	for (std::set<int>::const_iterator ui = losUnits.begin();
+			(ui != losUnits.end()) && (a < unitIds_max); ++ui) {
+		const CUnit* u = GetVisibleEnemy(*ui, allyTeam, LOS_INLOS);
 
-		// IsUnitNeutral does the LOS check
-		if (IsUnitNeutral(u->id)) {
+		if ((u != NULL) && u->IsNeutral()) {
 			unitIds[a++] = u->id;
-			if (a >= unitIds_max) {
-				break;
-			}
 		}
 	}
 
@@ -914,6 +976,7 @@ int CAICallback::GetNeutralUnits(int* unitIds, int unitIds_max)
 int CAICallback::GetNeutralUnits(int* unitIds, const float3& pos, float radius, int unitIds_max)
 {
 	verify();
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	std::vector<CUnit*> unit = qf->GetUnitsExact(pos, radius);
 	std::vector<CUnit*>::const_iterator ui;
 	int a = 0;
@@ -1110,6 +1173,7 @@ void CAICallback::DrawUnit(const char* unitName,float3 pos,float rotation,int li
 
 bool CAICallback::CanBuildAt(const UnitDef* unitDef, float3 pos, int facing)
 {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	CFeature* f;
 	BuildInfo bi(unitDef, pos, facing);
 	bi.pos = helper->Pos2BuildPos(bi);
@@ -1119,6 +1183,7 @@ bool CAICallback::CanBuildAt(const UnitDef* unitDef, float3 pos, int facing)
 
 float3 CAICallback::ClosestBuildSite(const UnitDef* unitDef, float3 pos, float searchRadius, int minDist, int facing)
 {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	return helper->ClosestBuildSite(team, unitDef, pos, searchRadius, minDist, facing);
 }
 
@@ -1237,6 +1302,7 @@ int CAICallback::GetFeatures(int* featureIds, int featureIds_sizeMax, const floa
 	int featureIds_size = 0;
 
 	verify();
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	const std::vector<CFeature*> ft = qf->GetFeaturesExact(pos, radius);
 	const int allyteam = teamHandler->AllyTeam(team);
 
@@ -12,6 +12,10 @@ class CAICallback: public IAICallback
 	bool noMessages;
 	CGroupHandler* gh;
 
+	/// see SetQueueCommands()
+	bool queueCommands;
+	std::vector< std::pair<int, Command> > queuedCommands;
+
 	void verify();
 
 public:
@@ -198,6 +202,16 @@ public:
 	// 3. the return data is subject to lua garbage collection,
 	//    copy it if you wish to continue using it
 	const char* CallLuaRules(const char* data, int inSize = -1, int* outSize = NULL);
+
+	/**
+	 * While enabled, GiveOrder() only checks and buffers the commands
+	 * instead of sending them right away. Used while the AI runs on a
+	 * worker thread, so the orders reach the network in a fixed order.
+	 * @see FlushQueuedCommands()
+	 */
+	void SetQueueCommands(bool enable) { queueCommands = enable; }
+	/// sends the commands buffered since SetQueueCommands(true)
+	void FlushQueuedCommands();
 };
 
 #endif /* AICALLBACK_H */
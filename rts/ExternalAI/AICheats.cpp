@@ -2,6 +2,7 @@
 
 #include "StdAfx.h"
 #include "ExternalAI/SkirmishAIWrapper.h"
+#include "ExternalAI/SkirmishAIWorker.h"
 #include "Game/GameHelper.h"
 #include "Sim/Units/Unit.h"
 #include "Sim/Units/CommandAI/CommandAI.h"
@@ -127,6 +128,8 @@ int CAICheats::GetEnemyUnits(int* unitIds, int unitIds_max)
 
 int CAICheats::GetEnemyUnits(int* unitIds, const float3& pos, float radius, int unitIds_max)
 {
+	// QuadField queries change shared state, see CAICallback::InitPath()
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	std::vector<CUnit*> unit = qf->GetUnitsExact(pos, radius);
 	std::vector<CUnit*>::iterator ui;
 	int a = 0;
@@ -169,6 +172,8 @@ int CAICheats::GetNeutralUnits(int* unitIds, int unitIds_max)
 
 int CAICheats::GetNeutralUnits(int* unitIds, const float3& pos, float radius, int unitIds_max)
 {
+	// QuadField queries change shared state, see CAICallback::InitPath()
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	std::vector<CUnit*> unit = qf->GetUnitsExact(pos, radius);
 	std::vector<CUnit*>::iterator ui;
 	int a = 0;
@@ -18,6 +18,7 @@
 #include "EngineOutHandler.h"
 
 #include "ExternalAI/SkirmishAIWrapper.h"
+#include "ExternalAI/SkirmishAIWorker.h"
 #include "ExternalAI/SkirmishAIData.h"
 #include "ExternalAI/SkirmishAIHandler.h"
 #include "ExternalAI/Interface/AISCommands.h"
@@ -27,6 +28,7 @@
 #include "Game/Player.h"
 #include "Game/PlayerHandler.h"
 #include "Sim/Units/Unit.h"
+#include "Sim/Units/UnitHandler.h"
 #include "Sim/Misc/Team.h"
 #include "Sim/Misc/TeamHandler.h"
 #include "Sim/Weapons/WeaponDef.h"
@@ -39,6 +41,8 @@
 
 #include "creg/STL_Map.h"
 
+#include <stdexcept>
+
 
 CR_BIND_DERIVED(CEngineOutHandler, CObject, )
 
@@ -107,11 +111,17 @@ void CEngineOutHandler::Destroy() {
 }
 
 CEngineOutHandler::CEngineOutHandler()
+	: losUnitIds(MAX_TEAMS)
+	, radarUnitIds(MAX_TEAMS)
+	, threadedUpdate(configHandler->Get("AIThreadedUpdate", 0) != 0)
 {
 }
 
 CEngineOutHandler::~CEngineOutHandler() {
 
+	for (std::map<size_t, CSkirmishAIWorker*>::iterator w = id_worker.begin(); w != id_worker.end(); ++w) {
+		delete w->second;
+	}
 	// id_skirmishAI should be empty already, but this can not hurt
 	for (id_ai_t::iterator ai = id_skirmishAI.begin(); ai != id_skirmishAI.end(); ++ai) {
 		delete ai->second;
@@ -134,7 +144,34 @@ CEngineOutHandler::~CEngineOutHandler() {
 		}
 
 
-void CEngineOutHandler::PostLoad() {}
+void CEngineOutHandler::PostLoad() {
+
+	// the visible unit sets are not saved
+	RebuildVisibleUnitIds();
+}
+
+
+void CEngineOutHandler::RebuildVisibleUnitIds() {
+
+	for (int at = 0; at < MAX_TEAMS; ++at) {
+		losUnitIds[at].clear();
+		radarUnitIds[at].clear();
+	}
+
+	const int numAllyTeams = teamHandler->ActiveAllyTeams();
+	std::list<CUnit*>::const_iterator ui;
+	for (ui = uh->activeUnits.begin(); ui != uh->activeUnits.end(); ++ui) {
+		const CUnit* u = *ui;
+		for (int at = 0; at < numAllyTeams; ++at) {
+			if (u->losStatus[at] & LOS_INLOS) {
+				losUnitIds[at].insert(u->id);
+			}
+			if (u->losStatus[at] & LOS_INRADAR) {
+				radarUnitIds[at].insert(u->id);
+			}
+		}
+	}
+}
 
 void CEngineOutHandler::PreDestroy() {
 	AI_EVT_MTH();
@@ -160,7 +197,67 @@ void CEngineOutHandler::Update() {
 
 	const int frame = gs->frameNum;
 
-	DO_FOR_SKIRMISH_AIS(Update(frame))
+	if (threadedUpdate) {
+		UpdateThreaded(frame);
+	} else {
+		DO_FOR_SKIRMISH_AIS(Update(frame))
+	}
+}
+
+void CEngineOutHandler::UpdateThreaded(int frame) {
+
+	// AIs controlling the same team share the temporary buffers of the
+	// team callback, so they are run one after the other; each round
+	// updates at most one AI per team, all of them concurrently
+	std::string error;
+
+	for (size_t round = 0; ; ++round) {
+		std::vector<size_t> running;
+
+		for (team_ais_t::const_iterator t = team_skirmishAIs.begin(); t != team_skirmishAIs.end(); ++t) {
+			if (round >= t->second.size()) {
+				continue;
+			}
+
+			const size_t aiId = t->second[round];
+			CSkirmishAIWrapper* ai = id_skirmishAI[aiId];
+			CSkirmishAIWorker*& worker = id_worker[aiId];
+			if (worker == NULL) {
+				worker = new CSkirmishAIWorker(ai);
+			}
+
+			ai->SetQueueCommands(true);
+			worker->StartUpdate(frame);
+			running.push_back(aiId);
+		}
+
+		if (running.empty()) {
+			break;
+		}
+
+		// the simulation only continues once all AIs are done, so they get
+		// to see a consistent world; their commands are then sent in the
+		// order of team and AI ID, regardless of which thread finished first
+		for (std::vector<size_t>::const_iterator r = running.begin(); r != running.end(); ++r) {
+			CSkirmishAIWorker* worker = id_worker[*r];
+			CSkirmishAIWrapper* ai = id_skirmishAI[*r];
+
+			if (!worker->WaitForUpdate() && error.empty()) {
+				error = worker->GetError();
+			}
+			profiler.AddTime("AI Team " + IntToString(ai->GetTeamId()), worker->GetUpdateTime());
+			worker->ApplyQueued();
+
+			ai->SetQueueCommands(false);
+			ai->FlushQueuedCommands();
+		}
+	}
+
+	if (!error.empty()) {
+		// same as CATCH_AI_EXCEPTION on the engine thread
+		CEngineOutHandler::HandleAIException(error.c_str());
+		throw std::runtime_error(error);
+	}
 }
 
 
@@ -187,6 +284,8 @@ void CEngineOutHandler::UnitEnteredLos(const CUnit& unit, int allyTeamId) {
 	const int unitId         = unit.id;
 	const int unitAllyTeamId = unit.allyteam;
 
+	losUnitIds[allyTeamId].insert(unitId);
+
 	DO_FOR_ALLIED_SKIRMISH_AIS(EnemyEnterLOS(unitId), allyTeamId, unitAllyTeamId)
 }
 
@@ -196,6 +295,8 @@ void CEngineOutHandler::UnitLeftLos(const CUnit& unit, int allyTeamId) {
 	const int unitId         = unit.id;
 	const int unitAllyTeamId = unit.allyteam;
 
+	losUnitIds[allyTeamId].erase(unitId);
+
 	DO_FOR_ALLIED_SKIRMISH_AIS(EnemyLeaveLOS(unitId), allyTeamId, unitAllyTeamId)
 }
 
@@ -205,6 +306,8 @@ void CEngineOutHandler::UnitEnteredRadar(const CUnit& unit, int allyTeamId) {
 	const int unitId         = unit.id;
 	const int unitAllyTeamId = unit.allyteam;
 
+	radarUnitIds[allyTeamId].insert(unitId);
+
 	DO_FOR_ALLIED_SKIRMISH_AIS(EnemyEnterRadar(unitId), allyTeamId, unitAllyTeamId)
 }
 
@@ -214,6 +317,8 @@ void CEngineOutHandler::UnitLeftRadar(const CUnit& unit, int allyTeamId) {
 	const int unitId         = unit.id;
 	const int unitAllyTeamId = unit.allyteam;
 
+	radarUnitIds[allyTeamId].erase(unitId);
+
 	DO_FOR_ALLIED_SKIRMISH_AIS(EnemyLeaveRadar(unitId), allyTeamId, unitAllyTeamId)
 }
 
@@ -298,6 +403,11 @@ void CEngineOutHandler::UnitDestroyed(const CUnit& destroyed,
 	const int attackerId  = attacker ? attacker->id : -1;
 	const int dt          = destroyed.team;
 
+	for (int at = 0; at < teamHandler->ActiveAllyTeams(); ++at) {
+		losUnitIds[at].erase(destroyedId);
+		radarUnitIds[at].erase(destroyedId);
+	}
+
 	// inform destroyed units team (not allies)
 	if (team_skirmishAIs.find(dt) != team_skirmishAIs.end()) {
 		const bool attackerInLosOrRadar = attacker && isUnitInLosOrRadarOfAllyTeam(*attacker, destroyed.allyteam);
@@ -463,6 +573,11 @@ void CEngineOutHandler::CreateSkirmishAI(const size_t skirmishAIId) {
 		// currently, we need doing nothing for Lua AIs
 		net->Send(CBaseNetProtocol::Get().SendAIStateChanged(gu->myPlayerNum, skirmishAIId, SKIRMAISTATE_ALIVE));
 	} else {
+		if (id_skirmishAI.empty()) {
+			// the visible unit sets are only maintained while there are AIs
+			RebuildVisibleUnitIds();
+		}
+
 		CSkirmishAIWrapper* aiWrapper = NULL;
 		try {
 			CSkirmishAIWrapper* aiWrapper_tmp = new CSkirmishAIWrapper(skirmishAIId);
@@ -524,6 +639,12 @@ void CEngineOutHandler::DestroySkirmishAI(const size_t skirmishAIId) {
 
 		aiWrapper->Release(reason);
 
+		std::map<size_t, CSkirmishAIWorker*>::iterator w = id_worker.find(skirmishAIId);
+		if (w != id_worker.end()) {
+			delete w->second;
+			id_worker.erase(w);
+		}
+
 		id_skirmishAI.erase(skirmishAIId);
 		internal_aiErase(team_skirmishAIs[aiWrapper->GetTeamId()], skirmishAIId);
 
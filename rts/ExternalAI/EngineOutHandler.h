@@ -22,6 +22,7 @@
 #include "Sim/Misc/GlobalConstants.h"
 
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 
@@ -32,6 +33,7 @@ class CGroup;
 struct WeaponDef;
 class SkirmishAIKey;
 class CSkirmishAIWrapper;
+class CSkirmishAIWorker;
 struct SSkirmishAICallback;
 
 void handleAIException(const char* description);
@@ -108,6 +110,21 @@ public:
 	void DestroySkirmishAI(const size_t skirmishAIId);
 
 
+	/**
+	 * IDs of the units that entered the LOS (resp. radar) of an ally-team.
+	 * These are maintained incrementally from the Unit{Entered,Left}{Los,Radar}
+	 * events while there are local Skirmish AIs, so queries on them cost
+	 * O(result) instead of a walk over all active units.
+	 * Entries may be stale (dead units, units whose losStatus was reset by a
+	 * team change), so callers still have to check CUnit::losStatus.
+	 */
+	const std::set<int>& GetLosUnitIds(int allyTeamId) const {
+		return losUnitIds[allyTeamId];
+	}
+	const std::set<int>& GetRadarUnitIds(int allyTeamId) const {
+		return radarUnitIds[allyTeamId];
+	}
+
 	void SetCheating(bool enable);
 	bool IsCheating() const;
 
@@ -177,6 +194,23 @@ private:
 	 * There can be multiple Skirmish AIs per team.
 	 */
 	team_ais_t team_skirmishAIs;
+
+	/// re-fills losUnitIds and radarUnitIds from the current unit states
+	void RebuildVisibleUnitIds();
+
+	/// sends the Update event to all AIs through their worker threads
+	void UpdateThreaded(int frame);
+
+	/**
+	 * If set, the Update events run on one worker thread per AI,
+	 * see the AIThreadedUpdate config key.
+	 */
+	bool threadedUpdate;
+	/// the worker threads of local Skirmish AIs, indexed by their ID
+	std::map<size_t, CSkirmishAIWorker*> id_worker;
+
+	std::vector< std::set<int> > losUnitIds;
+	std::vector< std::set<int> > radarUnitIds;
 };
 
 #define eoh CEngineOutHandler::GetInstance()
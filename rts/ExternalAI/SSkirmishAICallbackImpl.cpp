@@ -24,6 +24,7 @@
 #include "ExternalAI/SkirmishAILibraryInfo.h"
 #include "ExternalAI/SAIInterfaceCallbackImpl.h"
 #include "ExternalAI/SkirmishAIHandler.h"
+#include "ExternalAI/SkirmishAIWorker.h"
 //#include "ExternalAI/EngineOutHandler.h"
 #include "ExternalAI/Interface/AISCommands.h"
 #include "ExternalAI/Interface/SSkirmishAILibrary.h"
@@ -52,6 +53,7 @@
 #include "Game/GameSetup.h"
 #include "GlobalUnsynced.h" // for myTeam
 #include "LogOutput.h"
+#include "Util.h"
 
 
 static const char* SKIRMISH_AIS_VERSION_COMMON = "common";
@@ -255,6 +257,10 @@ EXPORT(int) skirmishAiCallback_Engine_handleCommand(int teamId, int toId, int co
 
 	int ret = 0;
 
+	// commands may change engine state, so AIs running
+	// on worker threads have to take turns here
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
+
 	IAICallback* clb = team_callback[teamId];
 	// if this is != NULL, cheating is enabled
 	IAICheats* clbCheat = team_cheatCallback[teamId];
@@ -739,19 +745,40 @@ EXPORT(void) skirmishAiCallback_Log_log(int teamId, const char* const msg) {
 	checkTeamId(teamId);
 
 	const CSkirmishAILibraryInfo* info = getSkirmishAILibraryInfo(teamId);
-	logOutput.Print("Skirmish AI <%s-%s>: %s", info->GetName().c_str(), info->GetVersion().c_str(), msg);
+	const std::string line = "Skirmish AI <" + info->GetName() + "-" + info->GetVersion() + ">: " + msg;
+
+	// the log is not thread safe, threaded updates log after they are done
+	CSkirmishAIWorker* worker = CSkirmishAIWorker::GetCurrent();
+	if (worker != NULL) {
+		worker->QueueLog(line);
+	} else {
+		logOutput.Print("%s", line.c_str());
+	}
 }
 EXPORT(void) skirmishAiCallback_Log_exception(int teamId, const char* const msg, int severety, bool die) {
 
 	checkTeamId(teamId);
 
 	const CSkirmishAILibraryInfo* info = getSkirmishAILibraryInfo(teamId);
-	logOutput.Print("Skirmish AI <%s-%s>: error, severety %i: [%s] %s",
-			info->GetName().c_str(), info->GetVersion().c_str(), severety,
-			(die ? "AI shutting down" : "AI still running"), msg);
+	const std::string line = "Skirmish AI <" + info->GetName() + "-" + info->GetVersion()
+			+ ">: error, severety " + IntToString(severety) + ": ["
+			+ (die ? "AI shutting down" : "AI still running") + "] " + msg;
+
+	// neither the log nor the AI handler are thread safe, so threaded
+	// updates leave both to the engine thread, after they are done
+	CSkirmishAIWorker* worker = CSkirmishAIWorker::GetCurrent();
+	if (worker != NULL) {
+		worker->QueueLog(line);
+	} else {
+		logOutput.Print("%s", line.c_str());
+	}
 	if (die) {
 		const size_t skirmishAIId = getFirstSkirmishAIIdForTeam(teamId);
-		skirmishAIHandler.SetLocalSkirmishAIDieing(skirmishAIId, 4 /* = AI crashed */);
+		if (worker != NULL) {
+			worker->QueueDieing(skirmishAIId, 4 /* = AI crashed */);
+		} else {
+			skirmishAIHandler.SetLocalSkirmishAIDieing(skirmishAIId, 4 /* = AI crashed */);
+		}
 	}
 }
 
@@ -1323,6 +1350,8 @@ EXPORT(int) skirmishAiCallback_Map_0ARRAY1VALS0REF1Resource2resourceId0getResour
 	return size;
 }
 static inline const CResourceMapAnalyzer* getResourceMapAnalyzer(int resourceId) {
+	// the analyzer is created on first use
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	return resourceHandler->GetResourceMapAnalyzer(resourceId);
 }
 EXPORT(int) skirmishAiCallback_Map_0ARRAY1SIZE0REF1Resource2resourceId0getResourceMapSpotsPositions(
@@ -1486,11 +1515,13 @@ EXPORT(bool) skirmishAiCallback_getValue(int teamId, int id, void* dst) {
 */
 
 EXPORT(int) skirmishAiCallback_File_getSize(int teamId, const char* fileName) {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	IAICallback* clb = team_callback[teamId]; return clb->GetFileSize(fileName);
 }
 
 EXPORT(bool) skirmishAiCallback_File_getContent(int teamId, const char* fileName, void* buffer,
 		int bufferLen) {
+	boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 	IAICallback* clb = team_callback[teamId]; return clb->ReadFile(fileName,
 			buffer, bufferLen);
 }
@@ -2470,7 +2501,7 @@ EXPORT(int) skirmishAiCallback_Unit_CurrentCommand_0ARRAY1VALS0getParams(int tea
 		return -1;
 	}
 
-	const std::vector<float>& ps = q->at(commandId).params;
+	const CommandParams& ps = q->at(commandId).params;
 	size_t params_size = (params_sizeMax > 0) ? params_sizeMax : 0;
 	if (ps.size() < params_size) {
 		params_size = ps.size();
@@ -2663,7 +2694,7 @@ EXPORT(int) skirmishAiCallback_0MULTI1SIZE3FriendlyUnits0Unit(int teamId) {
 	IAICallback* clb = team_callback[teamId]; return clb->GetFriendlyUnits(tmpIntArr[teamId]);
 }
 EXPORT(int) skirmishAiCallback_0MULTI1VALS3FriendlyUnits0Unit(int teamId, int* unitIds, int unitIds_max) {
-	IAICallback* clb = team_callback[teamId]; return clb->GetFriendlyUnits(unitIds);
+	IAICallback* clb = team_callback[teamId]; return clb->GetFriendlyUnits(unitIds, unitIds_max);
 }
 
 EXPORT(int) skirmishAiCallback_0MULTI1SIZE3FriendlyUnitsIn0Unit(int teamId, SAIFloat3 pos, float radius) {
@@ -2852,6 +2883,8 @@ EXPORT(int) skirmishAiCallback_0MULTI1VALS0Feature(int teamId, int* featureIds,
 EXPORT(int) skirmishAiCallback_0MULTI1SIZE3FeaturesIn0Feature(int teamId, SAIFloat3 pos, float radius) {
 
 	if (skirmishAiCallback_Cheats_isEnabled(teamId)) {
+		// QuadField queries change shared state, see CAICallback::InitPath()
+		boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 		return qf->GetFeaturesExact(pos, radius).size();
 	} else {
 		tmpSize[teamId] = team_callback[teamId]->GetFeatures(tmpIntArr[teamId], TMP_ARR_SIZE, pos, radius);
@@ -2866,6 +2899,7 @@ EXPORT(int) skirmishAiCallback_0MULTI1VALS3FeaturesIn0Feature(int teamId, SAIFlo
 	const size_t featureIds_max = static_cast<size_t>(_featureIds_max);
 
 	if (skirmishAiCallback_Cheats_isEnabled(teamId)) {
+		boost::recursive_mutex::scoped_lock lock(CSkirmishAIWorker::GetCallbackMutex());
 		const vector<CFeature*>& fset = qf->GetFeaturesExact(pos, radius);
 		vector<CFeature*>::const_iterator it;
 		size_t i=0;
@@ -19,6 +19,7 @@
 
 #include "IAILibraryManager.h"
 #include "SkirmishAILibrary.h"
+#include "SkirmishAIWorker.h"
 #include "TimeProfiler.h"
 #include "Util.h"
 
@@ -50,11 +51,16 @@ void CSkirmishAI::Dieing() {
 
 int CSkirmishAI::HandleEvent(int topic, const void* data) const {
 
-	SCOPED_TIMER(timerName.c_str());
-	if (!dieing) {
-		return library->HandleEvent(teamId, topic, data);
-	} else {
+	if (dieing) {
 		// to prevent log error spam, signal: OK
 		return 0;
 	}
+	if (CSkirmishAIWorker::GetCurrent() != NULL) {
+		// threaded updates are timed by the engine thread,
+		// see CEngineOutHandler::UpdateThreaded()
+		return library->HandleEvent(teamId, topic, data);
+	}
+
+	SCOPED_TIMER(timerName.c_str());
+	return library->HandleEvent(teamId, topic, data);
 }
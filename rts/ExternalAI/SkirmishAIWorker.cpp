@@ -0,0 +1,174 @@
+/*
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SkirmishAIWorker.h"
+
+#include "System/StdAfx.h"
+#include "System/mmgr.h"
+#include "System/Util.h"
+#include "System/TimeProfiler.h"
+#include "System/LogOutput.h"
+#include "ExternalAI/SkirmishAIWrapper.h"
+#include "ExternalAI/SkirmishAIHandler.h"
+
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/thread/tss.hpp>
+#include <SDL_timer.h>
+
+
+CSkirmishAIWorker::CSkirmishAIWorker(CSkirmishAIWrapper* ai)
+	: ai(ai)
+	, thread(NULL)
+	, frame(0)
+	, busy(false)
+	, quit(false)
+	, updateTime(0)
+	, failed(false)
+	, dieingAIId(0)
+	, dieingReason(-1)
+{
+	thread = new boost::thread(boost::bind(&CSkirmishAIWorker::Run, this));
+}
+
+CSkirmishAIWorker::~CSkirmishAIWorker()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		quit = true;
+	}
+	cond.notify_all();
+
+	thread->join();
+	delete thread;
+}
+
+
+boost::recursive_mutex& CSkirmishAIWorker::GetCallbackMutex()
+{
+	static boost::recursive_mutex callbackMutex;
+	return callbackMutex;
+}
+
+
+// the workers are owned by CEngineOutHandler, not by their threads
+static void KeepWorker(CSkirmishAIWorker*) {}
+static boost::thread_specific_ptr<CSkirmishAIWorker> currentWorker(KeepWorker);
+
+CSkirmishAIWorker* CSkirmishAIWorker::GetCurrent()
+{
+	return currentWorker.get();
+}
+
+
+void CSkirmishAIWorker::QueueLog(const std::string& msg)
+{
+	queuedLogs.push_back(msg);
+}
+
+void CSkirmishAIWorker::QueueDieing(size_t skirmishAIId, int reason)
+{
+	if (dieingReason < 0) {
+		dieingAIId = skirmishAIId;
+		dieingReason = reason;
+	}
+}
+
+void CSkirmishAIWorker::ApplyQueued()
+{
+	for (std::vector<std::string>::const_iterator l = queuedLogs.begin(); l != queuedLogs.end(); ++l) {
+		logOutput.Print("%s", l->c_str());
+	}
+	queuedLogs.clear();
+
+	if (dieingReason >= 0) {
+		skirmishAIHandler.SetLocalSkirmishAIDieing(dieingAIId, dieingReason);
+		dieingReason = -1;
+	}
+}
+
+
+void CSkirmishAIWorker::StartUpdate(int f)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		assert(!busy);
+		frame = f;
+		busy = true;
+		failed = false;
+		error.clear();
+	}
+	cond.notify_all();
+}
+
+bool CSkirmishAIWorker::WaitForUpdate()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	while (busy) {
+		cond.wait(lock);
+	}
+	return !failed;
+}
+
+
+void CSkirmishAIWorker::Run()
+{
+	profiler.SetThreadName("Skirmish AI " + IntToString(ai->GetTeamId()));
+	currentWorker.reset(this);
+
+	while (true) {
+		int f;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			while (!busy && !quit) {
+				cond.wait(lock);
+			}
+			if (quit) {
+				return;
+			}
+			f = frame;
+		}
+
+		// exceptions can not cross the thread boundary,
+		// so remember them for the engine thread to report
+		bool fail = false;
+		std::string err;
+
+		const unsigned startTime = SDL_GetTicks();
+		try {
+			ai->Update(f);
+		} catch (const std::exception& e) {
+			fail = true; err = e.what();
+		} catch (const std::string& s) {
+			fail = true; err = s;
+		} catch (const char* s) {
+			fail = true; err = s;
+		} catch (int e) {
+			fail = true; err = IntToString(e);
+		} catch (...) {
+			fail = true; err = "Unknown";
+		}
+		const unsigned endTime = SDL_GetTicks();
+
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			updateTime = endTime - startTime;
+			failed = fail;
+			error = err;
+			busy = false;
+		}
+		cond.notify_all();
+	}
+}
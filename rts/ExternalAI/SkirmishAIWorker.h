@@ -0,0 +1,99 @@
+/*
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SKIRMISHAIWORKER_H
+#define _SKIRMISHAIWORKER_H
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+class CSkirmishAIWrapper;
+
+/**
+ * Runs the Update events of one Skirmish AI on a dedicated thread.
+ * The engine hands over a frame with StartUpdate(), and blocks in
+ * WaitForUpdate() before the simulation continues, so the AI always sees
+ * the world as it was at the end of that frame.
+ * All other events are still sent from the calling thread, but never while
+ * an Update is in progress.
+ * @see CEngineOutHandler::Update()
+ */
+class CSkirmishAIWorker : public boost::noncopyable {
+public:
+	CSkirmishAIWorker(CSkirmishAIWrapper* ai);
+	~CSkirmishAIWorker();
+
+	/// sends the Update event on the worker thread; returns immediately
+	void StartUpdate(int frame);
+	/**
+	 * Blocks until the event passed to StartUpdate() was handled.
+	 * @return false if the AI threw an exception, see GetError()
+	 */
+	bool WaitForUpdate();
+
+	/// milliseconds the AI spent in the last Update event
+	unsigned GetUpdateTime() const { return updateTime; }
+	const std::string& GetError() const { return error; }
+
+	/**
+	 * Serializes the AI callbacks that have side effects (commands, drawing,
+	 * path requests, file access, ...) between concurrently running AIs.
+	 * This includes queries that look read-only, but keep scratch state in
+	 * shared objects, like the QuadField ones marking visited units.
+	 */
+	static boost::recursive_mutex& GetCallbackMutex();
+
+	/// @return the worker running on the calling thread, or NULL
+	static CSkirmishAIWorker* GetCurrent();
+
+	/// logs msg from the engine thread, once the update is done
+	void QueueLog(const std::string& msg);
+	/// lets the AI die from the engine thread, once the update is done
+	void QueueDieing(size_t skirmishAIId, int reason);
+	/**
+	 * Carries out what the AI queued during the last update.
+	 * Call from the engine thread, after WaitForUpdate().
+	 */
+	void ApplyQueued();
+
+private:
+	void Run();
+
+	CSkirmishAIWrapper* ai;
+
+	boost::mutex mutex;
+	boost::condition cond;
+	boost::thread* thread;
+
+	int frame;
+	bool busy;
+	bool quit;
+
+	unsigned updateTime;
+	bool failed;
+	std::string error;
+
+	/// only touched by the worker thread while busy
+	std::vector<std::string> queuedLogs;
+	size_t dieingAIId;
+	int dieingReason;
+};
+
+#endif // _SKIRMISHAIWORKER_H
@@ -406,6 +406,13 @@ int CSkirmishAIWrapper::GetTeamId() const { return teamId; }
 const SkirmishAIKey& CSkirmishAIWrapper::GetKey() const { return key; }
 const SSkirmishAICallback* CSkirmishAIWrapper::GetCallback() const { return c_callback; }
 
+void CSkirmishAIWrapper::SetQueueCommands(bool enable) {
+	callback->callback.SetQueueCommands(enable);
+}
+void CSkirmishAIWrapper::FlushQueuedCommands() {
+	callback->callback.FlushQueuedCommands();
+}
+
 void CSkirmishAIWrapper::SetCheatEventsEnabled(bool enable) {
 	cheatEvents = enable;
 }
@@ -94,6 +94,11 @@ public:
 
 	size_t GetSkirmishAIID() const { return skirmishAIId; }
 
+	/// @see CAICallback::SetQueueCommands()
+	void SetQueueCommands(bool enable);
+	/// @see CAICallback::FlushQueuedCommands()
+	void FlushQueuedCommands();
+
 private:
 	size_t skirmishAIId;
 	int teamId;
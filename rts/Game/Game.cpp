@@ -8,6 +8,9 @@
 #include <stdlib.h>
 #include <time.h>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <locale>
 #include <sstream>
 
@@ -16,6 +19,8 @@
 
 #include <boost/thread/barrier.hpp>
 
+#include <zlib.h>
+
 #include <SDL_keyboard.h>
 #include <SDL_keysym.h>
 #include <SDL_mouse.h>
@@ -33,6 +38,7 @@
 #include "FPUCheck.h"
 #include "GameHelper.h"
 #include "GameServer.h"
+#include "GameVersion.h"
 #include "CommandMessage.h"
 #include "GameSetup.h"
 #include "LoadSaveHandler.h"
@@ -42,6 +48,7 @@
 #include "Sync/SyncTracer.h"
 #include "ChatMessage.h"
 #include "TimeProfiler.h"
+#include "LoadTaskGraph.h"
 #include "WaitCommandsAI.h"
 #include "WordCompletion.h"
 #include "OSCStatsSender.h"
@@ -54,6 +61,8 @@
 #include "Sim/Units/Groups/Group.h"
 #include "Sim/Units/Groups/GroupHandler.h"
 #include "FileSystem/ArchiveScanner.h"
+#include "FileSystem/CacheFile.h"
+#include "FileSystem/CRC.h"
 #include "FileSystem/FileHandler.h"
 #include "FileSystem/VFSHandler.h"
 #include "Map/BaseGroundDrawer.h"
@@ -241,6 +250,199 @@ CR_REG_METADATA(CGame,(
 ));
 
 
+/******************************************************************************/
+//
+//  Definitions cache
+//
+//  The table returned by gamedata/defs.lua only depends on the mod and map
+//  archives (the only ones the script can read), the mod and map options and
+//  the engine build, so it is stored after the first run and loaded from a
+//  binary file on later starts instead of running all the def scripts again.
+//
+
+static const char DEFS_CACHE_MAGIC[8] = "SPRDEFS";
+static const int DEFS_CACHE_VERSION = 2;
+
+
+/// CRC over the engine build and the mod and map archives
+static CRC GetArchivesCRC(const std::string& modArchive)
+{
+	CRC crc;
+	const std::string version = SpringVersion::GetFull() + SpringVersion::BuildTime;
+	crc.Update(version.data(), version.size());
+	crc.Update(archiveScanner->GetArchiveCompleteChecksum(modArchive));
+	crc.Update(archiveScanner->GetArchiveCompleteChecksum(archiveScanner->ArchiveFromName(gameSetup->mapName)));
+	return crc;
+}
+
+
+static std::string GetDefsCacheFile(const std::string& modArchive)
+{
+	if (gameSetup == NULL) {
+		return "";
+	}
+
+	CRC crc = GetArchivesCRC(modArchive);
+
+	const std::map<std::string, std::string>* options[2] = { &gameSetup->modOptions, &gameSetup->mapOptions };
+	for (int i = 0; i < 2; ++i) {
+		crc.Update((unsigned int)options[i]->size());
+		std::map<std::string, std::string>::const_iterator it;
+		for (it = options[i]->begin(); it != options[i]->end(); ++it) {
+			crc.Update(it->first.c_str(), it->first.size() + 1);
+			crc.Update(it->second.c_str(), it->second.size() + 1);
+		}
+	}
+
+	char name[32];
+	SNPRINTF(name, sizeof(name), "%08x.bin", crc.GetDigest());
+	return filesystem.LocateDir("cache/defs/", FileSystem::WRITE | FileSystem::CREATE_DIRS) + name;
+}
+
+
+static LuaParser* NewDefsParser()
+{
+	LuaParser* parser = new LuaParser("gamedata/defs.lua",
+	                                  SPRING_VFS_MOD_BASE, SPRING_VFS_ZIP);
+	// customize the defs environment
+	parser->GetTable("Spring");
+	parser->AddFunc("GetModOptions", LuaSyncedRead::GetModOptions);
+	parser->AddFunc("GetMapOptions", LuaSyncedRead::GetMapOptions);
+	parser->EndTable();
+	return parser;
+}
+
+
+/******************************************************************************/
+
+/// background stage, only reads the heightmap
+static void LoadSmoothHeightMesh()
+{
+	smoothGround = new SmoothHeightMesh(ground, float3::maxxpos, float3::maxzpos, SQUARE_SIZE*2, SQUARE_SIZE*40);
+}
+
+
+void CGame::LoadMap(const std::string& mapname)
+{
+	explGenHandler = new CExplosionGeneratorHandler();
+
+	shadowHandler = new CShadowHandler();
+
+	ground = new CGround();
+
+	PrintLoadMsg("Loading map informations");
+
+	const_cast<CMapInfo*>(mapInfo)->Load();
+	readmap = CReadMap::LoadMap (mapname);
+	groundBlockingObjectMap = new CGroundBlockingObjectMap(gs->mapSquares);
+	wind.LoadWind(mapInfo->atmosphere.minWind, mapInfo->atmosphere.maxWind);
+}
+
+
+void CGame::LoadDefinitions()
+{
+	moveinfo = new CMoveInfo();
+	groundDecals = new CGroundDecalHandler();
+	ReColorTeams();
+
+	guihandler = new CGuiHandler();
+	minimap = new CMiniMap();
+
+	ph = new CProjectileHandler();
+
+	damageArrayHandler = new CDamageArrayHandler();
+	unitDefHandler = new CUnitDefHandler();
+
+	inMapDrawer = new CInMapDraw();
+	cmdColors.LoadConfig("cmdcolors.txt");
+
+	const std::map<std::string, int>& unitMap = unitDefHandler->unitDefIDsByName;
+	std::map<std::string, int>::const_iterator uit;
+	for (uit = unitMap.begin(); uit != unitMap.end(); uit++) {
+		wordCompletion->AddWord(uit->first + " ", false, true, false);
+	}
+
+	geometricObjects = new CGeometricObjects();
+}
+
+
+void CGame::LoadSimulation(bool loadedGame)
+{
+	qf = new CQuadField();
+
+	featureHandler = new CFeatureHandler();
+	featureDrawer = new CFeatureDrawer();
+
+	// the feature defs were the last ones to be read
+	delete defsParser;
+	defsParser = NULL;
+
+	mapDamage = IMapDamage::GetMapDamage();
+	loshandler = new CLosHandler();
+	radarhandler = new CRadarHandler(false);
+
+	uh = new CUnitHandler();
+	unitDrawer = new CUnitDrawer();
+	fartextureHandler = new CFartextureHandler();
+	// models only depend on the files in the archives, not on any options
+	const bool useModelCache = (gameSetup != NULL) && !!configHandler->Get("ModelCache", 1);
+	modelParser = new C3DModelLoader(useModelCache ? GetArchivesCRC(modInfo.filename).GetDigest() : 0);
+
+	featureHandler->LoadFeaturesFromMap(loadedGame);
+}
+
+
+void CGame::LoadPathing()
+{
+	pathManager = new CPathManager();
+
+#ifdef SYNCCHECK
+	// update the checksum with path data
+	{ SyncedUint tmp(pathManager->GetPathChecksum()); }
+#endif
+	logOutput.Print("Pathing data checksum: %08x\n", pathManager->GetPathChecksum());
+}
+
+
+void CGame::LoadInterface()
+{
+	sky = CBaseSky::GetSky();
+
+	resourceBar = new CResourceBar();
+	keyCodes = new CKeyCodes();
+	keyBindings = new CKeyBindings();
+	keyBindings->Load("uikeys.txt");
+	selectionKeys = new CSelectionKeyHandler();
+
+	water=CBaseWater::GetWater(NULL);
+	for(int t = 0; t < teamHandler->ActiveTeams(); ++t) {
+		grouphandlers.push_back(new CGroupHandler(t));
+	}
+	CCobInstance::InitVars(teamHandler->ActiveTeams(), teamHandler->ActiveAllyTeams());
+	CEngineOutHandler::Initialize();
+}
+
+
+void CGame::LoadLua()
+{
+	GameSetupDrawer::Enable();
+
+	PrintLoadMsg("Loading LuaRules");
+	CLuaRules::LoadHandler();
+
+	if (gs->useLuaGaia) {
+		PrintLoadMsg("Loading LuaGaia");
+		CLuaGaia::LoadHandler();
+	}
+	{
+		PrintLoadMsg("Loading LuaUI");
+		CLuaUI::LoadHandler();
+	}
+}
+
+
+/******************************************************************************/
+
 CGame::CGame(std::string mapname, std::string modName, CLoadSaveHandler *saveFile):
 	drawMode(notDrawing),
 	defsParser(NULL),
@@ -376,16 +578,29 @@ CGame::CGame(std::string mapname, std::string modName, CLoadSaveHandler *saveFil
 		ScopedOnceTimer timer("Loading defs");
 		PrintLoadMsg("Parsing definitions");
 
-		defsParser = new LuaParser("gamedata/defs.lua",
-										SPRING_VFS_MOD_BASE, SPRING_VFS_ZIP);
-		// customize the defs environment
-		defsParser->GetTable("Spring");
-		defsParser->AddFunc("GetModOptions", LuaSyncedRead::GetModOptions);
-		defsParser->AddFunc("GetMapOptions", LuaSyncedRead::GetMapOptions);
-		defsParser->EndTable();
-		// run the parser
-		if (!defsParser->Execute()) {
-			throw content_error(defsParser->GetErrorLog());
+		const bool useCache = !!configHandler->Get("DefsCache", 1);
+		const std::string cacheFile = useCache ? GetDefsCacheFile(modName) : "";
+
+		std::string cacheData;
+		if (!cacheFile.empty() && CacheFile::Read(cacheFile, DEFS_CACHE_MAGIC, DEFS_CACHE_VERSION, cacheData)) {
+			defsParser = NewDefsParser();
+			if (defsParser->ExecuteData(cacheData)) {
+				logOutput.Print("Loaded definitions from %s", cacheFile.c_str());
+			} else {
+				delete defsParser;
+				defsParser = NULL;
+			}
+		}
+		if (defsParser == NULL) {
+			defsParser = NewDefsParser();
+			// run the parser
+			if (!defsParser->Execute()) {
+				throw content_error(defsParser->GetErrorLog());
+			}
+			// defs holding functions or metatables can not be cached
+			if (!cacheFile.empty() && defsParser->GetRootData(cacheData)) {
+				CacheFile::Write(cacheFile, DEFS_CACHE_MAGIC, DEFS_CACHE_VERSION, cacheData);
+			}
 		}
 		const LuaTable root = defsParser->GetRoot();
 		if (!root.IsValid()) {
@@ -409,99 +624,33 @@ CGame::CGame(std::string mapname, std::string modName, CLoadSaveHandler *saveFil
 			throw content_error("Error loading MoveDefs");
 		}
 	}
-	explGenHandler = new CExplosionGeneratorHandler();
-
-	shadowHandler = new CShadowHandler();
-
-	ground = new CGround();
-
-	PrintLoadMsg("Loading map informations");
-
-	const_cast<CMapInfo*>(mapInfo)->Load();
-	readmap = CReadMap::LoadMap (mapname);
-	groundBlockingObjectMap = new CGroundBlockingObjectMap(gs->mapSquares);
-	wind.LoadWind(mapInfo->atmosphere.minWind, mapInfo->atmosphere.maxWind);
-
-	PrintLoadMsg("Calculating smooth height mesh");
-	smoothGround = new SmoothHeightMesh(ground, float3::maxxpos, float3::maxzpos, SQUARE_SIZE*2, SQUARE_SIZE*40);
-
-	moveinfo = new CMoveInfo();
-	groundDecals = new CGroundDecalHandler();
-	ReColorTeams();
-
-	guihandler = new CGuiHandler();
-	minimap = new CMiniMap();
-
-	ph = new CProjectileHandler();
-
-	damageArrayHandler = new CDamageArrayHandler();
-	unitDefHandler = new CUnitDefHandler();
-
-	inMapDrawer = new CInMapDraw();
-	cmdColors.LoadConfig("cmdcolors.txt");
-
-	const std::map<std::string, int>& unitMap = unitDefHandler->unitDefIDsByName;
-	std::map<std::string, int>::const_iterator uit;
-	for (uit = unitMap.begin(); uit != unitMap.end(); uit++) {
-		wordCompletion->AddWord(uit->first + " ", false, true, false);
-	}
-
-	geometricObjects = new CGeometricObjects();
-
-	qf = new CQuadField();
-
-	featureHandler = new CFeatureHandler();
-	featureDrawer = new CFeatureDrawer();
-
-	mapDamage = IMapDamage::GetMapDamage();
-	loshandler = new CLosHandler();
-	radarhandler = new CRadarHandler(false);
-
-	uh = new CUnitHandler();
-	unitDrawer = new CUnitDrawer();
-	fartextureHandler = new CFartextureHandler();
-	modelParser = new C3DModelLoader();
-
-	featureHandler->LoadFeaturesFromMap(saveFile || CScriptHandler::Instance().chosenScript->loadGame);
-	pathManager = new CPathManager();
-
-#ifdef SYNCCHECK
-	// update the checksum with path data
-	{ SyncedUint tmp(pathManager->GetPathChecksum()); }
-#endif
-	logOutput.Print("Pathing data checksum: %08x\n", pathManager->GetPathChecksum());
-
-	delete defsParser;
-	defsParser = NULL;
-
-	sky = CBaseSky::GetSky();
-
-	resourceBar = new CResourceBar();
-	keyCodes = new CKeyCodes();
-	keyBindings = new CKeyBindings();
-	keyBindings->Load("uikeys.txt");
-	selectionKeys = new CSelectionKeyHandler();
-
-	water=CBaseWater::GetWater(NULL);
-	for(int t = 0; t < teamHandler->ActiveTeams(); ++t) {
-		grouphandlers.push_back(new CGroupHandler(t));
-	}
-	CCobInstance::InitVars(teamHandler->ActiveTeams(), teamHandler->ActiveAllyTeams());
-	CEngineOutHandler::Initialize();
-
-	GameSetupDrawer::Enable();
-
-	PrintLoadMsg("Loading LuaRules");
-	CLuaRules::LoadHandler();
-
-	if (gs->useLuaGaia) {
-		PrintLoadMsg("Loading LuaGaia");
-		CLuaGaia::LoadHandler();
-	}
 	{
-		PrintLoadMsg("Loading LuaUI");
-		CLuaUI::LoadHandler();
+		// GL, Lua and the loading screen need the main thread, only the
+		// stages marked as background overlap with the rest of the loading
+		CLoadTaskGraph loader("Loading");
+		const bool loadedGame = (saveFile || CScriptHandler::Instance().chosenScript->loadGame);
+
+		const int mapTask    = loader.AddTask("Map",              boost::bind(&CGame::LoadMap, this, mapname));
+		const int smoothTask = loader.AddTask("SmoothHeightMesh", &LoadSmoothHeightMesh, true);
+		const int defsTask   = loader.AddTask("Definitions",      boost::bind(&CGame::LoadDefinitions, this));
+		const int simTask    = loader.AddTask("Simulation",       boost::bind(&CGame::LoadSimulation, this, loadedGame));
+		const int pathTask   = loader.AddTask("Pathing",          boost::bind(&CGame::LoadPathing, this));
+		const int uiTask     = loader.AddTask("Interface",        boost::bind(&CGame::LoadInterface, this));
+		const int luaTask    = loader.AddTask("Lua",              boost::bind(&CGame::LoadLua, this));
+
+		loader.AddDependency(smoothTask, mapTask);
+		loader.AddDependency(defsTask,   mapTask);
+		loader.AddDependency(simTask,    defsTask);
+		loader.AddDependency(pathTask,   simTask);
+		loader.AddDependency(uiTask,     mapTask);
+		// Lua can query everything, including the smooth mesh
+		loader.AddDependency(luaTask,    smoothTask);
+		loader.AddDependency(luaTask,    pathTask);
+		loader.AddDependency(luaTask,    uiTask);
+
+		loader.Run();
 	}
+
 	PrintLoadMsg("Finalizing...");
 
 	if (true || !shadowHandler->drawShadows) { // FIXME ?
@@ -2247,6 +2396,14 @@ bool CGame::ActionPressed(const Action& action,
 			sound->PrintDebugInfo();
 		} else if (action.extra == "profiling") {
 			profiler.PrintProfilingInfo();
+		} else if (action.extra == "trace") {
+			// toggles recording, the trace is written when it stops
+			if (profiler.IsTracing()) {
+				profiler.StopTrace("profile-trace.json");
+			} else {
+				profiler.StartTrace();
+				logOutput.Print("Profiler: recording trace, repeat /debuginfo trace to stop");
+			}
 		}
 	}
 	else if (cmd == "benchmark-script") {
@@ -2981,6 +3138,8 @@ bool CGame::DrawMT() {
 bool CGame::Draw() {
 #endif
 
+	profiler.MarkFrame("Draw frame", gu->drawFrame);
+
 	//! timings and frame interpolation
 	const unsigned currentTime = SDL_GetTicks();
 
@@ -3429,7 +3588,51 @@ void CGame::StartPlaying()
 
 
 
+void CGame::SendSnapshot()
+{
+	if (luaRules || luaGaia) {
+		// the state of synced Lua is not part of a savegame, a joiner would
+		// desync; an empty snapshot tells the server to replay the game instead
+		net->Send(CBaseNetProtocol::Get().SendSnapshotData(gu->myPlayerNum, gs->frameNum, 0, 0, 0, NULL, 0));
+		return;
+	}
+
+	ScopedOnceTimer timer("Game state snapshot");
+
+	// the joiner checks the state it loaded against this
+	const unsigned int checksum = CLoadSaveHandler::GetSimChecksum();
+	std::ostringstream state(std::ios::out | std::ios::binary);
+	state.write((const char*) &checksum, sizeof(checksum));
+	try {
+		CLoadSaveHandler ls;
+		ls.mapName = gameSetup->mapName;
+		ls.modName = modInfo.filename;
+		// the AIs are private to this client
+		ls.SaveGame(state, false);
+	} catch (const std::exception& e) {
+		logOutput.Print("Game state snapshot failed: %s", e.what());
+		return;
+	}
+
+	const std::string raw = state.str();
+	uLongf compressedSize = compressBound(raw.size());
+	std::vector<boost::uint8_t> compressed(compressedSize);
+	if (compress2(&compressed[0], &compressedSize, reinterpret_cast<const Bytef*>(raw.data()), raw.size(), Z_BEST_SPEED) != Z_OK) {
+		logOutput.Print("Game state snapshot failed: could not compress %u bytes", (unsigned)raw.size());
+		return;
+	}
+
+	// stay well below the 15 bit message size limit
+	const unsigned pieceSize = 16384;
+	for (unsigned offset = 0; offset < compressedSize; offset += pieceSize) {
+		const unsigned length = std::min(pieceSize, (unsigned)compressedSize - offset);
+		net->Send(CBaseNetProtocol::Get().SendSnapshotData(gu->myPlayerNum, gs->frameNum, offset, compressedSize, raw.size(), &compressed[offset], length));
+	}
+}
+
+
 void CGame::SimFrame() {
+	profiler.MarkFrame("Sim frame", gs->frameNum);
 	ScopedTimer cputimer("CPU load"); // SimFrame
 
 	good_fpu_control_registers("CGame::SimFrame");
@@ -4135,6 +4338,16 @@ void CGame::ClientReadNet()
 				AddTraffic(player, packetCode, dataLength);
 				break;
 			}
+			case NETMSG_SNAPSHOTREQUEST: {
+				const int frameNum = *(int*)&inbuf[1];
+				if (frameNum == gs->frameNum) {
+					SendSnapshot();
+				} else {
+					logOutput.Print("Got snapshot request for frame %i in frame %i", frameNum, gs->frameNum);
+				}
+				AddTraffic(-1, packetCode, dataLength);
+				break;
+			}
 			case NETMSG_AI_CREATED: {
 				// inbuf[1] contains the message size
 				const unsigned char playerId = inbuf[2];
@@ -148,6 +148,14 @@ private:
 
 	void ReColorTeams();
 
+	/// stages of the loading sequence run by the constructor
+	void LoadMap(const std::string& mapname);
+	void LoadDefinitions();
+	void LoadSimulation(bool loadedGame);
+	void LoadPathing();
+	void LoadInterface();
+	void LoadLua();
+
 	void ReloadCOB(const std::string& msg, int player);
 	void StartSkip(int toFrame);
 	void DrawSkip(bool blackscreen = true);
@@ -186,6 +194,8 @@ private:
 
 	void SimFrame();
 	void StartPlaying();
+	/// send the server a snapshot of the game state for late joiners
+	void SendSnapshot();
 
 	// to smooth out SimFrame calls
 	int leastQue;       ///< Lowest value of que in the past second.
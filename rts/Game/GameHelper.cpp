@@ -286,7 +286,14 @@ float CGameHelper::TraceRay(const float3& start, const float3& dir, float length
 	int* endQuad = quads;
 	qf->GetQuadsOnRay(start, dir, length, endQuad);
 
+	// candidates are gathered first (in quad order) and passed through the
+	// batched bounding-sphere cull, only the survivors get the exact test
+	static std::vector<CFeature*> features;
+	static std::vector<CUnit*> units;
+
 	if (!ignoreFeatures) {
+		features.clear();
+
 		for (int* qi = quads; qi != endQuad; ++qi) {
 			const CQuadField::Quad& quad = qf->GetQuad(*qi);
 
@@ -298,26 +305,34 @@ float CGameHelper::TraceRay(const float3& start, const float3& dir, float length
 					continue;
 				}
 
-				if (CCollisionHandler::Intersect(f, start, start + dir * length, &cq)) {
-					const float3& intPos = (cq.b0)? cq.p0: cq.p1;
-					const float tmpLen = (intPos - start).Length();
+				features.push_back(f);
+			}
+		}
+
+		CFeature** fi = features.empty()? NULL: &features[0];
+		CFeature** endFeature = CCollisionHandler::CullHitCandidates(fi, fi + features.size(), start, start + dir * length);
 
-					// we want the closest feature (intersection point) on the ray
-					if (tmpLen < length) {
-						length = tmpLen;
-					}
+		for (; fi != endFeature; ++fi) {
+			if (CCollisionHandler::Intersect(*fi, start, start + dir * length, &cq)) {
+				const float3& intPos = (cq.b0)? cq.p0: cq.p1;
+				const float tmpLen = (intPos - start).Length();
+
+				// we want the closest feature (intersection point) on the ray
+				if (tmpLen < length) {
+					length = tmpLen;
 				}
 			}
 		}
 	}
 
 	hit = NULL;
+	units.clear();
 
 	for (int* qi = quads; qi != endQuad; ++qi) {
 		const CQuadField::Quad& quad = qf->GetQuad(*qi);
 
 		for (std::list<CUnit*>::const_iterator ui = quad.units.begin(); ui != quad.units.end(); ++ui) {
-			const CUnit* u = *ui;
+			CUnit* u = *ui;
 
 			if (u == owner)
 				continue;
@@ -327,15 +342,22 @@ float CGameHelper::TraceRay(const float3& start, const float3& dir, float length
 				continue;
 			}
 
-			if (CCollisionHandler::Intersect(u, start, start + dir * length, &cq)) {
-				const float3& intPos = (cq.b0)? cq.p0: cq.p1;
-				const float tmpLen = (intPos - start).Length();
+			units.push_back(u);
+		}
+	}
 
-				// we want the closest unit (intersection point) on the ray
-				if (tmpLen < length) {
-					length = tmpLen;
-					hit = u;
-				}
+	CUnit** ui = units.empty()? NULL: &units[0];
+	CUnit** endUnit = CCollisionHandler::CullHitCandidates(ui, ui + units.size(), start, start + dir * length);
+
+	for (; ui != endUnit; ++ui) {
+		if (CCollisionHandler::Intersect(*ui, start, start + dir * length, &cq)) {
+			const float3& intPos = (cq.b0)? cq.p0: cq.p1;
+			const float tmpLen = (intPos - start).Length();
+
+			// we want the closest unit (intersection point) on the ray
+			if (tmpLen < length) {
+				length = tmpLen;
+				hit = *ui;
 			}
 		}
 	}
@@ -6,6 +6,7 @@
 
 #include "Net/UDPListener.h"
 #include "Net/UDPConnection.h"
+#include "Net/BroadcastBuffer.h"
 
 #include <stdarg.h>
 #include <ctime>
@@ -31,6 +32,7 @@
 #endif
 
 #include "LogOutput.h"
+#include "TimeProfiler.h"
 #include "GameSetup.h"
 #include "ClientSetup.h"
 #include "Action.h"
@@ -105,6 +107,33 @@ void SetBoolArg(bool& value, const std::string& str)
 		value = (num != 0);
 	}
 }
+
+/**
+ * Messages not covered by a game state snapshot,
+ * late joiners need them even if they load one.
+ */
+bool IsSessionMessage(const RawPacket& packet)
+{
+	switch (packet.data[0])
+	{
+		case NETMSG_PLAYERNAME:
+		case NETMSG_GAMEID:
+		case NETMSG_STARTPLAYING:
+		case NETMSG_PLAYERLEFT:
+		case NETMSG_CHAT:
+		case NETMSG_SYSTEMMSG:
+		case NETMSG_PAUSE:
+		case NETMSG_USER_SPEED:
+		case NETMSG_INTERNAL_SPEED:
+		case NETMSG_AI_CREATED:
+		case NETMSG_AI_STATE_CHANGED:
+			return true;
+		case NETMSG_TEAM:
+			return (packet.data[2] == TEAMMSG_JOIN_TEAM);
+		default:
+			return false;
+	}
+}
 }
 
 
@@ -112,10 +141,12 @@ CGameServer* gameServer=0;
 
 CGameServer::CGameServer(const ClientSetup* settings, bool onlyLocal, const GameData* const newGameData, const CGameSetup* const mysetup)
 : setup(mysetup)
+, broadcastBuffer(new netcode::BroadcastBuffer())
 {
 	assert(setup);
 	serverStartTime = spring_gettime();
 	lastUpdate = serverStartTime;
+	lastBroadcastFlush = serverStartTime;
 	lastPlayerInfo  = serverStartTime;
 	syncErrorFrame=0;
 	syncWarningFrame=0;
@@ -146,6 +177,11 @@ CGameServer::CGameServer(const ClientSetup* settings, bool onlyLocal, const Game
 	enforceSpeed = configHandler->Get("EnforceGameSpeed", 0);
 
 	allowAdditionalPlayers = configHandler->Get("AllowAdditionalPlayers", false);
+	// Snapshots only work for games without LuaRules and LuaGaia, as their
+	// state is not saved; most mods have LuaRules, so for them this stays
+	// off once the first snapshot request was answered with an empty one.
+	snapshotInterval = configHandler->Get("SnapshotInterval", 0);
+	snapshotSource = -1;
 
 	if (!onlyLocal)
 		UDPNet.reset(new netcode::UDPListener(settings->hostport));
@@ -304,11 +340,15 @@ void CGameServer::SkipTo(int targetframe)
 			modGameTime = demoReader->GetNextReadTime()+0.1f; // skip time
 			SendDemoData(true);
 			if (serverframenum % 20 == 0 && UDPNet)
+			{
+				FlushBroadcast(true);
 				UDPNet->Update(); // send some data (otherwise packets will grow too big)
+			}
 		}
 		CommandMessage msg2("skip end", SERVER_PLAYER);
 		Broadcast(boost::shared_ptr<const netcode::RawPacket>(msg2.Pack()));
 
+		FlushBroadcast(true);
 		if (UDPNet)
 			UDPNet->Update();
 		lastUpdate = spring_gettime();
@@ -359,7 +399,9 @@ void CGameServer::SendDemoData(const bool skipping)
 						msgCode != NETMSG_SETPLAYERNUM &&
 						msgCode != NETMSG_USER_SPEED &&
 						msgCode != NETMSG_INTERNAL_SPEED &&
-						msgCode != NETMSG_PAUSE) // dont send these from demo
+						msgCode != NETMSG_PAUSE &&
+						msgCode != NETMSG_SNAPSHOTREQUEST &&
+						msgCode != NETMSG_SNAPSHOTDATA) // dont send these from demo
 		{
 			Broadcast(boost::shared_ptr<const RawPacket>(buf));
 		}
@@ -376,8 +418,11 @@ void CGameServer::Broadcast(boost::shared_ptr<const netcode::RawPacket> packet)
 {
 	for (size_t p = 0; p < players.size(); ++p)
 	{
-		players[p].SendData(packet);
+		// the local client is not slowed down by batching
+		if (players[p].isLocal)
+			players[p].SendData(packet);
 	}
+	broadcastBuffer->Add(packet);
 	if (allowAdditionalPlayers || !spring_istime(gameStartTime))
 	{
 		packetCache.push_back(packet);
@@ -389,6 +434,27 @@ void CGameServer::Broadcast(boost::shared_ptr<const netcode::RawPacket> packet)
 #endif
 }
 
+void CGameServer::FlushBroadcast(const bool forced)
+{
+	if (broadcastBuffer->Empty())
+		return;
+
+	// same rules as in UDPConnection::Flush(): do not create more than
+	// 30 chunks per second, and wait a bit longer for small amounts of data
+	const spring_time curTime = spring_gettime();
+	const bool waitMore = (lastBroadcastFlush < curTime - spring_msecs(34)) ? false : true;
+	if (!forced && (waitMore || lastBroadcastFlush + spring_msecs(200) >= (curTime + broadcastBuffer->GetLength()*10)))
+		return;
+
+	for (size_t p = 0; p < players.size(); ++p)
+	{
+		if (!players[p].isLocal)
+			players[p].SendData(*broadcastBuffer);
+	}
+	broadcastBuffer->Clear();
+	lastBroadcastFlush = curTime;
+}
+
 void CGameServer::Message(const std::string& message, bool broadcast)
 {
 	if (broadcast) {
@@ -409,6 +475,7 @@ void CGameServer::Message(const std::string& message, bool broadcast)
 }
 
 void CGameServer::PrivateMessage(int playernum, const std::string& message) {
+	FlushBroadcast(true);
 	players[playernum].SendData(CBaseNetProtocol::Get().SendSystemMessage(SERVER_PLAYER, message));
 }
 
@@ -648,6 +715,19 @@ void CGameServer::Update()
 			CheckForGameEnd();
 	}
 
+	if (snapshotInterval > 0 && allowAdditionalPlayers && !demoReader && serverframenum > 0)
+	{
+		const int intervalFrames = snapshotInterval * GAME_SPEED;
+		if (snapshotSource >= 0 && (!players[snapshotSource].link || serverframenum > pendingSnapshot.frameNum + intervalFrames))
+		{
+			// left or too slow, try again with someone else
+			snapshotSource = -1;
+			pendingSnapshot.data.clear();
+		}
+		if (snapshotSource < 0 && serverframenum >= pendingSnapshot.frameNum + intervalFrames)
+			RequestSnapshot();
+	}
+
 	if (hostif)
 	{
 		std::string msg = hostif->GetChatMessage();
@@ -798,6 +878,7 @@ void CGameServer::ProcessPacket(const unsigned playernum, boost::shared_ptr<cons
 		case NETMSG_QUIT: {
 			Message(str(format(PlayerLeft) %players[a].GetType() %players[a].name %" normal quit"));
 			Broadcast(CBaseNetProtocol::Get().SendPlayerLeft(a, 1));
+			FlushBroadcast(true);
 			players[a].Kill("User exited");
 			if (hostif)
 			{
@@ -1297,6 +1378,56 @@ void CGameServer::ProcessPacket(const unsigned playernum, boost::shared_ptr<cons
 				hostif->Send(packet->data, packet->length);
 			break;
 		}
+
+		case NETMSG_SNAPSHOTDATA: {
+			// /* uint16_t messageSize */, uchar myPlayerNum, int frameNum, uint offset, uint totalSize, uint rawSize
+			const unsigned headerSize = 20;
+			if (packet->length < headerSize || inbuf[3] != a) {
+				Message(str(format(WrongPlayer) %(unsigned)inbuf[0] %a %(unsigned)inbuf[3]));
+				break;
+			}
+			if (a != snapshotSource)
+				break; // not asked for, or given up on
+
+			netcode::UnpackPacket msg(packet, 4);
+			int frameNum;
+			unsigned offset, totalSize, rawSize;
+			msg >> frameNum;
+			msg >> offset;
+			msg >> totalSize;
+			msg >> rawSize;
+			const unsigned length = packet->length - headerSize;
+			if (totalSize == 0)
+			{
+				// the game runs synced Lua, whose state a snapshot can't hold;
+				// late joiners get the whole packetCache replayed instead
+				Message("Game state snapshots are not possible with synced Lua, late joiners will simulate the whole game", false);
+				snapshotInterval = 0;
+				snapshotSource = -1;
+				pendingSnapshot.data.clear();
+				snapshot = Snapshot();
+				break;
+			}
+			if (frameNum != pendingSnapshot.frameNum || offset != pendingSnapshot.data.size() || offset + length > totalSize)
+			{
+				Message(str(format("Invalid game state snapshot from player %d") %a));
+				snapshotSource = -1;
+				pendingSnapshot.data.clear();
+				break;
+			}
+			pendingSnapshot.data.insert(pendingSnapshot.data.end(), inbuf + headerSize, inbuf + packet->length);
+			if (pendingSnapshot.data.size() == totalSize)
+			{
+				snapshot.frameNum = pendingSnapshot.frameNum;
+				snapshot.cacheSize = pendingSnapshot.cacheSize;
+				snapshot.rawSize = rawSize;
+				snapshot.data.swap(pendingSnapshot.data);
+				pendingSnapshot.data.clear();
+				snapshotSource = -1;
+				Message(str(format("Game state of frame %d stored for late joiners (%d KB)") %snapshot.frameNum %(snapshot.data.size() / 1024)), false);
+			}
+			break;
+		}
 #ifdef SYNCDEBUG
 		case NETMSG_SD_CHKRESPONSE:
 		case NETMSG_SD_BLKRESPONSE:
@@ -1359,6 +1490,7 @@ void CGameServer::ServerReadNet()
 		{
 			Message(str(format(PlayerLeft) %players[a].GetType() %players[a].name %" timeout")); //this must happen BEFORE the reset!
 			Broadcast(CBaseNetProtocol::Get().SendPlayerLeft(a, 0));
+			FlushBroadcast(true);
 			players[a].Kill("User timeout");
 			if (hostif)
 			{
@@ -1739,6 +1871,8 @@ void CGameServer::CreateNewFrame(bool fromServerThread, bool fixedFrameTime)
 
 void CGameServer::UpdateLoop()
 {
+	profiler.SetThreadName("Server");
+
 	while (!quitServer)
 	{
 		spring_sleep(spring_msecs(10));
@@ -1749,10 +1883,12 @@ void CGameServer::UpdateLoop()
 		boost::recursive_mutex::scoped_lock scoped_lock(gameServerMutex);
 		ServerReadNet();
 		Update();
+		FlushBroadcast();
 	}
 	if (hostif)
 		hostif->SendQuit();
 	Broadcast(CBaseNetProtocol::Get().SendQuit("Server shutdown"));
+	FlushBroadcast(true);
 }
 
 bool CGameServer::WaitsOnCon() const
@@ -1771,6 +1907,7 @@ void CGameServer::KickPlayer(const int playerNum)
 	{
 		Message(str(format(PlayerLeft) %players[playerNum].GetType() %players[playerNum].name %"kicked"));
 		Broadcast(CBaseNetProtocol::Get().SendPlayerLeft(playerNum, 2));
+		FlushBroadcast(true);
 		players[playerNum].Kill("Kicked from the battle");
 		if (hostif)
 		{
@@ -1840,14 +1977,23 @@ unsigned CGameServer::BindConnection(std::string name, const std::string& passwd
 			return 0;
 		};
 	}
+	// everything broadcast so far is in the packetCache or was not meant for him
+	FlushBroadcast(true);
+
 	GameParticipant& newGuy = players[hisNewNumber];
 	newGuy.Connected(link, isLocal);
 	newGuy.SendData(boost::shared_ptr<const RawPacket>(gameData->Pack()));
+
+	// spares him simulating everything up to it, has to arrive before the playernum
+	const size_t snapshotPackets = isLocal ? 0 : SendSnapshot(newGuy);
 	newGuy.SendData(CBaseNetProtocol::Get().SendSetPlayerNum((unsigned char)hisNewNumber));
 
 	// after gamedata and playernum, the player can start loading
-	for (std::list< boost::shared_ptr<const netcode::RawPacket> >::const_iterator it = packetCache.begin(); it != packetCache.end(); ++it)
+	size_t cached = 0;
+	for (std::list< boost::shared_ptr<const netcode::RawPacket> >::const_iterator it = packetCache.begin(); it != packetCache.end(); ++it, ++cached)
 	{
+		if (cached < snapshotPackets && !IsSessionMessage(**it))
+			continue; // part of the snapshot
 		newGuy.SendData(*it); // throw at him all stuff he missed until now
 	}
 
@@ -1871,6 +2017,52 @@ unsigned CGameServer::BindConnection(std::string name, const std::string& passwd
 	return hisNewNumber;
 }
 
+void CGameServer::RequestSnapshot()
+{
+	// prefer the host, as its snapshot doesn't need to go over the network
+	int source = -1;
+	if (hasLocalClient && players[localClientNumber].link && players[localClientNumber].myState == GameParticipant::INGAME)
+	{
+		source = localClientNumber;
+	}
+	else
+	{
+		for (size_t p = 0; p < players.size(); ++p)
+		{
+			if (players[p].link && players[p].myState == GameParticipant::INGAME)
+			{
+				source = p;
+				break;
+			}
+		}
+	}
+	if (source < 0)
+		return;
+
+	// the request marks the point in the stream the snapshot belongs to
+	FlushBroadcast(true);
+	snapshotSource = source;
+	pendingSnapshot.frameNum = serverframenum;
+	pendingSnapshot.cacheSize = packetCache.size();
+	pendingSnapshot.data.clear();
+	players[source].SendData(CBaseNetProtocol::Get().SendSnapshotRequest(serverframenum));
+}
+
+size_t CGameServer::SendSnapshot(GameParticipant& player)
+{
+	if (snapshot.frameNum < 0)
+		return 0;
+
+	const unsigned pieceSize = 16384;
+	const unsigned totalSize = snapshot.data.size();
+	for (unsigned offset = 0; offset < totalSize; offset += pieceSize)
+	{
+		const unsigned length = std::min(pieceSize, totalSize - offset);
+		player.SendData(CBaseNetProtocol::Get().SendSnapshotData(SERVER_PLAYER, snapshot.frameNum, offset, totalSize, snapshot.rawSize, &snapshot.data[offset], length));
+	}
+	return snapshot.cacheSize;
+}
+
 void CGameServer::GotChatMessage(const ChatMessage& msg)
 {
 	if (!msg.msg.empty()) // silently drop empty chat messages
@@ -4,6 +4,7 @@
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/cstdint.hpp>
 #include <string>
 #include <map>
 #include <deque>
@@ -22,6 +23,7 @@ namespace netcode
 	class RawPacket;
 	class CConnection;
 	class UDPListener;
+	class BroadcastBuffer;
 }
 class CDemoReader;
 class Action;
@@ -115,7 +117,24 @@ private:
 	/// read data from demo and send it to clients
 	void SendDemoData(const bool skipping=false);
 
+	/// ask a client for a snapshot of the game state, for late joiners
+	void RequestSnapshot();
+	/**
+	 * @brief send the last snapshot to a late joiner
+	 * @return the number of packets in packetCache the snapshot replaces
+	 */
+	size_t SendSnapshot(GameParticipant& player);
+
 	void Broadcast(boost::shared_ptr<const netcode::RawPacket> packet);
+	/**
+	 * @brief send the buffered broadcasts to the remote players
+	 *
+	 * Broadcasts to remote players are collected and cut into chunks once for
+	 * all of them, batched the same way UDPConnection::Flush() does it.
+	 * @param forced send them right away, needed before a message to a single
+	 *   remote player, so it does not overtake earlier broadcasts
+	 */
+	void FlushBroadcast(const bool forced = false);
 
 	/**
 	 * @brief skip frames
@@ -180,6 +199,29 @@ private:
 	bool allowAdditionalPlayers;
 	std::list< boost::shared_ptr<const netcode::RawPacket> > packetCache; //waaa, the overhead
 
+	/// game seconds between the snapshots for late joiners, 0 disables them
+	int snapshotInterval;
+	struct Snapshot
+	{
+		Snapshot() : frameNum(-1), cacheSize(0), rawSize(0) {};
+		/// frame after which the game state was saved, -1 if none
+		int frameNum;
+		/// number of packets in packetCache before the snapshot
+		size_t cacheSize;
+		/// size of the uncompressed game state
+		unsigned rawSize;
+		std::vector<boost::uint8_t> data;
+	};
+	/// the last complete snapshot
+	Snapshot snapshot;
+	/// snapshot being received from player snapshotSource, -1 if none
+	Snapshot pendingSnapshot;
+	int snapshotSource;
+
+	/// broadcasts not yet sent to remote players, see FlushBroadcast()
+	boost::scoped_ptr<netcode::BroadcastBuffer> broadcastBuffer;
+	spring_time lastBroadcastFlush;
+
 	/////////////////// sync stuff ///////////////////
 #ifdef SYNCCHECK
 	std::deque<int> outstandingSyncFrames;
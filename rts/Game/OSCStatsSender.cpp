@@ -345,7 +345,7 @@ bool COSCStatsSender::SendTeamStats() {
 	static unsigned int prevHistSize = 0;
 
 	if (IsEnabled()) {
-		std::list<CTeam::Statistics> statHistory =
+		const CTeamStatHistory& statHistory =
 				teamHandler->Team(teamId)->statHistory;
 		unsigned int currHistSize = statHistory.size();
 		// only send if we did not yet send the latest history stats
@@ -354,9 +354,7 @@ bool COSCStatsSender::SendTeamStats() {
 		}
 
 		// get the latest history stats
-		std::list<CTeam::Statistics>::const_iterator latestStats_p =
-				--(statHistory.end());
-		const CTeam::Statistics& teamStats = *latestStats_p;
+		const CTeam::Statistics teamStats = statHistory.back();
 
 		(*oscPacker)
 				<< osc::BeginBundleImmediate
@@ -5,6 +5,8 @@
 #include <SDL_timer.h>
 #include <set>
 #include <cfloat>
+#include <fstream>
+#include <zlib.h>
 
 #include "mmgr.h"
 
@@ -23,6 +25,7 @@
 #include "ExternalAI/SkirmishAIHandler.h"
 #include "NetProtocol.h"
 #include "Net/RawPacket.h"
+#include "Net/UnpackPacket.h"
 #include "DemoRecorder.h"
 #include "DemoReader.h"
 #include "LoadSaveHandler.h"
@@ -51,7 +54,9 @@ extern bool globalQuit;
 
 CPreGame::CPreGame(const ClientSetup* setup) :
 		settings(setup),
-		savefile(NULL)
+		savefile(NULL),
+		fromSnapshot(false),
+		snapshotChecksum(0)
 {
 	net = new CNetProtocol();
 	activeController=this;
@@ -215,6 +220,10 @@ void CPreGame::UpdateClientNet()
 				GameDataReceived(packet);
 				break;
 			}
+			case NETMSG_SNAPSHOTDATA: { // sent before our playernum if we join late
+				SnapshotDataReceived(packet);
+				break;
+			}
 			case NETMSG_SETPLAYERNUM: { // this is sent afterwards to let us know which playernum we have
 				gu->SetMyPlayer(packet->data[1]);
 				logOutput.Print("User number %i (team %i, allyteam %i)", gu->myPlayerNum, gu->myTeam, gu->myAllyTeam);
@@ -234,7 +243,33 @@ void CPreGame::UpdateClientNet()
 				game = new CGame(gameSetup->MapFile(), modArchive, savefile);
 
 				if (savefile) {
-					savefile->LoadGame();
+					const int myTeam = gu->myTeam;
+					const int myAllyTeam = gu->myAllyTeam;
+					const bool spectating = gu->spectating;
+					const bool spectatingFullView = gu->spectatingFullView;
+					const bool spectatingFullSelect = gu->spectatingFullSelect;
+
+					// snapshots are saved without the AIs of their creator
+					savefile->LoadGame(!fromSnapshot);
+
+					if (fromSnapshot) {
+						const unsigned int checksum = CLoadSaveHandler::GetSimChecksum();
+						if (checksum != snapshotChecksum) {
+							// continuing would desync, simulating from the start is still possible
+							char buf[256];
+							SNPRINTF(buf, sizeof(buf), "The loaded game state snapshot differs from its creator's (checksum %08x instead of %08x), set SnapshotInterval=0 on the host", checksum, snapshotChecksum);
+							throw std::runtime_error(buf);
+						}
+						logOutput.Print("Loaded game state snapshot matches its creator's (checksum %08x)", checksum);
+
+						// the snapshot also holds who its creator was
+						gu->myPlayerNum = packet->data[1];
+						gu->myTeam = myTeam;
+						gu->myAllyTeam = myAllyTeam;
+						gu->spectating = spectating;
+						gu->spectatingFullView = spectatingFullView;
+						gu->spectatingFullSelect = spectatingFullSelect;
+					}
 				}
 
 				pregame=0;
@@ -249,6 +284,74 @@ void CPreGame::UpdateClientNet()
 	}
 }
 
+bool CPreGame::HasSyncedLua() const
+{
+	if (CFileHandler("LuaRules/main.lua", SPRING_VFS_MOD).FileExists() ||
+	    CFileHandler("LuaRules/draw.lua", SPRING_VFS_MOD).FileExists()) {
+		return true;
+	}
+	return gameSetup->useLuaGaia &&
+	       (CFileHandler("LuaGaia/main.lua", SPRING_VFS_MAP).FileExists() ||
+	        CFileHandler("LuaGaia/draw.lua", SPRING_VFS_MAP).FileExists());
+}
+
+void CPreGame::SnapshotDataReceived(boost::shared_ptr<const netcode::RawPacket> packet)
+{
+	// /* uint16_t messageSize */, uchar myPlayerNum, int frameNum, uint offset, uint totalSize, uint rawSize
+	const unsigned headerSize = 20;
+	if (packet->length < headerSize) {
+		throw std::runtime_error("Received a broken game state snapshot");
+	}
+	netcode::UnpackPacket msg(packet, 4);
+	int frameNum;
+	unsigned offset, totalSize, rawSize;
+	msg >> frameNum;
+	msg >> offset;
+	msg >> totalSize;
+	msg >> rawSize;
+
+	const unsigned length = packet->length - headerSize;
+	if (totalSize == 0 || offset != snapshotData.size() || offset + length > totalSize) {
+		throw std::runtime_error("Received a broken game state snapshot");
+	}
+	if (HasSyncedLua()) {
+		// the server should never have taken one, see CGame::SendSnapshot()
+		throw std::runtime_error("Received a game state snapshot, but synced Lua state can not be restored from one");
+	}
+	snapshotData.insert(snapshotData.end(), packet->data + headerSize, packet->data + packet->length);
+	if (snapshotData.size() < totalSize) {
+		return;
+	}
+
+	std::vector<boost::uint8_t> state(rawSize);
+	uLongf size = rawSize;
+	if (rawSize <= sizeof(snapshotChecksum) ||
+	    uncompress(&state[0], &size, &snapshotData[0], snapshotData.size()) != Z_OK || size != rawSize) {
+		throw std::runtime_error("Received a broken game state snapshot");
+	}
+	snapshotData.clear();
+	// the snapshot starts with CLoadSaveHandler::GetSimChecksum() of its creator
+	memcpy(&snapshotChecksum, &state[0], sizeof(snapshotChecksum));
+
+	// CLoadSaveHandler only reads from files
+	const std::string file = "Saves/_joinsnapshot.ssf";
+	if (!filesystem.CreateDirectory("Saves")) {
+		throw content_error("Unable to create the Saves directory");
+	}
+	{
+		std::ofstream ofs(filesystem.LocateFile(file, FileSystem::WRITE).c_str(), std::ios::out | std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(&state[sizeof(snapshotChecksum)]), state.size() - sizeof(snapshotChecksum));
+		if (ofs.bad() || !ofs.is_open()) {
+			throw content_error("Unable to save game state snapshot to \"" + file + "\"");
+		}
+	}
+
+	logOutput.Print("Loading the game state of frame %i instead of simulating up to it", frameNum);
+	savefile = new CLoadSaveHandler();
+	savefile->LoadGameStartInfo(file);
+	fromSnapshot = true;
+}
+
 void CPreGame::ReadDataFromDemo(const std::string& demoName)
 {
 	ScopedOnceTimer startserver("Reading demo data");
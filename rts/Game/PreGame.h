@@ -2,6 +2,8 @@
 #define PREGAME_H
 
 #include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 
@@ -60,6 +62,10 @@ private:
 	void LoadMod(const std::string& modName);
 
 	void GameDataReceived(boost::shared_ptr<const netcode::RawPacket> packet);
+	/// collect the game state snapshot the server sends to late joiners
+	void SnapshotDataReceived(boost::shared_ptr<const netcode::RawPacket> packet);
+	/// whether the game will run LuaRules or LuaGaia, whose state snapshots lack
+	bool HasSyncedLua() const;
 
 	/**
 	@brief GameData we received from server
@@ -70,6 +76,12 @@ private:
 	boost::scoped_ptr<const ClientSetup> settings;
 	std::string modArchive;
 	CLoadSaveHandler *savefile;
+	/// compressed snapshot, until it is complete
+	std::vector<boost::uint8_t> snapshotData;
+	/// savefile was made by another player
+	bool fromSnapshot;
+	/// CLoadSaveHandler::GetSimChecksum() of the snapshot's creator
+	unsigned int snapshotChecksum;
 	
 	unsigned timer;
 };
@@ -768,7 +768,7 @@ void CSelectedUnits::SendCommand(Command& c)
 	if (selectionChanged) {		//send new selection
 		SendSelection();
 	}
-	net->Send(CBaseNetProtocol::Get().SendCommand(gu->myPlayerNum, c.id, c.options, c.params));
+	net->Send(CBaseNetProtocol::Get().SendCommand(gu->myPlayerNum, c.id, c.options, c.params.begin(), c.params.size()));
 }
 
 
@@ -1,6 +1,7 @@
 #include "GameParticipant.h"
 
 #include "Net/Connection.h"
+#include "Net/BroadcastBuffer.h"
 #include "BaseNetProtocol.h"
 
 GameParticipant::GameParticipant()
@@ -16,6 +17,12 @@ void GameParticipant::SendData(boost::shared_ptr<const netcode::RawPacket> packe
 		link->SendData(packet);
 }
 
+void GameParticipant::SendData(netcode::BroadcastBuffer& packets)
+{
+	if (link)
+		link->SendData(packets);
+}
+
 void GameParticipant::Connected(boost::shared_ptr<netcode::CConnection> _link, bool local)
 {
 	link = _link;
@@ -10,6 +10,7 @@ namespace netcode
 {
 	class CConnection;
 	class RawPacket;
+	class BroadcastBuffer;
 }
 
 class GameParticipant : public PlayerBase
@@ -17,6 +18,7 @@ class GameParticipant : public PlayerBase
 public:
 	GameParticipant();
 	void SendData(boost::shared_ptr<const netcode::RawPacket> packet);
+	void SendData(netcode::BroadcastBuffer& packets);
 
 	void Connected(boost::shared_ptr<netcode::CConnection> link, bool local);
 	void Kill(const std::string& reason);
@@ -433,7 +433,10 @@ void CEndGameBox::FillTeamStats()
 
 	for(int team=0; team<teamHandler->ActiveTeams(); team++){
 		if (teamHandler->Team(team)->gaia) continue;
-		for(std::list<CTeam::Statistics>::iterator si=teamHandler->Team(team)->statHistory.begin(); si!=teamHandler->Team(team)->statHistory.end(); si++){
+		const CTeamStatHistory& history = teamHandler->Team(team)->statHistory;
+		for(size_t h=0; h<history.size(); h++){
+			const CTeam::Statistics stat = history[h];
+			const CTeam::Statistics* si = &stat;
 			stats[0].AddStat(team,0);
 
 			stats[1].AddStat(team, si->metalUsed);
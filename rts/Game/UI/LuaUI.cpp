@@ -204,6 +204,7 @@ CLuaUI::CLuaUI()
 	}
 
 	// register for call-ins
+	UpdateBatchedCallIns();
 	eventHandler.AddClient(this);
 
 	// update extra call-ins
@@ -262,7 +263,7 @@ bool CLuaUI::HasCallIn(const string& name)
 	lua_getglobal(L, name.c_str());
 	if (!lua_isfunction(L, -1)) {
 		lua_pop(L, 1);
-		return false;
+		return HasBatchedCallIn(name);
 	}
 	lua_pop(L, 1);
 	return true;
@@ -340,6 +341,9 @@ void CLuaUI::Shutdown()
 
 void CLuaUI::GameFrame(int frameNumber)
 {
+	// hand over the events batched during the last frame first
+	DeliverBatchedEvents();
+
 	LUA_CALL_IN_CHECK(L);
 	lua_checkstack(L, 3);
 	static const LuaHashString cmdStr("GameFrame");
@@ -37,6 +37,7 @@
 #include "Sim/Weapons/Weapon.h"
 #include "EventHandler.h"
 #include "LogOutput.h"
+#include "ConfigHandler.h"
 #include "SpringApp.h"
 #include "FileSystem/FileHandler.h"
 
@@ -58,6 +59,8 @@ int CLuaHandle::activeReadAllyTeam = CEventClient::NoAccessTeam;
 CLuaHandle::CLuaHandle(const string& _name, int _order, bool _userMode)
 : CEventClient(_name, _order, false), // FIXME
   userMode   (_userMode),
+  memPool    ((size_t) configHandler->Get("LuaMemLimitMB", 0) * 1024 * 1024,
+              !!configHandler->Get("LuaMemPool", 1)),
   killMe     (false),
   synced     (false),
 #ifdef DEBUG
@@ -65,10 +68,16 @@ CLuaHandle::CLuaHandle(const string& _name, int _order, bool _userMode)
 #else
   printTracebacks(false),
 #endif
-  callinErrors(0)
+  callinErrors(0),
+  batchedCallIns(0)
 {
-	L = lua_open();
+	L = memPool.NewState();
 	luaopen_debug(L);
+
+	unitDamagedBatch.reserve(1024);
+	projectileCreatedBatch.reserve(1024);
+	projectileDestroyedBatch.reserve(1024);
+	explosionBatch.reserve(256);
 }
 
 
@@ -92,6 +101,13 @@ void CLuaHandle::KillLua()
 		SetActiveHandle();
 		lua_close(L);
 		SetActiveHandle(orig);
+
+		const LuaMemPool::Stats& stats = memPool.GetStats();
+		logOutput.Print("%s: Lua memory peak %u KB, %u allocs (%u pooled, %u refused), %u KB in pool chunks\n",
+		                GetName().c_str(),
+		                (unsigned) (stats.peakBytes / 1024), (unsigned) stats.numAllocs,
+		                (unsigned) stats.numPooled, (unsigned) stats.numFailed,
+		                (unsigned) (stats.chunkBytes / 1024));
 	}
 	L = NULL;
 }
@@ -649,7 +665,7 @@ void CLuaHandle::UnitCommand(const CUnit* unit, const Command& command)
 	lua_pushnumber(L, command.id);
 	lua_pushnumber(L, command.options);
 
-	const vector<float> params = command.params;
+	const CommandParams& params = command.params;
 	lua_createtable(L, params.size(), 0);
 	for (unsigned int i = 0; i < params.size(); i++) {
 		lua_pushnumber(L, i + 1);
@@ -693,6 +709,22 @@ void CLuaHandle::UnitDamaged(const CUnit* unit, const CUnit* attacker,
                              float damage, int weaponID, bool paralyzer)
 {
 	LUA_CALL_IN_CHECK(L);
+
+	if (batchedCallIns & BATCH_UNIT_DAMAGED) {
+		UnitDamagedEvent e;
+		e.unitID        = unit->id;
+		e.unitDefID     = unit->unitDef->id;
+		e.unitTeam      = unit->team;
+		e.damage        = damage;
+		e.paralyzer     = paralyzer;
+		e.weaponID      = weaponID;
+		e.attackerID    = (attacker != NULL) ? attacker->id          : -1;
+		e.attackerDefID = (attacker != NULL) ? attacker->unitDef->id : -1;
+		e.attackerTeam  = (attacker != NULL) ? attacker->team        : -1;
+		unitDamagedBatch.push_back(e);
+		return;
+	}
+
 	lua_checkstack(L, 11);
 
 	int errfunc = SetupTraceback();
@@ -1004,6 +1036,15 @@ void CLuaHandle::FeatureDestroyed(const CFeature* feature)
 void CLuaHandle::ProjectileCreated(const CProjectile* projectile)
 {
 	LUA_CALL_IN_CHECK(L);
+
+	if (batchedCallIns & BATCH_PROJECTILE_CREATED) {
+		ProjectileCreatedEvent e;
+		e.projectileID = projectile->id;
+		e.ownerID      = (projectile->owner() != NULL) ? projectile->owner()->id : -1;
+		projectileCreatedBatch.push_back(e);
+		return;
+	}
+
 	lua_checkstack(L, 4);
 	static const LuaHashString cmdStr("ProjectileCreated");
 	if (!cmdStr.GetGlobalFunc(L)) {
@@ -1024,6 +1065,12 @@ void CLuaHandle::ProjectileCreated(const CProjectile* projectile)
 void CLuaHandle::ProjectileDestroyed(const CProjectile* projectile)
 {
 	LUA_CALL_IN_CHECK(L);
+
+	if (batchedCallIns & BATCH_PROJECTILE_DESTROYED) {
+		projectileDestroyedBatch.push_back(projectile->id);
+		return;
+	}
+
 	lua_checkstack(L, 4);
 	static const LuaHashString cmdStr("ProjectileDestroyed");
 	if (!cmdStr.GetGlobalFunc(L)) {
@@ -1049,6 +1096,17 @@ bool CLuaHandle::Explosion(int weaponID, const float3& pos, const CUnit* owner)
 	}
 
 	LUA_CALL_IN_CHECK(L);
+
+	if (batchedCallIns & BATCH_EXPLOSION) {
+		// the noGfx return value can not be honoured when batching
+		ExplosionEvent e;
+		e.weaponID = weaponID;
+		e.pos      = pos;
+		e.ownerID  = (owner != NULL) ? owner->id : -1;
+		explosionBatch.push_back(e);
+		return false;
+	}
+
 	lua_checkstack(L, 7);
 	static const LuaHashString cmdStr("Explosion");
 	if (!cmdStr.GetGlobalFunc(L)) {
@@ -1103,6 +1161,203 @@ void CLuaHandle::StockpileChanged(const CUnit* unit,
 }
 
 
+/******************************************************************************/
+/******************************************************************************/
+//
+//  Batched call-ins
+//
+
+template<typename E, typename T>
+static inline void PushBatchArray(lua_State* L, const vector<E>& events, int count, T E::*field)
+{
+	lua_createtable(L, count, 0);
+	for (int i = 0; i < count; i++) {
+		lua_pushnumber(L, events[i].*field);
+		lua_rawseti(L, -2, i + 1);
+	}
+}
+
+
+template<typename E>
+static inline void PushBatchArray(lua_State* L, const vector<E>& events, int count, bool E::*field)
+{
+	lua_createtable(L, count, 0);
+	for (int i = 0; i < count; i++) {
+		lua_pushboolean(L, events[i].*field);
+		lua_rawseti(L, -2, i + 1);
+	}
+}
+
+
+bool CLuaHandle::HasBatchedCallIn(const string& name)
+{
+	if ((name != "UnitDamaged") &&
+	    (name != "ProjectileCreated") &&
+	    (name != "ProjectileDestroyed") &&
+	    (name != "Explosion")) {
+		return false;
+	}
+	const string batchName = name + "Batch";
+	lua_getglobal(L, batchName.c_str());
+	const bool haveFunc = lua_isfunction(L, -1);
+	lua_pop(L, 1);
+	return haveFunc;
+}
+
+
+void CLuaHandle::UpdateBatchedCallIns()
+{
+	static const LuaHashString unitDamagedStr("UnitDamagedBatch");
+	static const LuaHashString projCreatedStr("ProjectileCreatedBatch");
+	static const LuaHashString projDestroyedStr("ProjectileDestroyedBatch");
+	static const LuaHashString explosionStr("ExplosionBatch");
+
+	batchedCallIns = 0;
+	if (unitDamagedStr.GetGlobalFunc(L))   { lua_pop(L, 1); batchedCallIns |= BATCH_UNIT_DAMAGED; }
+	if (projCreatedStr.GetGlobalFunc(L))   { lua_pop(L, 1); batchedCallIns |= BATCH_PROJECTILE_CREATED; }
+	if (projDestroyedStr.GetGlobalFunc(L)) { lua_pop(L, 1); batchedCallIns |= BATCH_PROJECTILE_DESTROYED; }
+	if (explosionStr.GetGlobalFunc(L))     { lua_pop(L, 1); batchedCallIns |= BATCH_EXPLOSION; }
+}
+
+
+void CLuaHandle::DeliverBatchedEvents()
+{
+	if (L == NULL) {
+		return;
+	}
+
+	LUA_CALL_IN_CHECK(L);
+
+	if (!unitDamagedBatch.empty())         { DeliverUnitDamagedBatch(); }
+	if (!projectileCreatedBatch.empty())   { DeliverProjectileCreatedBatch(); }
+	if (!projectileDestroyedBatch.empty()) { DeliverProjectileDestroyedBatch(); }
+	if (!explosionBatch.empty())           { DeliverExplosionBatch(); }
+
+	// pick up scripts that (un)defined a batch call-in since the last frame
+	UpdateBatchedCallIns();
+}
+
+
+/*
+ * The event arrays are built before the call-in runs, so events raised
+ * from inside the call-in (e.g. damage dealt by a gadget) are appended
+ * behind the delivered ones and go out with the next batch.
+ */
+
+void CLuaHandle::DeliverUnitDamagedBatch()
+{
+	const int count = (int)unitDamagedBatch.size();
+
+	lua_checkstack(L, 13);
+	int errfunc = SetupTraceback();
+
+	static const LuaHashString cmdStr("UnitDamagedBatch");
+	if (!cmdStr.GetGlobalFunc(L)) {
+		if (errfunc) lua_pop(L, 1);
+		unitDamagedBatch.clear();
+		return;
+	}
+
+	int argCount = 6;
+	lua_pushnumber(L, count);
+	PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::unitID);
+	PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::unitDefID);
+	PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::unitTeam);
+	PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::damage);
+	PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::paralyzer);
+	if (fullRead) {
+		PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::weaponID);
+		PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::attackerID);
+		PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::attackerDefID);
+		PushBatchArray(L, unitDamagedBatch, count, &UnitDamagedEvent::attackerTeam);
+		argCount += 4;
+	}
+
+	// call the routine
+	RunCallInTraceback(cmdStr, argCount, 0, errfunc);
+
+	unitDamagedBatch.erase(unitDamagedBatch.begin(), unitDamagedBatch.begin() + count);
+}
+
+
+void CLuaHandle::DeliverProjectileCreatedBatch()
+{
+	const int count = (int)projectileCreatedBatch.size();
+
+	lua_checkstack(L, 5);
+	static const LuaHashString cmdStr("ProjectileCreatedBatch");
+	if (!cmdStr.GetGlobalFunc(L)) {
+		projectileCreatedBatch.clear();
+		return;
+	}
+
+	lua_pushnumber(L, count);
+	PushBatchArray(L, projectileCreatedBatch, count, &ProjectileCreatedEvent::projectileID);
+	PushBatchArray(L, projectileCreatedBatch, count, &ProjectileCreatedEvent::ownerID);
+
+	// call the routine
+	RunCallIn(cmdStr, 3, 0);
+
+	projectileCreatedBatch.erase(projectileCreatedBatch.begin(), projectileCreatedBatch.begin() + count);
+}
+
+
+void CLuaHandle::DeliverProjectileDestroyedBatch()
+{
+	const int count = (int)projectileDestroyedBatch.size();
+
+	lua_checkstack(L, 4);
+	static const LuaHashString cmdStr("ProjectileDestroyedBatch");
+	if (!cmdStr.GetGlobalFunc(L)) {
+		projectileDestroyedBatch.clear();
+		return;
+	}
+
+	lua_pushnumber(L, count);
+	lua_createtable(L, count, 0);
+	for (int i = 0; i < count; i++) {
+		lua_pushnumber(L, projectileDestroyedBatch[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	// call the routine
+	RunCallIn(cmdStr, 2, 0);
+
+	projectileDestroyedBatch.erase(projectileDestroyedBatch.begin(), projectileDestroyedBatch.begin() + count);
+}
+
+
+void CLuaHandle::DeliverExplosionBatch()
+{
+	const int count = (int)explosionBatch.size();
+
+	lua_checkstack(L, 8);
+	static const LuaHashString cmdStr("ExplosionBatch");
+	if (!cmdStr.GetGlobalFunc(L)) {
+		explosionBatch.clear();
+		return;
+	}
+
+	lua_pushnumber(L, count);
+	PushBatchArray(L, explosionBatch, count, &ExplosionEvent::weaponID);
+	lua_createtable(L, count, 0); // px
+	lua_createtable(L, count, 0); // py
+	lua_createtable(L, count, 0); // pz
+	for (int i = 0; i < count; i++) {
+		const float3& pos = explosionBatch[i].pos;
+		lua_pushnumber(L, pos.x); lua_rawseti(L, -4, i + 1);
+		lua_pushnumber(L, pos.y); lua_rawseti(L, -3, i + 1);
+		lua_pushnumber(L, pos.z); lua_rawseti(L, -2, i + 1);
+	}
+	PushBatchArray(L, explosionBatch, count, &ExplosionEvent::ownerID);
+
+	// call the routine
+	RunCallIn(cmdStr, 6, 0);
+
+	explosionBatch.erase(explosionBatch.begin(), explosionBatch.begin() + count);
+}
+
+
 bool CLuaHandle::RecvLuaMsg(const string& msg, int playerID)
 {
 	LUA_CALL_IN_CHECK(L);
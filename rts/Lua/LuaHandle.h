@@ -13,6 +13,7 @@ using std::set;
 #include <boost/cstdint.hpp>
 
 #include "EventClient.h"
+#include "float3.h"
 //FIXME#include "LuaArrays.h"
 #include "LuaShaders.h"
 #include "LuaTextures.h"
@@ -20,6 +21,7 @@ using std::set;
 #include "LuaRBOs.h"
 //FIXME#include "LuaVBOs.h"
 #include "LuaDisplayLists.h"
+#include "LuaMemPool.h"
 
 
 #define LUA_HANDLE_ORDER_RULES            100
@@ -82,6 +84,7 @@ class CLuaHandle : public CEventClient
 		LuaFBOs& GetFBOs() { return fbos; }
 		LuaRBOs& GetRBOs() { return rbos; }
 		CLuaDisplayLists& GetDisplayLists() { return displayLists; }
+		const LuaMemPool& GetMemPool() const { return memPool; }
 
 	public:
 		const bool userMode;
@@ -197,6 +200,10 @@ class CLuaHandle : public CEventClient
 		void DrawScreen();
 		void DrawInMiniMap();
 
+	public: // batched call-ins
+		/// delivers the events buffered since the last call as packed arrays
+		void DeliverBatchedEvents();
+
 	public: // custom call-in  (inter-script calls)
 		virtual bool HasSyncedXCall(const string& funcName) { return false; }
 		virtual bool HasUnsyncedXCall(const string& funcName) { return false; }
@@ -239,7 +246,18 @@ class CLuaHandle : public CEventClient
 
 		inline bool CheckModUICtrl() { return modUICtrl || userMode; }
 
+		/// true if name is UnitDamaged, ProjectileCreated, etc.
+		/// and the matching <name>Batch global function exists
+		bool HasBatchedCallIn(const string& name);
+		void UpdateBatchedCallIns();
+
+		void DeliverUnitDamagedBatch();
+		void DeliverProjectileCreatedBatch();
+		void DeliverProjectileDestroyedBatch();
+		void DeliverExplosionBatch();
+
 	protected:
+		LuaMemPool memPool; // must outlive L
 		lua_State* L;
 
 		bool killMe;
@@ -269,6 +287,37 @@ class CLuaHandle : public CEventClient
 
 		int callinErrors;
 
+		// opt-in batched delivery: if a script defines e.g. UnitDamagedBatch,
+		// the UnitDamaged events are buffered and handed over once per frame
+		enum BatchedCallIn {
+			BATCH_UNIT_DAMAGED         = (1 << 0),
+			BATCH_PROJECTILE_CREATED   = (1 << 1),
+			BATCH_PROJECTILE_DESTROYED = (1 << 2),
+			BATCH_EXPLOSION            = (1 << 3)
+		};
+		unsigned int batchedCallIns;
+
+		struct UnitDamagedEvent {
+			int unitID, unitDefID, unitTeam;
+			float damage;
+			bool paralyzer;
+			int weaponID;
+			int attackerID, attackerDefID, attackerTeam; // -1 if no attacker
+		};
+		struct ProjectileCreatedEvent {
+			int projectileID;
+			int ownerID;
+		};
+		struct ExplosionEvent {
+			int weaponID;
+			float3 pos;
+			int ownerID;
+		};
+		vector<UnitDamagedEvent>       unitDamagedBatch;
+		vector<ProjectileCreatedEvent> projectileCreatedBatch;
+		vector<int>                    projectileDestroyedBatch;
+		vector<ExplosionEvent>         explosionBatch;
+
 	protected: // call-outs
 		static int KillActiveHandle(lua_State* L);
 		static int CallOutGetName(lua_State* L);
@@ -166,6 +166,7 @@ void CLuaHandleSynced::Init(const string& syncedFile,
 	}
 
 	// register for call-ins
+	UpdateBatchedCallIns();
 	eventHandler.AddClient(this);
 
 	SetActiveHandle(origHandle);
@@ -574,6 +575,10 @@ bool CLuaHandleSynced::HasCallIn(const string& name)
 	}
 	lua_settop(L, 0);
 
+	if (!haveFunc && (tableIndex == LUA_GLOBALSINDEX)) {
+		haveFunc = HasBatchedCallIn(name);
+	}
+
 	return haveFunc;
 }
 
@@ -692,6 +697,9 @@ void CLuaHandleSynced::GameFrame(int frameNumber)
 		return;
 	}
 
+	// hand over the events batched during the last frame first
+	DeliverBatchedEvents();
+
 	LUA_CALL_IN_CHECK(L);
 	lua_checkstack(L, 4);
 
@@ -0,0 +1,185 @@
+#include "StdAfx.h"
+// LuaMemPool.cpp: implementation of the LuaMemPool class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmgr.h"
+
+#include "LuaMemPool.h"
+#include "LuaInclude.h"
+
+
+/******************************************************************************/
+/******************************************************************************/
+
+static int PanicFunc(lua_State* L)
+{
+	fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n",
+	        lua_tostring(L, -1));
+	return 0;
+}
+
+
+/******************************************************************************/
+
+LuaMemPool::LuaMemPool(size_t _maxBytes, bool _enabled)
+: enabled(_enabled),
+  maxBytes(_maxBytes),
+  chunkPos(NULL),
+  chunkEnd(NULL)
+{
+	memset(freeLists, 0, sizeof(freeLists));
+	memset(&stats, 0, sizeof(stats));
+}
+
+
+LuaMemPool::~LuaMemPool()
+{
+	// the owner must have called lua_close() on the state already,
+	// so every pooled block is back on a free-list by now
+	for (size_t i = 0; i < chunks.size(); i++) {
+		free(chunks[i]);
+	}
+}
+
+
+lua_State* LuaMemPool::NewState()
+{
+	lua_State* L = lua_newstate(Alloc, this);
+	if (L != NULL) {
+		lua_atpanic(L, PanicFunc);
+	}
+	return L;
+}
+
+
+/******************************************************************************/
+
+void* LuaMemPool::Alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	return static_cast<LuaMemPool*>(ud)->Realloc(ptr, osize, nsize);
+}
+
+
+void* LuaMemPool::Realloc(void* ptr, size_t osize, size_t nsize)
+{
+	if (nsize == 0) {
+		if (ptr != NULL) {
+			FreeBlock(ptr, osize);
+			stats.usedBytes -= osize;
+			stats.numFrees++;
+		}
+		return NULL;
+	}
+
+	if (ptr == NULL) {
+		osize = 0;
+	}
+
+	// Lua assumes shrinking never fails, so only check the limit on growth
+	if ((maxBytes > 0) && (nsize > osize) &&
+	    ((stats.usedBytes + (nsize - osize)) > maxBytes)) {
+		stats.numFailed++;
+		return NULL;
+	}
+
+	void* newPtr = NULL;
+
+	if (ptr == NULL) {
+		newPtr = AllocBlock(nsize);
+		stats.numAllocs++;
+	}
+	else if (!enabled || (!IsPooledSize(osize) && !IsPooledSize(nsize))) {
+		newPtr = realloc(ptr, nsize);
+	}
+	else if (IsPooledSize(osize) && IsPooledSize(nsize) &&
+	         (GetSizeClass(osize) == GetSizeClass(nsize))) {
+		newPtr = ptr;
+	}
+	else {
+		// crossing a size class (or the pooled/unpooled boundary)
+		newPtr = AllocBlock(nsize);
+		stats.numAllocs++;
+		if (newPtr != NULL) {
+			memcpy(newPtr, ptr, (osize < nsize) ? osize : nsize);
+			FreeBlock(ptr, osize);
+			stats.numFrees++;
+		}
+		else if (nsize < osize) {
+			// Lua assumes shrinking never fails, so keep the old block: it
+			// is large enough, and freeing it later as nsize is safe, as a
+			// cell of nsize's class fits into it (a malloc()ed one then
+			// stays in the pool instead of going back to the system)
+			newPtr = ptr;
+		}
+	}
+
+	if (newPtr == NULL) {
+		return NULL;
+	}
+
+	stats.usedBytes += nsize;
+	stats.usedBytes -= osize;
+	if (stats.usedBytes > stats.peakBytes) {
+		stats.peakBytes = stats.usedBytes;
+	}
+	return newPtr;
+}
+
+
+/******************************************************************************/
+
+void* LuaMemPool::AllocBlock(size_t size)
+{
+	if (!enabled || !IsPooledSize(size)) {
+		return malloc(size);
+	}
+
+	const size_t sizeClass = GetSizeClass(size);
+	const size_t cellSize = (sizeClass + 1) * SIZE_CLASS_STEP;
+
+	void* p = freeLists[sizeClass];
+	if (p != NULL) {
+		freeLists[sizeClass] = *(void**)p;
+		stats.numPooled++;
+		return p;
+	}
+
+	if ((chunkPos == NULL) || ((size_t)(chunkEnd - chunkPos) < cellSize)) {
+		char* chunk = (char*) malloc(CHUNK_SIZE);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunks.push_back(chunk);
+		stats.chunkBytes += CHUNK_SIZE;
+		// the tail of the previous chunk (less than one cell) is abandoned
+		chunkPos = chunk;
+		chunkEnd = chunk + CHUNK_SIZE;
+	}
+
+	p = chunkPos;
+	chunkPos += cellSize;
+	stats.numPooled++;
+	return p;
+}
+
+
+void LuaMemPool::FreeBlock(void* ptr, size_t size)
+{
+	if (!enabled || !IsPooledSize(size)) {
+		free(ptr);
+		return;
+	}
+
+	const size_t sizeClass = GetSizeClass(size);
+	*(void**)ptr = freeLists[sizeClass];
+	freeLists[sizeClass] = ptr;
+}
+
+
+/******************************************************************************/
+/******************************************************************************/
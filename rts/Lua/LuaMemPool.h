@@ -0,0 +1,92 @@
+#ifndef LUA_MEM_POOL_H
+#define LUA_MEM_POOL_H
+// LuaMemPool.h: interface for the LuaMemPool class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <vector>
+
+struct lua_State;
+
+
+/**
+ * @brief size-class pool allocator for lua_State's
+ *
+ * Every engine Lua state gets its own pool, passed to lua_newstate() as the
+ * allocator userdata. Requests up to MAX_POOLED_SIZE bytes are rounded up to
+ * a multiple of SIZE_CLASS_STEP and served from per-class free-lists carved
+ * out of CHUNK_SIZE blocks; anything larger goes straight to the C heap.
+ * Chunks are only returned to the system when the pool is destroyed, which
+ * keeps the churn of Lua's small strings, tables and closures off the
+ * process heap.
+ *
+ * A pool is not thread-safe; like the lua_State it serves, it must only be
+ * used by one thread at a time.
+ */
+class LuaMemPool {
+	public:
+		struct Stats {
+			size_t numAllocs;    ///< allocation requests (incl. reallocs that grow into a new block)
+			size_t numFrees;
+			size_t numPooled;    ///< allocations served from a free-list
+			size_t numFailed;    ///< allocations refused by the memory limit
+			size_t usedBytes;    ///< bytes currently requested by Lua
+			size_t peakBytes;
+			size_t chunkBytes;   ///< bytes held in pool chunks (pooled or not)
+		};
+
+	public:
+		LuaMemPool(size_t maxBytes = 0, bool enabled = true);
+		~LuaMemPool();
+
+		/// create a new lua_State using this pool
+		lua_State* NewState();
+
+		/// lua_Alloc compatible entry point, ud must be a LuaMemPool*
+		static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+		const Stats& GetStats() const { return stats; }
+
+		/// 0 means unlimited
+		void SetMaxBytes(size_t bytes) { maxBytes = bytes; }
+		size_t GetMaxBytes() const { return maxBytes; }
+
+		bool IsEnabled() const { return enabled; }
+
+	public:
+		static const size_t SIZE_CLASS_STEP = 8;
+		static const size_t MAX_POOLED_SIZE = 256;
+		static const size_t NUM_SIZE_CLASSES = MAX_POOLED_SIZE / SIZE_CLASS_STEP;
+		static const size_t CHUNK_SIZE = 16 * 1024;
+
+	private:
+		LuaMemPool(const LuaMemPool&);
+		LuaMemPool& operator=(const LuaMemPool&);
+
+		void* Realloc(void* ptr, size_t osize, size_t nsize);
+
+		void* AllocBlock(size_t size);
+		void  FreeBlock(void* ptr, size_t size);
+
+		static size_t GetSizeClass(size_t size) {
+			return ((size + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP) - 1;
+		}
+		static bool IsPooledSize(size_t size) {
+			return (size > 0 && size <= MAX_POOLED_SIZE);
+		}
+
+	private:
+		bool enabled;
+		size_t maxBytes;
+
+		void* freeLists[NUM_SIZE_CLASSES];
+		std::vector<void*> chunks;
+		char* chunkPos; ///< bump pointer into the newest chunk
+		char* chunkEnd;
+
+		Stats stats;
+};
+
+
+#endif /* LUA_MEM_POOL_H */
@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <limits.h>
+#include <string.h>
 #include <boost/regex.hpp>
 
 #include "mmgr.h"
@@ -58,7 +59,7 @@ LuaParser::LuaParser(const string& _fileName,
   lowerKeys(true),
   lowerCppKeys(true)
 {
-	L = lua_open();
+	L = memPool.NewState();
 
 	if (L != NULL) {
 		SetupEnv();
@@ -79,7 +80,7 @@ LuaParser::LuaParser(const string& _textChunk,
   lowerKeys(true),
   lowerCppKeys(true)
 {
-	L = lua_open();
+	L = memPool.NewState();
 
 	if (L != NULL) {
 		SetupEnv();
@@ -230,6 +231,205 @@ bool LuaParser::Execute()
 }
 
 
+/******************************************************************************/
+//
+//  Root table (de)serialization
+//
+
+// one type byte per value, followed by:
+//   boolean: 1 byte
+//   number:  the raw lua_Number
+//   string:  unsigned int length, then the characters
+//   table:   unsigned int pair count, then key and value of each pair
+enum {
+	DATA_BOOLEAN = 1,
+	DATA_NUMBER  = 2,
+	DATA_STRING  = 3,
+	DATA_TABLE   = 4
+};
+
+static const int MAX_DATA_DEPTH = 64;
+
+
+static bool DumpValue(lua_State* L, int index, string& data, int depth)
+{
+	switch (lua_type(L, index)) {
+		case LUA_TBOOLEAN: {
+			data += (char)DATA_BOOLEAN;
+			data += (char)(lua_toboolean(L, index) ? 1 : 0);
+			return true;
+		}
+		case LUA_TNUMBER: {
+			const lua_Number n = lua_tonumber(L, index);
+			data += (char)DATA_NUMBER;
+			data.append((const char*)&n, sizeof(n));
+			return true;
+		}
+		case LUA_TSTRING: {
+			size_t len;
+			const char* str = lua_tolstring(L, index, &len);
+			const unsigned int len32 = len;
+			data += (char)DATA_STRING;
+			data.append((const char*)&len32, sizeof(len32));
+			data.append(str, len);
+			return true;
+		}
+		case LUA_TTABLE: {
+			if ((depth >= MAX_DATA_DEPTH) || !lua_checkstack(L, 3)) {
+				return false;
+			}
+			// lua_next() does not see what a metatable adds through __index
+			// (e.g. reftable() inheritance), while LuaTable reads through it
+			if (lua_getmetatable(L, index)) {
+				lua_pop(L, 1);
+				return false;
+			}
+			if (index < 0) {
+				index = lua_gettop(L) + index + 1;
+			}
+			data += (char)DATA_TABLE;
+			const size_t countPos = data.size();
+			unsigned int count = 0;
+			data.append((const char*)&count, sizeof(count));
+
+			for (lua_pushnil(L); lua_next(L, index) != 0; lua_pop(L, 1)) {
+				if (!DumpValue(L, -2, data, depth + 1) ||
+				    !DumpValue(L, -1, data, depth + 1)) {
+					lua_pop(L, 2);
+					return false;
+				}
+				count++;
+			}
+			memcpy(&data[countPos], &count, sizeof(count));
+			return true;
+		}
+		default: {
+			return false; // functions, userdata, threads
+		}
+	}
+}
+
+
+static bool LoadValue(lua_State* L, const char*& p, const char* end)
+{
+	if (p >= end) {
+		return false;
+	}
+	const char type = *p++;
+
+	switch (type) {
+		case DATA_BOOLEAN: {
+			if (p + 1 > end) {
+				return false;
+			}
+			lua_pushboolean(L, *p++ != 0);
+			return true;
+		}
+		case DATA_NUMBER: {
+			lua_Number n;
+			if (p + sizeof(n) > end) {
+				return false;
+			}
+			memcpy(&n, p, sizeof(n));
+			p += sizeof(n);
+			lua_pushnumber(L, n);
+			return true;
+		}
+		case DATA_STRING: {
+			unsigned int len;
+			if (p + sizeof(len) > end) {
+				return false;
+			}
+			memcpy(&len, p, sizeof(len));
+			p += sizeof(len);
+			if (len > (unsigned int)(end - p)) {
+				return false;
+			}
+			lua_pushlstring(L, p, len);
+			p += len;
+			return true;
+		}
+		case DATA_TABLE: {
+			unsigned int count;
+			if (p + sizeof(count) > end) {
+				return false;
+			}
+			memcpy(&count, p, sizeof(count));
+			p += sizeof(count);
+			if (!lua_checkstack(L, 3)) {
+				return false;
+			}
+			lua_newtable(L);
+			for (unsigned int i = 0; i < count; i++) {
+				if (!LoadValue(L, p, end)) {
+					lua_pop(L, 1);
+					return false;
+				}
+				if (!LoadValue(L, p, end)) {
+					lua_pop(L, 2);
+					return false;
+				}
+				lua_rawset(L, -3);
+			}
+			return true;
+		}
+		default: {
+			return false;
+		}
+	}
+}
+
+
+bool LuaParser::GetRootData(string& data)
+{
+	data.clear();
+
+	if (!valid || (L == NULL) || (rootRef == LUA_NOREF)) {
+		return false;
+	}
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, rootRef);
+	const bool ok = DumpValue(L, -1, data, 0);
+	lua_settop(L, 0);
+
+	if (!ok) {
+		data.clear();
+	}
+	return ok;
+}
+
+
+bool LuaParser::ExecuteData(const string& data)
+{
+	if (L == NULL) {
+		errorLog = "could not initialize LUA library";
+		return false;
+	}
+
+	rootRef = LUA_NOREF;
+
+	assert(initDepth == 0);
+	initDepth = -1;
+
+	const char* p = data.data();
+	const char* end = p + data.size();
+	if (!LoadValue(L, p, end) || (p != end) || !lua_istable(L, -1)) {
+		errorLog = "invalid table data";
+		lua_close(L);
+		L = NULL;
+		return false;
+	}
+
+	rootRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	lua_settop(L, 0);
+
+	valid = true;
+
+	return true;
+}
+
+
 void LuaParser::AddTable(LuaTable* tbl)
 {
 	tables.insert(tbl);
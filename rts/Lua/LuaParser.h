@@ -14,6 +14,7 @@ using std::map;
 using std::set;
 
 #include "FileSystem/VFSModes.h"
+#include "LuaMemPool.h"
 
 class float3;
 class LuaTable;
@@ -120,6 +121,19 @@ class LuaParser {
 
 		bool Execute();
 
+		/**
+		 * Serializes the table returned by Execute() into a compact binary
+		 * blob. Fails for tables that hold anything but booleans, numbers,
+		 * strings and tables, that have a metatable, or that nest too deep
+		 * (cycles).
+		 */
+		bool GetRootData(string& data);
+		/**
+		 * Uses a blob from GetRootData() as the root table instead of
+		 * running the code, e.g. to skip expensive def scripts on later runs.
+		 */
+		bool ExecuteData(const string& data);
+
 		bool IsValid() const { return (L != NULL); }
 
 		LuaTable GetRoot();
@@ -168,6 +182,7 @@ class LuaParser {
 		bool valid;
 		int initDepth;
 
+		LuaMemPool memPool; // must outlive L
 		lua_State* L;
 		set<LuaTable*> tables;
 		int rootRef;
@@ -190,6 +190,12 @@ bool LuaSyncedRead::PushEntries(lua_State* L)
 	REGISTER_LUA_CFUNC(GetUnitNearestAlly);
 	REGISTER_LUA_CFUNC(GetUnitNearestEnemy);
 
+	REGISTER_LUA_CFUNC(GetUnitsPosition);
+	REGISTER_LUA_CFUNC(GetUnitsBasePosition);
+	REGISTER_LUA_CFUNC(GetUnitsHealth);
+	REGISTER_LUA_CFUNC(GetUnitsVelocity);
+	REGISTER_LUA_CFUNC(GetUnitsDefID);
+
 	REGISTER_LUA_CFUNC(GetUnitTooltip);
 	REGISTER_LUA_CFUNC(GetUnitDefID);
 	REGISTER_LUA_CFUNC(GetUnitTeam);
@@ -1180,8 +1186,7 @@ int LuaSyncedRead::GetTeamStatsHistory(lua_State* L)
 		return 1;
 	}
 
-	const list<CTeam::Statistics>& teamStats = team->statHistory;
-	std::list<CTeam::Statistics>::const_iterator it = teamStats.begin();
+	const CTeamStatHistory& teamStats = team->statHistory;
 	const int statCount = teamStats.size();
 
 	int start = 0;
@@ -1196,15 +1201,60 @@ int LuaSyncedRead::GetTeamStatsHistory(lua_State* L)
 		end = max(0, min(statCount - 1, end));
 	}
 
-	std::advance(it, start);
-
 	const int statsFrames = (CTeam::statsPeriod * GAME_SPEED);
 
+	// with a field name as 4th argument, only that field is returned, as a
+	// plain array; this is much cheaper for long ranges
+	if ((args >= 4) && lua_isstring(L, 4)) {
+		// in CTeamStatHistory::Field order
+		static const char* fieldNames[CTeamStatHistory::NUM_FIELDS] = {
+			"metalUsed",     "energyUsed",
+			"metalProduced", "energyProduced",
+			"metalExcess",   "energyExcess",
+			"metalReceived", "energyReceived",
+			"metalSent",     "energySent",
+			"damageDealt",   "damageReceived",
+			"unitsProduced",
+			"unitsDied",
+			"unitsReceived",
+			"unitsSent",
+			"unitsCaptured",
+			"unitsOutCaptured",
+			"unitsKilled"
+		};
+		const string fieldName = lua_tostring(L, 4);
+		int f = 0;
+		while ((f < CTeamStatHistory::NUM_FIELDS) && (fieldName != fieldNames[f])) {
+			++f;
+		}
+		if (f == CTeamStatHistory::NUM_FIELDS) {
+			luaL_error(L, "Incorrect arguments to %s(): unknown field %s", __FUNCTION__, fieldName.c_str());
+		}
+		const CTeamStatHistory::Field field = (CTeamStatHistory::Field) f;
+
+		lua_newtable(L);
+		int count = 0;
+		if (statCount > 0) {
+			for (int i = start; i <= end; ++i) {
+				count++;
+				lua_pushnumber(L, count);
+				if (field >= CTeamStatHistory::FIRST_INT_FIELD) {
+					lua_pushnumber(L, teamStats.GetInt(field, i));
+				} else {
+					lua_pushnumber(L, teamStats.GetFloat(field, i));
+				}
+				lua_rawset(L, -3);
+			}
+		}
+		hs_n.PushNumber(L, count);
+		return 1;
+	}
+
 	lua_newtable(L);
 	int count = 0;
 	if (statCount > 0) {
-		for (int i = start; i <= end; ++i, ++it) {
-			const CTeam::Statistics& stats = *it;
+		for (int i = start; i <= end; ++i) {
+			const CTeam::Statistics stats = teamStats[i];
 			count++;
 			lua_pushnumber(L, count);
 			lua_newtable(L); {
@@ -2307,6 +2357,231 @@ int LuaSyncedRead::GetFeaturesInRectangle(lua_State* L)
 }
 
 
+/******************************************************************************/
+/******************************************************************************/
+//
+//  Bulk Unit Queries
+//
+//  Spring.GetUnitsXXX(unitIDs [, results]) -> results
+//
+//  Vectorised variants of the per-unit GetUnitXXX() calls. unitIDs is an
+//  array of unit IDs (e.g. from GetUnitsInRectangle()), results is keyed by
+//  unitID and holds one array per readable unit. Passing the results table
+//  of the previous call back in reuses its sub-tables, so steady-state calls
+//  do not allocate. Entries for units that are invalid or not readable
+//  (the same rules as the per-unit calls), and for units no longer in
+//  unitIDs, are removed.
+//
+
+// fills values[] for a readable unit and returns the count, 0 otherwise
+typedef int (*BulkUnitFunc)(const CUnit* unit, float* values);
+
+static const int MAX_BULK_VALUES = 5;
+
+
+static int BulkUnitPosition(const CUnit* unit, float* values)
+{
+	if (!IsUnitVisible(unit)) {
+		return 0;
+	}
+	float3 pos;
+	if (IsAllyUnit(unit)) {
+		pos = unit->midPos;
+	} else {
+		pos = helper->GetUnitErrorPos(unit, readAllyTeam);
+	}
+	values[0] = pos.x;
+	values[1] = pos.y;
+	values[2] = pos.z;
+	return 3;
+}
+
+
+static int BulkUnitBasePosition(const CUnit* unit, float* values)
+{
+	if (!IsUnitVisible(unit)) {
+		return 0;
+	}
+	float3 pos;
+	if (IsAllyUnit(unit)) {
+		pos = unit->pos;
+	} else {
+		pos = helper->GetUnitErrorPos(unit, readAllyTeam);
+		pos = pos - (unit->midPos - unit->pos);
+	}
+	values[0] = pos.x;
+	values[1] = pos.y;
+	values[2] = pos.z;
+	return 3;
+}
+
+
+static int BulkUnitHealth(const CUnit* unit, float* values)
+{
+	if (!IsUnitInLos(unit)) {
+		return 0;
+	}
+	const UnitDef* ud = unit->unitDef;
+	const bool enemyUnit = IsEnemyUnit(unit);
+	if (ud->hideDamage && enemyUnit) {
+		return 0;
+	}
+	const float scale = (!enemyUnit || (ud->decoyDef == NULL)) ?
+	                    1.0f : (ud->decoyDef->health / ud->health);
+	values[0] = scale * unit->health;
+	values[1] = scale * unit->maxHealth;
+	values[2] = scale * unit->paralyzeDamage;
+	values[3] = unit->captureProgress;
+	values[4] = unit->buildProgress;
+	return 5;
+}
+
+
+static int BulkUnitVelocity(const CUnit* unit, float* values)
+{
+	if (!IsUnitInLos(unit)) {
+		return 0;
+	}
+	values[0] = unit->speed.x;
+	values[1] = unit->speed.y;
+	values[2] = unit->speed.z;
+	return 3;
+}
+
+
+static int BulkUnitDefID(const CUnit* unit, float* values)
+{
+	if (!IsUnitVisible(unit)) {
+		return 0;
+	}
+	if (IsAllyUnit(unit)) {
+		values[0] = unit->unitDef->id;
+		return 1;
+	}
+	if (!IsUnitTyped(unit)) {
+		return 0;
+	}
+	values[0] = EffectiveUnitDef(unit)->id;
+	return 1;
+}
+
+
+static int BulkUnitQuery(lua_State* L, BulkUnitFunc func)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	const int unitCount = lua_objlen(L, 1);
+
+	const bool reused = lua_istable(L, 2);
+	if (reused) {
+		lua_settop(L, 2);
+	} else {
+		lua_settop(L, 1);
+		lua_createtable(L, 0, unitCount);
+	}
+	const int resultsIndex = 2;
+
+	// units queried this time, to drop the other entries of a reused table
+	std::vector<bool> queried;
+	if (reused) {
+		queried.resize(uh->MaxUnits(), false);
+	}
+
+	float values[MAX_BULK_VALUES];
+
+	for (int i = 1; i <= unitCount; i++) {
+		lua_rawgeti(L, 1, i);
+		if (!lua_isnumber(L, -1)) {
+			lua_pop(L, 1);
+			continue;
+		}
+		const int unitID = lua_toint(L, -1);
+		lua_pop(L, 1);
+
+		if ((unitID < 0) || (static_cast<size_t>(unitID) >= uh->MaxUnits())) {
+			continue;
+		}
+		if (reused) {
+			queried[unitID] = true;
+		}
+		const CUnit* unit = uh->units[unitID];
+		const int valueCount = (unit != NULL) ? func(unit, values) : 0;
+
+		if (valueCount == 0) {
+			lua_pushnil(L);
+			lua_rawseti(L, resultsIndex, unitID);
+			continue;
+		}
+
+		lua_rawgeti(L, resultsIndex, unitID);
+		if (!lua_istable(L, -1)) {
+			lua_pop(L, 1);
+			lua_createtable(L, valueCount, 0);
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, resultsIndex, unitID);
+		}
+		for (int v = 0; v < valueCount; v++) {
+			lua_pushnumber(L, values[v]);
+			lua_rawseti(L, -2, v + 1);
+		}
+		// the table may come from a query with more values
+		const int oldCount = lua_objlen(L, -1);
+		for (int v = valueCount + 1; v <= oldCount; v++) {
+			lua_pushnil(L);
+			lua_rawseti(L, -2, v);
+		}
+		lua_pop(L, 1);
+	}
+
+	if (reused) {
+		// assigning nil to existing fields is allowed during lua_next()
+		lua_pushnil(L);
+		while (lua_next(L, resultsIndex) != 0) {
+			lua_pop(L, 1);
+			const bool keep = (lua_type(L, -1) == LUA_TNUMBER) &&
+			                  (lua_tonumber(L, -1) >= 0) && (lua_tonumber(L, -1) < uh->MaxUnits()) &&
+			                  queried[lua_toint(L, -1)];
+			if (!keep) {
+				lua_pushvalue(L, -1);
+				lua_pushnil(L);
+				lua_rawset(L, resultsIndex);
+			}
+		}
+	}
+
+	return 1;
+}
+
+
+int LuaSyncedRead::GetUnitsPosition(lua_State* L)
+{
+	return BulkUnitQuery(L, BulkUnitPosition);
+}
+
+
+int LuaSyncedRead::GetUnitsBasePosition(lua_State* L)
+{
+	return BulkUnitQuery(L, BulkUnitBasePosition);
+}
+
+
+int LuaSyncedRead::GetUnitsHealth(lua_State* L)
+{
+	return BulkUnitQuery(L, BulkUnitHealth);
+}
+
+
+int LuaSyncedRead::GetUnitsVelocity(lua_State* L)
+{
+	return BulkUnitQuery(L, BulkUnitVelocity);
+}
+
+
+int LuaSyncedRead::GetUnitsDefID(lua_State* L)
+{
+	return BulkUnitQuery(L, BulkUnitDefID);
+}
+
+
 /******************************************************************************/
 /******************************************************************************/
 
@@ -86,6 +86,12 @@ class LuaSyncedRead {
 
 		static int GetFeaturesInRectangle(lua_State* L);
 
+		static int GetUnitsPosition(lua_State* L);
+		static int GetUnitsBasePosition(lua_State* L);
+		static int GetUnitsHealth(lua_State* L);
+		static int GetUnitsVelocity(lua_State* L);
+		static int GetUnitsDefID(lua_State* L);
+
 		static int ValidUnitID(lua_State* L);
 		static int GetUnitTooltip(lua_State* L);
 		static int GetUnitDefID(lua_State* L);
@@ -15,6 +15,10 @@
 #include "FastMath.h"
 #include "GlobalUnsynced.h"
 #include "Sim/Misc/SmoothHeightMesh.h"
+#include "TimeProfiler.h"
+#include "WorkerPool.h"
+#include <boost/bind.hpp>
+#include <boost/version.hpp>
 #include "mmgr.h"
 
 #ifdef USE_GML
@@ -73,6 +77,34 @@ CBFGroundDrawer::CBFGroundDrawer(CSmfReadMap* rm) :
 #ifdef USE_GML
 	multiThreadDrawGround=configHandler->Get("MultiThreadDrawGround", 1);
 	multiThreadDrawGroundShadow=configHandler->Get("MultiThreadDrawGroundShadow", 0);
+#else
+	meshWorkers = NULL;
+
+	//! same knob the path estimator uses, the render thread is one of them
+	int numThreads = configHandler->Get("HardwareThreadCount", 0);
+	if (numThreads <= 0) {
+	#if (BOOST_VERSION >= 103500)
+		numThreads = boost::thread::hardware_concurrency();
+	#else
+		numThreads = 1;
+	#endif
+	}
+	//! a job is one row of big squares
+	numThreads = std::min(numThreads, numBigTexY);
+
+	if (numThreads > 1) {
+		meshWorkers = new CWorkerPool("Ground mesh", numThreads - 1);
+
+		bigSquareMeshes.resize(numBigTexX * numBigTexY);
+		for (size_t i = 0; i < bigSquareMeshes.size(); ++i) {
+			bigSquareMeshes[i] = new CVertexArray();
+		}
+		rowRanges.resize(numBigTexY);
+
+		for (int nlod = 0; nlod < NUM_LODS+1; ++nlod) {
+			shadowMeshes[nlod] = new CVertexArray();
+		}
+	}
 #endif
 }
 
@@ -99,6 +131,17 @@ CBFGroundDrawer::~CBFGroundDrawer(void)
 #ifdef USE_GML
 	configHandler->Set("MultiThreadDrawGround", multiThreadDrawGround);
 	configHandler->Set("MultiThreadDrawGroundShadow", multiThreadDrawGroundShadow);
+#else
+	if (meshWorkers != NULL) {
+		delete meshWorkers;
+
+		for (size_t i = 0; i < bigSquareMeshes.size(); ++i) {
+			delete bigSquareMeshes[i];
+		}
+		for (int nlod = 0; nlod < NUM_LODS+1; ++nlod) {
+			delete shadowMeshes[nlod];
+		}
+	}
 #endif
 }
 
@@ -248,20 +291,18 @@ inline void CBFGroundDrawer::FindRange(int &xs, int &xe, const std::vector<fline
 
 #define CLAMP(i) std::max(0, std::min((i), maxIdx))
 
-inline void CBFGroundDrawer::DoDrawGroundRow(int bty) {
+void CBFGroundDrawer::FindBigSquareRange(int bty, int& sx, int& ex) {
+	sx = 0;
+	ex = 0;
+
 	if (!BigTexSquareRowVisible(bty)) {
 		//! skip this entire row of squares if we can't see it
 		return;
 	}
 
-	CVertexArray *ma = GetVertexArray();
-
-	bool inStrip = false;
 	float x0, x1;
-	int x,y;
-	int sx = 0;
-	int ex = numBigTexX;
-	std::vector<fline>::iterator fli;
+	ex = numBigTexX;
+	std::vector<fline>::const_iterator fli;
 
 	//! only process the necessary big squares in the x direction
 	int bigSquareSizeY = bty * bigSquareSize;
@@ -289,383 +330,418 @@ inline void CBFGroundDrawer::DoDrawGroundRow(int bty) {
 		if (x0 < ex)
 			ex = (int) x0;
 	}
+}
+
+void CBFGroundDrawer::BuildBigSquare(CVertexArray* ma, int btx, int bty) {
+	bool inStrip = false;
+	int x,y;
 
 	float cx2 = cam2->pos.x / SQUARE_SIZE;
 	float cy2 = cam2->pos.z / SQUARE_SIZE;
 
-	for (int btx = sx; btx < ex; ++btx) {
-		ma->Initialize();
+	for (int lod = 1; lod < neededLod; lod <<= 1) {
+		float oldcamxpart = 0.0f;
+		float oldcamypart = 0.0f;
 
-		for (int lod = 1; lod < neededLod; lod <<= 1) {
-			float oldcamxpart = 0.0f;
-			float oldcamypart = 0.0f;
+		int hlod = lod >> 1;
+		int dlod = lod << 1;
 
-			int hlod = lod >> 1;
-			int dlod = lod << 1;
+		int cx = (int)cx2;
+		int cy = (int)cy2;
 
-			int cx = (int)cx2;
-			int cy = (int)cy2;
+		if(lod>1) {
+			int cxo = (cx / hlod) * hlod;
+			int cyo = (cy / hlod) * hlod;
+			float cx2o = (cxo / lod) * lod;
+			float cy2o = (cyo / lod) * lod;
+			oldcamxpart = (cx2 - cx2o) / lod;
+			oldcamypart = (cy2 - cy2o) / lod;
+		}
 
-			if(lod>1) {
-				int cxo = (cx / hlod) * hlod;
-				int cyo = (cy / hlod) * hlod;
-				float cx2o = (cxo / lod) * lod;
-				float cy2o = (cyo / lod) * lod;
-				oldcamxpart = (cx2 - cx2o) / lod;
-				oldcamypart = (cy2 - cy2o) / lod;
-			}
+		cx = (cx / lod) * lod;
+		cy = (cy / lod) * lod;
+		int ysquaremod = (cy % dlod) / lod;
+		int xsquaremod = (cx % dlod) / lod;
 
-			cx = (cx / lod) * lod;
-			cy = (cy / lod) * lod;
-			int ysquaremod = (cy % dlod) / lod;
-			int xsquaremod = (cx % dlod) / lod;
+		float camxpart = (cx2 - ((cx / dlod) * dlod)) / dlod;
+		float camypart = (cy2 - ((cy / dlod) * dlod)) / dlod;
 
-			float camxpart = (cx2 - ((cx / dlod) * dlod)) / dlod;
-			float camypart = (cy2 - ((cy / dlod) * dlod)) / dlod;
+		float mcxp=1.0f-camxpart;
+		float hcxp=0.5f*camxpart;
+		float hmcxp=0.5f*mcxp;
 
-			float mcxp=1.0f-camxpart;
-			float hcxp=0.5f*camxpart;
-			float hmcxp=0.5f*mcxp;
+		float mcyp=1.0f-camypart;
+		float hcyp=0.5f*camypart;
+		float hmcyp=0.5f*mcyp;
 
-			float mcyp=1.0f-camypart;
-			float hcyp=0.5f*camypart;
-			float hmcyp=0.5f*mcyp;
+		float mocxp=1.0f-oldcamxpart;
+		float hocxp=0.5f*oldcamxpart;
+		float hmocxp=0.5f*mocxp;
 
-			float mocxp=1.0f-oldcamxpart;
-			float hocxp=0.5f*oldcamxpart;
-			float hmocxp=0.5f*mocxp;
+		float mocyp=1.0f-oldcamypart;
+		float hocyp=0.5f*oldcamypart;
+		float hmocyp=0.5f*mocyp;
 
-			float mocyp=1.0f-oldcamypart;
-			float hocyp=0.5f*oldcamypart;
-			float hmocyp=0.5f*mocyp;
+		int minty = bty * bigSquareSize;
+		int maxty = minty + bigSquareSize;
+		int mintx = btx * bigSquareSize;
+		int maxtx = mintx + bigSquareSize;
 
-			int minty = bty * bigSquareSize;
-			int maxty = minty + bigSquareSize;
-			int mintx = btx * bigSquareSize;
-			int maxtx = mintx + bigSquareSize;
+		int minly = cy + (-viewRadius + 3 - ysquaremod) * lod;
+		int maxly = cy + ( viewRadius - 1 - ysquaremod) * lod;
+		int minlx = cx + (-viewRadius + 3 - xsquaremod) * lod;
+		int maxlx = cx + ( viewRadius - 1 - xsquaremod) * lod;
 
-			int minly = cy + (-viewRadius + 3 - ysquaremod) * lod;
-			int maxly = cy + ( viewRadius - 1 - ysquaremod) * lod;
-			int minlx = cx + (-viewRadius + 3 - xsquaremod) * lod;
-			int maxlx = cx + ( viewRadius - 1 - xsquaremod) * lod;
+		int xstart = max(minlx, mintx);
+		int xend   = min(maxlx, maxtx);
+		int ystart = max(minly, minty);
+		int yend   = min(maxly, maxty);
 
-			int xstart = max(minlx, mintx);
-			int xend   = min(maxlx, maxtx);
-			int ystart = max(minly, minty);
-			int yend   = min(maxly, maxty);
+		int vrhlod = viewRadius * hlod;
 
-			int vrhlod = viewRadius * hlod;
+		for (y = ystart; y < yend; y += lod) {
+			int xs = xstart;
+			int xe = xend;
+			FindRange(/*inout*/ xs, /*inout*/ xe, left, right, y, lod);
 
-			for (y = ystart; y < yend; y += lod) {
-				int xs = xstart;
-				int xe = xend;
-				FindRange(/*inout*/ xs, /*inout*/ xe, left, right, y, lod);
+			// If FindRange modifies (xs, xe) to a (less then) empty range,
+			// continue to the next row.
+			// If we'd continue, nloop (below) would become negative and we'd
+			// allocate a vertex array with negative size.  (mantis #1415)
+			if (xe < xs) continue;
 
-				// If FindRange modifies (xs, xe) to a (less then) empty range,
-				// continue to the next row.
-				// If we'd continue, nloop (below) would become negative and we'd
-				// allocate a vertex array with negative size.  (mantis #1415)
-				if (xe < xs) continue;
+			int ylod = y + lod;
+			int yhlod = y + hlod;
 
-				int ylod = y + lod;
-				int yhlod = y + hlod;
+			int nloop=(xe-xs)/lod+1;
+			ma->EnlargeArrays(52*nloop, 14*nloop+1); //! includes one extra for final endstrip
 
-				int nloop=(xe-xs)/lod+1;
-				ma->EnlargeArrays(52*nloop, 14*nloop+1); //! includes one extra for final endstrip
+			int yhdx = y * heightDataX;
+			int ylhdx = yhdx + lod * heightDataX;
+			int yhhdx = yhdx + hlod * heightDataX;
 
-				int yhdx = y * heightDataX;
-				int ylhdx = yhdx + lod * heightDataX;
-				int yhhdx = yhdx + hlod * heightDataX;
+			for (x = xs; x < xe; x += lod) {
+				int xlod = x + lod;
+				int xhlod = x + hlod;
+				//! info: all triangle quads start in the top left corner
+				if ((lod == 1) ||
+					(x > cx + vrhlod) || (x < cx - vrhlod) ||
+					(y > cy + vrhlod) || (y < cy - vrhlod)) {
+					//! normal terrain (all vertices in one LOD)
+					if (!inStrip) {
+						DrawVertexAQ(ma, x, y);
+						DrawVertexAQ(ma, x, ylod);
+						inStrip = true;
+					}
 
-				for (x = xs; x < xe; x += lod) {
-					int xlod = x + lod;
-					int xhlod = x + hlod;
-					//! info: all triangle quads start in the top left corner
-					if ((lod == 1) ||
-						(x > cx + vrhlod) || (x < cx - vrhlod) ||
-						(y > cy + vrhlod) || (y < cy - vrhlod)) {
-						//! normal terrain (all vertices in one LOD)
-						if (!inStrip) {
-							DrawVertexAQ(ma, x, y);
-							DrawVertexAQ(ma, x, ylod);
-							inStrip = true;
+					DrawVertexAQ(ma, xlod, y);
+					DrawVertexAQ(ma, xlod, ylod);
+				} else {
+					//! border between 2 different LODs
+					if ((x >= cx + vrhlod)) {
+						//! lower LOD to the right
+						int idx1 = CLAMP(yhdx + x),  idx1LOD = CLAMP(idx1 + lod), idx1HLOD = CLAMP(idx1 + hlod);
+						int idx2 = CLAMP(ylhdx + x), idx2LOD = CLAMP(idx2 + lod), idx2HLOD = CLAMP(idx2 + hlod);
+						int idx3 = CLAMP(yhhdx + x),                              idx3HLOD = CLAMP(idx3 + hlod);
+						float h1 = (heightData[idx1] + heightData[idx2   ]) * hmocxp + heightData[idx3    ] * oldcamxpart;
+						float h2 = (heightData[idx1] + heightData[idx1LOD]) * hmocxp + heightData[idx1HLOD] * oldcamxpart;
+						float h3 = (heightData[idx2] + heightData[idx1LOD]) * hmocxp + heightData[idx3HLOD] * oldcamxpart;
+						float h4 = (heightData[idx2] + heightData[idx2LOD]) * hmocxp + heightData[idx2HLOD] * oldcamxpart;
+
+						if (inStrip) {
+							EndStripQ(ma);
+							inStrip = false;
 						}
 
-						DrawVertexAQ(ma, xlod, y);
+						DrawVertexAQ(ma, x, y);
+						DrawVertexAQ(ma, x, yhlod, h1);
+						DrawVertexAQ(ma, xhlod, y, h2);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						EndStripQ(ma);
+						DrawVertexAQ(ma, x, yhlod, h1);
+						DrawVertexAQ(ma, x, ylod);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, xhlod, ylod, h4);
+						EndStripQ(ma);
+						DrawVertexAQ(ma, xhlod, ylod, h4);
 						DrawVertexAQ(ma, xlod, ylod);
-					} else {
-						//! border between 2 different LODs
-						if ((x >= cx + vrhlod)) {
-							//! lower LOD to the right
-							int idx1 = CLAMP(yhdx + x),  idx1LOD = CLAMP(idx1 + lod), idx1HLOD = CLAMP(idx1 + hlod);
-							int idx2 = CLAMP(ylhdx + x), idx2LOD = CLAMP(idx2 + lod), idx2HLOD = CLAMP(idx2 + hlod);
-							int idx3 = CLAMP(yhhdx + x),                              idx3HLOD = CLAMP(idx3 + hlod);
-							float h1 = (heightData[idx1] + heightData[idx2   ]) * hmocxp + heightData[idx3    ] * oldcamxpart;
-							float h2 = (heightData[idx1] + heightData[idx1LOD]) * hmocxp + heightData[idx1HLOD] * oldcamxpart;
-							float h3 = (heightData[idx2] + heightData[idx1LOD]) * hmocxp + heightData[idx3HLOD] * oldcamxpart;
-							float h4 = (heightData[idx2] + heightData[idx2LOD]) * hmocxp + heightData[idx2HLOD] * oldcamxpart;
-
-							if (inStrip) {
-								EndStripQ(ma);
-								inStrip = false;
-							}
-
-							DrawVertexAQ(ma, x, y);
-							DrawVertexAQ(ma, x, yhlod, h1);
-							DrawVertexAQ(ma, xhlod, y, h2);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							EndStripQ(ma);
-							DrawVertexAQ(ma, x, yhlod, h1);
-							DrawVertexAQ(ma, x, ylod);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, xhlod, ylod, h4);
-							EndStripQ(ma);
-							DrawVertexAQ(ma, xhlod, ylod, h4);
-							DrawVertexAQ(ma, xlod, ylod);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, xlod, y);
-							DrawVertexAQ(ma, xhlod, y, h2);
-							EndStripQ(ma);
-						}
-						else if ((x <= cx - vrhlod)) {
-							//! lower LOD to the left
-							int idx1 = CLAMP(yhdx + x),  idx1LOD = CLAMP(idx1 + lod), idx1HLOD = CLAMP(idx1 + hlod);
-							int idx2 = CLAMP(ylhdx + x), idx2LOD = CLAMP(idx2 + lod), idx2HLOD = CLAMP(idx2 + hlod);
-							int idx3 = CLAMP(yhhdx + x), idx3LOD = CLAMP(idx3 + lod), idx3HLOD = CLAMP(idx3 + hlod);
-							float h1 = (heightData[idx1LOD] + heightData[idx2LOD]) * hocxp + heightData[idx3LOD ] * mocxp;
-							float h2 = (heightData[idx1   ] + heightData[idx1LOD]) * hocxp + heightData[idx1HLOD] * mocxp;
-							float h3 = (heightData[idx2   ] + heightData[idx1LOD]) * hocxp + heightData[idx3HLOD] * mocxp;
-							float h4 = (heightData[idx2   ] + heightData[idx2LOD]) * hocxp + heightData[idx2HLOD] * mocxp;
-
-							if (inStrip) {
-								EndStripQ(ma);
-								inStrip = false;
-							}
-
-							DrawVertexAQ(ma, xlod, yhlod, h1);
-							DrawVertexAQ(ma, xlod, y);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, xhlod, y, h2);
-							EndStripQ(ma);
-							DrawVertexAQ(ma, xlod, ylod);
-							DrawVertexAQ(ma, xlod, yhlod, h1);
-							DrawVertexAQ(ma, xhlod, ylod, h4);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							EndStripQ(ma);
-							DrawVertexAQ(ma, xhlod, y, h2);
-							DrawVertexAQ(ma, x, y);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, x, ylod);
-							DrawVertexAQ(ma, xhlod, ylod, h4);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, xlod, y);
+						DrawVertexAQ(ma, xhlod, y, h2);
+						EndStripQ(ma);
+					}
+					else if ((x <= cx - vrhlod)) {
+						//! lower LOD to the left
+						int idx1 = CLAMP(yhdx + x),  idx1LOD = CLAMP(idx1 + lod), idx1HLOD = CLAMP(idx1 + hlod);
+						int idx2 = CLAMP(ylhdx + x), idx2LOD = CLAMP(idx2 + lod), idx2HLOD = CLAMP(idx2 + hlod);
+						int idx3 = CLAMP(yhhdx + x), idx3LOD = CLAMP(idx3 + lod), idx3HLOD = CLAMP(idx3 + hlod);
+						float h1 = (heightData[idx1LOD] + heightData[idx2LOD]) * hocxp + heightData[idx3LOD ] * mocxp;
+						float h2 = (heightData[idx1   ] + heightData[idx1LOD]) * hocxp + heightData[idx1HLOD] * mocxp;
+						float h3 = (heightData[idx2   ] + heightData[idx1LOD]) * hocxp + heightData[idx3HLOD] * mocxp;
+						float h4 = (heightData[idx2   ] + heightData[idx2LOD]) * hocxp + heightData[idx2HLOD] * mocxp;
+
+						if (inStrip) {
 							EndStripQ(ma);
+							inStrip = false;
 						}
 
-						if ((y >= cy + vrhlod)) {
-							//! lower LOD above
-							int idx1 = yhdx + x,  idx1LOD = CLAMP(idx1 + lod), idx1HLOD = CLAMP(idx1 + hlod);
-							int idx2 = ylhdx + x, idx2LOD = CLAMP(idx2 + lod);
-							int idx3 = yhhdx + x, idx3LOD = CLAMP(idx3 + lod), idx3HLOD = CLAMP(idx3 + hlod);
-							float h1 = (heightData[idx1   ] + heightData[idx1LOD]) * hmocyp + heightData[idx1HLOD] * oldcamypart;
-							float h2 = (heightData[idx1   ] + heightData[idx2   ]) * hmocyp + heightData[idx3    ] * oldcamypart;
-							float h3 = (heightData[idx2   ] + heightData[idx1LOD]) * hmocyp + heightData[idx3HLOD] * oldcamypart;
-							float h4 = (heightData[idx2LOD] + heightData[idx1LOD]) * hmocyp + heightData[idx3LOD ] * oldcamypart;
-
-							if (inStrip) {
-								EndStripQ(ma);
-								inStrip = false;
-							}
-
-							DrawVertexAQ(ma, x, y);
-							DrawVertexAQ(ma, x, yhlod, h2);
-							DrawVertexAQ(ma, xhlod, y, h1);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, xlod, y);
-							DrawVertexAQ(ma, xlod, yhlod, h4);
-							EndStripQ(ma);
-							DrawVertexAQ(ma, x, yhlod, h2);
-							DrawVertexAQ(ma, x, ylod);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, xlod, ylod);
-							DrawVertexAQ(ma, xlod, yhlod, h4);
+						DrawVertexAQ(ma, xlod, yhlod, h1);
+						DrawVertexAQ(ma, xlod, y);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, xhlod, y, h2);
+						EndStripQ(ma);
+						DrawVertexAQ(ma, xlod, ylod);
+						DrawVertexAQ(ma, xlod, yhlod, h1);
+						DrawVertexAQ(ma, xhlod, ylod, h4);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						EndStripQ(ma);
+						DrawVertexAQ(ma, xhlod, y, h2);
+						DrawVertexAQ(ma, x, y);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, x, ylod);
+						DrawVertexAQ(ma, xhlod, ylod, h4);
+						EndStripQ(ma);
+					}
+
+					if ((y >= cy + vrhlod)) {
+						//! lower LOD above
+						int idx1 = yhdx + x,  idx1LOD = CLAMP(idx1 + lod), idx1HLOD = CLAMP(idx1 + hlod);
+						int idx2 = ylhdx + x, idx2LOD = CLAMP(idx2 + lod);
+						int idx3 = yhhdx + x, idx3LOD = CLAMP(idx3 + lod), idx3HLOD = CLAMP(idx3 + hlod);
+						float h1 = (heightData[idx1   ] + heightData[idx1LOD]) * hmocyp + heightData[idx1HLOD] * oldcamypart;
+						float h2 = (heightData[idx1   ] + heightData[idx2   ]) * hmocyp + heightData[idx3    ] * oldcamypart;
+						float h3 = (heightData[idx2   ] + heightData[idx1LOD]) * hmocyp + heightData[idx3HLOD] * oldcamypart;
+						float h4 = (heightData[idx2LOD] + heightData[idx1LOD]) * hmocyp + heightData[idx3LOD ] * oldcamypart;
+
+						if (inStrip) {
 							EndStripQ(ma);
+							inStrip = false;
 						}
-						else if ((y <= cy - vrhlod)) {
-							//! lower LOD beneath
-							int idx1 = CLAMP(yhdx + x),  idx1LOD = CLAMP(idx1 + lod);
-							int idx2 = CLAMP(ylhdx + x), idx2LOD = CLAMP(idx2 + lod), idx2HLOD = CLAMP(idx2 + hlod);
-							int idx3 = CLAMP(yhhdx + x), idx3LOD = CLAMP(idx3 + lod), idx3HLOD = CLAMP(idx3 + hlod);
-							float h1 = (heightData[idx2   ] + heightData[idx2LOD]) * hocyp + heightData[idx2HLOD] * mocyp;
-							float h2 = (heightData[idx1   ] + heightData[idx2   ]) * hocyp + heightData[idx3    ] * mocyp;
-							float h3 = (heightData[idx2   ] + heightData[idx1LOD]) * hocyp + heightData[idx3HLOD] * mocyp;
-							float h4 = (heightData[idx2LOD] + heightData[idx1LOD]) * hocyp + heightData[idx3LOD ] * mocyp;
-
-							if (inStrip) {
-								EndStripQ(ma);
-								inStrip = false;
-							}
-
-							DrawVertexAQ(ma, x, yhlod, h2);
-							DrawVertexAQ(ma, x, ylod);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, xhlod, ylod, h1);
-							DrawVertexAQ(ma, xlod, yhlod, h4);
-							DrawVertexAQ(ma, xlod, ylod);
-							EndStripQ(ma);
-							DrawVertexAQ(ma, xlod, yhlod, h4);
-							DrawVertexAQ(ma, xlod, y);
-							DrawVertexAQ(ma, xhlod, yhlod, h3);
-							DrawVertexAQ(ma, x, y);
-							DrawVertexAQ(ma, x, yhlod, h2);
+
+						DrawVertexAQ(ma, x, y);
+						DrawVertexAQ(ma, x, yhlod, h2);
+						DrawVertexAQ(ma, xhlod, y, h1);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, xlod, y);
+						DrawVertexAQ(ma, xlod, yhlod, h4);
+						EndStripQ(ma);
+						DrawVertexAQ(ma, x, yhlod, h2);
+						DrawVertexAQ(ma, x, ylod);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, xlod, ylod);
+						DrawVertexAQ(ma, xlod, yhlod, h4);
+						EndStripQ(ma);
+					}
+					else if ((y <= cy - vrhlod)) {
+						//! lower LOD beneath
+						int idx1 = CLAMP(yhdx + x),  idx1LOD = CLAMP(idx1 + lod);
+						int idx2 = CLAMP(ylhdx + x), idx2LOD = CLAMP(idx2 + lod), idx2HLOD = CLAMP(idx2 + hlod);
+						int idx3 = CLAMP(yhhdx + x), idx3LOD = CLAMP(idx3 + lod), idx3HLOD = CLAMP(idx3 + hlod);
+						float h1 = (heightData[idx2   ] + heightData[idx2LOD]) * hocyp + heightData[idx2HLOD] * mocyp;
+						float h2 = (heightData[idx1   ] + heightData[idx2   ]) * hocyp + heightData[idx3    ] * mocyp;
+						float h3 = (heightData[idx2   ] + heightData[idx1LOD]) * hocyp + heightData[idx3HLOD] * mocyp;
+						float h4 = (heightData[idx2LOD] + heightData[idx1LOD]) * hocyp + heightData[idx3LOD ] * mocyp;
+
+						if (inStrip) {
 							EndStripQ(ma);
+							inStrip = false;
 						}
-					}
-				}
 
-				if (inStrip) {
-					EndStripQ(ma);
-					inStrip = false;
+						DrawVertexAQ(ma, x, yhlod, h2);
+						DrawVertexAQ(ma, x, ylod);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, xhlod, ylod, h1);
+						DrawVertexAQ(ma, xlod, yhlod, h4);
+						DrawVertexAQ(ma, xlod, ylod);
+						EndStripQ(ma);
+						DrawVertexAQ(ma, xlod, yhlod, h4);
+						DrawVertexAQ(ma, xlod, y);
+						DrawVertexAQ(ma, xhlod, yhlod, h3);
+						DrawVertexAQ(ma, x, y);
+						DrawVertexAQ(ma, x, yhlod, h2);
+						EndStripQ(ma);
+					}
 				}
-			} //for (y = ystart; y < yend; y += lod)
+			}
 
-			int yst=max(ystart - lod, minty);
-			int yed=min(yend + lod, maxty);
-			int nloop=(yed-yst)/lod+1;
+			if (inStrip) {
+				EndStripQ(ma);
+				inStrip = false;
+			}
+		} //for (y = ystart; y < yend; y += lod)
 
-			if (nloop > 0)
-				ma->EnlargeArrays(8*nloop, 2*nloop);
+		int yst=max(ystart - lod, minty);
+		int yed=min(yend + lod, maxty);
+		int nloop=(yed-yst)/lod+1;
 
-			//! rita yttre begr?snings yta mot n?ta lod
-			if (maxlx < maxtx && maxlx >= mintx) {
-				x = maxlx;
-				int xlod = x + lod;
-				for (y = yst; y < yed; y += lod) {
-					DrawVertexAQ(ma, x, y);
-					DrawVertexAQ(ma, x, y + lod);
+		if (nloop > 0)
+			ma->EnlargeArrays(8*nloop, 2*nloop);
 
-					if (y % dlod) {
-						int idx1 = CLAMP((y      ) * heightDataX + x), idx1LOD = CLAMP(idx1 + lod);
-						int idx2 = CLAMP((y + lod) * heightDataX + x), idx2LOD = CLAMP(idx2 + lod);
-						int idx3 = CLAMP((y - lod) * heightDataX + x), idx3LOD = CLAMP(idx3 + lod);
-						float h = (heightData[idx3LOD] + heightData[idx2LOD]) * hmcxp +	heightData[idx1LOD] * camxpart;
-						DrawVertexAQ(ma, xlod, y, h);
-						DrawVertexAQ(ma, xlod, y + lod);
-					} else {
-						int idx1 = CLAMP((y       ) * heightDataX + x), idx1LOD = CLAMP(idx1 + lod);
-						int idx2 = CLAMP((y +  lod) * heightDataX + x), idx2LOD = CLAMP(idx2 + lod);
-						int idx3 = CLAMP((y + dlod) * heightDataX + x), idx3LOD = CLAMP(idx3 + lod);
-						float h = (heightData[idx1LOD] + heightData[idx3LOD]) * hmcxp + heightData[idx2LOD] * camxpart;
-						DrawVertexAQ(ma, xlod, y);
-						DrawVertexAQ(ma, xlod, y + lod, h);
-					}
-					EndStripQ(ma);
+		//! rita yttre begr?snings yta mot n?ta lod
+		if (maxlx < maxtx && maxlx >= mintx) {
+			x = maxlx;
+			int xlod = x + lod;
+			for (y = yst; y < yed; y += lod) {
+				DrawVertexAQ(ma, x, y);
+				DrawVertexAQ(ma, x, y + lod);
+
+				if (y % dlod) {
+					int idx1 = CLAMP((y      ) * heightDataX + x), idx1LOD = CLAMP(idx1 + lod);
+					int idx2 = CLAMP((y + lod) * heightDataX + x), idx2LOD = CLAMP(idx2 + lod);
+					int idx3 = CLAMP((y - lod) * heightDataX + x), idx3LOD = CLAMP(idx3 + lod);
+					float h = (heightData[idx3LOD] + heightData[idx2LOD]) * hmcxp +	heightData[idx1LOD] * camxpart;
+					DrawVertexAQ(ma, xlod, y, h);
+					DrawVertexAQ(ma, xlod, y + lod);
+				} else {
+					int idx1 = CLAMP((y       ) * heightDataX + x), idx1LOD = CLAMP(idx1 + lod);
+					int idx2 = CLAMP((y +  lod) * heightDataX + x), idx2LOD = CLAMP(idx2 + lod);
+					int idx3 = CLAMP((y + dlod) * heightDataX + x), idx3LOD = CLAMP(idx3 + lod);
+					float h = (heightData[idx1LOD] + heightData[idx3LOD]) * hmcxp + heightData[idx2LOD] * camxpart;
+					DrawVertexAQ(ma, xlod, y);
+					DrawVertexAQ(ma, xlod, y + lod, h);
 				}
+				EndStripQ(ma);
 			}
+		}
 
-			if (minlx > mintx && minlx < maxtx) {
-				x = minlx - lod;
-				int xlod = x + lod;
-				for (y = yst; y < yed; y += lod) {
-					if (y % dlod) {
-						int idx1 = CLAMP((y      ) * heightDataX + x);
-						int idx2 = CLAMP((y + lod) * heightDataX + x);
-						int idx3 = CLAMP((y - lod) * heightDataX + x);
-						float h = (heightData[idx3] + heightData[idx2]) * hcxp + heightData[idx1] * mcxp;
-						DrawVertexAQ(ma, x, y, h);
-						DrawVertexAQ(ma, x, y + lod);
-					} else {
-						int idx1 = CLAMP((y       ) * heightDataX + x);
-						int idx2 = CLAMP((y +  lod) * heightDataX + x);
-						int idx3 = CLAMP((y + dlod) * heightDataX + x);
-						float h = (heightData[idx1] + heightData[idx3]) * hcxp + heightData[idx2] * mcxp;
-						DrawVertexAQ(ma, x, y);
-						DrawVertexAQ(ma, x, y + lod, h);
-					}
-					DrawVertexAQ(ma, xlod, y);
-					DrawVertexAQ(ma, xlod, y + lod);
-					EndStripQ(ma);
+		if (minlx > mintx && minlx < maxtx) {
+			x = minlx - lod;
+			int xlod = x + lod;
+			for (y = yst; y < yed; y += lod) {
+				if (y % dlod) {
+					int idx1 = CLAMP((y      ) * heightDataX + x);
+					int idx2 = CLAMP((y + lod) * heightDataX + x);
+					int idx3 = CLAMP((y - lod) * heightDataX + x);
+					float h = (heightData[idx3] + heightData[idx2]) * hcxp + heightData[idx1] * mcxp;
+					DrawVertexAQ(ma, x, y, h);
+					DrawVertexAQ(ma, x, y + lod);
+				} else {
+					int idx1 = CLAMP((y       ) * heightDataX + x);
+					int idx2 = CLAMP((y +  lod) * heightDataX + x);
+					int idx3 = CLAMP((y + dlod) * heightDataX + x);
+					float h = (heightData[idx1] + heightData[idx3]) * hcxp + heightData[idx2] * mcxp;
+					DrawVertexAQ(ma, x, y);
+					DrawVertexAQ(ma, x, y + lod, h);
 				}
+				DrawVertexAQ(ma, xlod, y);
+				DrawVertexAQ(ma, xlod, y + lod);
+				EndStripQ(ma);
 			}
+		}
 
-			if (maxly < maxty && maxly > minty) {
-				y = maxly;
-				int xs = max(xstart - lod, mintx);
-				int xe = min(xend + lod,   maxtx);
-				FindRange(xs, xe, left, right, y, lod);
-
-				if (xs < xe) {
-					x = xs;
-					int ylod = y + lod;
-					int nloop=(xe-xs)/lod+2; //! one extra for if statment
-					ma->EnlargeArrays(2*nloop, 1);
-					int ylhdx=(y + lod) * heightDataX;
+		if (maxly < maxty && maxly > minty) {
+			y = maxly;
+			int xs = max(xstart - lod, mintx);
+			int xe = min(xend + lod,   maxtx);
+			FindRange(xs, xe, left, right, y, lod);
+
+			if (xs < xe) {
+				x = xs;
+				int ylod = y + lod;
+				int nloop=(xe-xs)/lod+2; //! one extra for if statment
+				ma->EnlargeArrays(2*nloop, 1);
+				int ylhdx=(y + lod) * heightDataX;
+				if (x % dlod) {
+					int idx2 = CLAMP(ylhdx + x), idx2PLOD = CLAMP(idx2 + lod), idx2MLOD = CLAMP(idx2 - lod);
+					float h = (heightData[idx2MLOD] + heightData[idx2PLOD]) * hmcyp + heightData[idx2] * camypart;
+					DrawVertexAQ(ma, x, y);
+					DrawVertexAQ(ma, x, ylod, h);
+				} else {
+					DrawVertexAQ(ma, x, y);
+					DrawVertexAQ(ma, x, ylod);
+				}
+				for (x = xs; x < xe; x += lod) {
 					if (x % dlod) {
-						int idx2 = CLAMP(ylhdx + x), idx2PLOD = CLAMP(idx2 + lod), idx2MLOD = CLAMP(idx2 - lod);
-						float h = (heightData[idx2MLOD] + heightData[idx2PLOD]) * hmcyp + heightData[idx2] * camypart;
-						DrawVertexAQ(ma, x, y);
-						DrawVertexAQ(ma, x, ylod, h);
+						DrawVertexAQ(ma, x + lod, y);
+						DrawVertexAQ(ma, x + lod, ylod);
 					} else {
-						DrawVertexAQ(ma, x, y);
-						DrawVertexAQ(ma, x, ylod);
-					}
-					for (x = xs; x < xe; x += lod) {
-						if (x % dlod) {
-							DrawVertexAQ(ma, x + lod, y);
-							DrawVertexAQ(ma, x + lod, ylod);
-						} else {
-							int idx2 = CLAMP(ylhdx + x), idx2PLOD  = CLAMP(idx2 +  lod), idx2PLOD2 = CLAMP(idx2 + dlod);
-							float h = (heightData[idx2PLOD2] + heightData[idx2]) * hmcyp + heightData[idx2PLOD] * camypart;
-							DrawVertexAQ(ma, x + lod, y);
-							DrawVertexAQ(ma, x + lod, ylod, h);
-						}
+						int idx2 = CLAMP(ylhdx + x), idx2PLOD  = CLAMP(idx2 +  lod), idx2PLOD2 = CLAMP(idx2 + dlod);
+						float h = (heightData[idx2PLOD2] + heightData[idx2]) * hmcyp + heightData[idx2PLOD] * camypart;
+						DrawVertexAQ(ma, x + lod, y);
+						DrawVertexAQ(ma, x + lod, ylod, h);
 					}
-					EndStripQ(ma);
 				}
+				EndStripQ(ma);
 			}
+		}
+
+		if (minly > minty && minly < maxty) {
+			y = minly - lod;
+			int xs = max(xstart - lod, mintx);
+			int xe = min(xend + lod,   maxtx);
+			FindRange(xs, xe, left, right, y, lod);
 
-			if (minly > minty && minly < maxty) {
-				y = minly - lod;
-				int xs = max(xstart - lod, mintx);
-				int xe = min(xend + lod,   maxtx);
-				FindRange(xs, xe, left, right, y, lod);
-
-				if (xs < xe) {
-					x = xs;
-					int ylod = y + lod;
-					int nloop=(xe-xs)/lod+2; //! one extra for if statment
-					ma->EnlargeArrays(2*nloop, 1);
-					int yhdx=y * heightDataX;
+			if (xs < xe) {
+				x = xs;
+				int ylod = y + lod;
+				int nloop=(xe-xs)/lod+2; //! one extra for if statment
+				ma->EnlargeArrays(2*nloop, 1);
+				int yhdx=y * heightDataX;
+				if (x % dlod) {
+					int idx1 = CLAMP(yhdx + x), idx1PLOD = CLAMP(idx1 + lod), idx1MLOD = CLAMP(idx1 - lod);
+					float h = (heightData[idx1MLOD] + heightData[idx1PLOD]) * hcyp + heightData[idx1] * mcyp;
+					DrawVertexAQ(ma, x, y, h);
+					DrawVertexAQ(ma, x, ylod);
+				} else {
+					DrawVertexAQ(ma, x, y);
+					DrawVertexAQ(ma, x, ylod);
+				}
+
+				for (x = xs; x < xe; x+= lod) {
 					if (x % dlod) {
-						int idx1 = CLAMP(yhdx + x), idx1PLOD = CLAMP(idx1 + lod), idx1MLOD = CLAMP(idx1 - lod);
-						float h = (heightData[idx1MLOD] + heightData[idx1PLOD]) * hcyp + heightData[idx1] * mcyp;
-						DrawVertexAQ(ma, x, y, h);
-						DrawVertexAQ(ma, x, ylod);
+						DrawVertexAQ(ma, x + lod, y);
+						DrawVertexAQ(ma, x + lod, ylod);
 					} else {
-						DrawVertexAQ(ma, x, y);
-						DrawVertexAQ(ma, x, ylod);
+						int idx1 = CLAMP(yhdx + x), idx1PLOD  = CLAMP(idx1 +  lod), idx1PLOD2 = CLAMP(idx1 + dlod);
+						float h = (heightData[idx1PLOD2] + heightData[idx1]) * hcyp + heightData[idx1PLOD] * mcyp;
+						DrawVertexAQ(ma, x + lod, y, h);
+						DrawVertexAQ(ma, x + lod, ylod);
 					}
-
-					for (x = xs; x < xe; x+= lod) {
-						if (x % dlod) {
-							DrawVertexAQ(ma, x + lod, y);
-							DrawVertexAQ(ma, x + lod, ylod);
-						} else {
-							int idx1 = CLAMP(yhdx + x), idx1PLOD  = CLAMP(idx1 +  lod), idx1PLOD2 = CLAMP(idx1 + dlod);
-							float h = (heightData[idx1PLOD2] + heightData[idx1]) * hcyp + heightData[idx1PLOD] * mcyp;
-							DrawVertexAQ(ma, x + lod, y, h);
-							DrawVertexAQ(ma, x + lod, ylod);
-						}
-					}
-					EndStripQ(ma);
 				}
+				EndStripQ(ma);
 			}
+		}
 
-		} //for (int lod = 1; lod < neededLod; lod <<= 1)
+	} //for (int lod = 1; lod < neededLod; lod <<= 1)
+}
+
+inline void CBFGroundDrawer::DoDrawGroundRow(int bty) {
+	int sx, ex;
+	FindBigSquareRange(bty, sx, ex);
+
+	CVertexArray *ma = GetVertexArray();
+
+	for (int btx = sx; btx < ex; ++btx) {
+		ma->Initialize();
+		BuildBigSquare(ma, btx, bty);
 
 		SetupBigSquare(btx,bty);
 		DrawGroundVertexArrayQ(ma);
 	}
 }
 
+#ifndef USE_GML
+void CBFGroundDrawer::BuildGroundRow(int bty) {
+	int& sx = rowRanges[bty].first;
+	int& ex = rowRanges[bty].second;
+	FindBigSquareRange(bty, sx, ex);
+
+	for (int btx = sx; btx < ex; ++btx) {
+		CVertexArray* ma = bigSquareMeshes[bty * numBigTexX + btx];
+		ma->Initialize();
+		BuildBigSquare(ma, btx, bty);
+	}
+}
+
+void CBFGroundDrawer::DrawGroundRow(int bty) {
+	for (int btx = rowRanges[bty].first; btx < rowRanges[bty].second; ++btx) {
+		SetupBigSquare(btx,bty);
+		bigSquareMeshes[bty * numBigTexX + btx]->DrawArray0(GL_TRIANGLE_STRIP);
+	}
+}
+#endif
+
+
 void CBFGroundDrawer::Draw(bool drawWaterReflection, bool drawUnitReflection, unsigned int VP)
 {
 	if (mapInfo->map.voidWater && map->currMaxHeight<0) {
@@ -722,12 +798,31 @@ void CBFGroundDrawer::Draw(bool drawWaterReflection, bool drawUnitReflection, un
 		int camBty = (int)math::floor(cam2->pos.z / (bigSquareSize * SQUARE_SIZE));
 		camBty = std::max(0,std::min(numBigTexY-1, camBty ));
 
-		//! try to render in "front to back" (so start with the camera nearest BigGroundLines)
-		for (int bty = camBty; bty >= 0; --bty) {
-			DoDrawGroundRow(bty);
+#ifndef USE_GML
+		if (meshWorkers != NULL) {
+			{
+				SCOPED_TIMER("Ground mesh");
+				meshWorkers->Run(boost::bind(&CBFGroundDrawer::BuildGroundRow, this, _1), numBigTexY);
+			}
+
+			//! try to render in "front to back" (so start with the camera nearest BigGroundLines)
+			for (int bty = camBty; bty >= 0; --bty) {
+				DrawGroundRow(bty);
+			}
+			for (int bty = camBty+1; bty < numBigTexY; ++bty) {
+				DrawGroundRow(bty);
+			}
 		}
-		for (int bty = camBty+1; bty < numBigTexY; ++bty) {
-			DoDrawGroundRow(bty);
+		else
+#endif
+		{
+			//! try to render in "front to back" (so start with the camera nearest BigGroundLines)
+			for (int bty = camBty; bty >= 0; --bty) {
+				DoDrawGroundRow(bty);
+			}
+			for (int bty = camBty+1; bty < numBigTexY; ++bty) {
+				DoDrawGroundRow(bty);
+			}
 		}
 	}
 	ResetTextureUnits(drawWaterReflection);
@@ -761,10 +856,7 @@ void CBFGroundDrawer::Draw(bool drawWaterReflection, bool drawUnitReflection, un
 }
 
 
-inline void CBFGroundDrawer::DoDrawGroundShadowLOD(int nlod) {
-	CVertexArray *ma = GetVertexArray();
-	ma->Initialize();
-
+void CBFGroundDrawer::BuildGroundShadowLOD(CVertexArray* ma, int nlod) {
 	bool inStrip=false;
 	int x,y;
 	int lod=1<<nlod;
@@ -1087,9 +1179,22 @@ inline void CBFGroundDrawer::DoDrawGroundShadowLOD(int nlod) {
 			EndStripQ(ma);
 		}
 	}
+}
+
+inline void CBFGroundDrawer::DoDrawGroundShadowLOD(int nlod) {
+	CVertexArray *ma = GetVertexArray();
+	ma->Initialize();
+	BuildGroundShadowLOD(ma, nlod);
 	DrawGroundVertexArrayQ(ma);
 }
 
+#ifndef USE_GML
+void CBFGroundDrawer::BuildGroundShadowMesh(int nlod) {
+	shadowMeshes[nlod]->Initialize();
+	BuildGroundShadowLOD(shadowMeshes[nlod], nlod);
+}
+#endif
+
 
 void CBFGroundDrawer::DrawShadowPass(void)
 {
@@ -1098,8 +1203,6 @@ void CBFGroundDrawer::DrawShadowPass(void)
 	}
 
 //	glEnable(GL_CULL_FACE);
-	const int NUM_LODS = 4;
-
 	glPolygonOffset(1, 1);
 	glEnable(GL_POLYGON_OFFSET_FILL);
 
@@ -1111,6 +1214,18 @@ void CBFGroundDrawer::DrawShadowPass(void)
 		gmlProcessor->Work(NULL,&CBFGroundDrawer::DoDrawGroundShadowLODMT,NULL,this,gmlThreadCount,FALSE,NULL,NUM_LODS+1,50,100,TRUE,NULL);
 	}
 	else
+#endif
+#ifndef USE_GML
+	if (meshWorkers != NULL) {
+		{
+			SCOPED_TIMER("Ground shadow mesh");
+			meshWorkers->Run(boost::bind(&CBFGroundDrawer::BuildGroundShadowMesh, this, _1), NUM_LODS+1);
+		}
+		for (int nlod = 0; nlod < NUM_LODS+1; ++nlod) {
+			shadowMeshes[nlod]->DrawArray0(GL_TRIANGLE_STRIP);
+		}
+	}
+	else
 #endif
 	{
 		for (int nlod = 0; nlod < NUM_LODS+1; ++nlod) {
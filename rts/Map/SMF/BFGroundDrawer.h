@@ -4,11 +4,14 @@
 #ifndef __BF_GROUND_DRAWER_H__
 #define __BF_GROUND_DRAWER_H__
 
+#include <vector>
+#include <utility>
 #include "Map/BaseGroundDrawer.h"
 
 class CVertexArray;
 class CSmfReadMap;
 class CBFGroundTextures;
+class CWorkerPool;
 
 
 /**
@@ -28,6 +31,8 @@ public:
 	void DecreaseDetail();
 
 protected:
+	static const int NUM_LODS = 4;
+
 	int viewRadius;
 	CSmfReadMap* map;
 	CBFGroundTextures* textures;
@@ -64,6 +69,23 @@ protected:
 	static void DoDrawGroundShadowLODMT(void *c,int nlod) {((CBFGroundDrawer *)c)->DoDrawGroundShadowLOD(nlod);}
 #endif
 
+#ifndef USE_GML
+	/**
+	 * Without GML the meshes are built by meshWorkers into one array per
+	 * big square (and per shadow LOD), then drawn from the render thread.
+	 * NULL if there is only one core to use.
+	 */
+	CWorkerPool* meshWorkers;
+	std::vector<CVertexArray*> bigSquareMeshes;
+	/// visible big squares [first, second) of every row
+	std::vector<std::pair<int, int> > rowRanges;
+	CVertexArray* shadowMeshes[NUM_LODS + 1];
+
+	void BuildGroundRow(int bty);
+	void DrawGroundRow(int bty);
+	void BuildGroundShadowMesh(int nlod);
+#endif
+
 	GLuint waterPlaneCamOutDispList;
 	GLuint waterPlaneCamInDispList;
 
@@ -72,11 +94,14 @@ protected:
 	inline void DrawWaterPlane(bool drawWaterReflection);
 
 	void FindRange(int &xs, int &xe, const std::vector<fline> &left, const std::vector<fline> &right, int y, int lod);
+	void FindBigSquareRange(int bty, int& sx, int& ex);
+	void BuildBigSquare(CVertexArray* ma, int btx, int bty);
 	void DoDrawGroundRow(int bty);
 	void DrawVertexAQ(CVertexArray *ma, int x, int y);
 	void DrawVertexAQ(CVertexArray *ma, int x, int y, float height);
 	void EndStripQ(CVertexArray *ma);
 	void DrawGroundVertexArrayQ(CVertexArray * &ma);
+	void BuildGroundShadowLOD(CVertexArray* ma, int nlod);
 	void DoDrawGroundShadowLOD(int nlod);
 
 	inline bool BigTexSquareRowVisible(int);
@@ -17,6 +17,7 @@
 #include "FileSystem/VFSHandler.h"
 #include "FileSystem/FileHandler.h"
 #include "FileSystem/SimpleParser.h"
+#include "FileSystem/CacheFile.h"
 #include "Sim/Misc/CollisionVolume.h"
 #include "Sim/Units/COB/CobInstance.h"
 #include "Rendering/Textures/TAPalette.h"
@@ -144,6 +145,16 @@ S3DModel* C3DOParser::Load(string name)
 
 	// Load the Model
 	S3DOPiece* rootobj = ReadChild(0, NULL, &model->numobjects);
+
+	SetModelBounds(model, rootobj);
+
+	delete[] fileBuf;
+	return model;
+}
+
+
+void C3DOParser::SetModelBounds(S3DModel* model, S3DOPiece* rootobj) const
+{
 	model->rootobject = rootobj;
 
 	// PreProcessing
@@ -167,12 +178,127 @@ S3DModel* C3DOParser::Load(string name)
 	model->minz = rootobj->minz;
 
 	model->relMidPos = rootobj->relMidPos;
+}
 
-	delete[] fileBuf;
+
+void C3DOParser::SaveCached(const S3DModel* model, std::string& data) const
+{
+	// primitives point into the texture atlas, store the texture names instead
+	TextureNames textureNames;
+	const std::map<std::string, C3DOTextureHandler::UnitTexture*>& textures = texturehandler3DO->GetAtlasTextures();
+	for (std::map<std::string, C3DOTextureHandler::UnitTexture*>::const_iterator ti = textures.begin(); ti != textures.end(); ++ti) {
+		if (ti->second != NULL) {
+			textureNames[ti->second] = ti->first;
+		}
+	}
+
+	CCacheWriter out(data);
+	SaveCachedPiece(static_cast<const S3DOPiece*>(model->rootobject), textureNames, out);
+}
+
+
+void C3DOParser::SaveCachedPiece(const S3DOPiece* object, const TextureNames& textureNames, CCacheWriter& out) const
+{
+	out.WriteString(object->name);
+	out.Write(object->offset);
+
+	out.Write((unsigned int) object->vertices.size());
+	for (std::vector<S3DOVertex>::const_iterator vi = object->vertices.begin(); vi != object->vertices.end(); ++vi) {
+		out.Write(vi->pos);
+		out.Write(vi->normal);
+		out.WriteVector(vi->prims);
+	}
+
+	out.Write((unsigned int) object->prims.size());
+	for (std::vector<S3DOPrimitive>::const_iterator pi = object->prims.begin(); pi != object->prims.end(); ++pi) {
+		const TextureNames::const_iterator ti = textureNames.find(pi->texture);
+
+		out.WriteVector(pi->vertices);
+		out.WriteVector(pi->normals);
+		out.Write(pi->normal);
+		out.Write(pi->numVertex);
+		out.WriteString((ti != textureNames.end())? ti->second: "");
+	}
+
+	out.Write((unsigned int) object->childs.size());
+	for (std::vector<S3DModelPiece*>::const_iterator ci = object->childs.begin(); ci != object->childs.end(); ++ci) {
+		SaveCachedPiece(static_cast<const S3DOPiece*>(*ci), textureNames, out);
+	}
+}
+
+
+S3DModel* C3DOParser::LoadCached(const std::string& name, const std::string& data)
+{
+	CCacheReader in(data);
+
+	S3DModel* model = new S3DModel;
+	model->name = name;
+	model->type = MODELTYPE_3DO;
+	model->textureType = 0;
+	model->numobjects  = 0;
+
+	S3DOPiece* rootobj = LoadCachedPiece(in, &model->numobjects);
+
+	if (!in.AtEnd()) {
+		DeletePieces(rootobj);
+		delete model;
+		return NULL;
+	}
+
+	SetModelBounds(model, rootobj);
 	return model;
 }
 
 
+S3DOPiece* C3DOParser::LoadCachedPiece(CCacheReader& in, int* numobj) const
+{
+	(*numobj)++;
+
+	S3DOPiece* object = new S3DOPiece;
+	object->displist = 0;
+	object->colvol = NULL;
+	object->type = MODELTYPE_3DO;
+
+	in.ReadString(object->name);
+	in.Read(object->offset);
+
+	unsigned int numVertices = 0;
+	in.Read(numVertices);
+	for (unsigned int a = 0; (a < numVertices) && in.IsOk(); ++a) {
+		S3DOVertex vertex;
+		in.Read(vertex.pos);
+		in.Read(vertex.normal);
+		in.ReadVector(vertex.prims);
+		object->vertices.push_back(vertex);
+	}
+
+	unsigned int numPrims = 0;
+	in.Read(numPrims);
+	for (unsigned int a = 0; (a < numPrims) && in.IsOk(); ++a) {
+		S3DOPrimitive prim;
+		std::string texture;
+		in.ReadVector(prim.vertices);
+		in.ReadVector(prim.normals);
+		in.Read(prim.normal);
+		in.Read(prim.numVertex);
+		in.ReadString(texture);
+		prim.texture = texture.empty()? NULL: texturehandler3DO->Get3DOTexture(texture);
+		object->prims.push_back(prim);
+	}
+
+	object->vertexCount = object->vertices.size();
+	object->isEmpty = (object->prims.size() < 1);
+
+	unsigned int numChilds = 0;
+	in.Read(numChilds);
+	for (unsigned int a = 0; (a < numChilds) && in.IsOk(); ++a) {
+		object->childs.push_back(LoadCachedPiece(in, numobj));
+	}
+
+	return object;
+}
+
+
 void C3DOParser::GetVertexes(_3DObject* o, S3DOPiece* object)
 {
 	curOffset = o->OffsetToVertexArray;
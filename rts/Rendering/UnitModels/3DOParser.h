@@ -15,6 +15,8 @@
 
 class CMatrix44f;
 class CFileHandler;
+class CCacheWriter;
+class CCacheReader;
 
 struct S3DOVertex {
 	float3 pos;
@@ -78,7 +80,16 @@ public:
 	S3DModel* Load(std::string name);
 	void Draw(const S3DModelPiece *o) const;
 
+	void SaveCached(const S3DModel* model, std::string& data) const;
+	S3DModel* LoadCached(const std::string& name, const std::string& data);
+
 private:
+	typedef std::map<const C3DOTextureHandler::UnitTexture*, std::string> TextureNames;
+
+	void SaveCachedPiece(const S3DOPiece* object, const TextureNames& textureNames, CCacheWriter& out) const;
+	S3DOPiece* LoadCachedPiece(CCacheReader& in, int* numobj) const;
+	void SetModelBounds(S3DModel* model, S3DOPiece* rootobj) const;
+
 	void FindCenter(S3DOPiece* object) const;
 	float FindRadius(const S3DOPiece* object, float3 offset) const;
 	float FindHeight(const S3DOPiece* object, float3 offset) const;
@@ -12,6 +12,8 @@
 #include "Sim/Units/COB/CobInstance.h"
 #include "Rendering/FartextureHandler.h"
 #include "FileSystem/FileSystem.h"
+#include "FileSystem/CacheFile.h"
+#include "FileSystem/CRC.h"
 #include "Util.h"
 #include "LogOutput.h"
 #include "Exceptions.h"
@@ -19,12 +21,24 @@
 
 C3DModelLoader* modelParser = NULL;
 
+static const char MODEL_CACHE_MAGIC[8] = "SPRMODL";
+static const int MODEL_CACHE_VERSION = 1;
+
+
+void IModelParser::DeletePieces(S3DModelPiece* o)
+{
+	for (std::vector<S3DModelPiece*>::iterator ci = o->childs.begin(); ci != o->childs.end(); ++ci) {
+		DeletePieces(*ci);
+	}
+	delete o;
+}
+
 
 //////////////////////////////////////////////////////////////////////
 // C3DModelLoader
 //
 
-C3DModelLoader::C3DModelLoader(void)
+C3DModelLoader::C3DModelLoader(unsigned int cacheKey): cacheKey(cacheKey)
 {
 	C3DOParser* unit3doparser = new C3DOParser();
 	CS3OParser* units3oparser = new CS3OParser();
@@ -82,7 +96,23 @@ S3DModel* C3DModelLoader::Load3DModel(std::string name, const float3& centerOffs
 	std::map<std::string, IModelParser*>::iterator pi;
 	if ((pi = parsers.find(fileExt)) != parsers.end()) {
 		IModelParser* p = pi->second;
-		S3DModel* model = p->Load(name);
+		S3DModel* model = NULL;
+
+		// parsed geometry is cached, only textures and GL resources are
+		// created on every start
+		const std::string cacheFile = GetCacheFile(name);
+		std::string cacheData;
+		if (!cacheFile.empty() && CacheFile::Read(cacheFile, MODEL_CACHE_MAGIC, MODEL_CACHE_VERSION, cacheData)) {
+			model = p->LoadCached(name, cacheData);
+		}
+		if (model == NULL) {
+			model = p->Load(name);
+			if (!cacheFile.empty()) {
+				cacheData.clear();
+				p->SaveCached(model, cacheData);
+				CacheFile::Write(cacheFile, MODEL_CACHE_MAGIC, MODEL_CACHE_VERSION, cacheData);
+			}
+		}
 
 		model->relMidPos += centerOffset;
 
@@ -97,6 +127,21 @@ S3DModel* C3DModelLoader::Load3DModel(std::string name, const float3& centerOffs
 	return NULL;
 }
 
+std::string C3DModelLoader::GetCacheFile(const std::string& name) const
+{
+	if (cacheKey == 0) {
+		return "";
+	}
+
+	CRC crc;
+	crc.Update(cacheKey);
+	crc.Update(name.c_str(), name.size() + 1);
+
+	char file[32];
+	SNPRINTF(file, sizeof(file), "%08x.bin", crc.GetDigest());
+	return filesystem.LocateDir("cache/models/", FileSystem::WRITE | FileSystem::CREATE_DIRS) + file;
+}
+
 void C3DModelLoader::Update() {
 #if defined(USE_GML) && GML_ENABLE_SIM
 	GML_STDMUTEX_LOCK(model); // Update
@@ -20,13 +20,27 @@ class IModelParser
 public:
 	virtual S3DModel* Load(std::string name) = 0;
 	virtual void Draw(const S3DModelPiece* o) const = 0;
+
+	/// appends the geometry of a model returned by Load() to data
+	virtual void SaveCached(const S3DModel* model, std::string& data) const = 0;
+	/// @return the model stored by SaveCached(), or NULL if data is damaged
+	virtual S3DModel* LoadCached(const std::string& name, const std::string& data) = 0;
+
+protected:
+	/// deletes o and all pieces below it
+	static void DeletePieces(S3DModelPiece* o);
 };
 
 
 class C3DModelLoader
 {
 public:
-	C3DModelLoader(void);
+	/**
+	 * @param cacheKey identifies the content of the archives the models are
+	 *   loaded from, parsed models are stored in and loaded from the model
+	 *   cache under this key; 0 disables the cache
+	 */
+	C3DModelLoader(unsigned int cacheKey = 0);
 	~C3DModelLoader(void);
 
 	void Update();
@@ -43,6 +57,10 @@ private:
 	std::map<std::string, S3DModel*> cache;
 	std::map<std::string, IModelParser*> parsers;
 
+	unsigned int cacheKey;
+	/// @return the model cache file of name, or an empty string if not caching
+	std::string GetCacheFile(const std::string& name) const;
+
 #if defined(USE_GML) && GML_ENABLE_SIM
 	struct ModelParserPair {
 		ModelParserPair(S3DModelPiece* o, IModelParser* p) : model(o), parser(p) {};
@@ -1,4 +1,5 @@
 #include "StdAfx.h"
+#include <algorithm>
 #include "mmgr.h"
 
 #include "UnitDrawer.h"
@@ -35,6 +36,7 @@
 #include "Sim/Features/Feature.h"
 #include "Sim/Misc/CollisionVolume.h"
 #include "Sim/Misc/LosHandler.h"
+#include "Sim/Misc/QuadField.h"
 #include "Sim/Misc/RadarHandler.h"
 #include "Sim/Misc/TeamHandler.h"
 #include "Sim/Units/CommandAI/BuilderCAI.h"
@@ -49,6 +51,7 @@
 #include "System/LogOutput.h"
 #include "System/ConfigHandler.h"
 #include "System/GlobalUnsynced.h"
+#include "System/TimeProfiler.h"
 
 #ifdef USE_GML
 #include "lib/gml/gmlsrv.h"
@@ -87,6 +90,10 @@ CUnitDrawer::CUnitDrawer(void)
 	LODScaleReflection = GetLODFloat("LODScaleReflection", 1.0f);
 	LODScaleRefraction = GetLODFloat("LODScaleRefraction", 1.0f);
 
+#ifndef USE_GML
+	visitPass = 0;
+#endif
+
 	CBitmap white;
 	white.Alloc(1, 1);
 	for (int a = 0; a < 4; ++a) {
@@ -221,8 +228,14 @@ void CUnitDrawer::Update(void)
 	{
 		GML_RECMUTEX_LOCK(unit); // Update
 
+#ifndef USE_GML
+		ResetQuadBounds();
+#endif
 		for (std::list<CUnit*>::iterator usi = uh->renderUnits.begin(); usi != uh->renderUnits.end(); ++usi) {
 			(*usi)->UpdateDrawPos();
+#ifndef USE_GML
+			AddQuadBounds(*usi);
+#endif
 		}
 	}
 
@@ -270,11 +283,7 @@ inline void CUnitDrawer::DrawUnitLOD(CUnit* unit)
 		if ((lodMat != NULL) && lodMat->IsActive()) {
 			lodMat->AddUnit(unit);
 		} else {
-			if (unit->model->type==MODELTYPE_S3O) {
-				QueS3ODraw(unit, unit->model->textureType);
-			} else {
-				DrawUnitNow(unit);
-			}
+			drawOpaque.push_back(unit);
 		}
 	}
 }
@@ -287,18 +296,14 @@ inline void CUnitDrawer::DrawUnit(CUnit* unit)
 		return;
 	}
 
-	if (unit->model->type == MODELTYPE_S3O) {
-		if (unit->isCloaked) {
+	if (unit->isCloaked) {
+		if (unit->model->type == MODELTYPE_S3O) {
 			drawCloakedS3O.push_back(unit);
 		} else {
-			QueS3ODraw(unit, unit->model->textureType);
-		}
-	} else {
-		if (unit->isCloaked) {
 			drawCloaked.push_back(unit);
-		} else {
-			DrawUnitNow(unit);
 		}
+	} else {
+		drawOpaque.push_back(unit);
 	}
 }
 
@@ -349,7 +354,6 @@ inline void CUnitDrawer::DoDrawUnit(CUnit *unit, bool drawReflection, bool drawR
 				if (sqDist > farLength) {
 					drawFar.push_back(unit);
 				} else {
-					SetTeamColour(unit->team);
 					DrawUnit(unit);
 				}
 
@@ -395,6 +399,56 @@ inline void CUnitDrawer::DoDrawUnit(CUnit *unit, bool drawReflection, bool drawR
 }
 
 
+/// groups units that need the same GL state, see DrawOpaqueUnits()
+struct OpaqueUnitOrder {
+	bool operator() (const CUnit* a, const CUnit* b) const {
+		const S3DModel* ma = a->model;
+		const S3DModel* mb = b->model;
+		if (ma->type != mb->type) {
+			return (ma->type < mb->type);
+		}
+		if (ma->textureType != mb->textureType) {
+			return (ma->textureType < mb->textureType);
+		}
+		if (a->team != b->team) {
+			return (a->team < b->team);
+		}
+		// keeps the data of one model hot
+		return (ma < mb);
+	}
+};
+
+void CUnitDrawer::DrawOpaqueUnits(int modelType)
+{
+	int lastTexture = -1;
+	int lastTeam = -1;
+
+	for (GML_VECTOR<CUnit*>::iterator ui = drawOpaque.begin(); ui != drawOpaque.end(); ++ui) {
+		CUnit* unit = *ui;
+
+		if (unit->model->type != modelType) {
+			continue;
+		}
+		if (modelType == MODELTYPE_S3O && unit->model->textureType != lastTexture) {
+			lastTexture = unit->model->textureType;
+			texturehandlerS3O->SetS3oTexture(lastTexture);
+		}
+		if (unit->team != lastTeam) {
+			lastTeam = unit->team;
+			SetTeamColour(lastTeam);
+		}
+
+		DrawUnitNow(unit);
+
+		if (unit->luaDraw || unit->beingBuilt) {
+			// Lua and the nanoframe may leave other textures or colours behind
+			lastTexture = -1;
+			lastTeam = -1;
+		}
+	}
+}
+
+
 void CUnitDrawer::Draw(bool drawReflection, bool drawRefraction)
 {
 	drawFar.clear();
@@ -430,6 +484,7 @@ void CUnitDrawer::Draw(bool drawReflection, bool drawRefraction)
 
 	drawCloaked.clear();
 	drawCloakedS3O.clear();
+	drawOpaque.clear();
 
 #ifdef USE_GML
 	if(multiThreadDrawUnit) {
@@ -441,10 +496,19 @@ void CUnitDrawer::Draw(bool drawReflection, bool drawRefraction)
 	else
 #endif
 	{
+#ifdef USE_GML
 		for (std::list<CUnit*>::iterator usi = uh->renderUnits.begin(); usi != uh->renderUnits.end(); ++usi) {
 			CUnit* unit = *usi;
 			DoDrawUnit(unit,drawReflection,drawRefraction, excludeUnit);
 		}
+#else
+		// same margin as the exact test in DoDrawUnit
+		GetQuadVisibleUnits(30.0f, quadVisibleUnits);
+
+		for (std::vector<CUnit*>::iterator ui = quadVisibleUnits.begin(); ui != quadVisibleUnits.end(); ++ui) {
+			DoDrawUnit(*ui, drawReflection, drawRefraction, excludeUnit);
+		}
+#endif
 	}
 
 	{
@@ -467,8 +531,16 @@ void CUnitDrawer::Draw(bool drawReflection, bool drawRefraction)
 		}
 	}
 
-	CleanUp3DO();
-	DrawQuedS3O();
+	{
+		// CPU cost of submitting the opaque units, see the profiler
+		SCOPED_TIMER("Opaque unit drawing");
+
+		std::sort(drawOpaque.begin(), drawOpaque.end(), OpaqueUnitOrder());
+		DrawOpaqueUnits(MODELTYPE_3DO);
+		CleanUp3DO();
+		DrawOpaqueUnits(MODELTYPE_S3O);
+		DrawQuedS3O();
+	}
 	CleanUpUnitDrawing();
 
 	DrawOpaqueShaderUnits();
@@ -698,6 +770,77 @@ inline void CUnitDrawer::DoDrawUnitShadow(CUnit *unit) {
 	}
 }
 
+#ifndef USE_GML
+/*
+ * With GML the sim thread moves units while they are drawn, so the bounds
+ * from Update() would not hold; there every unit is tested as before.
+ */
+
+void CUnitDrawer::ResetQuadBounds()
+{
+	QuadBounds empty;
+	empty.mins = float3( 1e9f,  1e9f,  1e9f);
+	empty.maxs = float3(-1e9f, -1e9f, -1e9f);
+
+	quadBounds.assign(qf->GetNumQuadsX() * qf->GetNumQuadsZ(), empty);
+}
+
+void CUnitDrawer::AddQuadBounds(const CUnit* unit)
+{
+	const float3& p = unit->drawMidPos;
+	const float r = unit->radius;
+
+	// the quads of a unit are the ones its radius around pos overlaps
+	for (std::vector<int>::const_iterator qi = unit->quads.begin(); qi != unit->quads.end(); ++qi) {
+		QuadBounds& qb = quadBounds[*qi];
+		qb.mins.x = std::min(qb.mins.x, p.x - r);
+		qb.mins.y = std::min(qb.mins.y, p.y - r);
+		qb.mins.z = std::min(qb.mins.z, p.z - r);
+		qb.maxs.x = std::max(qb.maxs.x, p.x + r);
+		qb.maxs.y = std::max(qb.maxs.y, p.y + r);
+		qb.maxs.z = std::max(qb.maxs.z, p.z + r);
+	}
+}
+
+void CUnitDrawer::GetQuadVisibleUnits(float margin, std::vector<CUnit*>& units)
+{
+	units.clear();
+
+	if (unitVisitPasses.size() < uh->MaxUnits()) {
+		unitVisitPasses.resize(uh->MaxUnits(), 0);
+	}
+	if (++visitPass == 0) {
+		std::fill(unitVisitPasses.begin(), unitVisitPasses.end(), 0);
+		visitPass = 1;
+	}
+
+	const float3 m(margin, margin, margin);
+
+	for (size_t q = 0; q < quadBounds.size(); ++q) {
+		const QuadBounds& qb = quadBounds[q];
+
+		if (qb.mins.x > qb.maxs.x) {
+			continue; // no units
+		}
+		if (!camera->InView(qb.mins - m, qb.maxs + m)) {
+			continue;
+		}
+
+		const std::list<CUnit*>& quadUnits = qf->GetQuad(q).units;
+		for (std::list<CUnit*>::const_iterator ui = quadUnits.begin(); ui != quadUnits.end(); ++ui) {
+			CUnit* unit = *ui;
+
+			// units overlapping several quads are in all of them
+			if (unitVisitPasses[unit->id] != visitPass) {
+				unitVisitPasses[unit->id] = visitPass;
+				units.push_back(unit);
+			}
+		}
+	}
+}
+#endif
+
+
 void CUnitDrawer::DrawShadowPass(void)
 {
 	glColor3f(1.0f, 1.0f, 1.0f);
@@ -719,10 +862,19 @@ void CUnitDrawer::DrawShadowPass(void)
 	else
 #endif
 	{
+#ifdef USE_GML
 		for (std::list<CUnit*>::iterator usi = uh->renderUnits.begin(); usi != uh->renderUnits.end(); ++usi) {
 			CUnit* unit = *usi;
 			DoDrawUnitShadow(unit);
 		}
+#else
+		// same margin as the exact test in DoDrawUnitShadow
+		GetQuadVisibleUnits(700.0f, quadVisibleUnits);
+
+		for (std::vector<CUnit*>::iterator ui = quadVisibleUnits.begin(); ui != quadVisibleUnits.end(); ++ui) {
+			DoDrawUnitShadow(*ui);
+		}
+#endif
 	}
 
 	glDisable(GL_POLYGON_OFFSET_FILL);
@@ -88,6 +88,8 @@ public:
 	GML_VECTOR<CUnit*> drawCloakedSave;
 	GML_VECTOR<CUnit*> drawCloakedS3OSave;
 
+	/// opaque units without a Lua material, drawn by DrawOpaqueUnits()
+	GML_VECTOR<CUnit*> drawOpaque;
 	GML_VECTOR<CUnit*> drawFar;
 	GML_VECTOR<CUnit*> drawStat;
 
@@ -173,8 +175,37 @@ private:
 	void CleanupBasicS3OTexture1(void) const;
 	void CleanupBasicS3OTexture0(void) const;
 	void DrawIcon(CUnit* unit, bool asRadarBlip);
+	/**
+	 * Draws the units of one model type in drawOpaque; as drawOpaque is
+	 * sorted by texture and team, those are only changed between groups
+	 * instead of for every unit.
+	 */
+	void DrawOpaqueUnits(int modelType);
 	void DrawCloakedUnitsHelper(GML_VECTOR<CUnit*>& units, std::list<GhostBuilding*>& ghostedBuildings, bool is_s3o);
 
+#ifndef USE_GML
+	/// bounding box of the units in one quad of the CQuadField
+	struct QuadBounds {
+		float3 mins;
+		float3 maxs;
+	};
+
+	void ResetQuadBounds();
+	void AddQuadBounds(const CUnit* unit);
+	/**
+	 * Collects the units in the quads of the CQuadField whose bounds, grown
+	 * by margin, are in view of the camera; every unit is added once.
+	 */
+	void GetQuadVisibleUnits(float margin, std::vector<CUnit*>& units);
+
+	/// rebuilt by Update(), from the draw positions of this frame
+	std::vector<QuadBounds> quadBounds;
+	/// per unit ID, the pass of GetQuadVisibleUnits() that last added it
+	std::vector<unsigned int> unitVisitPasses;
+	unsigned int visitPass;
+	std::vector<CUnit*> quadVisibleUnits;
+#endif
+
 	/// Returns true if the given unit should be drawn as icon in the current frame.
 	bool DrawAsIcon(const CUnit& unit, const float sqUnitCamDist) const;
 	bool distToGroundForIcons_useMethod;
@@ -12,6 +12,7 @@
 #include "s3oParser.h"
 #include "Rendering/GL/myGL.h"
 #include "FileSystem/FileHandler.h"
+#include "FileSystem/CacheFile.h"
 #include "s3o.h"
 #include "Sim/Misc/CollisionVolume.h"
 #include "Sim/Units/COB/CobInstance.h"
@@ -47,9 +48,6 @@ S3DModel* CS3OParser::Load(std::string name)
 	SS3OPiece* rootPiece = LoadPiece(fileBuf, header.rootPiece, model);
 	rootPiece->type = MODELTYPE_S3O;
 
-	FindMinMax(rootPiece);
-
-	model->rootobject = rootPiece;
 	model->radius = header.radius;
 	model->height = header.height;
 
@@ -57,6 +55,17 @@ S3DModel* CS3OParser::Load(std::string name)
 	model->relMidPos.y = header.midy;
 	model->relMidPos.z = header.midz;
 
+	SetModelBounds(model, rootPiece);
+
+	delete[] fileBuf;
+	return model;
+}
+
+void CS3OParser::SetModelBounds(S3DModel* model, SS3OPiece* rootPiece) const
+{
+	FindMinMax(rootPiece);
+
+	model->rootobject = rootPiece;
 	model->relMidPos.y = std::max(model->relMidPos.y, 1.0f); // ?
 
 	model->maxx = rootPiece->maxx;
@@ -66,11 +75,95 @@ S3DModel* CS3OParser::Load(std::string name)
 	model->minx = rootPiece->minx;
 	model->miny = rootPiece->miny;
 	model->minz = rootPiece->minz;
+}
 
-	delete[] fileBuf;
+
+void CS3OParser::SaveCached(const S3DModel* model, std::string& data) const
+{
+	CCacheWriter out(data);
+	out.WriteString(model->tex1);
+	out.WriteString(model->tex2);
+	out.Write(model->radius);
+	out.Write(model->height);
+	out.Write(model->relMidPos);
+
+	SaveCachedPiece(static_cast<const SS3OPiece*>(model->rootobject), out);
+}
+
+void CS3OParser::SaveCachedPiece(const SS3OPiece* piece, CCacheWriter& out) const
+{
+	out.WriteString(piece->name);
+	out.Write(piece->offset);
+	out.Write(piece->primitiveType);
+	out.WriteVector(piece->vertices);
+	out.WriteVector(piece->vertexDrawOrder);
+	out.WriteVector(piece->sTangents);
+	out.WriteVector(piece->tTangents);
+
+	out.Write((unsigned int) piece->childs.size());
+	for (std::vector<S3DModelPiece*>::const_iterator ci = piece->childs.begin(); ci != piece->childs.end(); ++ci) {
+		SaveCachedPiece(static_cast<const SS3OPiece*>(*ci), out);
+	}
+}
+
+S3DModel* CS3OParser::LoadCached(const std::string& name, const std::string& data)
+{
+	CCacheReader in(data);
+
+	S3DModel* model = new S3DModel;
+	model->type = MODELTYPE_S3O;
+	model->numobjects = 0;
+	model->name = name;
+
+	in.ReadString(model->tex1);
+	in.ReadString(model->tex2);
+	in.Read(model->radius);
+	in.Read(model->height);
+	in.Read(model->relMidPos);
+
+	SS3OPiece* rootPiece = LoadCachedPiece(in, model);
+
+	if (!in.AtEnd()) {
+		DeletePieces(rootPiece);
+		delete model;
+		return NULL;
+	}
+
+	texturehandlerS3O->LoadS3OTexture(model);
+	SetModelBounds(model, rootPiece);
 	return model;
 }
 
+SS3OPiece* CS3OParser::LoadCachedPiece(CCacheReader& in, S3DModel* model) const
+{
+	model->numobjects++;
+
+	SS3OPiece* piece = new SS3OPiece;
+	piece->type = MODELTYPE_S3O;
+	piece->displist = 0;
+	piece->colvol = NULL;
+
+	in.ReadString(piece->name);
+	in.Read(piece->offset);
+	in.Read(piece->primitiveType);
+	in.ReadVector(piece->vertices);
+	in.ReadVector(piece->vertexDrawOrder);
+	in.ReadVector(piece->sTangents);
+	in.ReadVector(piece->tTangents);
+
+	piece->isEmpty = piece->vertexDrawOrder.empty();
+	piece->vertexCount = piece->vertices.size();
+
+	unsigned int numChilds = 0;
+	in.Read(numChilds);
+
+	for (unsigned int a = 0; (a < numChilds) && in.IsOk(); ++a) {
+		piece->childs.push_back(LoadCachedPiece(in, model));
+	}
+
+	return piece;
+}
+
 SS3OPiece* CS3OParser::LoadPiece(unsigned char* buf, int offset, S3DModel* model)
 {
 	model->numobjects++;
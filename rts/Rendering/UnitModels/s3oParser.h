@@ -7,6 +7,8 @@
 #include <map>
 #include "IModelParser.h"
 
+class CCacheWriter;
+class CCacheReader;
 
 struct SS3OVertex {
 	float3 pos;
@@ -48,8 +50,14 @@ public:
 	S3DModel* Load(std::string name);
 	void Draw(const S3DModelPiece* o) const;
 
+	void SaveCached(const S3DModel* model, std::string& data) const;
+	S3DModel* LoadCached(const std::string& name, const std::string& data);
+
 private:
 	SS3OPiece* LoadPiece(unsigned char* buf, int offset, S3DModel* model);
+	void SaveCachedPiece(const SS3OPiece* piece, CCacheWriter& out) const;
+	SS3OPiece* LoadCachedPiece(CCacheReader& in, S3DModel* model) const;
+	void SetModelBounds(S3DModel* model, SS3OPiece* rootPiece) const;
 	void FindMinMax(SS3OPiece* object) const;
 	void SetVertexTangents(SS3OPiece*);
 };
@@ -1,6 +1,10 @@
 #include "StdAfx.h"
 #include "mmgr.h"
 
+#ifndef DEDICATED_NOSSE
+#include <xmmintrin.h>
+#endif
+
 #include "FastMath.h"
 #include "float3.h"
 #include "Matrix44f.h"
@@ -22,6 +26,9 @@ CR_BIND(CCollisionHandler, );
 unsigned int CCollisionHandler::numCollisionTests = 0;
 unsigned int CCollisionHandler::numIntersectionTests = 0;
 
+// number of candidates CullHitCandidates() gathers per TouchSpheres() batch
+static const int CULL_BATCH_SIZE = 64;
+
 
 
 bool CCollisionHandler::DetectHit(const CUnit* u, const float3& p0, const float3& p1, CollisionQuery* q)
@@ -61,6 +68,153 @@ bool CCollisionHandler::DetectHit(const CFeature* f, const float3& p0, const flo
 
 
 
+/**
+ * Sphere around pos that contains the collision volume of u in every frame of
+ * its movement, for both test types: the volume is centered at pos + R *
+ * (relMidPos + offsets) for continuous tests and at midPos + offsets for
+ * discrete ones, R being a rotation. Units with piece volumes get none.
+ */
+static bool GetCullingSphere(const CUnit* u, float3& c, float& r)
+{
+	const CollisionVolume* v = u->collisionVolume;
+
+	if (u->unitDef->usePieceCollisionVolumes) {
+		return false;
+	}
+
+	const float midDist = std::max(u->relMidPos.Length(), (u->midPos - u->pos).Length());
+
+	c = u->pos;
+	r = v->GetBoundingRadius() + v->GetOffsets().Length() + midDist;
+	return true;
+}
+
+static bool GetCullingSphere(const CFeature* f, float3& c, float& r)
+{
+	const CollisionVolume* v = f->collisionVolume;
+
+	if (v == NULL) {
+		return false;
+	}
+
+	c = f->pos;
+	r = v->GetBoundingRadius() + v->GetOffsets().Length() + (f->midPos - f->pos).Length();
+	return true;
+}
+
+template<typename T>
+static T** CullCandidates(T** begin, T** end, const float3& p0, const float3& p1)
+{
+	float cx[CULL_BATCH_SIZE];
+	float cy[CULL_BATCH_SIZE];
+	float cz[CULL_BATCH_SIZE];
+	float cr[CULL_BATCH_SIZE];
+	bool touch[CULL_BATCH_SIZE];
+
+	// objects are only ever moved towards the front, after being read
+	T** out = begin;
+
+	for (T** batch = begin; batch < end; batch += CULL_BATCH_SIZE) {
+		const int n = std::min(int(end - batch), CULL_BATCH_SIZE);
+
+		for (int i = 0; i < n; i++) {
+			float3 c;
+			float r;
+
+			if (GetCullingSphere(batch[i], c, r)) {
+				// margin for rounding and slightly denormalized direction
+				// vectors in the transform matrices of flying units
+				r = r * 1.01f + 1.0f;
+			} else {
+				// can't bound this one, so it always passes
+				c = p0;
+				r = 1.0f;
+			}
+
+			cx[i] = c.x;
+			cy[i] = c.y;
+			cz[i] = c.z;
+			cr[i] = r;
+		}
+
+		CCollisionHandler::TouchSpheres(p0, p1, cx, cy, cz, cr, n, touch);
+
+		for (int i = 0; i < n; i++) {
+			if (touch[i]) {
+				*(out++) = batch[i];
+			}
+		}
+	}
+
+	return out;
+}
+
+CUnit** CCollisionHandler::CullHitCandidates(CUnit** begin, CUnit** end, const float3& p0, const float3& p1)
+{
+	return CullCandidates(begin, end, p0, p1);
+}
+
+CFeature** CCollisionHandler::CullHitCandidates(CFeature** begin, CFeature** end, const float3& p0, const float3& p1)
+{
+	return CullCandidates(begin, end, p0, p1);
+}
+
+
+void CCollisionHandler::TouchSpheres(
+	const float3& p0, const float3& p1,
+	const float* cx, const float* cy, const float* cz, const float* r,
+	int n, bool* touch)
+{
+	// closest point to each center is p0 + d * t, t clamped to [0, 1]
+	const float3 d = p1 - p0;
+	const float dd = d.dot(d);
+	const float invDD = (dd > 0.0f)? (1.0f / dd): 0.0f;
+
+	int i = 0;
+
+#ifndef DEDICATED_NOSSE
+	const __m128 px = _mm_set1_ps(p0.x);
+	const __m128 py = _mm_set1_ps(p0.y);
+	const __m128 pz = _mm_set1_ps(p0.z);
+	const __m128 dx = _mm_set1_ps(d.x);
+	const __m128 dy = _mm_set1_ps(d.y);
+	const __m128 dz = _mm_set1_ps(d.z);
+	const __m128 idd = _mm_set1_ps(invDD);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (; i + 4 <= n; i += 4) {
+		const __m128 wx = _mm_sub_ps(_mm_loadu_ps(cx + i), px);
+		const __m128 wy = _mm_sub_ps(_mm_loadu_ps(cy + i), py);
+		const __m128 wz = _mm_sub_ps(_mm_loadu_ps(cz + i), pz);
+		const __m128 rr = _mm_loadu_ps(r + i);
+
+		__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, dx), _mm_mul_ps(wy, dy)), _mm_mul_ps(wz, dz));
+		t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t, idd), zero), one);
+
+		const __m128 ex = _mm_sub_ps(wx, _mm_mul_ps(t, dx));
+		const __m128 ey = _mm_sub_ps(wy, _mm_mul_ps(t, dy));
+		const __m128 ez = _mm_sub_ps(wz, _mm_mul_ps(t, dz));
+		const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+
+		// "not greater" lets NaNs through, culling must never drop a hit
+		const int mask = _mm_movemask_ps(_mm_cmpngt_ps(distSq, _mm_mul_ps(rr, rr)));
+
+		touch[i    ] = ((mask & 1) != 0);
+		touch[i + 1] = ((mask & 2) != 0);
+		touch[i + 2] = ((mask & 4) != 0);
+		touch[i + 3] = ((mask & 8) != 0);
+	}
+#endif
+
+	for (; i < n; i++) {
+		const float3 w(cx[i] - p0.x, cy[i] - p0.y, cz[i] - p0.z);
+		const float t = std::min(std::max(w.dot(d) * invDD, 0.0f), 1.0f);
+		const float3 e = w - d * t;
+
+		touch[i] = !(e.SqLength() > r[i] * r[i]);
+	}
+}
 
 
 
@@ -45,6 +45,27 @@ class CCollisionHandler {
 		static bool Intersect(const CUnit*, const float3&, const float3&, CollisionQuery*);
 		static bool Intersect(const CFeature*, const float3&, const float3&, CollisionQuery*);
 
+		/**
+		 * Drops the objects in [begin, end) whose collision volume the segment
+		 * from p0 to p1 can not touch, keeping the others in order, and returns
+		 * the new end. Meant to run on the candidates of a ray or projectile
+		 * before DetectHit() / Intersect() are called on them: it only compares
+		 * the segment against conservative bounding spheres (in batches, with
+		 * SSE) and never rejects a hit, so the exact per-object tests, and with
+		 * them all CollisionQuery results, stay the same.
+		 */
+		static CUnit** CullHitCandidates(CUnit** begin, CUnit** end, const float3& p0, const float3& p1);
+		static CFeature** CullHitCandidates(CFeature** begin, CFeature** end, const float3& p0, const float3& p1);
+
+		/**
+		 * Segment versus sphere test for a batch of n spheres in SoA layout
+		 * (centers cx, cy, cz and radii r). touch[i] is set unless the segment
+		 * from p0 to p1 certainly misses sphere i.
+		 */
+		static void TouchSpheres(const float3& p0, const float3& p1,
+			const float* cx, const float* cy, const float* cz, const float* r,
+			int n, bool* touch);
+
 	private:
 		static bool Collision(const CUnit*, const float3&);
 		static bool Collision(const CFeature*, const float3&);
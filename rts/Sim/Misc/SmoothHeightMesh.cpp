@@ -10,7 +10,6 @@
 #include "Map/Ground.h"
 #include "Map/ReadMap.h"
 #include "LogOutput.h"
-#include "TimeProfiler.h"
 
 using std::vector;
 
@@ -92,7 +91,6 @@ float SmoothHeightMesh::SetMaxHeight(int index, float h)
 
 void  SmoothHeightMesh::MakeSmoothMesh(const CGround *ground)
 {
-	ScopedOnceTimer timer("Calculating smooth mesh");
 	if (!mesh) {
 		size_t size = (size_t)((this->maxx+1) * (this->maxy + 1));
 		mesh = new float[size];
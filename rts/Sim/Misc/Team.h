@@ -11,6 +11,7 @@
 
 #include "TeamBase.h"
 #include "TeamStatistics.h"
+#include "TeamStatHistory.h"
 #include "Sim/Units/UnitSet.h"
 #include "ExternalAI/SkirmishAIKey.h"
 
@@ -103,7 +104,7 @@ public:
 	int lastStatSave;
 	/// number of units with commander tag in team, if it reaches zero with cmd ends the team dies
 	int numCommanders;
-	std::list<Statistics> statHistory;
+	CTeamStatHistory statHistory;
 	void CommanderDied(CUnit* commander);
 	void LeftLineage(CUnit* unit);
 
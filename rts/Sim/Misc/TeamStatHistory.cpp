@@ -0,0 +1,195 @@
+#include "TeamStatHistory.h"
+
+#include <cstring>
+#include <algorithm>
+#include <boost/static_assert.hpp>
+
+// TeamStatistics is accessed as an array of NUM_FIELDS 32 bit words
+BOOST_STATIC_ASSERT(sizeof(TeamStatistics) == CTeamStatHistory::NUM_FIELDS * sizeof(boost::uint32_t));
+
+
+static void WriteVarInt(std::vector<boost::uint8_t>& data, boost::uint32_t v)
+{
+	while (v >= 0x80) {
+		data.push_back((v & 0x7F) | 0x80);
+		v >>= 7;
+	}
+	data.push_back(v);
+}
+
+/// @return false if data ends before the number does
+static bool ReadVarInt(const boost::uint8_t*& data, const boost::uint8_t* end, boost::uint32_t& v)
+{
+	v = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (data == end) {
+			return false;
+		}
+		const boost::uint8_t b = *(data++);
+		v |= boost::uint32_t(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/// difference of two ints, mapped so that small negative values stay small
+static boost::uint32_t EncodeDelta(bool isInt, boost::uint32_t cur, boost::uint32_t prev)
+{
+	if (isInt) {
+		const boost::int32_t d = boost::int32_t(cur - prev);
+		return (boost::uint32_t(d) << 1) ^ boost::uint32_t(d >> 31);
+	}
+	// growing floats mostly keep sign, exponent and the high mantissa bits
+	return cur ^ prev;
+}
+
+static boost::uint32_t DecodeDelta(bool isInt, boost::uint32_t delta, boost::uint32_t prev)
+{
+	if (isInt) {
+		const boost::uint32_t d = (delta >> 1) ^ (0 - (delta & 1));
+		return prev + d;
+	}
+	return delta ^ prev;
+}
+
+
+
+const size_t CTeamStatHistory::CHUNK_SIZE;
+
+
+CTeamStatHistory::CTeamStatHistory(): numRecords(0)
+{
+}
+
+CTeamStatHistory::CTeamStatHistory(const CTeamStatHistory& h): numRecords(0)
+{
+	*this = h;
+}
+
+CTeamStatHistory::~CTeamStatHistory()
+{
+	clear();
+}
+
+CTeamStatHistory& CTeamStatHistory::operator=(const CTeamStatHistory& h)
+{
+	if (this != &h) {
+		clear();
+		for (size_t c = 0; c < h.chunks.size(); ++c) {
+			chunks.push_back(new Chunk(*h.chunks[c]));
+		}
+		numRecords = h.numRecords;
+	}
+	return *this;
+}
+
+
+void CTeamStatHistory::push_back(const TeamStatistics& stats)
+{
+	const size_t offset = numRecords % CHUNK_SIZE;
+
+	if (offset == 0) {
+		chunks.push_back(new Chunk());
+	}
+
+	boost::uint32_t words[NUM_FIELDS];
+	memcpy(words, &stats, sizeof(words));
+
+	Chunk* chunk = chunks.back();
+	for (int f = 0; f < NUM_FIELDS; ++f) {
+		chunk->columns[f][offset] = words[f];
+	}
+	++numRecords;
+}
+
+void CTeamStatHistory::clear()
+{
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		delete chunks[c];
+	}
+	chunks.clear();
+	numRecords = 0;
+}
+
+
+TeamStatistics CTeamStatHistory::operator[](size_t i) const
+{
+	const Chunk* chunk = chunks[i / CHUNK_SIZE];
+	const size_t offset = i % CHUNK_SIZE;
+
+	boost::uint32_t words[NUM_FIELDS];
+	for (int f = 0; f < NUM_FIELDS; ++f) {
+		words[f] = chunk->columns[f][offset];
+	}
+
+	TeamStatistics stats;
+	memcpy(&stats, words, sizeof(words));
+	return stats;
+}
+
+float CTeamStatHistory::GetFloat(Field field, size_t i) const
+{
+	float v;
+	memcpy(&v, &chunks[i / CHUNK_SIZE]->columns[field][i % CHUNK_SIZE], sizeof(v));
+	return v;
+}
+
+int CTeamStatHistory::GetInt(Field field, size_t i) const
+{
+	return boost::int32_t(chunks[i / CHUNK_SIZE]->columns[field][i % CHUNK_SIZE]);
+}
+
+
+void CTeamStatHistory::Serialize(std::vector<boost::uint8_t>& data) const
+{
+	WriteVarInt(data, numRecords);
+
+	for (int f = 0; f < NUM_FIELDS; ++f) {
+		const bool isInt = (f >= FIRST_INT_FIELD);
+		boost::uint32_t prev = 0;
+
+		for (size_t i = 0; i < numRecords; ++i) {
+			const boost::uint32_t cur = chunks[i / CHUNK_SIZE]->columns[f][i % CHUNK_SIZE];
+			WriteVarInt(data, EncodeDelta(isInt, cur, prev));
+			prev = cur;
+		}
+	}
+}
+
+size_t CTeamStatHistory::Deserialize(const boost::uint8_t* data, size_t size)
+{
+	const boost::uint8_t* pos = data;
+	const boost::uint8_t* end = data + size;
+
+	clear();
+
+	boost::uint32_t count;
+	// every record takes at least one byte per field
+	if (!ReadVarInt(pos, end, count) || count > size / NUM_FIELDS) {
+		return 0;
+	}
+
+	const TeamStatistics empty = TeamStatistics();
+	for (boost::uint32_t i = 0; i < count; ++i) {
+		push_back(empty);
+	}
+
+	for (int f = 0; f < NUM_FIELDS; ++f) {
+		const bool isInt = (f >= FIRST_INT_FIELD);
+		boost::uint32_t prev = 0;
+
+		for (size_t i = 0; i < numRecords; ++i) {
+			boost::uint32_t delta;
+			if (!ReadVarInt(pos, end, delta)) {
+				clear();
+				return 0;
+			}
+			prev = DecodeDelta(isInt, delta, prev);
+			chunks[i / CHUNK_SIZE]->columns[f][i % CHUNK_SIZE] = prev;
+		}
+	}
+
+	return pos - data;
+}
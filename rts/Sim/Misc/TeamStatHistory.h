@@ -0,0 +1,83 @@
+#ifndef TEAMSTATHISTORY_H
+#define TEAMSTATHISTORY_H
+
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+#include "TeamStatistics.h"
+
+/**
+ * @brief history of the TeamStatistics of one team
+ *
+ * Stored column-wise (one array per TeamStatistics member) in fixed size
+ * chunks, so appending is O(1) without ever moving the older records, and
+ * any record, or a single member of it, can be read by index.
+ *
+ * Serialize() writes each column delta encoded (integer members as the
+ * difference to the previous record, floats as the XOR of their bits) in
+ * variable length integers; as the statistics are mostly growing totals this
+ * is a fraction of the size of the raw records.
+ */
+class CTeamStatHistory
+{
+public:
+	/// the members of TeamStatistics, in declaration order
+	enum Field {
+		METAL_USED,     ENERGY_USED,
+		METAL_PRODUCED, ENERGY_PRODUCED,
+		METAL_EXCESS,   ENERGY_EXCESS,
+		METAL_RECEIVED, ENERGY_RECEIVED,
+		METAL_SENT,     ENERGY_SENT,
+		DAMAGE_DEALT,   DAMAGE_RECEIVED,
+		UNITS_PRODUCED,
+		UNITS_DIED,
+		UNITS_RECEIVED,
+		UNITS_SENT,
+		UNITS_CAPTURED,
+		UNITS_OUT_CAPTURED,
+		UNITS_KILLED,
+		NUM_FIELDS,
+		/// the fields from here on are ints, the ones before floats
+		FIRST_INT_FIELD = UNITS_PRODUCED
+	};
+
+	static const size_t CHUNK_SIZE = 256;
+
+	CTeamStatHistory();
+	CTeamStatHistory(const CTeamStatHistory& h);
+	~CTeamStatHistory();
+	CTeamStatHistory& operator=(const CTeamStatHistory& h);
+
+	void push_back(const TeamStatistics& stats);
+	void clear();
+
+	size_t size() const { return numRecords; }
+	bool empty() const { return (numRecords == 0); }
+
+	TeamStatistics operator[](size_t i) const;
+	TeamStatistics back() const { return (*this)[numRecords - 1]; }
+
+	/// field of record i, without assembling the whole record; i < size()
+	float GetFloat(Field field, size_t i) const;
+	/// see GetFloat(), for the fields from FIRST_INT_FIELD on
+	int   GetInt(Field field, size_t i) const;
+
+	/// appends the delta encoded history to data
+	void Serialize(std::vector<boost::uint8_t>& data) const;
+	/**
+	 * @brief replaces the history with one written by Serialize()
+	 * @return number of bytes read, 0 if data is truncated or corrupt
+	 */
+	size_t Deserialize(const boost::uint8_t* data, size_t size);
+
+private:
+	struct Chunk {
+		boost::uint32_t columns[NUM_FIELDS][CHUNK_SIZE];
+	};
+
+	std::vector<Chunk*> chunks;
+	size_t numRecords;
+};
+
+#endif // TEAMSTATHISTORY_H
@@ -9,6 +9,8 @@
 #include <boost/version.hpp>
 
 #include "LogOutput.h"
+#include "TimeProfiler.h"
+#include "Util.h"
 #include "Rendering/GL/myGL.h"
 #include "FileSystem/FileHandler.h"
 #include "ConfigHandler.h"
@@ -201,6 +203,9 @@ void CPathEstimator::InitBlocks() {
 
 void CPathEstimator::CalcOffsetsAndPathCosts(int thread) {
 	streflop_init<streflop::Simple>();
+	if (thread > 0) {
+		profiler.SetThreadName("Path estimator " + IntToString(thread));
+	}
 	// NOTE: EstimatePathCosts() [B] is temporally dependent on CalculateBlockOffsets() [A],
 	// A must be completely finished before B_i can be safely called. This means we cannot
 	// let thread i execute (A_i, B_i), but instead have to split the work such that every
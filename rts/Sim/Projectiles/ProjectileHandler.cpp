@@ -889,6 +889,9 @@ void CProjectileHandler::CheckUnitCollisions(
 {
 	CollisionQuery q;
 
+	// drop the units this projectile can't reach before the exact tests
+	endUnit = CCollisionHandler::CullHitCandidates(&tempUnits[0], endUnit, ppos0, ppos1);
+
 	for (CUnit** ui = &tempUnits[0]; ui != endUnit; ++ui) {
 		CUnit* unit = *ui;
 
@@ -946,6 +949,8 @@ void CProjectileHandler::CheckFeatureCollisions(
 		return;
 	}
 
+	endFeature = CCollisionHandler::CullHitCandidates(&tempFeatures[0], endFeature, ppos0, ppos1);
+
 	for (CFeature** fi = &tempFeatures[0]; fi != endFeature; ++fi) {
 		CFeature* feature = *fi;
 
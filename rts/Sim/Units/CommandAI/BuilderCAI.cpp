@@ -64,9 +64,9 @@ CR_REG_METADATA(CBuilderCAI , (
 				));
 
 // not adding to members, should repopulate itself
-CUnitSet CBuilderCAI::reclaimers;
-CUnitSet CBuilderCAI::featureReclaimers;
-CUnitSet CBuilderCAI::resurrecters;
+CBuilderTargets CBuilderCAI::reclaimers;
+CBuilderTargets CBuilderCAI::featureReclaimers;
+CBuilderTargets CBuilderCAI::resurrecters;
 
 
 CBuilderCAI::CBuilderCAI():
@@ -825,7 +825,7 @@ void CBuilderCAI::ExecuteReclaim(Command& c)
 					FinishCommand();
 					RemoveUnitFromFeatureReclaimers(owner);
 				} else {
-					AddUnitToFeatureReclaimers(owner);
+					AddUnitToFeatureReclaimers(owner, feature->id);
 				}
 			} else {
 				StopMove();
@@ -854,7 +854,7 @@ void CBuilderCAI::ExecuteReclaim(Command& c)
 					StopMove();
 					FinishCommand();
 				} else {
-					AddUnitToReclaimers(owner);
+					AddUnitToReclaimers(owner, unit->id);
 				}
 			} else {
 				RemoveUnitFromReclaimers(owner);
@@ -923,7 +923,7 @@ void CBuilderCAI::ExecuteResurrect(Command& c)
 					FinishCommand();
 				}
 				else {
-					AddUnitToResurrecters(owner);
+					AddUnitToResurrecters(owner, feature->id);
 				}
 			} else {
 				RemoveUnitFromResurrecters(owner);
@@ -1135,126 +1135,146 @@ int CBuilderCAI::GetDefaultCmd(const CUnit* pointed, const CFeature* feature)
 }
 
 
-void CBuilderCAI::AddUnitToReclaimers(CUnit* unit)
+void CBuilderTargets::Add(CUnit* builder, int targetId)
 {
-	reclaimers.insert(unit);
+	SPRING_HASH_MAP<int, int>::iterator ti = targets.find(builder->id);
+	if (ti != targets.end()) {
+		if (ti->second == targetId) {
+			return;
+		}
+		Remove(builder);
+	}
+	targets[builder->id] = targetId;
+	builders[targetId].insert(builder);
+}
+
+
+void CBuilderTargets::Remove(CUnit* builder)
+{
+	SPRING_HASH_MAP<int, int>::iterator ti = targets.find(builder->id);
+	if (ti == targets.end()) {
+		return;
+	}
+	SPRING_HASH_MAP<int, CUnitSet>::iterator bi = builders.find(ti->second);
+	if (bi != builders.end()) {
+		bi->second.erase(builder);
+		if (bi->second.empty()) {
+			builders.erase(bi);
+		}
+	}
+	targets.erase(ti);
+}
+
+
+const CUnitSet* CBuilderTargets::GetBuilders(int targetId) const
+{
+	SPRING_HASH_MAP<int, CUnitSet>::const_iterator bi = builders.find(targetId);
+	if (bi == builders.end()) {
+		return NULL;
+	}
+	return &bi->second;
+}
+
+
+void CBuilderCAI::AddUnitToReclaimers(CUnit* unit, int targetId)
+{
+	reclaimers.Add(unit, targetId);
 }
 
 
 void CBuilderCAI::RemoveUnitFromReclaimers(CUnit* unit)
 {
-	reclaimers.erase(unit);
+	reclaimers.Remove(unit);
 }
 
 
-void CBuilderCAI::AddUnitToFeatureReclaimers(CUnit* unit)
+void CBuilderCAI::AddUnitToFeatureReclaimers(CUnit* unit, int targetId)
 {
-	featureReclaimers.insert(unit);
+	featureReclaimers.Add(unit, targetId);
 }
 
 void CBuilderCAI::RemoveUnitFromFeatureReclaimers(CUnit* unit)
 {
-	featureReclaimers.erase(unit);
+	featureReclaimers.Remove(unit);
 }
 
-void CBuilderCAI::AddUnitToResurrecters(CUnit* unit)
+void CBuilderCAI::AddUnitToResurrecters(CUnit* unit, int targetId)
 {
-	resurrecters.insert(unit);
+	resurrecters.Add(unit, targetId);
 }
 
 void CBuilderCAI::RemoveUnitFromResurrecters(CUnit* unit)
 {
-	resurrecters.erase(unit);
+	resurrecters.Remove(unit);
 }
 
 
-/** check if a unit is being reclaimed by a friendly con.
+/** check if the current command of a con still targets cmdTargetId
+(a unit id, or a feature id offset by uh->MaxUnits()) */
+static bool IsWorkingOn(const CUnit* builder, int cmdId, int cmdTargetId)
+{
+	const CCommandQueue& q = builder->commandAI->commandQue;
+	if (q.empty()) {
+		return false;
+	}
+	const Command& c = q.front();
+	if (c.id != cmdId) {
+		return false;
+	}
+	if (c.params.size() != 1 && (cmdId != CMD_RECLAIM || c.params.size() != 5)) {
+		return false;
+	}
+	return ((int)c.params[0] == cmdTargetId);
+}
+
 
-we assume that there won't be a lot of reclaimers because performance would suck
-if there were. ideally reclaimers should be assigned on a per-unit basis, but
-this requires tracking of deaths, which albeit already done isn't exactly simple
-to follow.
+/** check if any (allied) con is working on a target.
 
-TODO easy: store reclaiming units per allyteam
-TODO harder: update reclaimers as they start/finish reclaims and/or die */
-bool CBuilderCAI::IsUnitBeingReclaimed(CUnit* unit, CUnit *friendUnit)
+only the cons registered for this target are looked at, and those that moved
+on to another command since are dropped from the index */
+static bool IsTargetTaken(CBuilderTargets& index, int targetId, int cmdId, int cmdTargetId, CUnit* friendUnit)
 {
+	const CUnitSet* builders = index.GetBuilders(targetId);
+	if (builders == NULL) {
+		return false;
+	}
+
 	bool retval = false;
 	std::list<CUnit*> rm;
 
-	for (CUnitSet::iterator it = reclaimers.begin(); it != reclaimers.end(); ++it) {
-		if ((*it)->commandAI->commandQue.empty()) {
-			rm.push_back(*it);
-			continue;
-		}
-		const Command& c = (*it)->commandAI->commandQue.front();
-		if (c.id != CMD_RECLAIM || (c.params.size() != 1 && c.params.size() != 5)) {
+	for (CUnitSet::const_iterator it = builders->begin(); it != builders->end(); ++it) {
+		if (!IsWorkingOn(*it, cmdId, cmdTargetId)) {
 			rm.push_back(*it);
 			continue;
 		}
-		const int cmdUnitId = (int)c.params[0];
-		if (cmdUnitId == unit->id && (!friendUnit || teamHandler->Ally(friendUnit->allyteam, (*it)->allyteam))) {
+		if (!friendUnit || teamHandler->Ally(friendUnit->allyteam, (*it)->allyteam)) {
 			retval = true;
 			break;
 		}
 	}
+	// invalidates builders
 	for (std::list<CUnit*>::iterator it = rm.begin(); it != rm.end(); ++it)
-		RemoveUnitFromReclaimers(*it);
+		index.Remove(*it);
 	return retval;
 }
 
 
-bool CBuilderCAI::IsFeatureBeingReclaimed(int featureId, CUnit *friendUnit)
+/// check if a unit is being reclaimed by a friendly con
+bool CBuilderCAI::IsUnitBeingReclaimed(CUnit* unit, CUnit *friendUnit)
 {
-	bool retval = false;
-	std::list<CUnit*> rm;
+	return IsTargetTaken(reclaimers, unit->id, CMD_RECLAIM, unit->id, friendUnit);
+}
 
-	for (CUnitSet::iterator it = featureReclaimers.begin(); it != featureReclaimers.end(); ++it) {
-		if ((*it)->commandAI->commandQue.empty()) {
-			rm.push_back(*it);
-			continue;
-		}
-		const Command& c = (*it)->commandAI->commandQue.front();
-		if (c.id != CMD_RECLAIM || (c.params.size() != 1 && c.params.size() != 5)) {
-			rm.push_back(*it);
-			continue;
-		}
-		const int cmdFeatureId = (int)c.params[0];
-		if (cmdFeatureId-uh->MaxUnits() == featureId && (!friendUnit || teamHandler->Ally(friendUnit->allyteam, (*it)->allyteam))) {
-			retval = true;
-			break;
-		}
-	}
-	for (std::list<CUnit*>::iterator it = rm.begin(); it != rm.end(); ++it)
-		RemoveUnitFromFeatureReclaimers(*it);
-	return retval;
+
+bool CBuilderCAI::IsFeatureBeingReclaimed(int featureId, CUnit *friendUnit)
+{
+	return IsTargetTaken(featureReclaimers, featureId, CMD_RECLAIM, featureId + uh->MaxUnits(), friendUnit);
 }
 
 
 bool CBuilderCAI::IsFeatureBeingResurrected(int featureId, CUnit *friendUnit)
 {
-	bool retval = false;
-	std::list<CUnit*> rm;
-
-	for (CUnitSet::iterator it = resurrecters.begin(); it != resurrecters.end(); ++it) {
-		if ((*it)->commandAI->commandQue.empty()) {
-			rm.push_back(*it);
-			continue;
-		}
-		const Command& c = (*it)->commandAI->commandQue.front();
-		if (c.id != CMD_RESURRECT || c.params.size() != 1) {
-			rm.push_back(*it);
-			continue;
-		}
-		const int cmdFeatureId = (int)c.params[0];
-		if (cmdFeatureId-uh->MaxUnits() == featureId && (!friendUnit || teamHandler->Ally(friendUnit->allyteam, (*it)->allyteam))) {
-			retval = true;
-			break;
-		}
-	}
-	for (std::list<CUnit*>::iterator it = rm.begin(); it != rm.end(); ++it)
-		RemoveUnitFromResurrecters(*it);
-	return retval;
+	return IsTargetTaken(resurrecters, featureId, CMD_RESURRECT, featureId + uh->MaxUnits(), friendUnit);
 }
 
 
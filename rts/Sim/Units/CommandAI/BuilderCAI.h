@@ -6,6 +6,28 @@
 #include "Sim/Units/UnitDef.h"
 #include "Sim/Units/UnitSet.h"
 #include "Sim/Objects/SolidObject.h"
+#include "SpringHashMap.h"
+
+/**
+ * Index from reclaim/resurrect targets to the cons working on them, so
+ * checking whether a target is taken only looks at the cons on that target
+ * instead of at every con in the game.
+ * Entries are not updated when a con's command queue changes under it;
+ * callers validate the cons they get back and Remove() the stale ones.
+ */
+class CBuilderTargets
+{
+public:
+	/// builder works on targetId now, replaces its previous target
+	void Add(CUnit* builder, int targetId);
+	void Remove(CUnit* builder);
+	/// @return NULL if nobody works on targetId
+	const CUnitSet* GetBuilders(int targetId) const;
+
+private:
+	SPRING_HASH_MAP<int, CUnitSet> builders; ///< target id -> builders
+	SPRING_HASH_MAP<int, int> targets;       ///< builder unit id -> target id
+};
 
 class CBuilderCAI :
 	public CMobileCAI
@@ -85,9 +107,9 @@ public:
 	}
 
 public:
-	static CUnitSet reclaimers;
-	static CUnitSet featureReclaimers;
-	static CUnitSet resurrecters;
+	static CBuilderTargets reclaimers;
+	static CBuilderTargets featureReclaimers;
+	static CBuilderTargets resurrecters;
 
 private:
 
@@ -97,15 +119,15 @@ private:
 	void ReclaimFeature(CFeature* f);
 
 	// fix for patrolling cons repairing/resurrecting stuff that's being reclaimed
-	static void AddUnitToReclaimers(CUnit*);
+	static void AddUnitToReclaimers(CUnit*, int targetId);
 	static void RemoveUnitFromReclaimers(CUnit*);
 
 	// fix for cons wandering away from their target circle
-	static void AddUnitToFeatureReclaimers(CUnit*);
+	static void AddUnitToFeatureReclaimers(CUnit*, int targetId);
 	static void RemoveUnitFromFeatureReclaimers(CUnit*);
 
 	// fix for patrolling cons reclaiming stuff that is being resurrected
-	static void AddUnitToResurrecters(CUnit*);
+	static void AddUnitToResurrecters(CUnit*, int targetId);
 	static void RemoveUnitFromResurrecters(CUnit*);
 public:
 	static bool IsUnitBeingReclaimed(CUnit *unit, CUnit *friendUnit=NULL);
@@ -6,6 +6,23 @@
 #include "Command.h"
 
 
+namespace creg
+{
+	// serialized exactly like the std::vector<float> it replaced,
+	// so older savegames still load
+	template<>
+	inline bool IsContiguous(const CommandParams*) { return true; }
+
+	template<>
+	struct DeduceType<CommandParams> {
+		boost::shared_ptr<IType> Get() {
+			DeduceType<float> elemtype;
+			return boost::shared_ptr<IType>(new DynamicArrayType<CommandParams>(elemtype.Get()));
+		}
+	};
+};
+
+
 CR_BIND(Command, );
 CR_REG_METADATA(Command, (
 				CR_MEMBER(id),
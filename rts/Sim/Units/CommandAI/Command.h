@@ -3,6 +3,8 @@
 
 #include <string>
 #include <vector>
+#include <stdexcept>
+#include <algorithm>
 #include <limits.h> // for INT_MAX
 #include "creg/creg_cond.h"
 
@@ -90,6 +92,107 @@
 #define INTERNAL_ORDER  (DONT_REPEAT)
 
 
+/**
+ * Parameter list of a Command, with the subset of the std::vector interface
+ * the engine and the AIs use.
+ * Up to INLINE_SIZE parameters (which covers nearly every order: positions,
+ * build orders, area commands, unit targets) are stored in the Command
+ * itself, so creating, copying and queueing commands does not touch the heap.
+ * Longer lists move to a heap block that is kept when the list is cleared.
+ */
+class CommandParams
+{
+public:
+	typedef float        value_type;
+	typedef float&       reference;
+	typedef const float& const_reference;
+	typedef float*       iterator;
+	typedef const float* const_iterator;
+	typedef size_t       size_type;
+
+	static const size_type INLINE_SIZE = 4;
+
+	CommandParams(): numParams(0), maxParams(INLINE_SIZE), heapData(NULL) {}
+	CommandParams(const CommandParams& p): numParams(0), maxParams(INLINE_SIZE), heapData(NULL) {
+		assign(p.begin(), p.end());
+	}
+	~CommandParams() { delete[] heapData; }
+
+	CommandParams& operator=(const CommandParams& p) {
+		if (this != &p) {
+			assign(p.begin(), p.end());
+		}
+		return *this;
+	}
+
+	void assign(const_iterator first, const_iterator last) {
+		const size_type n = last - first;
+		numParams = 0;
+		reserve(n);
+		std::copy(first, last, begin());
+		numParams = n;
+	}
+
+	size_type size() const { return numParams; }
+	size_type capacity() const { return maxParams; }
+	bool empty() const { return (numParams == 0); }
+	void clear() { numParams = 0; }
+
+	iterator       begin()       { return (heapData != NULL) ? heapData : inlineData; }
+	const_iterator begin() const { return (heapData != NULL) ? heapData : inlineData; }
+	iterator       end()         { return begin() + numParams; }
+	const_iterator end()   const { return begin() + numParams; }
+
+	float&       operator[](size_type i)       { return begin()[i]; }
+	const float& operator[](size_type i) const { return begin()[i]; }
+	float&       at(size_type i)       { CheckRange(i); return begin()[i]; }
+	const float& at(size_type i) const { CheckRange(i); return begin()[i]; }
+
+	float&       front()       { return begin()[0]; }
+	const float& front() const { return begin()[0]; }
+	float&       back()        { return begin()[numParams - 1]; }
+	const float& back()  const { return begin()[numParams - 1]; }
+
+	void push_back(float f) {
+		if (numParams == maxParams) {
+			reserve(maxParams * 2);
+		}
+		begin()[numParams++] = f;
+	}
+	void pop_back() { --numParams; }
+
+	void resize(size_type n, float f = 0.0f) {
+		reserve(n);
+		std::fill(begin() + numParams, begin() + n, f);
+		numParams = n;
+	}
+
+	void reserve(size_type n) {
+		if (n <= maxParams) {
+			return;
+		}
+		float* newData = new float[n];
+		std::copy(begin(), end(), newData);
+		delete[] heapData;
+		heapData = newData;
+		maxParams = n;
+	}
+
+private:
+	void CheckRange(size_type i) const {
+		if (i >= numParams) {
+			throw std::out_of_range("CommandParams::at");
+		}
+	}
+
+	unsigned int numParams;
+	unsigned int maxParams;
+	/// NULL while the parameters fit into inlineData
+	float* heapData;
+	float inlineData[INLINE_SIZE];
+};
+
+
 struct Command
 {
 private:
@@ -106,7 +209,7 @@ public:
 	/// option bits
 	unsigned char options;
 	/// command parameters
-	std::vector<float> params;
+	CommandParams params;
 	/// adds a value to this commands parameter list
 	void AddParam(float par) {
 		params.push_back(par);
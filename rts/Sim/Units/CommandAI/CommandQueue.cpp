@@ -0,0 +1,46 @@
+#include "StdAfx.h"
+// CommandQueue.cpp: implementation of the CCommandQueuePool class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <new>
+#include "mmgr.h"
+
+#include "CommandQueue.h"
+
+
+void* CCommandQueuePool::freeLists[NUM_SIZE_CLASSES];
+
+
+void* CCommandQueuePool::Alloc(size_t bytes)
+{
+	if (bytes == 0 || bytes > MAX_POOLED_SIZE) {
+		return ::operator new(bytes);
+	}
+
+	const size_t sizeClass = (bytes - 1) / SIZE_CLASS_STEP;
+	void* p = freeLists[sizeClass];
+	if (p != NULL) {
+		freeLists[sizeClass] = *(void**)p;
+		return p;
+	}
+	return ::operator new((sizeClass + 1) * SIZE_CLASS_STEP);
+}
+
+
+void CCommandQueuePool::Free(void* p, size_t bytes)
+{
+	if (p == NULL) {
+		return;
+	}
+	if (bytes == 0 || bytes > MAX_POOLED_SIZE) {
+		::operator delete(p);
+		return;
+	}
+
+	// blocks are never returned to the heap, the pool only
+	// grows up to the peak number of queued commands
+	const size_t sizeClass = (bytes - 1) / SIZE_CLASS_STEP;
+	*(void**)p = freeLists[sizeClass];
+	freeLists[sizeClass] = p;
+}
@@ -7,8 +7,55 @@
 #define GML_STDMUTEX_LOCK(x)
 #endif
 #include <deque>
+#include <memory>
 #include "Command.h"
 
+
+#ifndef BUILDING_AI
+/**
+ * Recycles the memory blocks of the engine's command queues.
+ * Every unit owns at least one queue and queues are created, filled and
+ * emptied all the time, but std::deque only ever asks for a few distinct
+ * block sizes (its element buffers and its node map). Freed blocks are kept
+ * on a free-list per size class and handed out again instead of going back
+ * to the heap.
+ * Only to be used from the simulation thread.
+ */
+class CCommandQueuePool {
+	public:
+		static void* Alloc(size_t bytes);
+		static void  Free(void* p, size_t bytes);
+
+	private:
+		static const size_t SIZE_CLASS_STEP = 16;
+		static const size_t MAX_POOLED_SIZE = 1024;
+		static const size_t NUM_SIZE_CLASSES = MAX_POOLED_SIZE / SIZE_CLASS_STEP;
+
+		static void* freeLists[NUM_SIZE_CLASSES];
+};
+
+/// std::allocator that takes its memory from CCommandQueuePool
+template<typename T>
+class CommandQueueAllocator : public std::allocator<T> {
+	public:
+		template<typename U>
+		struct rebind { typedef CommandQueueAllocator<U> other; };
+
+		CommandQueueAllocator() {}
+		CommandQueueAllocator(const CommandQueueAllocator&): std::allocator<T>() {}
+		template<typename U>
+		CommandQueueAllocator(const CommandQueueAllocator<U>&) {}
+
+		T* allocate(size_t n, const void* = 0) {
+			return static_cast<T*>(CCommandQueuePool::Alloc(n * sizeof(T)));
+		}
+		void deallocate(T* p, size_t n) {
+			CCommandQueuePool::Free(p, n * sizeof(T));
+		}
+};
+#endif // BUILDING_AI
+
+
 // A wrapper class for  std::deque<Command>  to keep track of commands
 
 
@@ -34,7 +81,11 @@ class CCommandQueue {
 		/// limit to a float's integer range
 		static const int maxTagValue = (1 << 24); // 16777216
 
+#ifndef BUILDING_AI
+		typedef std::deque<Command, CommandQueueAllocator<Command> > basis;
+#else
 		typedef std::deque<Command> basis;
+#endif
 
 		typedef basis::size_type              size_type;
 		typedef basis::iterator               iterator;
@@ -114,7 +165,7 @@ class CCommandQueue {
 		inline void SetQueueType(QueueType type) { queueType = type; }
 
 	private:
-		std::deque<Command> queue;
+		basis queue;
 		QueueType queueType;
 		int tagCounter;
 };
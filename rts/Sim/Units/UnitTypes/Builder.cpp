@@ -328,17 +328,20 @@ void CBuilder::Update()
 						u->health*=0.05f;
 						u->lineage = this->lineage;
 
-						CBuilderCAI *cai = (CBuilderCAI *)commandAI;
-						for (CUnitSet::iterator it = cai->resurrecters.begin(); it != cai->resurrecters.end(); ++it) {
-							CBuilder *bld = (CBuilder *)*it;
-							if (bld->commandAI->commandQue.empty())
-								continue;
-							const Command& c = bld->commandAI->commandQue.front();
-							if (c.id != CMD_RESURRECT || c.params.size() != 1)
-								continue;
-							const int cmdFeatureId = (int)c.params[0];
-							if (cmdFeatureId - uh->MaxUnits() == curResurrect->id && teamHandler->Ally(allyteam, bld->allyteam))
-								bld->lastResurrected = u->id; // all units that were rezzing shall assist the repair too
+						// all units that were rezzing shall assist the repair too
+						const CUnitSet* rezzers = CBuilderCAI::resurrecters.GetBuilders(curResurrect->id);
+						if (rezzers != NULL) {
+							for (CUnitSet::const_iterator it = rezzers->begin(); it != rezzers->end(); ++it) {
+								CBuilder *bld = (CBuilder *)*it;
+								if (bld->commandAI->commandQue.empty())
+									continue;
+								const Command& c = bld->commandAI->commandQue.front();
+								if (c.id != CMD_RESURRECT || c.params.size() != 1)
+									continue;
+								const int cmdFeatureId = (int)c.params[0];
+								if (cmdFeatureId - uh->MaxUnits() == curResurrect->id && teamHandler->Ally(allyteam, bld->allyteam))
+									bld->lastResurrected = u->id;
+							}
 						}
 
 						curResurrect->resurrectProgress=0;
@@ -82,11 +82,14 @@ PacketType CBaseNetProtocol::SendGameID(const uchar* buf)
 }
 
 
-PacketType CBaseNetProtocol::SendCommand(uchar myPlayerNum, int id, uchar options, const std::vector<float>& params)
+PacketType CBaseNetProtocol::SendCommand(uchar myPlayerNum, int id, uchar options, const float* params, unsigned numParams)
 {
-	unsigned size = 9 + params.size() * sizeof(float);
+	unsigned size = 9 + numParams * sizeof(float);
 	PackPacket* packet = new PackPacket(size, NETMSG_COMMAND);
-	*packet << static_cast<unsigned short>(size) << myPlayerNum << id << options << params;
+	*packet << static_cast<unsigned short>(size) << myPlayerNum << id << options;
+	for (unsigned i = 0; i < numParams; ++i) {
+		*packet << params[i];
+	}
 	return PacketType(packet);
 }
 
@@ -108,11 +111,14 @@ PacketType CBaseNetProtocol::SendPause(uchar myPlayerNum, uchar bPaused)
 
 
 
-PacketType CBaseNetProtocol::SendAICommand(uchar myPlayerNum, short unitID, int id, uchar options, const std::vector<float>& params)
+PacketType CBaseNetProtocol::SendAICommand(uchar myPlayerNum, short unitID, int id, uchar options, const float* params, unsigned numParams)
 {
-	unsigned size = 11 + params.size() * sizeof(float);
+	unsigned size = 11 + numParams * sizeof(float);
 	PackPacket* packet = new PackPacket(size, NETMSG_AICOMMAND);
-	*packet << static_cast<unsigned short>(size) << myPlayerNum << unitID << id << options << params;
+	*packet << static_cast<unsigned short>(size) << myPlayerNum << unitID << id << options;
+	for (unsigned i = 0; i < numParams; ++i) {
+		*packet << params[i];
+	}
 	return PacketType(packet);
 }
 
@@ -355,6 +361,22 @@ PacketType CBaseNetProtocol::SendSetAllied(uchar myPlayerNum, uchar whichAllyTea
 	return PacketType(packet);
 }
 
+PacketType CBaseNetProtocol::SendSnapshotRequest(int frameNum)
+{
+	PackPacket* packet = new PackPacket(5, NETMSG_SNAPSHOTREQUEST);
+	*packet << frameNum;
+	return PacketType(packet);
+}
+
+PacketType CBaseNetProtocol::SendSnapshotData(uchar myPlayerNum, int frameNum, uint offset, uint totalSize, uint rawSize, const boost::uint8_t* data, unsigned length)
+{
+	const std::vector<boost::uint8_t> piece(data, data + length);
+	boost::uint16_t size = 1 + 2 + 1 + 4 + 4 + 4 + 4 + length;
+	PackPacket* packet = new PackPacket(size, NETMSG_SNAPSHOTDATA);
+	*packet << size << myPlayerNum << frameNum << offset << totalSize << rawSize << piece;
+	return PacketType(packet);
+}
+
 #ifdef SYNCDEBUG
 PacketType CBaseNetProtocol::SendSdCheckrequest(int frameNum)
 {
@@ -451,6 +473,9 @@ CBaseNetProtocol::CBaseNetProtocol()
 	proto->AddType(NETMSG_AI_CREATED, -1);
 	proto->AddType(NETMSG_AI_STATE_CHANGED, 7);
 
+	proto->AddType(NETMSG_SNAPSHOTREQUEST, 5);
+	proto->AddType(NETMSG_SNAPSHOTDATA, -2);
+
 #ifdef SYNCDEBUG
 	proto->AddType(NETMSG_SD_CHKREQUEST, 5);
 	proto->AddType(NETMSG_SD_CHKRESPONSE, -2);
@@ -87,6 +87,9 @@ enum NETMSG {
 
 	NETMSG_AI_CREATED       = 70, // /* uchar messageSize */, uchar myPlayerNum, uint whichSkirmishAI, uchar team, std::string name (ends with \0)
 	NETMSG_AI_STATE_CHANGED = 71, // uchar myPlayerNum, uint whichSkirmishAI, uchar newState
+
+	NETMSG_SNAPSHOTREQUEST  = 72, // int frameNum
+	NETMSG_SNAPSHOTDATA     = 73, // /* uint16_t messageSize */, uchar myPlayerNum, int frameNum, uint offset, uint totalSize, uint rawSize, std::vector<uint8_t> data
 };
 
 // action to do with NETMSG_TEAM 
@@ -122,11 +125,11 @@ public:
 	PacketType SendPlayerName(uchar myPlayerNum, const std::string& playerName);
 	PacketType SendRandSeed(uint randSeed);
 	PacketType SendGameID(const uchar* buf);
-	PacketType SendCommand(uchar myPlayerNum, int id, uchar options, const std::vector<float>& params);
+	PacketType SendCommand(uchar myPlayerNum, int id, uchar options, const float* params, unsigned numParams);
 	PacketType SendSelect(uchar myPlayerNum, const std::vector<short>& selectedUnitIDs);
 	PacketType SendPause(uchar myPlayerNum, uchar bPaused);
 
-	PacketType SendAICommand(uchar myPlayerNum, short unitID, int id, uchar options, const std::vector<float>& params);
+	PacketType SendAICommand(uchar myPlayerNum, short unitID, int id, uchar options, const float* params, unsigned numParams);
 	PacketType SendAIShare(uchar myPlayerNum, uchar sourceTeam, uchar destTeam, float metal, float energy, const std::vector<short>& unitIDs);
 
 	PacketType SendUserSpeed(uchar myPlayerNum, float userSpeed);
@@ -175,6 +178,19 @@ public:
 
 	PacketType SendSetAllied(uchar myPlayerNum, uchar whichAllyTeam, uchar state);
 
+	/// ask a client to save the game state when it reaches this point of the stream
+	PacketType SendSnapshotRequest(int frameNum);
+	/**
+	 * One piece of a compressed game state snapshot, sent by the client
+	 * asked for it, and by the server to late joiners.
+	 * A client that can't save the game state replies with totalSize 0,
+	 * which is the case whenever LuaRules or LuaGaia are running.
+	 * The uncompressed data starts with the creator's
+	 * CLoadSaveHandler::GetSimChecksum(), followed by the savegame.
+	 * @param rawSize size of the snapshot before compression
+	 */
+	PacketType SendSnapshotData(uchar myPlayerNum, int frameNum, uint offset, uint totalSize, uint rawSize, const boost::uint8_t* data, unsigned length);
+
 #ifdef SYNCDEBUG
 	PacketType SendSdCheckrequest(int frameNum);
 	PacketType SendSdCheckresponse(uchar myPlayerNum, uint64_t flop, std::vector<unsigned> checksums);
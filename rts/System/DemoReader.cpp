@@ -8,6 +8,7 @@
 
 #include "Net/RawPacket.h"
 #include "Game/GameVersion.h"
+#include "LogOutput.h"
 
 /////////////////////////////////////
 // CDemoReader implementation
@@ -97,7 +98,7 @@ const std::vector<PlayerStatistics>& CDemoReader::GetPlayerStats() const
 	return playerStats;
 }
 
-const std::vector< std::vector<TeamStatistics> >& CDemoReader::GetTeamStats() const
+const std::vector<CTeamStatHistory>& CDemoReader::GetTeamStats() const
 {
 	return teamStats;
 }
@@ -116,23 +117,39 @@ void CDemoReader::LoadStats()
 		playerStats.push_back(buf);
 	}
 
-	{ // Team statistics follow player statistics.
-		teamStats.clear();
+	teamStats.clear();
+	// Team statistics follow player statistics.
+	if (fileHeader.numTeams > 0 && fileHeader.numTeams <= fileHeader.teamStatSize / (int)sizeof(int)) {
 		teamStats.resize(fileHeader.numTeams);
-		// Read the array containing the number of team stats for each team.
-		std::vector<int> numStatsPerTeam(fileHeader.numTeams, 0);
-		playbackDemo.read((char*)(&numStatsPerTeam[0]), numStatsPerTeam.size());
+		// Read the array containing the size of the history of each team.
+		std::vector<int> statSizePerTeam(fileHeader.numTeams, 0);
+		playbackDemo.read((char*)(&statSizePerTeam[0]), statSizePerTeam.size() * sizeof(int));
 
+		// the histories can not be larger than the rest of the chunk
+		int remaining = fileHeader.teamStatSize - fileHeader.numTeams * sizeof(int);
+		std::vector<boost::uint8_t> buf;
 		for (int teamNum = 0; teamNum < fileHeader.numTeams; ++teamNum)
 		{
-			for (int i = 0; i < numStatsPerTeam[teamNum]; ++i)
-			{
-				TeamStatistics buf;
-				playbackDemo.read((char*)&buf, sizeof(buf));
-				buf.swab();
-				teamStats[teamNum].push_back(buf);
+			const int size = swabdword(statSizePerTeam[teamNum]);
+			if (size == 0)
+				continue;
+			if (size < 0 || size > remaining) {
+				logOutput.Print("Demo team statistics are corrupt: history of team %d has an invalid size of %d bytes", teamNum, size);
+				break;
+			}
+			remaining -= size;
+
+			buf.resize(size);
+			playbackDemo.read((char*)&buf[0], size);
+			if (!playbackDemo || teamStats[teamNum].Deserialize(&buf[0], size) == 0) {
+				logOutput.Print("Demo team statistics are corrupt: could not read the history of team %d", teamNum);
+				teamStats[teamNum].clear();
+				playbackDemo.clear();
+				break;
 			}
 		}
+	} else if (fileHeader.numTeams != 0) {
+		logOutput.Print("Demo team statistics are corrupt: %d teams in a chunk of %d bytes", fileHeader.numTeams, fileHeader.teamStatSize);
 	}
 
 	playbackDemo.seekg(curPos);
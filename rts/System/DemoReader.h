@@ -7,7 +7,7 @@
 #include "Demo.h"
 
 #include "Game/PlayerStatistics.h"
-#include "Sim/Misc/TeamStatistics.h"
+#include "Sim/Misc/TeamStatHistory.h"
 
 namespace netcode { class RawPacket; }
 
@@ -42,7 +42,7 @@ public:
 	};
 	
 	const std::vector<PlayerStatistics>& GetPlayerStats() const;
-	const std::vector< std::vector<TeamStatistics> >& GetTeamStats() const;
+	const std::vector<CTeamStatHistory>& GetTeamStats() const;
 
 	/// Not needed for normal demo watching
 	void LoadStats();
@@ -55,7 +55,7 @@ private:
 	std::string setupScript;	// the original, unaltered version from script
 	
 	std::vector<PlayerStatistics> playerStats;
-	std::vector< std::vector<TeamStatistics> > teamStats;
+	std::vector<CTeamStatHistory> teamStats;
 };
 
 #endif
@@ -150,15 +150,12 @@ void CDemoRecorder::SetPlayerStats(int playerNum, const PlayerStatistics& stats)
 }
 
 /** @brief Set (overwrite) the CTeam::Statistics history for team teamNum */
-void CDemoRecorder::SetTeamStats(int teamNum, const std::list< CTeam::Statistics >& stats)
+void CDemoRecorder::SetTeamStats(int teamNum, const CTeamStatHistory& stats)
 {
 	assert((unsigned)teamNum < teamStats.size());
 
 	teamStats[teamNum].clear();
-	teamStats[teamNum].reserve(stats.size());
-
-	for (std::list< CTeam::Statistics >::const_iterator it = stats.begin(); it != stats.end(); ++it)
-		teamStats[teamNum].push_back(*it);
+	stats.Serialize(teamStats[teamNum]);
 }
 
 /** @brief Write DemoFileHeader
@@ -205,19 +202,16 @@ void CDemoRecorder::WriteTeamStats()
 
 	int pos = recordDemo.tellp();
 
-	// Write array of dwords indicating number of CTeam::Statistics per team.
-	for (std::vector< std::vector< CTeam::Statistics > >::iterator it = teamStats.begin(); it != teamStats.end(); ++it) {
+	// Write array of dwords indicating the size of the history of each team.
+	for (std::vector< std::vector<boost::uint8_t> >::iterator it = teamStats.begin(); it != teamStats.end(); ++it) {
 		unsigned int c = swabdword(it->size());
 		recordDemo.write((char*)&c, sizeof(unsigned int));
 	}
 
-	// Write big array of CTeam::Statistics.
-	for (std::vector< std::vector< TeamStatistics > >::iterator it = teamStats.begin(); it != teamStats.end(); ++it) {
-		for (std::vector< CTeam::Statistics >::iterator it2 = it->begin(); it2 != it->end(); ++it2) {
-			CTeam::Statistics& stats = *it2;
-			stats.swab();
-			recordDemo.write((char*)&stats, sizeof(TeamStatistics));
-		}
+	// Write the (already delta encoded) histories.
+	for (std::vector< std::vector<boost::uint8_t> >::iterator it = teamStats.begin(); it != teamStats.end(); ++it) {
+		if (!it->empty())
+			recordDemo.write((char*)&(*it)[0], it->size());
 	}
 	teamStats.clear();
 
@@ -7,7 +7,7 @@
 
 #include "Demo.h"
 #include "Game/PlayerStatistics.h"
-#include "Sim/Misc/TeamStatistics.h"
+#include "Sim/Misc/TeamStatHistory.h"
 
 /**
 @brief Used to record demos
@@ -35,7 +35,7 @@ public:
 
 	void InitializeStats(int numPlayers, int numTeams, int winningAllyTeam);
 	void SetPlayerStats(int playerNum, const PlayerStatistics& stats);
-	void SetTeamStats(int teamNum, const std::list< TeamStatistics >& stats);
+	void SetTeamStats(int teamNum, const CTeamStatHistory& stats);
 
 private:
 	void WriteFileHeader(bool updateStreamLength = true);
@@ -45,7 +45,8 @@ private:
 	std::ofstream recordDemo;
 	std::string wantedName;
 	std::vector<PlayerStatistics> playerStats;
-	std::vector< std::vector<TeamStatistics> > teamStats;
+	/// CTeamStatHistory::Serialize()d, per team
+	std::vector< std::vector<boost::uint8_t> > teamStats;
 };
 
 
@@ -16,15 +16,22 @@ extern "C" {
 #include "mmgr.h"
 #include "LogOutput.h"
 
+// decompressed solid blocks are kept around up to this size, so reading
+// many small files from one block does not decompress it over and over
+static const size_t MAX_BLOCK_CACHE_SIZE = 32 * 1024 * 1024;
+
+
+CArchive7Zip::Block::~Block()
+{
+	SzFree(NULL, data);
+}
+
 CArchive7Zip::CArchive7Zip(const std::string& name) :
 	CArchiveBuffered(name),
+	blockCacheSize(0),
 	curSearchHandle(1),
 	isOpen(false)
 {
-	blockIndex = 0xFFFFFFFF;
-	outBuffer = NULL;
-	outBufferSize = 0;
-
 	allocImp.Alloc = SzAlloc;
 	allocImp.Free = SzFree;
 
@@ -46,7 +53,7 @@ CArchive7Zip::CArchive7Zip(const std::string& name) :
 	lookStream.realStream = &archiveStream.s;
 	LookToRead_Init(&lookStream);
 
-	CrcGenerateTable();
+	// the CRC table is built once by CArchiveScanner::RunScanJobs()
 
 	SRes res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
 	if (res == SZ_OK) {
@@ -95,60 +102,110 @@ CArchive7Zip::CArchive7Zip(const std::string& name) :
 			fd.crc = (f->Size > 0) ? f->FileCRC : 0;
 
 			StringToLowerInPlace(name);
-			fileData[name] = fd;
+			SPRING_HASH_MAP<std::string, int>::iterator it = fileIndex.find(name);
+			if (it != fileIndex.end()) {
+				fileData[it->second] = fd;
+			} else {
+				fileIndex[name] = fileData.size();
+				fileData.push_back(fd);
+			}
 		}
 	}
 }
 
 CArchive7Zip::~CArchive7Zip(void)
 {
-	if (outBuffer) {
-		IAlloc_Free(&allocImp, outBuffer);
-	}
 	if (isOpen) {
 		File_Close(&archiveStream.file);
 	}
 	SzArEx_Free(&db, &allocImp);
 }
 
+const CArchive7Zip::FileData* CArchive7Zip::FindFileData(const std::string& lowerName) const
+{
+	SPRING_HASH_MAP<std::string, int>::const_iterator it = fileIndex.find(lowerName);
+	if (it == fileIndex.end())
+		return NULL;
+	return &fileData[it->second];
+}
+
 unsigned int CArchive7Zip::GetCrc32 (const std::string& fileName)
 {
-	std::string lower = StringToLower(fileName);
-	FileData fd = fileData[lower];
-	return fd.crc;
+	const FileData* fd = FindFileData(StringToLower(fileName));
+	return fd ? fd->crc : 0;
 }
 
-FileBuffer* CArchive7Zip::GetEntireFileImpl(const std::string& fName)
+CArchive7Zip::BlockPtr CArchive7Zip::GetBlock(UInt32 folderIndex, UInt32 fileIndex, size_t* offset)
 {
-	if (!isOpen)
-		return NULL;
+	size_t outSizeProcessed;
 
-	// Figure out the file index
-	std::string fileName = StringToLower(fName);
+	std::list<std::pair<UInt32, BlockPtr> >::iterator bi;
+	for (bi = blockCache.begin(); bi != blockCache.end(); ++bi) {
+		if (bi->first == folderIndex)
+			break;
+	}
 
-	if (fileData.find(fileName) == fileData.end())
-		return NULL;
+	if (bi != blockCache.end()) {
+		// with a matching block index, SzAr_Extract only locates and checks the file
+		BlockPtr block = bi->second;
+		UInt32 blockIndex = folderIndex;
+		Byte* outBuffer = block->data;
+		size_t outBufferSize = block->size;
+		const SRes res = SzAr_Extract(&db, &lookStream.s, fileIndex, &blockIndex, &outBuffer, &outBufferSize, offset, &outSizeProcessed, &allocImp, &allocTempImp);
+		if (res != SZ_OK)
+			return BlockPtr();
+		blockCache.splice(blockCache.begin(), blockCache, bi);
+		return block;
+	}
 
-	FileData fd = fileData[fileName];
+	UInt32 blockIndex = 0xFFFFFFFF;
+	Byte* outBuffer = NULL;
+	size_t outBufferSize = 0;
+	const SRes res = SzAr_Extract(&db, &lookStream.s, fileIndex, &blockIndex, &outBuffer, &outBufferSize, offset, &outSizeProcessed, &allocImp, &allocTempImp);
 
-	// Get 7zip to decompress it
-	size_t offset;
-	size_t outSizeProcessed;
+	BlockPtr block(new Block);
+	block->data = outBuffer;
+	block->size = outBufferSize;
+	if (res != SZ_OK)
+		return BlockPtr();
 
-	SRes res;
+	blockCache.push_front(std::make_pair(folderIndex, block));
+	blockCacheSize += block->size;
 
-	res = SzAr_Extract(&db, &lookStream.s, fd.fp, &blockIndex, &outBuffer, &outBufferSize, &offset, &outSizeProcessed, &allocImp, &allocTempImp);
+	// blocks still used by open files stay alive until those are closed
+	while ((blockCacheSize > MAX_BLOCK_CACHE_SIZE) && (blockCache.size() > 1)) {
+		blockCacheSize -= blockCache.back().second->size;
+		blockCache.pop_back();
+	}
+	return block;
+}
 
-	FileBuffer* of = NULL;
-	if (res == SZ_OK) {
-		of = new FileBuffer;
-		of->size = outSizeProcessed;
-		of->data = (char*)outBuffer + offset;
+FileBuffer* CArchive7Zip::GetEntireFileImpl(const std::string& fName)
+{
+	if (!isOpen)
+		return NULL;
+
+	// Figure out the file index
+	const FileData* fd = FindFileData(StringToLower(fName));
+	if (!fd)
+		return NULL;
+
+	const UInt32 folderIndex = db.FileIndexToFolderIndexMap[fd->fp];
+	if (folderIndex == (UInt32)-1) {
+		// empty file, not part of any block
+		return new FileBuffer();
 	}
 
-	if (res != SZ_OK)
+	// Get 7zip to decompress it, unless the block is cached already
+	size_t offset;
+	BlockPtr block = GetBlock(folderIndex, fd->fp, &offset);
+	if (!block)
 		return NULL;
 
+	BlockFile* of = new BlockFile;
+	of->block = block;
+	of->size = fd->size;
+	of->data = (char*)block->data + offset;
 	return of;
 }
 
@@ -157,21 +214,22 @@ int CArchive7Zip::FindFiles(int cur, std::string* name, int* size)
 	if (cur == 0) {
 		curSearchHandle++;
 		cur = curSearchHandle;
-		searchHandles[cur] = fileData.begin();
+		searchHandles[cur] = 0;
 	}
 
-	if (searchHandles.find(cur) == searchHandles.end())
+	std::map<int, size_t>::iterator sh = searchHandles.find(cur);
+	if (sh == searchHandles.end())
 		throw std::runtime_error("Unregistered handle. Pass a handle returned by CArchive7Zip::FindFiles.");
 
-	if (searchHandles[cur] == fileData.end()) {
-		searchHandles.erase(cur);
+	if (sh->second >= fileData.size()) {
+		searchHandles.erase(sh);
 		return 0;
 	}
 
-	*name = searchHandles[cur]->second.origName;
-	*size = searchHandles[cur]->second.size;
+	*name = fileData[sh->second].origName;
+	*size = fileData[sh->second].size;
 
-	searchHandles[cur]++;
+	sh->second++;
 	return cur;
 }
 
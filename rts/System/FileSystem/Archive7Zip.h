@@ -1,7 +1,12 @@
 #ifndef __ARCHIVE_7ZIP_H
 #define __ARCHIVE_7ZIP_H
 
+#include <list>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
 #include "ArchiveBuffered.h"
+#include "SpringHashMap.h"
 
 extern "C" {
 #include "lib/7z/7zFile.h"
@@ -18,9 +23,24 @@ public:
 	virtual unsigned int GetCrc32 (const std::string& fileName);
 
 private:
-	UInt32 blockIndex;
-	Byte *outBuffer;
-	size_t outBufferSize;
+	/// a decompressed solid block, freed when neither the cache nor an open file uses it
+	struct Block {
+		Block(): data(NULL), size(0) {}
+		~Block();
+		Byte* data;
+		size_t size;
+	};
+	typedef boost::shared_ptr<Block> BlockPtr;
+	/// open file pointing into a cached block
+	class BlockFile : public FileBuffer
+	{
+	public:
+		BlockPtr block;
+	};
+	/// most recently used first
+	std::list<std::pair<UInt32, BlockPtr> > blockCache;
+	size_t blockCacheSize;
+	BlockPtr GetBlock(UInt32 folderIndex, UInt32 fileIndex, size_t* offset);
 
 	struct FileData {
 		int fp;
@@ -28,10 +48,13 @@ private:
 		std::string origName;
 		unsigned int crc;
 	};
-	std::map<std::string, FileData> fileData;
+	std::vector<FileData> fileData;
+	/// lower case name -> index into fileData
+	SPRING_HASH_MAP<std::string, int> fileIndex;
+	const FileData* FindFileData(const std::string& lowerName) const;
 
 	int curSearchHandle;
-	std::map<int, std::map<std::string, FileData>::iterator> searchHandles;
+	std::map<int, size_t> searchHandles;
 
 	CFileInStream archiveStream;
 	CSzArEx db;
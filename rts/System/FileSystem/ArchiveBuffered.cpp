@@ -6,7 +6,7 @@
 #include "mmgr.h"
 
 
-FileBuffer::FileBuffer() : pos(0), data(NULL)
+FileBuffer::FileBuffer() : size(0), pos(0), data(NULL)
 {
 }
 
@@ -1,10 +1,17 @@
 #include "StdAfx.h"
 
-#include <list>
 #include <algorithm>
+#include <set>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+extern "C" {
+#include "lib/7z/7zCrc.h"
+}
 
 #include "mmgr.h"
 
@@ -40,7 +47,10 @@ CLogSubsystem LOG_ARCHIVESCANNER("ArchiveScanner");
  * is not slow, but mapping them all every time to make the list is)
  */
 
-const int INTERNAL_VER = 9;
+const int INTERNAL_VER = 10;
+
+// archives are opened and checksummed on up to this many threads
+static const unsigned MAX_SCAN_THREADS = 8;
 
 
 CArchiveScanner* archiveScanner = NULL;
@@ -128,6 +138,57 @@ CArchiveScanner::ArchiveData CArchiveScanner::GetArchiveData(const LuaTable& arc
 	return md;
 }
 
+struct CArchiveScanner::ScanJob
+{
+	enum Mode {
+		FULL,     ///< read the archive info (and the checksum, if wanted)
+		VERIFY,   ///< directory archive: only rescan if a file changed
+		CHECKSUM  ///< cached, but the checksum is still missing
+	};
+	Mode mode;
+	bool doChecksum;
+
+	std::string fullName;
+	std::string fn;
+	std::string fpath;
+	std::string lcfn;
+	unsigned int modified;
+	unsigned int size;
+	bool isDir;
+	std::map<std::string, FileInfo> oldFiles;
+
+	// results, filled in by ScanArchive()
+	bool failed;
+	bool unchanged;
+	std::string mapfile;
+	bool hasModinfo;
+	bool hasMapinfo;
+	std::string infoFile;
+	std::string infoData;
+	bool infoRead;
+	unsigned int checksum;
+	std::map<std::string, FileInfo> files;
+};
+
+// hands out the jobs to the scanner threads
+struct CArchiveScanner::ScanQueue
+{
+	std::vector<ScanJob>* jobs;
+	size_t next;
+	boost::mutex mutex;
+};
+
+static bool GetFileInfo(const string& path, unsigned int* modified, unsigned int* size)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+	*modified = info.st_mtime;
+	*size = info.st_size;
+	return true;
+}
+
 void CArchiveScanner::ScanDirs(const vector<string>& scanDirs, bool doChecksum)
 {
 	// add the archives
@@ -148,6 +209,8 @@ void CArchiveScanner::Scan(const string& curPath, bool doChecksum)
 
 	const int flags = (FileSystem::INCLUDE_DIRS | FileSystem::RECURSE);
 	vector<string> found = filesystem.FindFiles(curPath, "*", flags);
+	vector<ScanJob> jobs;
+	std::set<string> names;
 
 	for (vector<string>::iterator it = found.begin(); it != found.end(); ++it) {
 		string fullName = *it;
@@ -177,10 +240,24 @@ void CArchiveScanner::Scan(const string& curPath, bool doChecksum)
 		// Is this an archive we should look into?
 		if (CArchiveFactory::IsScanArchive(fullName))
 		{
-			ScanArchive(fullName, doChecksum);
+			// a second archive of the same name replaces the first one,
+			// so the cache entry can not be trusted for it
+			const string lcname = StringToLower(filesystem.GetFilename(fullName));
+			const bool useCache = names.insert(lcname).second;
+
+			ScanJob job;
+			if (PrepareScan(fullName, doChecksum, useCache, job))
+				jobs.push_back(job);
 		}
 	}
 
+	// Opening and checksumming is done in parallel, but the results are
+	// merged in the order the archives were found, as before
+	RunScanJobs(jobs);
+	for (vector<ScanJob>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		FinishScan(*it);
+	}
+
 	// Now we'll have to parse the replaces-stuff found in the mods
 	for (std::map<string, ArchiveInfo>::iterator aii = archiveInfo.begin(); aii != archiveInfo.end(); ++aii)
 	{
@@ -201,6 +278,8 @@ void CArchiveScanner::Scan(const string& curPath, bool doChecksum)
 			ar->second.path = "";
 			ar->second.origName = lcname;
 			ar->second.modified = 1;
+			ar->second.size = 0;
+			ar->second.files.clear();
 			ArchiveData empty;
 			ar->second.archiveData = empty;
 			ar->second.updated = true;
@@ -221,147 +300,234 @@ void AddDependency(vector<string>& deps, const std::string& dependency)
 	deps.push_back(dependency);
 };
 
-void CArchiveScanner::ScanArchive(const string& fullName, bool doChecksum)
+bool CArchiveScanner::PrepareScan(const string& fullName, bool doChecksum, bool useCache, ScanJob& job)
 {
 	struct stat info;
 
 	stat(fullName.c_str(), &info);
 
-	const string fn    = filesystem.GetFilename(fullName);
-	const string fpath = filesystem.GetDirectory(fullName);
-	const string lcfn    = StringToLower(fn);
-	const string lcfpath = StringToLower(fpath);
-
-	// Determine whether to rely on the cached info or not
-	bool cached = false;
-
-	std::map<string, ArchiveInfo>::iterator aii = archiveInfo.find(lcfn);
+	job.fullName = fullName;
+	job.fn       = filesystem.GetFilename(fullName);
+	job.fpath    = filesystem.GetDirectory(fullName);
+	job.lcfn     = StringToLower(job.fn);
+	job.modified = info.st_mtime;
+	job.size     = info.st_size;
+	job.isDir    = S_ISDIR(info.st_mode);
+	job.mode     = ScanJob::FULL;
+	job.doChecksum = doChecksum;
+
+	std::map<string, ArchiveInfo>::iterator aii = archiveInfo.find(job.lcfn);
 	if (aii != archiveInfo.end()) {
 
 		// This archive may have been obsoleted, do not process it if so
 		if (aii->second.replaced.length() > 0)
-			return;
+			return false;
 
-		if ((unsigned)info.st_mtime == aii->second.modified && fpath == aii->second.path) {
-			cached = true;
+		if (useCache && job.modified == aii->second.modified && job.size == aii->second.size && job.fpath == aii->second.path) {
 			aii->second.updated = true;
+			job.oldFiles = aii->second.files;
+
+			// The modification time of a directory archive does not change
+			// with its contents, so compare the state of every file instead
+			if (job.isDir && doChecksum && !job.oldFiles.empty()) {
+				job.mode = ScanJob::VERIFY;
+			} else if (doChecksum && (aii->second.checksum == 0)) {
+				job.mode = ScanJob::CHECKSUM;
+			} else {
+				return false;
+			}
+		} else if (job.isDir) {
+			// still worth reusing the checksums of unchanged files
+			job.oldFiles = aii->second.files;
 		}
+	}
+	return true;
+}
+
+void CArchiveScanner::RunScanJobs(vector<ScanJob>& jobs)
+{
+	// make sure the shared CRC tables are built before the threads use
+	// them; this runs on every scan, even if no archive changed, as later
+	// opened 7z archives need the table too
+	CRC();
+	CrcGenerateTable();
+
+	if (jobs.empty())
+		return;
 
-		// If we are here, we could have invalid info in the cache
-		// Force a reread if it's a directory archive, as st_mtime only
-		// reflects changes to the directory itself, not the contents.
-		if (!cached) {
-			archiveInfo.erase(aii);
+	ScanQueue queue;
+	queue.jobs = &jobs;
+	queue.next = 0;
+
+	unsigned numThreads = std::min(boost::thread::hardware_concurrency(), MAX_SCAN_THREADS);
+	numThreads = std::max(1u, std::min(numThreads, (unsigned)jobs.size()));
+
+	if (numThreads == 1) {
+		ScanWorker(&queue);
+	} else {
+		boost::thread_group threads;
+		for (unsigned t = 0; t < numThreads; ++t) {
+			threads.create_thread(boost::bind(&CArchiveScanner::ScanWorker, &queue));
 		}
+		threads.join_all();
 	}
+}
 
-	// Time to parse the info we are interested in
-	if (cached)
-	{
-		// If cached is true, aii will point to the archive
-		if (doChecksum && (aii->second.checksum == 0))
-			aii->second.checksum = GetCRC(fullName);
-	}
-	else
-	{
-		CArchiveBase* ar = CArchiveFactory::OpenArchive(fullName);
-		if (ar)
+void CArchiveScanner::ScanWorker(ScanQueue* queue)
+{
+	while (true) {
+		ScanJob* job;
 		{
-			ArchiveInfo ai;
+			boost::mutex::scoped_lock lock(queue->mutex);
+			if (queue->next >= queue->jobs->size())
+				return;
+			job = &(*queue->jobs)[queue->next++];
+		}
+		ScanArchive(*job);
+	}
+}
 
-			string name;
-			int size;
+void CArchiveScanner::ScanArchive(ScanJob& job)
+{
+	job.failed = false;
+	job.unchanged = false;
+	job.hasModinfo = false;
+	job.hasMapinfo = false;
+	job.infoRead = false;
+	job.checksum = 0;
+
+	CArchiveBase* ar = CArchiveFactory::OpenArchive(job.fullName);
+	if (!ar) {
+		job.failed = true;
+		return;
+	}
 
-			std::string mapfile;
-			bool hasModinfo = false;
-			bool hasMapinfo = false;
-			for (int cur = 0; (cur = ar->FindFiles(cur, &name, &size)); /* no-op */)
-			{
-				const string lowerName = StringToLower(name);
-				const string ext = lowerName.substr(lowerName.find_last_of('.') + 1);
+	if (job.mode == ScanJob::VERIFY) {
+		if (DirArchiveUnchanged(ar, job)) {
+			job.unchanged = true;
+			delete ar;
+			return;
+		}
+		job.mode = ScanJob::FULL;
+	}
 
-				if ((ext == "smf") || (ext == "sm3"))
-				{
-					mapfile = name;
-				}
-				else if (lowerName == "modinfo.lua")
-				{
-					hasModinfo = true;
-				}
-				else if (lowerName == "mapinfo.lua")
-				{
-					hasMapinfo = true;
-				}
-			}
+	if (job.mode == ScanJob::FULL) {
+		string name;
+		int size;
 
-			if (hasMapinfo || !mapfile.empty())
-			{ // its a map
-				if (hasMapinfo)
-				{
-					ScanArchiveLua(ar, "mapinfo.lua", ai);
-				}
-				else if (hasModinfo) // backwards-compat for modinfo.lua in maps
-				{
-					ScanArchiveLua(ar, "modinfo.lua", ai);
-				}
-				if (ai.archiveData.name.empty())
-					ai.archiveData.name = filesystem.GetFilename(mapfile);
-				if (ai.archiveData.mapfile.empty())
-					ai.archiveData.mapfile = mapfile;
-				AddDependency(ai.archiveData.dependencies, "maphelper.sdz");
-				ai.archiveData.modType = modtype::map;
-				
+		for (int cur = 0; (cur = ar->FindFiles(cur, &name, &size)); /* no-op */)
+		{
+			const string lowerName = StringToLower(name);
+			const string ext = lowerName.substr(lowerName.find_last_of('.') + 1);
+
+			if ((ext == "smf") || (ext == "sm3"))
+			{
+				job.mapfile = name;
 			}
-			else if (hasModinfo)
-			{ // mod
-				ScanArchiveLua(ar, "modinfo.lua", ai);
-				if (ai.archiveData.modType == modtype::primary)
-					AddDependency(ai.archiveData.dependencies, "Spring content v1");
+			else if (lowerName == "modinfo.lua")
+			{
+				job.hasModinfo = true;
 			}
-			else
-			{ // error
-			LogObject() << "Failed to read archive, files missing: " << fullName;
-				delete ar;
-				return;
+			else if (lowerName == "mapinfo.lua")
+			{
+				job.hasMapinfo = true;
 			}
+		}
 
-			ai.path = fpath;
-			ai.modified = info.st_mtime;
-			ai.origName = fn;
-			ai.updated = true;
+		// its a map if it has a mapinfo or map file;
+		// modinfo.lua in maps is for backwards-compat
+		if (job.hasMapinfo)
+			job.infoFile = "mapinfo.lua";
+		else if (job.hasModinfo)
+			job.infoFile = "modinfo.lua";
+
+		// the Lua parser can only be used by one thread, so just read the file here
+		const int fh = job.infoFile.empty() ? 0 : ar->OpenFile(job.infoFile);
+		if (fh != 0) {
+			const int fsize = ar->FileSize(fh);
+			job.infoData.resize(fsize);
+			if (fsize > 0)
+				ar->ReadFile(fh, &job.infoData[0], fsize);
+			ar->CloseFile(fh);
+			job.infoRead = true;
+		}
+	}
 
-			delete ar;
+	// Optionally calculate a checksum for the file
+	if (job.doChecksum && (job.hasMapinfo || job.hasModinfo || !job.mapfile.empty() || (job.mode == ScanJob::CHECKSUM))) {
+		job.checksum = GetCRC(ar, job);
+	}
 
-			// Optionally calculate a checksum for the file
-			// To prevent reading all files in all directory (.sdd) archives
-			// every time this function is called, directory archive checksums
-			// are calculated on the fly.
-			if (doChecksum) {
-				ai.checksum = GetCRC(fullName);
-			} else {
-				ai.checksum = 0;
-			}
+	delete ar;
+}
+
+void CArchiveScanner::FinishScan(ScanJob& job)
+{
+	std::map<string, ArchiveInfo>::iterator aii = archiveInfo.find(job.lcfn);
 
-			archiveInfo[lcfn] = ai;
+	if (job.mode != ScanJob::FULL) {
+		if (aii == archiveInfo.end())
+			return;
+		if (job.mode == ScanJob::CHECKSUM && !job.failed) {
+			aii->second.checksum = job.checksum;
+			aii->second.files = job.files;
 		}
+		// a failed VERIFY keeps the cached info, like it did before
+		return;
 	}
-}
 
-bool CArchiveScanner::ScanArchiveLua(CArchiveBase* ar, const std::string& fileName, ArchiveInfo& ai)
-{
-	const int fh = ar->OpenFile(fileName);
-	if (fh == 0) {
-		return false;
+	// If we are here, we could have invalid info in the cache
+	if (aii != archiveInfo.end()) {
+		archiveInfo.erase(aii);
+	}
+	if (job.failed) {
+		return;
 	}
-	const int fsize = ar->FileSize(fh);
 
-	char* buf = new char[fsize];
-	ar->ReadFile(fh, buf, fsize);
-	ar->CloseFile(fh);
+	ArchiveInfo ai;
 
-	const string cleanbuf(buf, fsize);
-	delete [] buf;
-	LuaParser p(cleanbuf, SPRING_VFS_MOD);
+	if (job.hasMapinfo || !job.mapfile.empty())
+	{ // its a map
+		if (job.infoRead)
+		{
+			ScanArchiveLua(job.infoData, job.infoFile, ai);
+		}
+		if (ai.archiveData.name.empty())
+			ai.archiveData.name = filesystem.GetFilename(job.mapfile);
+		if (ai.archiveData.mapfile.empty())
+			ai.archiveData.mapfile = job.mapfile;
+		AddDependency(ai.archiveData.dependencies, "maphelper.sdz");
+		ai.archiveData.modType = modtype::map;
+	}
+	else if (job.hasModinfo)
+	{ // mod
+		if (job.infoRead)
+		{
+			ScanArchiveLua(job.infoData, job.infoFile, ai);
+		}
+		if (ai.archiveData.modType == modtype::primary)
+			AddDependency(ai.archiveData.dependencies, "Spring content v1");
+	}
+	else
+	{ // error
+		LogObject() << "Failed to read archive, files missing: " << job.fullName;
+		return;
+	}
+
+	ai.path = job.fpath;
+	ai.modified = job.modified;
+	ai.size = job.size;
+	ai.origName = job.fn;
+	ai.updated = true;
+	ai.checksum = job.checksum;
+	ai.files = job.files;
+
+	archiveInfo[job.lcfn] = ai;
+}
+
+bool CArchiveScanner::ScanArchiveLua(const string& buffer, const std::string& fileName, ArchiveInfo& ai)
+{
+	LuaParser p(buffer, SPRING_VFS_MOD);
 	if (!p.Execute()) {
 		logOutput.Print("ERROR in " + fileName + ": " + p.GetErrorLog());
 		return false;
@@ -394,45 +560,86 @@ IFileFilter* CArchiveScanner::CreateIgnoreFilter(CArchiveBase* ar)
 }
 
 
-/** Get CRC of the data in the specified archive.
-    Returns 0 if file could not be opened. */
-unsigned int CArchiveScanner::GetCRC(const string& arcName)
+/** Lists the files of an archive that count for its checksum,
+    as (lowercase, original) name pairs sorted for deterministic behaviour. */
+static void GetChecksumFiles(CArchiveBase* ar, IFileFilter* ignore, vector<std::pair<string, string> >& files)
 {
-	CRC crc;
-	CArchiveBase* ar;
-	std::list<string> files;
-
-	// Try to open an archive
-	ar = CArchiveFactory::OpenArchive(arcName);
-	if (!ar) {
-		return 0; // It wasn't an archive
-	}
-
-	// Load ignore list.
-	IFileFilter* ignore = CreateIgnoreFilter(ar);
-
 	string name;
 	int size;
-	// Sort all file paths for deterministic behaviour
 	for (int cur = 0; (cur = ar->FindFiles(cur, &name, &size)); /* no-op */) {
 		if (ignore->Match(name)) {
 			continue;
 		}
-		const string lower = StringToLower(name); // case insensitive hash
-		files.push_back(lower);
+		// case insensitive hash
+		files.push_back(std::make_pair(StringToLower(name), name));
 	}
-	files.sort();
+	std::sort(files.begin(), files.end());
+}
+
+
+/** True if no file of a directory archive was added, removed or modified
+    since the per-file state in job.oldFiles was recorded. */
+bool CArchiveScanner::DirArchiveUnchanged(CArchiveBase* ar, const ScanJob& job)
+{
+	IFileFilter* ignore = CreateIgnoreFilter(ar);
+	vector<std::pair<string, string> > files;
+	GetChecksumFiles(ar, ignore, files);
+	delete ignore;
+
+	if (files.size() != job.oldFiles.size()) {
+		return false;
+	}
+	for (vector<std::pair<string, string> >::const_iterator i = files.begin(); i != files.end(); ++i) {
+		std::map<string, FileInfo>::const_iterator old = job.oldFiles.find(i->first);
+		unsigned int modified, size;
+		if ((old == job.oldFiles.end()) ||
+		    !GetFileInfo(job.fullName + "/" + i->second, &modified, &size) ||
+		    (modified != old->second.modified) || (size != old->second.size)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/** Get CRC of the data in the specified archive.
+    For directory archives, the CRC of every file is remembered in job.files,
+    and files that did not change since job.oldFiles are not read again. */
+unsigned int CArchiveScanner::GetCRC(CArchiveBase* ar, ScanJob& job)
+{
+	CRC crc;
+
+	// Load ignore list.
+	IFileFilter* ignore = CreateIgnoreFilter(ar);
+
+	vector<std::pair<string, string> > files;
+	GetChecksumFiles(ar, ignore, files);
+	job.files.clear();
 
 	// Add all files in sorted order
-	for (std::list<string>::iterator i = files.begin(); i != files.end(); i++ ) {
-		const unsigned int nameCRC = CRC().Update(i->data(), i->size()).GetDigest();
-		const unsigned int dataCRC = ar->GetCrc32(*i);
+	for (vector<std::pair<string, string> >::const_iterator i = files.begin(); i != files.end(); ++i) {
+		const string& lower = i->first;
+		const unsigned int nameCRC = CRC().Update(lower.data(), lower.size()).GetDigest();
+		unsigned int dataCRC;
+
+		FileInfo fi;
+		if (job.isDir && GetFileInfo(job.fullName + "/" + i->second, &fi.modified, &fi.size)) {
+			std::map<string, FileInfo>::const_iterator old = job.oldFiles.find(lower);
+			if ((old != job.oldFiles.end()) && (old->second.modified == fi.modified) && (old->second.size == fi.size)) {
+				fi.crc = old->second.crc;
+			} else {
+				fi.crc = ar->GetCrc32(lower);
+			}
+			job.files[lower] = fi;
+			dataCRC = fi.crc;
+		} else {
+			dataCRC = ar->GetCrc32(lower);
+		}
 		crc.Update(nameCRC);
 		crc.Update(dataCRC);
 	}
 
 	delete ignore;
-	delete ar;
 
 	unsigned int digest = crc.GetDigest();
 
@@ -473,9 +680,20 @@ void CArchiveScanner::ReadCacheData(const string& filename)
 		// library uses 32-bit floats to represent numbers, which can only
 		// represent 2^24 consecutive integers
 		ai.modified = strtoul(curArchive.GetString("modified", "0").c_str(), 0, 10);
+		ai.size     = strtoul(curArchive.GetString("size", "0").c_str(), 0, 10);
 		ai.checksum = strtoul(curArchive.GetString("checksum", "0").c_str(), 0, 10);
 		ai.updated = false;
 
+		const LuaTable files = curArchive.SubTable("files");
+		for (int f = 1; files.KeyExists(f); ++f) {
+			const LuaTable file = files.SubTable(f);
+			FileInfo fi;
+			fi.modified = strtoul(file.GetString("modified", "0").c_str(), 0, 10);
+			fi.size     = strtoul(file.GetString("size", "0").c_str(), 0, 10);
+			fi.crc      = strtoul(file.GetString("crc", "0").c_str(), 0, 10);
+			ai.files[file.GetString("name", "")] = fi;
+		}
+
 		ai.archiveData = GetArchiveData(archived);
 		if (ai.archiveData.modType == modtype::map)
 			AddDependency(ai.archiveData.dependencies, "maphelper.sdz");
@@ -490,16 +708,21 @@ void CArchiveScanner::ReadCacheData(const string& filename)
 	isDirty = false;
 }
 
+static inline string QuoteStr(const string& str)
+{
+	if (str.find_first_of("\\\"") == string::npos) {
+		return "\"" + str + "\"";
+	} else {
+		return "[[" + str + "]]";
+	}
+}
+
 static inline void SafeStr(FILE* out, const char* prefix, const string& str)
 {
 	if (str.empty()) {
 		return;
 	}
-	if (str.find_first_of("\\\"") == string::npos) {
-		fprintf(out, "%s\"%s\",\n", prefix, str.c_str());
-	} else {
-		fprintf(out, "%s[[%s]],\n", prefix, str.c_str());
-	}
+	fprintf(out, "%s%s,\n", prefix, QuoteStr(str).c_str());
 }
 
 void FilterDep(vector<string>& deps, const std::string& exclude)
@@ -554,9 +777,20 @@ void CArchiveScanner::WriteCacheData(const string& filename)
 		SafeStr(out, "\t\t\tname = ",              arcInfo.origName);
 		SafeStr(out, "\t\t\tpath = ",              arcInfo.path);
 		fprintf(out, "\t\t\tmodified = \"%u\",\n", arcInfo.modified);
+		fprintf(out, "\t\t\tsize = \"%u\",\n",     arcInfo.size);
 		fprintf(out, "\t\t\tchecksum = \"%u\",\n", arcInfo.checksum);
 		SafeStr(out, "\t\t\treplaced = ",          arcInfo.replaced);
 
+		if (!arcInfo.files.empty()) {
+			fprintf(out, "\t\t\tfiles = {\n");
+			std::map<string, FileInfo>::const_iterator fi;
+			for (fi = arcInfo.files.begin(); fi != arcInfo.files.end(); ++fi) {
+				fprintf(out, "\t\t\t\t{ name = %s, modified = \"%u\", size = \"%u\", crc = \"%u\" },\n",
+				        QuoteStr(fi->first).c_str(), fi->second.modified, fi->second.size, fi->second.crc);
+			}
+			fprintf(out, "\t\t\t},\n");
+		}
+
 		// mod info?
 		const ArchiveData& archData = arcInfo.archiveData;
 		if (archData.name != "") {
@@ -70,31 +70,52 @@ public:
 	ArchiveData GetArchiveDataByArchive(const std::string& archive) const;
 
 private:
+	/// cached state of one file in a directory archive
+	struct FileInfo
+	{
+		unsigned int modified;
+		unsigned int size;
+		unsigned int crc;
+	};
 	struct ArchiveInfo
 	{
 		std::string path;
 		std::string origName;					// Could be useful to have the non-lowercased name around
 		unsigned int modified;
+		unsigned int size;
 		ArchiveData archiveData;
 		unsigned int checksum;
 		bool updated;
 		std::string replaced;					// If not empty, use that archive instead
+		/// lowercase name -> state; only kept for directory archives, whose
+		/// modification time does not reflect changes to their contents
+		std::map<std::string, FileInfo> files;
 	};
+	/// work on one archive, done by the scanner threads
+	struct ScanJob;
+	struct ScanQueue;
 
 	void ScanDirs(const std::vector<std::string>& dirs, bool checksum = false);
 	void Scan(const std::string& curPath, bool doChecksum);
 
-	void ScanArchive(const std::string& fullName, bool checksum = false);
+	/// decide from the cache what has to be done for an archive
+	bool PrepareScan(const std::string& fullName, bool doChecksum, bool useCache, ScanJob& job);
+	/// merge the results of a job into archiveInfo
+	void FinishScan(ScanJob& job);
+	static void RunScanJobs(std::vector<ScanJob>& jobs);
+	static void ScanWorker(ScanQueue* queue);
+	static void ScanArchive(ScanJob& job);
 	/// scan mapinfo / modinfo lua files
-	bool ScanArchiveLua(CArchiveBase* ar, const std::string& fileName, ArchiveInfo& ai);
+	bool ScanArchiveLua(const std::string& buffer, const std::string& fileName, ArchiveInfo& ai);
 
 	void ReadCacheData(const std::string& filename);
 	void WriteCacheData(const std::string& filename);
 
 	std::map<std::string, ArchiveInfo> archiveInfo;
 	ArchiveData GetArchiveData(const LuaTable& archiveTable);
-	IFileFilter* CreateIgnoreFilter(CArchiveBase* ar);
-	unsigned int GetCRC(const std::string& filename);
+	static IFileFilter* CreateIgnoreFilter(CArchiveBase* ar);
+	static bool DirArchiveUnchanged(CArchiveBase* ar, const ScanJob& job);
+	static unsigned int GetCRC(CArchiveBase* ar, ScanJob& job);
 	bool isDirty;
 	std::string cachefile;
 };
@@ -2,22 +2,120 @@
 #include "ArchiveZip.h"
 #include <algorithm>
 #include <stdexcept>
+#include <string.h>
 #include "Util.h"
 #include "mmgr.h"
 #include "LogOutput.h"
 
 
+namespace {
+
+// minizip IO on top of a CMappedFile, so reading the central directory and
+// the compressed data does not go through a read() call for every few bytes
+struct MemStream {
+	const char* data;
+	uLong size;
+	uLong pos;
+};
+
+voidpf ZCALLBACK mem_open(voidpf opaque, const char* filename, int mode)
+{
+	const CMappedFile* mapping = (const CMappedFile*)opaque;
+	MemStream* ms = new MemStream;
+	ms->data = mapping->GetData();
+	ms->size = mapping->GetSize();
+	ms->pos = 0;
+	return ms;
+}
+
+uLong ZCALLBACK mem_read(voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+	MemStream* ms = (MemStream*)stream;
+	if (ms->pos >= ms->size)
+		return 0;
+	const uLong n = std::min(size, ms->size - ms->pos);
+	memcpy(buf, ms->data + ms->pos, n);
+	ms->pos += n;
+	return n;
+}
+
+uLong ZCALLBACK mem_write(voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+	return 0;
+}
+
+long ZCALLBACK mem_tell(voidpf opaque, voidpf stream)
+{
+	return ((MemStream*)stream)->pos;
+}
+
+long ZCALLBACK mem_seek(voidpf opaque, voidpf stream, uLong offset, int origin)
+{
+	MemStream* ms = (MemStream*)stream;
+	uLong pos;
+	switch (origin) {
+		case ZLIB_FILEFUNC_SEEK_SET: pos = offset; break;
+		case ZLIB_FILEFUNC_SEEK_CUR: pos = ms->pos + offset; break;
+		case ZLIB_FILEFUNC_SEEK_END: pos = ms->size + offset; break;
+		default: return -1;
+	}
+	if (pos > ms->size)
+		return -1;
+	ms->pos = pos;
+	return 0;
+}
+
+int ZCALLBACK mem_close(voidpf opaque, voidpf stream)
+{
+	delete (MemStream*)stream;
+	return 0;
+}
+
+int ZCALLBACK mem_error(voidpf opaque, voidpf stream)
+{
+	return 0;
+}
+
+inline unsigned int GetLE16(const char* p)
+{
+	const unsigned char* b = (const unsigned char*)p;
+	return b[0] | (b[1] << 8);
+}
+
+inline unsigned int GetLE32(const char* p)
+{
+	const unsigned char* b = (const unsigned char*)p;
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24);
+}
+
+}
+
+
 CArchiveZip::CArchiveZip(const std::string& name):
 	CArchiveBuffered(name),
+	mapping(name),
 	curSearchHandle(1)
 {
+	if (mapping.IsOpen()) {
+		zlib_filefunc_def ffunc;
+		ffunc.zopen_file = mem_open;
+		ffunc.zread_file = mem_read;
+		ffunc.zwrite_file = mem_write;
+		ffunc.ztell_file = mem_tell;
+		ffunc.zseek_file = mem_seek;
+		ffunc.zclose_file = mem_close;
+		ffunc.zerror_file = mem_error;
+		ffunc.opaque = &mapping;
+		zip = unzOpen2(name.c_str(), &ffunc);
+	} else {
 #ifdef USEWIN32IOAPI
-	zlib_filefunc_def ffunc;
-	fill_win32_filefunc(&ffunc);
-	zip = unzOpen2(name.c_str(),&ffunc);
+		zlib_filefunc_def ffunc;
+		fill_win32_filefunc(&ffunc);
+		zip = unzOpen2(name.c_str(),&ffunc);
 #else
-	zip = unzOpen(name.c_str());
+		zip = unzOpen(name.c_str());
 #endif
+	}
 	if (!zip) {
 		LogObject() << "Error opening " << name;
 		return;
@@ -44,7 +142,15 @@ CArchiveZip::CArchiveZip(const std::string& name):
 		fd.size = info.uncompressed_size;
 		fd.origName = fname;
 		fd.crc = info.crc;
-		fileData[name] = fd;
+		fd.stored = GetStoredData(info, fd.fp);
+
+		SPRING_HASH_MAP<std::string, int>::iterator it = fileIndex.find(name);
+		if (it != fileIndex.end()) {
+			fileData[it->second] = fd; // the last entry of a name wins
+		} else {
+			fileIndex[name] = fileData.size();
+			fileData.push_back(fd);
+		}
 	}
 }
 
@@ -54,11 +160,42 @@ CArchiveZip::~CArchiveZip(void)
 		unzClose(zip);
 }
 
+const char* CArchiveZip::GetStoredData(const unz_file_info& info, const unz_file_pos& fp) const
+{
+	// only uncompressed, unencrypted entries can be used in place
+	if (!mapping.IsOpen() || (info.compression_method != 0) || (info.flag & 1) ||
+	    (info.compressed_size != info.uncompressed_size))
+		return NULL;
+
+	const char* base = mapping.GetData();
+	const size_t mapSize = mapping.GetSize();
+
+	// central directory entry -> local header -> data
+	const size_t central = fp.pos_in_zip_directory;
+	if ((central + 46 > mapSize) || (GetLE32(base + central) != 0x02014b50))
+		return NULL;
+	const size_t local = GetLE32(base + central + 42);
+	if ((local + 30 > mapSize) || (GetLE32(base + local) != 0x04034b50))
+		return NULL; // e.g. data prepended to the archive
+	const size_t start = local + 30 + GetLE16(base + local + 26) + GetLE16(base + local + 28);
+	if ((start > mapSize) || (info.uncompressed_size > mapSize - start))
+		return NULL;
+
+	return base + start;
+}
+
+const CArchiveZip::FileData* CArchiveZip::FindFileData(const std::string& lowerName) const
+{
+	SPRING_HASH_MAP<std::string, int>::const_iterator it = fileIndex.find(lowerName);
+	if (it == fileIndex.end())
+		return NULL;
+	return &fileData[it->second];
+}
+
 unsigned int CArchiveZip::GetCrc32 (const std::string& fileName)
 {
-	std::string lower = StringToLower(fileName);
-	FileData fd = fileData[lower];
-	return fd.crc;
+	const FileData* fd = FindFileData(StringToLower(fileName));
+	return fd ? fd->crc : 0;
 }
 
 bool CArchiveZip::IsOpen()
@@ -70,22 +207,27 @@ class zip_exception: public std::exception {};
 
 // To simplify things, files are always read completely into memory from the zipfile, since zlib does not
 // provide any way of reading more than one file at a time
-ABOpenFile_t* CArchiveZip::GetEntireFileImpl(const std::string& fName)
+FileBuffer* CArchiveZip::GetEntireFileImpl(const std::string& fName)
 {
 	// Don't allow opening files on missing/invalid archives
 	if (!zip)
 		return NULL;
 
-	std::string fileName = StringToLower(fName);
-
-	//if (unzLocateFile(zip, fileName.c_str(), 2) != UNZ_OK)
-	//	return 0;
-
-	if (fileData.find(fileName) == fileData.end())
+	const FileData* fd = FindFileData(StringToLower(fName));
+	if (!fd)
 		return NULL;
 
-	FileData fd = fileData[fileName];
-	unzGoToFilePos(zip, &fileData[fileName].fp);
+	if (fd->stored) {
+		// stored entries are handed out straight from the mapping;
+		// a plain FileBuffer does not free its data
+		FileBuffer* of = new FileBuffer;
+		of->size = fd->size;
+		of->data = const_cast<char*>(fd->stored);
+		return of;
+	}
+
+	unz_file_pos fp = fd->fp;
+	unzGoToFilePos(zip, &fp);
 
 	unz_file_info fi;
 	unzGetCurrentFileInfo(zip, &fi, NULL, 0, NULL, 0, NULL, 0);
@@ -105,7 +247,6 @@ ABOpenFile_t* CArchiveZip::GetEntireFileImpl(const std::string& fName)
 			throw zip_exception();
 	}
 	catch (zip_exception) {
-		free(of->data);
 		delete of;
 		return NULL;
 	}
@@ -118,21 +259,22 @@ int CArchiveZip::FindFiles(int cur, std::string* name, int* size)
 	if (cur == 0) {
 		curSearchHandle++;
 		cur = curSearchHandle;
-		searchHandles[cur] = fileData.begin();
+		searchHandles[cur] = 0;
 	}
 
-	if (searchHandles.find(cur) == searchHandles.end())
+	std::map<int, size_t>::iterator sh = searchHandles.find(cur);
+	if (sh == searchHandles.end())
 		throw std::runtime_error("Unregistered handle. Pass a handle returned by CArchiveZip::FindFiles.");
 
-	if (searchHandles[cur] == fileData.end()) {
-		searchHandles.erase(cur);
+	if (sh->second >= fileData.size()) {
+		searchHandles.erase(sh);
 		return 0;
 	}
 
-	*name = searchHandles[cur]->second.origName;
-	*size = searchHandles[cur]->second.size;
+	*name = fileData[sh->second].origName;
+	*size = fileData[sh->second].size;
 
-	searchHandles[cur]++;
+	sh->second++;
 	return cur;
 }
 
@@ -1,7 +1,11 @@
 #ifndef __ARCHIVE_ZIP
 #define __ARCHIVE_ZIP
 
+#include <vector>
+
 #include "ArchiveBuffered.h"
+#include "MappedFile.h"
+#include "SpringHashMap.h"
 #include "lib/minizip/unzip.h"
 
 #ifdef _WIN32
@@ -20,12 +24,21 @@ protected:
 		int size;
 		std::string origName;
 		unsigned int crc;
+		/// start of the data inside the mapping for stored entries, NULL otherwise
+		const char* stored;
 	};
+	/// the whole archive; minizip reads from this instead of the file when mapped
+	CMappedFile mapping;
 	unzFile zip;
-	std::map<std::string, FileData> fileData;		// using unzLocateFile is quite slow
+	/// entries in central directory order
+	std::vector<FileData> fileData;
+	/// lower case name -> index into fileData (using unzLocateFile is quite slow)
+	SPRING_HASH_MAP<std::string, int> fileIndex;
 	int curSearchHandle;
-	std::map<int, std::map<std::string, FileData>::iterator> searchHandles;
-	virtual ABOpenFile_t* GetEntireFileImpl(const std::string& fileName);
+	std::map<int, size_t> searchHandles;
+	virtual FileBuffer* GetEntireFileImpl(const std::string& fileName);
+	const FileData* FindFileData(const std::string& lowerName) const;
+	const char* GetStoredData(const unz_file_info& info, const unz_file_pos& fp) const;
 	void SetSlashesForwardToBack(std::string& name);
 	void SetSlashesBackToForward(std::string& name);
 public:
@@ -1,20 +1,73 @@
 #include "CRC.h"
 
-extern "C" {
-#include "lib/7z/7zCrc.h"
-};
 
+// CRC-32 as used by zip, 7z and zlib (reflected polynomial 0xEDB88320).
+// Instead of one table lookup per byte, the update works on 8 bytes at a
+// time with 8 tables ("slicing-by-8"), which gives the same result several
+// times faster. (The SSE4.2 crc32 instruction is no use here: it computes
+// CRC-32C, a different polynomial, and archive checksums must keep their
+// values.)
 
+#define CRC_POLY      0xEDB88320
+#define CRC_INIT_VAL  0xFFFFFFFF
+#define CRC_GET_DIGEST(crc) ((crc) ^ 0xFFFFFFFF)
+
+static unsigned int crcTable[8][256];
 static bool crcTableInitialized;
 
 
+static void GenerateTables()
+{
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned int r = i;
+		for (int j = 0; j < 8; ++j) {
+			r = (r >> 1) ^ (CRC_POLY & ~((r & 1) - 1));
+		}
+		crcTable[0][i] = r;
+	}
+	// crcTable[k][i] is the CRC of byte i followed by k zero bytes
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned int r = crcTable[0][i];
+		for (int k = 1; k < 8; ++k) {
+			r = crcTable[0][r & 0xFF] ^ (r >> 8);
+			crcTable[k][i] = r;
+		}
+	}
+}
+
+
+static unsigned int CrcUpdate(unsigned int crc, const void* data, unsigned int size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+
+	// the byte order of the input does not matter, the words are
+	// assembled byte by byte (compilers turn this into plain loads)
+	for (; size >= 8; size -= 8, p += 8) {
+		const unsigned int lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+		const unsigned int hi =        p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned int)p[7] << 24);
+		crc = crcTable[7][ lo        & 0xFF] ^
+		      crcTable[6][(lo >>  8) & 0xFF] ^
+		      crcTable[5][(lo >> 16) & 0xFF] ^
+		      crcTable[4][ lo >> 24        ] ^
+		      crcTable[3][ hi        & 0xFF] ^
+		      crcTable[2][(hi >>  8) & 0xFF] ^
+		      crcTable[1][(hi >> 16) & 0xFF] ^
+		      crcTable[0][ hi >> 24        ];
+	}
+	for (; size > 0; --size, ++p) {
+		crc = crcTable[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+
 /** @brief Construct a new CRC object. */
 CRC::CRC()
 {
 	crc = CRC_INIT_VAL;
 	if (!crcTableInitialized) {
+		GenerateTables();
 		crcTableInitialized = true;
-		CrcGenerateTable();
 	}
 }
 
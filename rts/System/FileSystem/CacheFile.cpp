@@ -0,0 +1,63 @@
+#include "StdAfx.h"
+#include "CacheFile.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "mmgr.h"
+
+#include "CRC.h"
+
+
+struct CacheFileHeader {
+	char magic[8];
+	int version;
+	unsigned int dataSize;
+	unsigned int dataCRC;
+};
+
+
+bool CacheFile::Read(const std::string& fileName, const char magic[8], int version, std::string& data)
+{
+	std::ifstream ifs(fileName.c_str(), std::ios::in | std::ios::binary);
+	ifs.seekg(0, std::ios::end);
+	const std::streamoff fileSize = ifs.tellg();
+	ifs.seekg(0, std::ios::beg);
+
+	CacheFileHeader header;
+	if (!ifs.read((char*)&header, sizeof(header)) ||
+	    (memcmp(header.magic, magic, sizeof(header.magic)) != 0) ||
+	    (header.version != version) ||
+	    (fileSize != (std::streamoff)(sizeof(header) + header.dataSize))) {
+		return false;
+	}
+	data.resize(header.dataSize);
+	if ((header.dataSize > 0) && !ifs.read(&data[0], header.dataSize)) {
+		return false;
+	}
+	return (CRC().Update(data.data(), data.size()).GetDigest() == header.dataCRC);
+}
+
+
+void CacheFile::Write(const std::string& fileName, const char magic[8], int version, const std::string& data)
+{
+	const std::string tempName = fileName + ".tmp";
+	{
+		CacheFileHeader header;
+		memcpy(header.magic, magic, sizeof(header.magic));
+		header.version = version;
+		header.dataSize = data.size();
+		header.dataCRC = CRC().Update(data.data(), data.size()).GetDigest();
+
+		std::ofstream ofs(tempName.c_str(), std::ios::out | std::ios::binary);
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write(data.data(), data.size());
+		if (!ofs) {
+			return;
+		}
+	}
+	remove(fileName.c_str()); // rename does not replace on windows
+	if (rename(tempName.c_str(), fileName.c_str()) != 0) {
+		remove(tempName.c_str());
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef CACHEFILE_H
+#define CACHEFILE_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+/**
+ * @brief files in the cache/ directory holding data derived from archives
+ *
+ * Every file starts with a header holding a magic, a format version and the
+ * size and CRC of the data, so damaged, truncated or outdated files are
+ * rejected instead of being used.
+ */
+namespace CacheFile
+{
+	/// @return false if the file is missing, damaged or has another magic or version
+	bool Read(const std::string& fileName, const char magic[8], int version, std::string& data);
+	/**
+	 * Writes under a temporary name first, so that concurrent starts of the
+	 * same content never see a partial file. Failing to write is not an error.
+	 */
+	void Write(const std::string& fileName, const char magic[8], int version, const std::string& data);
+}
+
+
+/**
+ * @brief appends plain values to cache file data
+ * Values are stored in native byte order, the cache never leaves the machine.
+ */
+class CCacheWriter
+{
+public:
+	CCacheWriter(std::string& data): data(data) {}
+
+	template<typename T>
+	void Write(const T& v) {
+		data.append((const char*) &v, sizeof(T));
+	}
+	void WriteString(const std::string& s) {
+		Write((unsigned int) s.size());
+		data.append(s);
+	}
+	/// T must be a plain struct
+	template<typename T>
+	void WriteVector(const std::vector<T>& v) {
+		Write((unsigned int) v.size());
+		if (!v.empty()) {
+			data.append((const char*) &v[0], v.size() * sizeof(T));
+		}
+	}
+
+private:
+	std::string& data;
+};
+
+
+/// reads what CCacheWriter wrote, once a read fails all further ones fail too
+class CCacheReader
+{
+public:
+	CCacheReader(const std::string& data): data(data), pos(0), ok(true) {}
+
+	template<typename T>
+	bool Read(T& v) {
+		if (!Take(sizeof(T))) {
+			return false;
+		}
+		memcpy(&v, &data[pos - sizeof(T)], sizeof(T));
+		return true;
+	}
+	bool ReadString(std::string& s) {
+		unsigned int size;
+		if (!Read(size) || !Take(size)) {
+			return false;
+		}
+		s.assign(data, pos - size, size);
+		return true;
+	}
+	template<typename T>
+	bool ReadVector(std::vector<T>& v) {
+		unsigned int size;
+		if (!Read(size) || (size > (data.size() - pos) / sizeof(T))) {
+			return (ok = false);
+		}
+		v.resize(size);
+		if (size > 0) {
+			memcpy(&v[0], &data[pos], size * sizeof(T));
+			pos += size * sizeof(T);
+		}
+		return true;
+	}
+
+	bool IsOk() const { return ok; }
+	/// @return true if everything was read, and nothing failed
+	bool AtEnd() const { return ok && (pos == data.size()); }
+
+private:
+	bool Take(size_t size) {
+		if (!ok || (size > data.size() - pos)) {
+			return (ok = false);
+		}
+		pos += size;
+		return true;
+	}
+
+	const std::string& data;
+	size_t pos;
+	bool ok;
+};
+
+#endif // CACHEFILE_H
@@ -0,0 +1,81 @@
+#include "StdAfx.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mmgr.h"
+
+
+#ifdef _WIN32
+
+CMappedFile::CMappedFile(const std::string& fileName):
+	data(NULL),
+	size(0),
+	file(INVALID_HANDLE_VALUE),
+	mapping(NULL)
+{
+	file = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+	                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart <= 0) ||
+	    ((unsigned long long)fileSize.QuadPart != (size_t)fileSize.QuadPart))
+		return;
+
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return;
+
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data != NULL)
+		size = (size_t)fileSize.QuadPart;
+}
+
+CMappedFile::~CMappedFile()
+{
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+#else
+
+CMappedFile::CMappedFile(const std::string& fileName):
+	data(NULL),
+	size(0)
+{
+	const int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat info;
+	if ((fstat(fd, &info) == 0) && (info.st_size > 0) &&
+	    ((off_t)(size_t)info.st_size == info.st_size)) {
+		void* p = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			data = (const char*)p;
+			size = (size_t)info.st_size;
+		}
+	}
+	// the mapping stays valid without the descriptor
+	close(fd);
+}
+
+CMappedFile::~CMappedFile()
+{
+	if (data != NULL)
+		munmap((void*)data, size);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __MAPPED_FILE_H
+#define __MAPPED_FILE_H
+
+#include <string>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include "Platform/Win/win32.h"
+#endif
+
+/**
+ * @brief read-only memory mapping of a whole file
+ *
+ * Used by the archive readers, so that looking at headers and serving
+ * uncompressed entries does not need a read() call and a copy each time.
+ * If the file can not be mapped (missing, empty, no address space left),
+ * IsOpen() returns false and the caller has to fall back to normal file IO.
+ */
+class CMappedFile
+{
+public:
+	CMappedFile(const std::string& fileName);
+	~CMappedFile();
+
+	bool IsOpen() const { return (data != NULL); }
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	CMappedFile(const CMappedFile&);
+	CMappedFile& operator=(const CMappedFile&);
+
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+#endif // __MAPPED_FILE_H
@@ -1,5 +1,6 @@
 #include "StdAfx.h"
 #include <algorithm>
+#include <cctype>
 #include <set>
 #include "mmgr.h"
 
@@ -64,7 +65,9 @@ bool CVFSHandler::AddArchive(const std::string& arName, bool override, const std
 		d.ar = ar;
 		d.size = size;
 		d.dynamic = !!dynamic_cast<CArchiveDir*>(ar);
-		files[name] = d;
+		FileData& fd = files[name];
+		fd = d;
+		fileIndex[name] = &fd;
 	}
 	return true;
 }
@@ -97,6 +100,7 @@ bool CVFSHandler::RemoveArchive(const std::string& arName)
 	for (std::map<std::string, FileData>::iterator f = files.begin(); f != files.end();) {
 		if (f->second.ar == ar) {
 			logOutput.Print(LOG_VFS_DETAIL, "%s (removing)", f->first.c_str());
+			fileIndex.erase(f->first);
 #ifdef _MSC_VER
 			f = files.erase(f);
 #else
@@ -122,19 +126,33 @@ CVFSHandler::~CVFSHandler()
 }
 
 
+CVFSHandler::FileData* CVFSHandler::FindFile(const std::string& rawName, std::string* name)
+{
+	// lower case and forward slashes in one go
+	name->resize(rawName.size());
+	for (size_t i = 0; i < rawName.size(); ++i) {
+		const char c = rawName[i];
+		(*name)[i] = (c == '\\') ? '/' : tolower((unsigned char)c);
+	}
+
+	SPRING_HASH_MAP<std::string, FileData*>::iterator fi = fileIndex.find(*name);
+	if (fi == fileIndex.end())
+		return NULL;
+	return fi->second;
+}
+
+
 int CVFSHandler::LoadFile(const std::string& rawName, void* buffer)
 {
 	logOutput.Print(LOG_VFS, "LoadFile(rawName = \"%s\", )", rawName.c_str());
 
-	std::string name = StringToLower(rawName);
-	filesystem.ForwardSlashes(name);
-
-	std::map<std::string, FileData>::iterator fi = files.find(name);
-	if (fi == files.end()) {
+	std::string name;
+	FileData* fi = FindFile(rawName, &name);
+	if (!fi) {
 		logOutput.Print(LOG_VFS, "LoadFile: File '%s' does not exist in VFS.", rawName.c_str());
 		return -1;
 	}
-	FileData& fd = fi->second;
+	FileData& fd = *fi;
 
 	int fh = fd.ar->OpenFile(name);
 	if (!fh) {
@@ -154,16 +172,14 @@ int CVFSHandler::GetFileSize(const std::string& rawName)
 {
 	logOutput.Print(LOG_VFS, "GetFileSize(rawName = \"%s\")", rawName.c_str());
 
-	std::string name = StringToLower(rawName);
-	filesystem.ForwardSlashes(name);
-
-	std::map<std::string, FileData>::iterator fi = files.find(name);
-	if (fi == files.end()) {
+	std::string name;
+	FileData* fi = FindFile(rawName, &name);
+	if (!fi) {
 		logOutput.Print(LOG_VFS, "GetFileSize: File '%s' does not exist in VFS.", rawName.c_str());
 		return -1;
 	}
 
-	FileData& fd = fi->second;
+	FileData& fd = *fi;
 
 	if (!fd.dynamic) {
 		return fd.size;
@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 
+#include "SpringHashMap.h"
+
 class CArchiveBase;
 
 class CVFSHandler
@@ -39,7 +41,11 @@ protected:
 		int size;
 		bool dynamic;
 	};
-	std::map<std::string, FileData> files; 
+	/// ordered, for listing directories
+	std::map<std::string, FileData> files;
+	/// name -> entry in files, for the per-file lookups
+	SPRING_HASH_MAP<std::string, FileData*> fileIndex;
+	FileData* FindFile(const std::string& rawName, std::string* name);
 	std::map<std::string, CArchiveBase*> archives;
 };
 
@@ -1,5 +1,7 @@
 #include "StdAfx.h"
 #include <fstream>
+#include <sstream>
+#include <zlib.h>
 #include "mmgr.h"
 
 #include "ExternalAI/EngineOutHandler.h"
@@ -15,7 +17,9 @@
 #include "Sim/Misc/CategoryHandler.h"
 #include "Sim/Projectiles/ProjectileHandler.h"
 #include "Platform/errorhandler.h"
+#include "Platform/byteorder.h"
 #include "FileSystem/FileSystem.h"
+#include "FileSystem/CRC.h"
 #include "creg/Serializer.h"
 #include "Game/Game.h"
 #include "Game/GameSetup.h"
@@ -25,6 +29,8 @@
 #include "Game/WaitCommandsAI.h"
 #include "Sim/Misc/Wind.h"
 #include "Sim/Units/CommandAI/BuilderCAI.h"
+#include "Sim/Units/Unit.h"
+#include "Sim/Features/Feature.h"
 #include "Sim/Units/Groups/GroupHandler.h"
 #include "Game/GameServer.h"
 #include "Rendering/InMapDraw.h"
@@ -103,6 +109,76 @@ void CGameStateCollector::Serialize(creg::ISerializer& s)
 //	s.Serialize()
 }
 
+/// start of savegames with a header, older ones start with the script text
+static const char savegameMagic[8] = "SPRSAVE";
+
+#pragma pack(push, 1)
+struct SavegameHeader
+{
+	char magic[8];
+	int version;
+	/// size of the data after decompression
+	unsigned int dataSize;
+};
+#pragma pack(pop)
+
+/// size of the pieces that go through zlib
+static const unsigned zlibBufferSize = 256 * 1024;
+
+static void WriteCompressed(std::ostream& s, const std::string& data)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// savegames are written while the game waits, so favour speed
+	if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+		throw std::runtime_error("Could not initialize zlib");
+	}
+	std::vector<Bytef> buffer(zlibBufferSize);
+	stream.next_in = (Bytef*) data.data();
+	stream.avail_in = data.size();
+	int ret;
+	do {
+		stream.next_out = &buffer[0];
+		stream.avail_out = buffer.size();
+		ret = deflate(&stream, Z_FINISH);
+		s.write((const char*) &buffer[0], buffer.size() - stream.avail_out);
+	} while (ret == Z_OK);
+	deflateEnd(&stream);
+	if (ret != Z_STREAM_END || s.bad()) {
+		throw std::runtime_error("Could not compress savegame");
+	}
+}
+
+static void ReadCompressed(std::istream& s, std::string& data)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK) {
+		throw std::runtime_error("Could not initialize zlib");
+	}
+	std::vector<Bytef> buffer(zlibBufferSize);
+	std::vector<Bytef> output(zlibBufferSize);
+	int ret = Z_OK;
+	while (ret == Z_OK) {
+		if (stream.avail_in == 0) {
+			s.read((char*) &buffer[0], buffer.size());
+			stream.next_in = &buffer[0];
+			stream.avail_in = s.gcount();
+			if (stream.avail_in == 0) {
+				break; // truncated
+			}
+		}
+		stream.next_out = &output[0];
+		stream.avail_out = output.size();
+		ret = inflate(&stream, Z_NO_FLUSH);
+		data.append((const char*) &output[0], output.size() - stream.avail_out);
+	}
+	inflateEnd(&stream);
+	if (ret != Z_STREAM_END) {
+		throw content_error("Savegame is corrupt");
+	}
+}
+
 void PrintSize(const char *txt, int size)
 {
 	if (size>1024*1024*1024) logOutput.Print("%s %.1f GB",txt,size/(1024.0f*1024*1024)); else
@@ -121,26 +197,18 @@ void CLoadSaveHandler::SaveGame(const std::string& file)
 			throw content_error("Unable to save game to file \"" + file + "\"");
 		}
 
-		std::string scriptText;
-		if (gameSetup) {
-			scriptText = gameSetup->gameSetupText;
-		}
-
-		WriteString(ofs, scriptText);
-
-		WriteString(ofs, modName);
-		WriteString(ofs, mapName);
+		// serialize into memory, the serializer seeks a lot
+		std::ostringstream state(std::ios::out | std::ios::binary);
+		SaveGame(state, true);
+		const std::string data = state.str();
 
-		CGameStateCollector *gsc = new CGameStateCollector();
-
-		creg::COutputStreamSerializer os;
-		os.SavePackage(&ofs, gsc, gsc->GetClass());
-		PrintSize("Game",ofs.tellp());
-		int aistart = ofs.tellp();
-		for (int a=0; a < teamHandler->ActiveTeams();a++)
-			grouphandlers[a]->Save(&ofs);
-		eoh->Save(&ofs);
-		PrintSize("AIs",((int)ofs.tellp())-aistart);
+		SavegameHeader header;
+		memcpy(header.magic, savegameMagic, sizeof(header.magic));
+		header.version = swabdword(SAVEGAME_VERSION);
+		header.dataSize = swabdword(data.size());
+		ofs.write((const char*) &header, sizeof(header));
+		WriteCompressed(ofs, data);
+		PrintSize("Compressed", ofs.tellp());
 	} catch (content_error &e) {
 		logOutput.Print("Save failed(content error): %s",e.what());
 	} catch (std::exception &e) {
@@ -153,10 +221,109 @@ void CLoadSaveHandler::SaveGame(const std::string& file)
 	UnloadStartPicture();
 }
 
+void CLoadSaveHandler::SaveGame(std::ostream& ofs, bool saveAIs)
+{
+	std::string scriptText;
+	if (gameSetup) {
+		scriptText = gameSetup->gameSetupText;
+	}
+
+	WriteString(ofs, scriptText);
+
+	WriteString(ofs, modName);
+	WriteString(ofs, mapName);
+
+	CGameStateCollector *gsc = new CGameStateCollector();
+
+	creg::COutputStreamSerializer os;
+	os.SavePackage(&ofs, gsc, gsc->GetClass());
+	delete gsc;
+	PrintSize("Game",ofs.tellp());
+	if (saveAIs) {
+		int aistart = ofs.tellp();
+		for (int a=0; a < teamHandler->ActiveTeams();a++)
+			grouphandlers[a]->Save(&ofs);
+		eoh->Save(&ofs);
+		PrintSize("AIs",((int)ofs.tellp())-aistart);
+	}
+}
+
+static void UpdateChecksum(CRC& crc, float f)
+{
+	crc.Update(&f, sizeof(f));
+}
+
+static void UpdateChecksum(CRC& crc, const float3& v)
+{
+	UpdateChecksum(crc, v.x);
+	UpdateChecksum(crc, v.y);
+	UpdateChecksum(crc, v.z);
+}
+
+unsigned int CLoadSaveHandler::GetSimChecksum()
+{
+	CRC crc;
+	crc.Update(gs->frameNum);
+	crc.Update(gs->GetRandSeed());
+
+	for (std::list<CUnit*>::const_iterator ui = uh->activeUnits.begin(); ui != uh->activeUnits.end(); ++ui) {
+		const CUnit* unit = *ui;
+		crc.Update(unit->id);
+		crc.Update(unit->team);
+		UpdateChecksum(crc, unit->pos);
+		UpdateChecksum(crc, unit->speed);
+		UpdateChecksum(crc, unit->health);
+		UpdateChecksum(crc, unit->buildProgress);
+	}
+
+	const CFeatureSet& features = featureHandler->GetActiveFeatures();
+	for (CFeatureSet::const_iterator fi = features.begin(); fi != features.end(); ++fi) {
+		const CFeature* feature = *fi;
+		crc.Update(feature->id);
+		UpdateChecksum(crc, feature->pos);
+		UpdateChecksum(crc, feature->health);
+		UpdateChecksum(crc, feature->reclaimLeft);
+	}
+
+	for (int a = 0; a < teamHandler->ActiveTeams(); a++) {
+		const CTeam* team = teamHandler->Team(a);
+		UpdateChecksum(crc, (float) team->metal);
+		UpdateChecksum(crc, (float) team->energy);
+	}
+
+	return crc.GetDigest();
+}
+
 /// this just loads the mapname and some other early stuff
 void CLoadSaveHandler::LoadGameStartInfo(const std::string& file)
 {
-	ifs = new std::ifstream (filesystem.LocateFile(file).c_str(), std::ios::in|std::ios::binary);
+	std::ifstream* fileStream = new std::ifstream (filesystem.LocateFile(file).c_str(), std::ios::in|std::ios::binary);
+	ifs = fileStream;
+
+	SavegameHeader header;
+	fileStream->read((char*) &header, sizeof(header));
+	if (fileStream->gcount() == sizeof(header) && memcmp(header.magic, savegameMagic, sizeof(header.magic)) == 0) {
+		if (swabdword(header.version) != SAVEGAME_VERSION) {
+			delete fileStream;
+			ifs = NULL;
+			throw content_error("Savegame \"" + file + "\" has an unsupported version");
+		}
+		std::string data;
+		data.reserve(swabdword(header.dataSize));
+		try {
+			ReadCompressed(*fileStream, data);
+		} catch (...) {
+			delete fileStream;
+			ifs = NULL;
+			throw;
+		}
+		delete fileStream;
+		ifs = new std::istringstream(data, std::ios::in | std::ios::binary);
+	} else {
+		// old savegame without header
+		fileStream->clear();
+		fileStream->seekg(0);
+	}
 
 	// in case these contained values alredy
 	// (this is the case when loading a game through the spring menu eg),
@@ -184,7 +351,7 @@ void CLoadSaveHandler::LoadGameStartInfo(const std::string& file)
 }
 
 /// this should be called on frame 0 when the game has started
-void CLoadSaveHandler::LoadGame()
+void CLoadSaveHandler::LoadGame(bool loadAIs)
 {
 	RandomStartPicture(teamHandler->Team(gu->myTeam)->side);
 	PrintLoadMsg("Loading game");
@@ -197,9 +364,11 @@ void CLoadSaveHandler::LoadGame()
 
 	CGameStateCollector *gsc = (CGameStateCollector *)pGSC;
 	delete gsc; // the only job of gsc is to collect gamestate data
-	for (int a=0; a < teamHandler->ActiveTeams();a++)
-		grouphandlers[a]->Load(ifs);
-	eoh->Load(ifs);
+	if (loadAIs) {
+		for (int a=0; a < teamHandler->ActiveTeams();a++)
+			grouphandlers[a]->Load(ifs);
+		eoh->Load(ifs);
+	}
 	delete ifs;
 	//for (int a=0; a < teamHandler->ActiveTeams(); a++) { // For old savegames
 	//	if (teamHandler->Team(a)->isDead && eoh->IsSkirmishAI(a)) {
@@ -2,7 +2,8 @@
 #define LOADSAVEHANDLER_H
 
 #include <string>
-#include <fstream>
+#include <istream>
+#include <ostream>
 
 class CLoadInterface;
 
@@ -12,16 +13,38 @@ public:
 	CLoadSaveHandler();
 	~CLoadSaveHandler();
 	void SaveGame(const std::string& file);
+	/**
+	 * @brief write the game state to a stream, without any user feedback
+	 * @param saveAIs include the state of the local Skirmish AIs
+	 */
+	void SaveGame(std::ostream& ofs, bool saveAIs);
 	/// load things such as map and mod, needed to fire up the engine
 	void LoadGameStartInfo(const std::string& file);
-	void LoadGame(); 
+	/**
+	 * @param loadAIs whether the state was saved with the Skirmish AIs,
+	 *   see SaveGame(std::ostream&, bool)
+	 */
+	void LoadGame(bool loadAIs = true);
 	std::string FindSaveFile(const char* name);
 
+	/**
+	 * @brief checksum of the simulation state
+	 * Covers the frame, the random seed, the units, the features and the
+	 * team resources. A game state loaded from a snapshot has to give the
+	 * value its creator got when saving it, or the creg round-trip lost
+	 * something and the joiner would desync.
+	 */
+	static unsigned int GetSimChecksum();
+
+	/// savegame format written by SaveGame(file), older files have no header
+	static const int SAVEGAME_VERSION = 1;
+
 	std::string scriptText;
 	std::string mapName;
 	std::string modName;
 protected:
-	std::ifstream *ifs;
+	/// the file, or its decompressed content
+	std::istream *ifs;
 };
 
 #endif // LOADSAVEHANDLER_H
@@ -0,0 +1,196 @@
+#include "StdAfx.h"
+// LoadTaskGraph.cpp: implementation of the CLoadTaskGraph class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/version.hpp>
+#include <SDL_timer.h>
+#include "mmgr.h"
+
+#include "LoadTaskGraph.h"
+#include "LogOutput.h"
+#include "ConfigHandler.h"
+#include "FPUCheck.h"
+#include "TimeProfiler.h"
+
+
+CLoadTaskGraph::CLoadTaskGraph(const std::string& name)
+	: name(name)
+	, serial(false)
+{
+	// same knob the path estimator uses for its worker count
+	const int numThreads = configHandler->Get("HardwareThreadCount", 0);
+	if (numThreads == 1) {
+		serial = true;
+	} else if (numThreads <= 0) {
+#if (BOOST_VERSION >= 103500)
+		serial = (boost::thread::hardware_concurrency() <= 1);
+#endif
+	}
+}
+
+CLoadTaskGraph::~CLoadTaskGraph()
+{
+	// a main thread stage threw, don't leave threads running on our tasks
+	JoinThreads();
+}
+
+
+int CLoadTaskGraph::AddTask(const std::string& name, const TaskFunc& func, bool background)
+{
+	Task task;
+	task.name = name;
+	task.func = func;
+	task.background = background;
+	task.state = TASK_WAITING;
+	task.time = 0;
+	tasks.push_back(task);
+	return tasks.size() - 1;
+}
+
+void CLoadTaskGraph::AddDependency(int task, int dependsOn)
+{
+	// only allowing older dependencies rules out cycles
+	if (dependsOn < 0 || dependsOn >= task || task >= (int)tasks.size()) {
+		throw std::logic_error("CLoadTaskGraph: invalid dependency for " + name);
+	}
+	tasks[task].deps.push_back(dependsOn);
+}
+
+
+bool CLoadTaskGraph::IsReady(const Task& task) const
+{
+	if (task.state != TASK_WAITING) {
+		return false;
+	}
+	for (size_t d = 0; d < task.deps.size(); ++d) {
+		if (tasks[task.deps[d]].state != TASK_DONE) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// needs the lock
+void CLoadTaskGraph::StartBackgroundTasks()
+{
+	if (serial) {
+		return;
+	}
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		if (tasks[i].background && IsReady(tasks[i])) {
+			tasks[i].state = TASK_RUNNING;
+			threads.create_thread(boost::bind(&CLoadTaskGraph::BackgroundTask, this, (int)i));
+		}
+	}
+}
+
+/// needs the lock
+int CLoadTaskGraph::NextMainTask() const
+{
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		if ((!tasks[i].background || serial) && IsReady(tasks[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+void CLoadTaskGraph::RunTask(int id)
+{
+	const unsigned startTime = SDL_GetTicks();
+	tasks[id].func();
+	const unsigned endTime = SDL_GetTicks();
+
+	boost::mutex::scoped_lock lock(mutex);
+	tasks[id].time = endTime - startTime;
+	tasks[id].state = TASK_DONE;
+	cond.notify_all();
+}
+
+void CLoadTaskGraph::BackgroundTask(int id)
+{
+	// background stages may compute synced data, e.g. the smooth height mesh
+	streflop_init<streflop::Simple>();
+	profiler.SetThreadName(name + ": " + tasks[id].name);
+
+	// exceptions can not cross the thread boundary,
+	// so remember them for the main thread to rethrow
+	std::string error;
+	try {
+		RunTask(id);
+		return;
+	} catch (const std::exception& e) {
+		error = e.what();
+	} catch (...) {
+		error = "unknown exception";
+	}
+
+	boost::mutex::scoped_lock lock(mutex);
+	tasks[id].error = error;
+	tasks[id].state = TASK_DONE;
+	cond.notify_all();
+}
+
+void CLoadTaskGraph::JoinThreads()
+{
+	threads.join_all();
+}
+
+
+void CLoadTaskGraph::Run()
+{
+	const unsigned startTime = SDL_GetTicks();
+	std::string error;
+
+	while (true) {
+		int next = -1;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+
+			bool allDone = true;
+			for (size_t i = 0; i < tasks.size(); ++i) {
+				if (!tasks[i].error.empty() && error.empty()) {
+					error = tasks[i].name + ": " + tasks[i].error;
+				}
+				allDone &= (tasks[i].state == TASK_DONE);
+			}
+			if (allDone || !error.empty()) {
+				break;
+			}
+
+			StartBackgroundTasks();
+			next = NextMainTask();
+			if (next < 0) {
+				// only background stages left to wait for
+				cond.wait(lock);
+				continue;
+			}
+			tasks[next].state = TASK_RUNNING;
+		}
+		RunTask(next);
+	}
+
+	JoinThreads();
+
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+	PrintTimings(SDL_GetTicks() - startTime);
+}
+
+
+void CLoadTaskGraph::PrintTimings(unsigned wallTime) const
+{
+	unsigned sumTime = 0;
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		const Task& t = tasks[i];
+		logOutput.Print("%s: %-24s %6u ms%s", name.c_str(), t.name.c_str(), t.time,
+		                (t.background && !serial) ? " (background)" : "");
+		sumTime += t.time;
+	}
+	logOutput.Print("%s: %u ms total, %u ms spent in stages", name.c_str(), wallTime, sumTime);
+}
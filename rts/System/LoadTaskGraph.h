@@ -0,0 +1,85 @@
+#ifndef LOADTASKGRAPH_H
+#define LOADTASKGRAPH_H
+// LoadTaskGraph.h: interface for the CLoadTaskGraph class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+
+/**
+ * @brief runs the stages of a loading sequence as a dependency graph
+ *
+ * Every stage is added with AddTask() and may depend on any stage added
+ * before it. Main thread stages run on the thread calling Run(), in the order
+ * they were added, as soon as their dependencies are done; this is where
+ * everything touching GL, Lua, the network or the loading screen belongs.
+ * Background stages are started on their own thread the moment their
+ * dependencies are done, so they overlap with whatever the main thread is
+ * doing; they must only do plain CPU work on data nobody else writes to at
+ * the same time, and must not log (the timings are reported by Run()).
+ *
+ * Exceptions thrown by a background stage are rethrown from Run() as
+ * std::runtime_error once all running stages have finished.
+ */
+class CLoadTaskGraph : public boost::noncopyable
+{
+public:
+	typedef boost::function<void()> TaskFunc;
+
+	CLoadTaskGraph(const std::string& name);
+	/// waits for background stages that are still running
+	~CLoadTaskGraph();
+
+	/// @return id of the new stage, to be passed to AddDependency()
+	int AddTask(const std::string& name, const TaskFunc& func, bool background = false);
+	/// task will not start before dependsOn is done; dependsOn must be older
+	void AddDependency(int task, int dependsOn);
+
+	/// runs all stages, returns when every one of them is done
+	void Run();
+
+private:
+	enum TaskState {
+		TASK_WAITING,
+		TASK_RUNNING,
+		TASK_DONE
+	};
+
+	struct Task {
+		std::string name;
+		TaskFunc func;
+		bool background;
+		std::vector<int> deps;
+
+		TaskState state;
+		unsigned startTime;
+		unsigned time;
+		std::string error;
+	};
+
+	bool IsReady(const Task& task) const;
+	void StartBackgroundTasks();
+	int  NextMainTask() const;
+	void RunTask(int id);
+	void BackgroundTask(int id);
+	void JoinThreads();
+	void PrintTimings(unsigned wallTime) const;
+
+	const std::string name;
+	std::vector<Task> tasks;
+	/// run background stages on the main thread too (single core systems)
+	bool serial;
+
+	boost::mutex mutex;
+	boost::condition cond;
+	boost::thread_group threads;
+};
+
+#endif // LOADTASKGRAPH_H
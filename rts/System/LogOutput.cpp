@@ -7,6 +7,9 @@
 #include <fstream>
 #include <string.h>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/bind.hpp>
 
 #ifdef _MSC_VER
 #include <windows.h>
@@ -42,8 +45,6 @@ CLogSubsystem::CLogSubsystem(const char* name, bool enabled)
 /******************************************************************************/
 /******************************************************************************/
 
-CLogOutput logOutput;
-
 namespace
 {
 	struct PreInitLogEntry
@@ -72,6 +73,149 @@ static bool initialized = false;
 static const int BUFFER_SIZE = 2048;
 
 
+/******************************************************************************/
+/******************************************************************************/
+
+// everything Output() hands over to the writer thread goes through a bounded
+// multi-producer queue (D. Vyukov's sequence-numbered ring buffer); its memory
+// is allocated once, messages are only copied into the slot strings
+namespace
+{
+	struct LogQueueEntry
+	{
+		volatile long seq;
+		const CLogSubsystem* subsystem;
+		int frameNum;
+		string text;
+	};
+
+	// must be a power of two
+	const long LOG_QUEUE_SIZE = 4096;
+	const long LOG_QUEUE_MASK = LOG_QUEUE_SIZE - 1;
+
+#ifdef _MSC_VER
+	inline long AtomicLoad(volatile long* p) { return InterlockedExchangeAdd(p, 0); }
+	inline void AtomicStore(volatile long* p, long v) { InterlockedExchange(p, v); }
+	inline long AtomicCAS(volatile long* p, long cmp, long v) { return InterlockedCompareExchange(p, v, cmp); }
+	inline long AtomicInc(volatile long* p) { return InterlockedIncrement(p); }
+#else
+	inline long AtomicLoad(volatile long* p) { return __sync_fetch_and_add(p, 0); }
+	inline void AtomicStore(volatile long* p, long v) { __sync_synchronize(); *p = v; }
+	inline long AtomicCAS(volatile long* p, long cmp, long v) { return __sync_val_compare_and_swap(p, cmp, v); }
+	inline long AtomicInc(volatile long* p) { return __sync_add_and_fetch(p, 1); }
+#endif
+}
+
+static LogQueueEntry* logQueue = 0;
+static volatile long enqueuePos = 0;
+static volatile long dequeuePos = 0;
+static volatile long numDropped = 0;
+static long numDroppedReported = 0;
+
+static boost::thread* writerThread = 0;
+static volatile bool writerQuit = false;
+static volatile bool synchronous = false;
+/// held by whoever writes to filelog / stdout
+static boost::mutex writeMutex;
+
+
+static bool LogQueuePush(const CLogSubsystem& subsystem, int frameNum, const string& text)
+{
+	long pos = AtomicLoad(&enqueuePos);
+	LogQueueEntry* e;
+
+	while (true) {
+		e = &logQueue[pos & LOG_QUEUE_MASK];
+		const long dif = AtomicLoad(&e->seq) - pos;
+
+		if (dif == 0) {
+			if (AtomicCAS(&enqueuePos, pos, pos + 1) == pos)
+				break;
+			pos = AtomicLoad(&enqueuePos);
+		} else if (dif < 0) {
+			// the writer is a whole queue behind
+			AtomicInc(&numDropped);
+			return false;
+		} else {
+			pos = AtomicLoad(&enqueuePos);
+		}
+	}
+
+	e->subsystem = &subsystem;
+	e->frameNum = frameNum;
+	e->text = text;
+	AtomicStore(&e->seq, pos + 1);
+	return true;
+}
+
+/// the swapped in text is the string the caller gets back
+static bool LogQueuePop(const CLogSubsystem*& subsystem, int& frameNum, string& text)
+{
+	long pos = AtomicLoad(&dequeuePos);
+	LogQueueEntry* e;
+
+	while (true) {
+		e = &logQueue[pos & LOG_QUEUE_MASK];
+		const long dif = AtomicLoad(&e->seq) - (pos + 1);
+
+		if (dif == 0) {
+			if (AtomicCAS(&dequeuePos, pos, pos + 1) == pos)
+				break;
+			pos = AtomicLoad(&dequeuePos);
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = AtomicLoad(&dequeuePos);
+		}
+	}
+
+	subsystem = e->subsystem;
+	frameNum = e->frameNum;
+	text.swap(e->text);
+	AtomicStore(&e->seq, pos + LOG_QUEUE_SIZE);
+	return true;
+}
+
+/**
+ * Locks writeMutex, but gives up after a while: in a crash the writer thread
+ * may have been stopped while holding it, and the report must still be written.
+ * After the first timeout the mutex is considered lost and no longer waited
+ * for, so a crash report does not take a second per line.
+ */
+class CrashSafeWriteLock
+{
+public:
+	CrashSafeWriteLock() : locked(false)
+	{
+		if (timedOut)
+			return;
+		for (int i = 0; i < 100 && !locked; ++i) {
+			locked = writeMutex.try_lock();
+			if (!locked)
+				boost::this_thread::sleep(boost::posix_time::millisec(10));
+		}
+		if (!locked)
+			timedOut = true;
+	}
+	~CrashSafeWriteLock()
+	{
+		if (locked)
+			writeMutex.unlock();
+	}
+
+private:
+	bool locked;
+	static volatile bool timedOut;
+};
+
+volatile bool CrashSafeWriteLock::timedOut = false;
+
+
+// defined after the statics above, so it is destroyed (and stops the
+// writer thread) before they are
+CLogOutput logOutput;
+
+
 LogObject::LogObject(const CLogSubsystem& _subsys) : subsys(_subsys)
 {
 }
@@ -104,6 +248,9 @@ void CLogOutput::End()
 {
 	GML_STDMUTEX_LOCK_NOPROF(log); // End
 
+	StopWriter();
+
+	CrashSafeWriteLock lock;
 	SafeDelete(filelog);
 }
 
@@ -111,7 +258,18 @@ void CLogOutput::Flush()
 {
 	GML_STDMUTEX_LOCK_NOPROF(log); // Flush
 
-	filelog->flush();
+	WriteQueued();
+}
+
+void CLogOutput::SetSynchronous()
+{
+	synchronous = true;
+	WriteQueued();
+}
+
+unsigned CLogOutput::GetNumDropped() const
+{
+	return AtomicLoad(&numDropped);
 }
 
 const char* CLogOutput::GetFilename() const
@@ -142,6 +300,8 @@ void CLogOutput::Initialize()
 	if (filelog->bad())
 		SafeDelete(filelog);
 
+	StartWriter();
+
 	initialized = true;
 	Print("LogOutput initialized.\n");
 	Print("Spring %s", SpringVersion::GetFull().c_str());
@@ -149,15 +309,20 @@ void CLogOutput::Initialize()
 
 	InitializeSubsystems();
 
-	for (vector<PreInitLogEntry>::iterator it = preInitLog().begin(); it != preInitLog().end(); ++it)
 	{
-		if (!it->subsystem->enabled) return;
-
-		// Output to subscribers
-		for(vector<ILogSubscriber*>::iterator lsi = subscribers.begin(); lsi != subscribers.end(); ++lsi)
-			(*lsi)->NotifyLogMsg(*(it->subsystem), it->text);
+		CrashSafeWriteLock lock;
+		for (vector<PreInitLogEntry>::iterator it = preInitLog().begin(); it != preInitLog().end(); ++it)
+		{
+			if (!it->subsystem->enabled) return;
+
+			// Output to subscribers
+			for(vector<ILogSubscriber*>::iterator lsi = subscribers.begin(); lsi != subscribers.end(); ++lsi)
+				(*lsi)->NotifyLogMsg(*(it->subsystem), it->text);
+			// already printed to stdout by Output()
+			WriteMessage(*it->subsystem, it->text, -1, false);
+		}
 		if (filelog)
-			ToFile(*it->subsystem, it->text);
+			filelog->flush();
 	}
 	preInitLog().clear();
 }
@@ -247,34 +412,146 @@ void CLogOutput::InitializeSubsystems()
  */
 void CLogOutput::Output(const CLogSubsystem& subsystem, const std::string& str)
 {
-	GML_STDMUTEX_LOCK(log); // Output
+	{
+		GML_STDMUTEX_LOCK(log); // Output
+
+		if (!initialized) {
+			ToStdout(subsystem, str);
+			preInitLog().push_back(PreInitLogEntry(&subsystem, str));
+			return;
+		}
+
+		if (!subsystem.enabled) return;
+
+		// Output to subscribers
+		for(vector<ILogSubscriber*>::iterator lsi = subscribers.begin(); lsi != subscribers.end(); ++lsi)
+			(*lsi)->NotifyLogMsg(subsystem, str);
+	}
+
+	int frameNum = -1;
+#if !defined UNITSYNC && !defined DEDICATED
+	if (gs) {
+		frameNum = gs->frameNum;
+	}
+#endif
+
+	if (synchronous || !writerThread) {
+		CrashSafeWriteLock lock;
+		WriteMessage(subsystem, str, frameNum);
+		if (filelog)
+			filelog->flush();
+		std::cout.flush();
+	} else {
+		LogQueuePush(subsystem, frameNum, str);
+	}
+}
+
+
+void CLogOutput::StartWriter()
+{
+	if (writerThread)
+		return;
+
+	logQueue = new LogQueueEntry[LOG_QUEUE_SIZE];
+	for (long i = 0; i < LOG_QUEUE_SIZE; ++i)
+		logQueue[i].seq = i;
+
+	writerQuit = false;
+	writerThread = new boost::thread(boost::bind(&CLogOutput::WriterLoop, this));
+}
+
 
-	if (!initialized) {
-		ToStdout(subsystem, str);
-		preInitLog().push_back(PreInitLogEntry(&subsystem, str));
+void CLogOutput::StopWriter()
+{
+	if (!writerThread)
 		return;
+
+	writerQuit = true;
+	// don't wait for ourselves, or for long (a crashed writer never returns);
+	// either way everything still queued gets written out right here
+	if (boost::this_thread::get_id() != writerThread->get_id() &&
+	    writerThread->timed_join(boost::posix_time::seconds(1))) {
+		delete writerThread;
 	}
+	writerThread = 0;
+	synchronous = true;
+	WriteQueued();
+}
 
-	if (!subsystem.enabled) return;
 
-	// Output to subscribers
-	for(vector<ILogSubscriber*>::iterator lsi = subscribers.begin(); lsi != subscribers.end(); ++lsi)
-		(*lsi)->NotifyLogMsg(subsystem, str);
+void CLogOutput::WriterLoop()
+{
+	while (!writerQuit) {
+		WriteQueued();
+		boost::this_thread::sleep(boost::posix_time::millisec(10));
+	}
+}
+
+
+void CLogOutput::WriteQueued()
+{
+	if (!logQueue)
+		return;
+
+	CrashSafeWriteLock lock;
+
+	const CLogSubsystem* subsystem;
+	int frameNum;
+	string text;
+	bool written = false;
+
+	while (LogQueuePop(subsystem, frameNum, text)) {
+		WriteMessage(*subsystem, text, frameNum);
+		written = true;
+	}
+
+	const long dropped = AtomicLoad(&numDropped);
+	if (dropped != numDroppedReported) {
+		char msg[128];
+		SNPRINTF(msg, sizeof(msg), "LogOutput: %ld messages dropped (log queue full)", dropped - numDroppedReported);
+		WriteMessage(LOG_DEFAULT, msg, -1);
+		numDroppedReported = dropped;
+		written = true;
+	}
+
+	// one flush per batch instead of one per message
+	if (written) {
+		if (filelog)
+			filelog->flush();
+		std::cout.flush();
+	}
+}
+
+
+void CLogOutput::WriteMessage(const CLogSubsystem& subsystem, const std::string& message, int frameNum, bool toStdout)
+{
+	if (message.empty())
+		return;
+	const bool newline = (message.at(message.size() -1) != '\n');
 
 #ifdef _MSC_VER
-	int index = strlen(str.c_str()) - 1;
-	bool newline = ((index < 0) || (str[index] != '\n'));
-	OutputDebugString(str.c_str());
+	OutputDebugString(message.c_str());
 	if (newline)
 		OutputDebugString("\n");
 #endif // _MSC_VER
 
-
 	if (filelog) {
-		ToFile(subsystem, str);
+		if (frameNum >= 0)
+			(*filelog) << IntToString(frameNum, "[%7d] ");
+		if (subsystem.name && *subsystem.name)
+			(*filelog) << subsystem.name << ": ";
+		(*filelog) << message;
+		if (newline)
+			(*filelog) << '\n';
 	}
 
-	ToStdout(subsystem, str);
+	if (!toStdout)
+		return;
+	if (subsystem.name && *subsystem.name)
+		std::cout << subsystem.name << ": ";
+	std::cout << message;
+	if (newline)
+		std::cout << '\n';
 }
 
 
@@ -383,23 +660,3 @@ void CLogOutput::ToStdout(const CLogSubsystem& subsystem, const std::string mess
 	else
 		std::cout.flush();
 }
-
-void CLogOutput::ToFile(const CLogSubsystem& subsystem, const std::string message)
-{
-	if (message.empty())
-		return;
-	const bool newline = (message.at(message.size() -1) != '\n');
-
-#if !defined UNITSYNC && !defined DEDICATED
-	if (gs) {
-		(*filelog) << IntToString(gs->frameNum, "[%7d] ");
-	}
-#endif
-	if (subsystem.name && *subsystem.name)
-		(*filelog) << subsystem.name << ": ";
-	(*filelog) << message;
-	if (newline)
-		(*filelog) << std::endl;
-	else
-		filelog->flush();
-}
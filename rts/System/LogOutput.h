@@ -93,7 +93,16 @@ public:
 };
 
 
-/** @brief logging class */
+/**
+ * @brief logging class
+ *
+ * Once initialized, messages are handed to the subscribers right away, but
+ * writing them to the log file and stdout happens on a background thread:
+ * Output() only pushes the message into a fixed size lock-free queue. If the
+ * queue is full the message is not written (subscribers still get it) and
+ * counted as dropped, so logging never blocks the calling thread.
+ * The crash handlers switch to synchronous output before writing their report.
+ */
 class CLogOutput
 {
 public:
@@ -121,14 +130,31 @@ public:
 	const char* GetFilename() const;
 	void SetFilename(const char* filename);
 	void Initialize();
+	/// writes out all queued messages and flushes the log file
 	void Flush();
+	/**
+	 * Writes out the queued messages and from then on every message directly
+	 * on the calling thread; for crash handlers, which may run while the
+	 * writer thread is gone or halted.
+	 */
+	void SetSynchronous();
+
+	/// number of messages not written to file / stdout because the queue was full
+	unsigned GetNumDropped() const;
 
 protected:
 	void InitializeSubsystems();
 	void Output(const CLogSubsystem& subsystem, const std::string& str);
 
 	void ToStdout(const CLogSubsystem& subsystem, const std::string message);
-	void ToFile(const CLogSubsystem& subsystem, const std::string message);
+
+	void StartWriter();
+	void StopWriter();
+	void WriterLoop();
+	/// writes out everything queued so far, on the calling thread
+	void WriteQueued();
+	/// writes one message without flushing the streams
+	void WriteMessage(const CLogSubsystem& subsystem, const std::string& message, int frameNum, bool toStdout = true);
 };
 
 
@@ -0,0 +1,37 @@
+#include "BroadcastBuffer.h"
+
+namespace netcode
+{
+
+BroadcastBuffer::BroadcastBuffer() : length(0), chunksValid(true)
+{
+}
+
+void BroadcastBuffer::Add(boost::shared_ptr<const RawPacket> packet)
+{
+	packets.push_back(packet);
+	length += packet->length;
+	chunksValid = false;
+}
+
+void BroadcastBuffer::Clear()
+{
+	packets.clear();
+	chunks.clear();
+	length = 0;
+	chunksValid = true;
+}
+
+const std::vector<ChunkDataPtr>& BroadcastBuffer::GetChunks()
+{
+	if (!chunksValid)
+	{
+		chunks.clear();
+		for (std::vector< boost::shared_ptr<const RawPacket> >::const_iterator it = packets.begin(); it != packets.end(); ++it)
+			AppendToChunks(chunks, (*it)->data, (*it)->length);
+		chunksValid = true;
+	}
+	return chunks;
+}
+
+} // namespace netcode
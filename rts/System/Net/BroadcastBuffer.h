@@ -0,0 +1,59 @@
+#ifndef BROADCASTBUFFER_H
+#define BROADCASTBUFFER_H
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "RawPacket.h"
+#include "UDPConnection.h"
+
+namespace netcode
+{
+
+/**
+@brief messages to be sent to several connections at once
+Collect the messages with Add(), then hand the buffer to every connection with
+CConnection::SendData(BroadcastBuffer&). UDP connections use GetChunks(), so the
+payload is cut into chunks only once and shared by all of them, instead of
+every connection copying and fragmenting the same messages on its own.
+*/
+class BroadcastBuffer : public boost::noncopyable
+{
+public:
+	BroadcastBuffer();
+
+	void Add(boost::shared_ptr<const RawPacket> packet);
+	void Clear();
+
+	bool Empty() const
+	{
+		return packets.empty();
+	};
+	/// total size of the messages in bytes
+	unsigned GetLength() const
+	{
+		return length;
+	};
+
+	const std::vector< boost::shared_ptr<const RawPacket> >& GetPackets() const
+	{
+		return packets;
+	};
+	/**
+	@brief the messages cut into chunk payloads
+	Built on the first call after the buffer was changed.
+	*/
+	const std::vector<ChunkDataPtr>& GetChunks();
+
+private:
+	std::vector< boost::shared_ptr<const RawPacket> > packets;
+	unsigned length;
+
+	std::vector<ChunkDataPtr> chunks;
+	bool chunksValid;
+};
+
+} // namespace netcode
+
+#endif // BROADCASTBUFFER_H
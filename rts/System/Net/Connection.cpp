@@ -1,5 +1,7 @@
 #include "Connection.h"
 
+#include "BroadcastBuffer.h"
+
 namespace netcode {
 
 CConnection::CConnection()
@@ -12,6 +14,13 @@ CConnection::~CConnection()
 {
 }
 
+void CConnection::SendData(BroadcastBuffer& data)
+{
+	const std::vector< boost::shared_ptr<const RawPacket> >& packets = data.GetPackets();
+	for (std::vector< boost::shared_ptr<const RawPacket> >::const_iterator it = packets.begin(); it != packets.end(); ++it)
+		SendData(*it);
+}
+
 unsigned CConnection::GetDataReceived() const
 {
 	return dataRecv;
@@ -8,6 +8,7 @@
 
 namespace netcode
 {
+class BroadcastBuffer;
 
 /**
 @brief Base class for connecting to various recievers / senders
@@ -19,6 +20,11 @@ public:
 	virtual ~CConnection();
 	
 	virtual void SendData(boost::shared_ptr<const RawPacket> data)=0;
+	/**
+	@brief Send messages which are sent to several connections
+	The default sends every packet on its own.
+	*/
+	virtual void SendData(BroadcastBuffer& data);
 
 	virtual bool HasIncomingData() const = 0;
 
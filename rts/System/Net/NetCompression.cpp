@@ -0,0 +1,84 @@
+#include "NetCompression.h"
+
+#include <string.h>
+#include <algorithm>
+#include <zlib.h>
+
+namespace netcode
+{
+
+/// size of the steps in which the output vectors grow
+static const unsigned outputStep = 1024;
+
+StreamDeflater::StreamDeflater()
+{
+	stream = new z_stream;
+	memset(stream, 0, sizeof(z_stream));
+	deflateInit(stream, Z_DEFAULT_COMPRESSION);
+}
+
+StreamDeflater::~StreamDeflater()
+{
+	deflateEnd(stream);
+	delete stream;
+}
+
+void StreamDeflater::Compress(const boost::uint8_t* data, unsigned length, std::vector<boost::uint8_t>& out)
+{
+	stream->next_in = const_cast<Bytef*>(data);
+	stream->avail_in = length;
+
+	do
+	{
+		const size_t pos = out.size();
+		out.resize(pos + outputStep);
+		stream->next_out = &out[pos];
+		stream->avail_out = outputStep;
+		deflate(stream, Z_SYNC_FLUSH);
+		out.resize(pos + outputStep - stream->avail_out);
+	} while (stream->avail_out == 0);
+}
+
+
+StreamInflater::StreamInflater()
+{
+	stream = new z_stream;
+	memset(stream, 0, sizeof(z_stream));
+	inflateInit(stream);
+}
+
+StreamInflater::~StreamInflater()
+{
+	inflateEnd(stream);
+	delete stream;
+}
+
+bool StreamInflater::Decompress(const boost::uint8_t* data, unsigned length, std::vector<boost::uint8_t>& out, unsigned maxOutput)
+{
+	stream->next_in = const_cast<Bytef*>(data);
+	stream->avail_in = length;
+
+	const size_t startSize = out.size();
+	do
+	{
+		// room for one byte more than allowed, to notice when there is more
+		const unsigned produced = out.size() - startSize;
+		if (produced > maxOutput)
+			return false;
+		const unsigned step = std::min(outputStep, maxOutput - produced + 1);
+
+		const size_t pos = out.size();
+		out.resize(pos + step);
+		stream->next_out = &out[pos];
+		stream->avail_out = step;
+		const int ret = inflate(stream, Z_SYNC_FLUSH);
+		out.resize(pos + step - stream->avail_out);
+		// Z_BUF_ERROR only means there was nothing left to do
+		if (ret != Z_OK && ret != Z_BUF_ERROR)
+			return false;
+	} while (stream->avail_out == 0);
+
+	return (out.size() - startSize <= maxOutput);
+}
+
+} // namespace netcode
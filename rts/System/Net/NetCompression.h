@@ -0,0 +1,55 @@
+#ifndef NETCOMPRESSION_H
+#define NETCOMPRESSION_H
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+
+struct z_stream_s;
+
+namespace netcode
+{
+
+/**
+@brief deflate compressor for one direction of a connection
+The compression history is kept between calls, so repeated messages compress
+well even when every call only sees a few of them. The output of every call
+is flushed, so the other side can decode it as soon as it arrives.
+*/
+class StreamDeflater : public boost::noncopyable
+{
+public:
+	StreamDeflater();
+	~StreamDeflater();
+
+	/// compress length bytes and append the result to out
+	void Compress(const boost::uint8_t* data, unsigned length, std::vector<boost::uint8_t>& out);
+
+private:
+	z_stream_s* stream;
+};
+
+/**
+@brief counterpart of StreamDeflater
+Must be fed everything the deflater produced, in order.
+*/
+class StreamInflater : public boost::noncopyable
+{
+public:
+	StreamInflater();
+	~StreamInflater();
+
+	/**
+	@brief decompress length bytes and append the result to out
+	@param maxOutput the data is treated as corrupt if it would append more
+	@return false if the data is corrupt, the stream is unusable afterwards
+	*/
+	bool Decompress(const boost::uint8_t* data, unsigned length, std::vector<boost::uint8_t>& out, unsigned maxOutput);
+
+private:
+	z_stream_s* stream;
+};
+
+} // namespace netcode
+
+#endif // NETCOMPRESSION_H
@@ -5,10 +5,14 @@
 #endif
 
 #include "UDPConnection.h"
+#include "BroadcastBuffer.h"
+#include "NetCompression.h"
 
 
 #include <boost/format.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
 
 #include "mmgr.h"
 
@@ -16,14 +20,126 @@
 #include "ProtocolDef.h"
 #include "Exception.h"
 #include "ConfigHandler.h"
+#include "LogOutput.h"
 #include <boost/cstdint.hpp>
 
 namespace netcode {
 using namespace boost::asio;
 
-const unsigned UDPMaxPacketSize = 4096;
 const int MaxChunkSize = 254;
 
+/// frame header: 1 byte type, 2 bytes length
+const unsigned FrameHeaderSize = 3;
+enum FrameType
+{
+	FRAME_RAW = 0,
+	FRAME_DEFLATE = 1
+};
+/// batches smaller than this are not worth compressing
+const unsigned MinDeflateSize = 32;
+/// input per deflate frame, the output has to fit into the length field
+const unsigned MaxDeflateInput = 8192;
+
+/**
+@brief free-list of blocks for objects of type T
+Blocks are carved out of slabs which are kept for the lifetime of the process,
+so after the first few packets chunks are recycled instead of allocated.
+Connections live in the client and in the server thread, hence the lock.
+*/
+template<typename T>
+class BlockPool : public boost::noncopyable
+{
+public:
+	BlockPool() : freeList(NULL) {};
+
+	void* Alloc()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		if (freeList == NULL)
+			Grow();
+		FreeNode* node = freeList;
+		freeList = node->next;
+		return node;
+	};
+	void Free(void* p)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		FreeNode* node = static_cast<FreeNode*>(p);
+		node->next = freeList;
+		freeList = node;
+	};
+
+	static BlockPool& GetInstance()
+	{
+		// never destructed, the last block may be freed very late
+		static BlockPool* pool = new BlockPool();
+		return *pool;
+	};
+
+private:
+	struct FreeNode
+	{
+		FreeNode* next;
+	};
+	static const unsigned blocksPerSlab = 64;
+	/// sizeof(T), rounded up so every block is aligned for a pointer
+	static const unsigned blockSize = ((sizeof(T) + sizeof(void*) - 1) / sizeof(void*)) * sizeof(void*);
+
+	void Grow()
+	{
+		char* slab = static_cast<char*>(::operator new(blockSize * blocksPerSlab));
+		for (unsigned i = 0; i != blocksPerSlab; ++i)
+		{
+			FreeNode* node = reinterpret_cast<FreeNode*>(slab + i * blockSize);
+			node->next = freeList;
+			freeList = node;
+		}
+	};
+
+	FreeNode* freeList;
+	boost::mutex mutex;
+};
+
+void* ChunkData::operator new(size_t size)
+{
+	assert(size == sizeof(ChunkData));
+	return BlockPool<ChunkData>::GetInstance().Alloc();
+}
+
+void ChunkData::operator delete(void* p)
+{
+	if (p != NULL)
+		BlockPool<ChunkData>::GetInstance().Free(p);
+}
+
+void* Chunk::operator new(size_t size)
+{
+	assert(size == sizeof(Chunk));
+	return BlockPool<Chunk>::GetInstance().Alloc();
+}
+
+void Chunk::operator delete(void* p)
+{
+	if (p != NULL)
+		BlockPool<Chunk>::GetInstance().Free(p);
+}
+
+void AppendToChunks(std::vector<ChunkDataPtr>& chunks, const unsigned char* data, unsigned length)
+{
+	while (length > 0)
+	{
+		if (chunks.empty() || chunks.back()->size == MaxChunkSize)
+			chunks.push_back(ChunkDataPtr(new ChunkData));
+
+		ChunkData& chunk = *chunks.back();
+		const unsigned numBytes = std::min((unsigned)MaxChunkSize - chunk.size, length);
+		memcpy(chunk.data + chunk.size, data, numBytes);
+		chunk.size += numBytes;
+		data += numBytes;
+		length -= numBytes;
+	}
+}
+
 class Unpacker
 {
 public:
@@ -39,9 +155,9 @@ public:
 		t = *reinterpret_cast<const T*>(data+pos);
 		pos += sizeof(t);
 	};
-	void Unpack(std::vector<uint8_t>& t, unsigned _length)
+	void Unpack(uint8_t* t, unsigned _length)
 	{
-		std::copy(data +pos, data +pos+_length, std::back_inserter(t));
+		memcpy(t, data + pos, _length);
 		pos+= _length;
 	};
 
@@ -72,15 +188,33 @@ public:
 	};
 	void Pack(std::vector<uint8_t>& _data)
 	{
-		std::copy(_data.begin(), _data.end(), std::back_inserter(data));
+		data.insert(data.end(), _data.begin(), _data.end());
+	};
+	void Pack(const uint8_t* _data, unsigned _length)
+	{
+		data.insert(data.end(), _data, _data + _length);
 	};
 
 private:
 	std::vector<uint8_t>& data;
 };
 
+Packet::Packet() : lastContinuous(0), nakType(0), flags(0), deflateFrom(-1)
+{
+}
+
 Packet::Packet(const unsigned char* data, unsigned length)
 {
+	Unpack(data, length);
+}
+
+void Packet::Unpack(const unsigned char* data, unsigned length)
+{
+	naks.clear();
+	chunks.clear();
+	flags = 0;
+	deflateFrom = -1;
+
 	Unpacker buf(data, length);
 	buf.Unpack(lastContinuous);
 	buf.Unpack(nakType);
@@ -100,37 +234,64 @@ Packet::Packet(const unsigned char* data, unsigned length)
 	while (buf.Remaining() > Chunk::headerSize)
 	{
 		ChunkPtr temp(new Chunk);
+		temp->payload = new ChunkData;
+		ChunkData& payload = *temp->payload;
 		buf.Unpack(temp->chunkNumber);
-		buf.Unpack(temp->chunkSize);
-		if (buf.Remaining() >= temp->chunkSize)
+		buf.Unpack(payload.size);
+		if (buf.Remaining() >= payload.size && payload.size <= ChunkData::maxSize)
 		{
-			buf.Unpack(temp->data, temp->chunkSize);
+			buf.Unpack(payload.data, payload.size);
 			chunks.push_back(temp);
 		}
 		else
 		{
 			// defective, ignore
-			break;
+			return;
 		}
 	}
+
+	// the optional trailer, too short to be taken for a chunk
+	if (buf.Remaining() == 1 || buf.Remaining() == 5)
+	{
+		buf.Unpack(flags);
+		if (buf.Remaining() == 4)
+			buf.Unpack(deflateFrom);
+	}
 }
 
-Packet::Packet(int _lastContinuous, int _nak) : lastContinuous(_lastContinuous), nakType(_nak)
+Packet::Packet(int _lastContinuous, int _nak) : lastContinuous(_lastContinuous), nakType(_nak), flags(0), deflateFrom(-1)
 {
 }
 
+void Packet::Reset(int _lastContinuous, int _nak)
+{
+	lastContinuous = _lastContinuous;
+	nakType = _nak;
+	naks.clear();
+	chunks.clear();
+	flags = 0;
+	deflateFrom = -1;
+}
+
 void Packet::Serialize(std::vector<uint8_t>& data)
 {
+	data.clear();
 	data.reserve(GetSize());
 	Packer buf(data);
 	buf.Pack(lastContinuous);
 	buf.Pack(nakType);
 	buf.Pack(naks);
-	for (std::list<ChunkPtr>::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
+	for (std::vector<ChunkPtr>::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
 	{
 		buf.Pack((*it)->chunkNumber);
-		buf.Pack((*it)->chunkSize);
-		buf.Pack((*it)->data);
+		buf.Pack((*it)->payload->size);
+		buf.Pack((*it)->payload->data, (*it)->payload->size);
+	}
+	if (flags != 0)
+	{
+		buf.Pack(flags);
+		if (deflateFrom >= 0)
+			buf.Pack(deflateFrom);
 	}
 }
 
@@ -160,8 +321,6 @@ UDPConnection::UDPConnection(int sourceport, const std::string& address, const u
 
 UDPConnection::~UDPConnection()
 {
-	if (fragmentBuffer)
-		delete fragmentBuffer;
 	Flush(true);
 }
 
@@ -171,6 +330,25 @@ void UDPConnection::SendData(boost::shared_ptr<const RawPacket> data)
 	outgoingData.push_back(data);
 }
 
+void UDPConnection::SendData(BroadcastBuffer& data)
+{
+	if (deflateFrom >= 0 || (compressionWanted && peerCanInflate))
+	{
+		// compressed chunks are specific to this connection, can't share them
+		const std::vector<boost::shared_ptr<const RawPacket> >& packets = data.GetPackets();
+		outgoingData.insert(outgoingData.end(), packets.begin(), packets.end());
+		return;
+	}
+
+	// chunk numbers are per connection, so whatever was queued before
+	// has to go into chunks of its own to keep the order of messages
+	CreateChunks();
+
+	const std::vector<ChunkDataPtr>& chunks = data.GetChunks();
+	for (std::vector<ChunkDataPtr>::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
+		CreateChunk(*it, currentNum++);
+}
+
 bool UDPConnection::HasIncomingData() const
 {
 	return !msgQueue.empty();
@@ -213,21 +391,20 @@ void UDPConnection::Update()
 		size_t bytes_avail = 0;
 		while ((bytes_avail = mySocket->available()) > 0)
 		{
-			std::vector<uint8_t> buffer(bytes_avail);
 			ip::udp::endpoint sender_endpoint;
 			size_t bytesReceived;
 			boost::asio::ip::udp::socket::message_flags flags = 0;
 			boost::system::error_code err;
-			bytesReceived = mySocket->receive_from(boost::asio::buffer(buffer), sender_endpoint, flags, err);
+			bytesReceived = mySocket->receive_from(boost::asio::buffer(recvBuffer), sender_endpoint, flags, err);
 			if (CheckErrorCode(err))
 				break;
 
 			if (bytesReceived < Packet::headerSize)
 				continue;
-			Packet data(&buffer[0], bytesReceived);
 			if (CheckAddress(sender_endpoint))
 			{
-				ProcessRawPacket(data);
+				recvPacket.Unpack(recvBuffer, bytesReceived);
+				ProcessRawPacket(recvPacket);
 			}
 		}
 	}
@@ -244,6 +421,18 @@ void UDPConnection::ProcessRawPacket(Packet& incoming)
 
 	AckChunks(incoming.lastContinuous);
 
+	peerCanInflate = (incoming.flags & Packet::CAN_INFLATE);
+	if ((incoming.flags & Packet::DEFLATING) && incoming.deflateFrom >= 0 && inflateFrom < 0)
+	{
+		inflateFrom = incoming.deflateFrom;
+		// without NetworkCompression we never offered CAN_INFLATE,
+		// so DecodeFrames() rejects any deflate frame
+		if (compressionWanted)
+			inflater.reset(new StreamInflater());
+	}
+	if (deflateFrom >= 0 && incoming.lastContinuous >= deflateFrom)
+		deflateFromAcked = true;
+
 	if (!unackedChunks.empty())
 	{
 		if (incoming.nakType < 0)
@@ -263,35 +452,43 @@ void UDPConnection::ProcessRawPacket(Packet& incoming)
 			}
 		}
 	}
-	for (std::list<ChunkPtr>::const_iterator it = incoming.chunks.begin(); it != incoming.chunks.end(); ++it)
+	for (std::vector<ChunkPtr>::const_iterator it = incoming.chunks.begin(); it != incoming.chunks.end(); ++it)
 	{
 		if (lastInOrder >= (*it)->chunkNumber || waitingPackets.find((*it)->chunkNumber) != waitingPackets.end())
 		{
 			++droppedChunks;
 			continue;
 		}
-		waitingPackets.insert((*it)->chunkNumber, new RawPacket(&(*it)->data[0], (*it)->data.size()));
+		// keep a reference instead of copying the payload
+		waitingPackets.insert(std::make_pair((*it)->chunkNumber, *it));
 	}
 
 	packetMap::iterator wpi;
 	//process all in order packets that we have waiting
 	while ((wpi = waitingPackets.find(lastInOrder+1)) != waitingPackets.end())
 	{
-		std::vector<boost::uint8_t> buf;
-		if (fragmentBuffer)
-		{
-			buf.resize(fragmentBuffer->length);
-			// combine with fragment buffer
-			std::copy(fragmentBuffer->data, fragmentBuffer->data+fragmentBuffer->length, buf.begin());
-			delete fragmentBuffer;
-			fragmentBuffer = NULL;
-		}
+		// the buffer still holds the fragment of the last message, if any
+		std::vector<boost::uint8_t>& buf = reassemblyBuffer;
 
 		lastInOrder++;
-		std::copy(wpi->second->data, wpi->second->data+wpi->second->length, std::back_inserter(buf));
+		const ChunkData& chunk = *wpi->second->payload;
+		if (inflateFrom >= 0 && lastInOrder >= inflateFrom)
+		{
+			frameBuffer.insert(frameBuffer.end(), chunk.data, chunk.data + chunk.size);
+			if (!inflateFailed && !DecodeFrames())
+			{
+				LogObject() << "Corrupt compressed data received from " << GetFullAddress();
+				inflateFailed = true;
+			}
+		}
+		else
+		{
+			buf.insert(buf.end(), chunk.data, chunk.data + chunk.size);
+		}
 		waitingPackets.erase(wpi);
 
-		for (unsigned pos = 0; pos < buf.size();)
+		unsigned pos = 0;
+		while (pos < buf.size())
 		{
 			char msgid = buf[pos];
 			ProtocolDef* proto = ProtocolDef::instance();
@@ -321,8 +518,7 @@ void UDPConnection::ProcessRawPacket(Packet& incoming)
 					}
 					else
 					{
-						// no => store the fragment and break
-						fragmentBuffer = new RawPacket(&buf[pos], buf.size() - pos);
+						// no => keep the fragment and break
 						break;
 					}
 				}
@@ -339,8 +535,7 @@ void UDPConnection::ProcessRawPacket(Packet& incoming)
 				}
 				else
 				{
-					// no => store the fragment and break
-					fragmentBuffer = new RawPacket(&buf[pos], buf.size() - pos);
+					// no => keep the fragment and break
 					break;
 				}
 			}
@@ -350,6 +545,7 @@ void UDPConnection::ProcessRawPacket(Packet& incoming)
 				pos++;
 			}
 		}
+		buf.erase(buf.begin(), buf.begin() + pos);
 	}
 }
 
@@ -365,38 +561,17 @@ void UDPConnection::Flush(const bool forced)
 	const bool waitMore = (lastChunkCreated < curTime - spring_msecs(34)) ? false : true;
 	if (forced || (!waitMore && lastChunkCreated + spring_msecs(200) < (curTime + outgoingLength*10)))
 	{
-		boost::uint8_t buffer[UDPMaxPacketSize];
-		unsigned pos = 0;
-		// Manually fragment packets to respect configured UDP_MTU.
-		// This is an attempt to fix the bug where players drop out of the game if
-		// someone in the game gives a large order.
-
-		do
-		{
-			if (!outgoingData.empty())
-			{
-				packetList::iterator it = outgoingData.begin();
-				unsigned numBytes = std::min((unsigned)MaxChunkSize-pos, (*it)->length);
-				assert((*it)->length > 0);
-				memcpy(buffer+pos, (*it)->data, numBytes);
-				pos+= numBytes;
-				if (numBytes == (*it)->length) // full packet copied
-					outgoingData.pop_front();
-				else // partially transfered
-					(*it).reset(new RawPacket((*it)->data + numBytes, (*it)->length - numBytes));
-			} // iterator "it" is now invalid
-			if (pos > 0 && (pos == MaxChunkSize || outgoingData.empty()))
-			{
-				CreateChunk(buffer, pos, currentNum++);
-				pos = 0;
-			}
-		} while (!outgoingData.empty());
+		CreateChunks();
 	}
 	SendIfNecessary(forced);
 }
 
 bool UDPConnection::CheckTimeout() const
 {
+	// the stream can't be recovered, let the owner drop the connection
+	if (inflateFailed)
+		return true;
+
 	const spring_duration timeout = ((dataRecv == 0) ? spring_secs(45) : spring_secs(30));
 	if((lastReceiveTime+timeout) < spring_gettime())
 	{
@@ -413,6 +588,12 @@ std::string UDPConnection::Statistics() const
 	msg += str( boost::format("Sent: %1% bytes in %2% packets (%3% bytes/package)\n") %dataSent %sentPackets %((float)dataSent / (float)sentPackets));
 	msg += str( boost::format("Relative protocol overhead: %1% up, %2% down\n") %((float)sentOverhead / (float)dataSent) %((float)recvOverhead / (float)dataRecv) );
 	msg += str( boost::format("%1% incoming chunks had been dropped, %2% outgoing chunks had to be resent\n") %droppedChunks %resentChunks);
+	if (deflateFrom >= 0)
+		msg += str( boost::format("Compression: %1% bytes of messages sent as %2% bytes (%3%)\n") %compressIn %compressOut %((float)compressOut / (float)compressIn));
+	else if (compressionWanted)
+		msg += "Compression: not supported by the other side\n";
+	else
+		msg += "Compression: off\n";
 	return msg;
 }
 
@@ -446,20 +627,123 @@ void UDPConnection::Init()
 	lastNak=-1;
 	sentOverhead = 0;
 	recvOverhead = 0;
-	fragmentBuffer = 0;
+	reassemblyBuffer.reserve(2 * MaxChunkSize);
 	resentChunks = 0;
 	sentPackets = recvPackets = 0;
 	droppedChunks = 0;
 	mtu = std::max(configHandler->Get("MaximumTransmissionUnit", 1400), 300);
+	compressionWanted = configHandler->Get("NetworkCompression", 0) != 0;
+	peerCanInflate = false;
+	deflateFrom = -1;
+	deflateFromAcked = false;
+	inflateFrom = -1;
+	inflateFailed = false;
+	compressIn = compressOut = 0;
+}
+
+void UDPConnection::CreateChunks()
+{
+	if (compressionWanted && peerCanInflate && deflateFrom < 0)
+	{
+		// everything from the next chunk on is compressed
+		deflateFrom = currentNum;
+		deflater.reset(new StreamDeflater());
+	}
+
+	// Manually fragment packets to respect configured UDP_MTU.
+	// This is an attempt to fix the bug where players drop out of the game if
+	// someone in the game gives a large order.
+	if (deflateFrom >= 0)
+	{
+		// compress all messages at once, they are too small on their own
+		for (packetList::const_iterator it = outgoingData.begin(); it != outgoingData.end(); ++it)
+		{
+			assert((*it)->length > 0);
+			rawBuffer.insert(rawBuffer.end(), (*it)->data, (*it)->data + (*it)->length);
+		}
+		if (!rawBuffer.empty())
+		{
+			EncodeFrames(&rawBuffer[0], rawBuffer.size(), frameOutBuffer);
+			AppendToChunks(chunkBuffer, &frameOutBuffer[0], frameOutBuffer.size());
+			rawBuffer.clear();
+			frameOutBuffer.clear();
+		}
+	}
+	else
+	{
+		for (packetList::const_iterator it = outgoingData.begin(); it != outgoingData.end(); ++it)
+		{
+			assert((*it)->length > 0);
+			AppendToChunks(chunkBuffer, (*it)->data, (*it)->length);
+		}
+	}
+	outgoingData.clear();
+
+	for (std::vector<ChunkDataPtr>::const_iterator it = chunkBuffer.begin(); it != chunkBuffer.end(); ++it)
+		CreateChunk(*it, currentNum++);
+	chunkBuffer.clear();
 }
 
-void UDPConnection::CreateChunk(const unsigned char* data, const unsigned length, const int packetNum)
+void UDPConnection::EncodeFrames(const uint8_t* data, unsigned length, std::vector<uint8_t>& out)
 {
-	assert(length > 0 && length < 255);
+	compressIn += length;
+	const size_t startSize = out.size();
+	while (length > 0)
+	{
+		const unsigned inLength = std::min(length, MaxDeflateInput);
+		const size_t headerPos = out.size();
+		out.resize(headerPos + FrameHeaderSize);
+		if (inLength < MinDeflateSize)
+		{
+			out[headerPos] = FRAME_RAW;
+			out.insert(out.end(), data, data + inLength);
+		}
+		else
+		{
+			out[headerPos] = FRAME_DEFLATE;
+			deflater->Compress(data, inLength, out);
+		}
+		const unsigned frameLength = out.size() - headerPos - FrameHeaderSize;
+		assert(frameLength <= 0xFFFF);
+		out[headerPos + 1] = frameLength & 0xFF;
+		out[headerPos + 2] = (frameLength >> 8) & 0xFF;
+
+		data += inLength;
+		length -= inLength;
+	}
+	compressOut += out.size() - startSize;
+}
+
+bool UDPConnection::DecodeFrames()
+{
+	unsigned pos = 0;
+	while (frameBuffer.size() >= pos + FrameHeaderSize)
+	{
+		const unsigned frameLength = frameBuffer[pos + 1] | (frameBuffer[pos + 2] << 8);
+		if (frameBuffer.size() < pos + FrameHeaderSize + frameLength)
+			break; // wait for the rest of the frame
+
+		const uint8_t* frameData = &frameBuffer[pos + FrameHeaderSize];
+		if (frameBuffer[pos] == FRAME_RAW)
+			reassemblyBuffer.insert(reassemblyBuffer.end(), frameData, frameData + frameLength);
+		else if (frameBuffer[pos] != FRAME_DEFLATE || inflater.get() == NULL)
+			return false;
+		// a deflate frame never holds more than MaxDeflateInput bytes,
+		// anything bigger is corrupt or meant to exhaust our memory
+		else if (!inflater->Decompress(frameData, frameLength, reassemblyBuffer, MaxDeflateInput))
+			return false;
+		pos += FrameHeaderSize + frameLength;
+	}
+	frameBuffer.erase(frameBuffer.begin(), frameBuffer.begin() + pos);
+	return true;
+}
+
+void UDPConnection::CreateChunk(const ChunkDataPtr& payload, const int packetNum)
+{
+	assert(payload->size > 0 && payload->size <= ChunkData::maxSize);
 	ChunkPtr buf(new Chunk);
 	buf->chunkNumber = packetNum;
-	buf->chunkSize = length;
-	std::copy(data, data+length, std::back_inserter(buf->data));
+	buf->payload = payload;
 	newChunks.push_back(buf);
 	lastChunkCreated = spring_gettime();
 }
@@ -525,7 +809,15 @@ void UDPConnection::SendIfNecessary(bool flushed)
 		bool todo = true;
 		while (todo && outgoing.GetAverage() < 64*1024)
 		{
-			Packet buf(lastInOrder, nak);
+			Packet& buf = sendPacket;
+			buf.Reset(lastInOrder, nak);
+			buf.flags = compressionWanted ? Packet::CAN_INFLATE : 0;
+			if (deflateFrom >= 0)
+			{
+				buf.flags |= Packet::DEFLATING;
+				if (!deflateFromAcked)
+					buf.deflateFrom = deflateFrom;
+			}
 			if (nak > 0)
 			{
 				buf.naks.resize(nak);
@@ -563,7 +855,7 @@ void UDPConnection::SendIfNecessary(bool flushed)
 
 void UDPConnection::SendPacket(Packet& pkt)
 {
-	std::vector<uint8_t> data;
+	std::vector<uint8_t>& data = sendBuffer;
 	pkt.Serialize(data);
 
 	outgoing.DataSent(data.size());
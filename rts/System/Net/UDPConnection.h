@@ -1,53 +1,152 @@
 #ifndef _REMOTE_CONNECTION
 #define _REMOTE_CONNECTION
 
-#include <boost/ptr_container/ptr_map.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/asio/ip/udp.hpp>
 #include <deque>
 #include <list>
+#include <map>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
 
 #include "Connection.h"
 #include "System/myTime.h"
 
 namespace netcode {
 
+class StreamDeflater;
+class StreamInflater;
+
+/// largest datagram we send or accept
+const unsigned UDPMaxPacketSize = 4096;
+
+/**
+@brief payload of a Chunk
+Payloads are fixed-size and come from a pool, see operator new. A payload that
+is broadcast is built once and shared by the chunks of all receiving
+connections, see BroadcastBuffer.
+*/
+class ChunkData
+{
+public:
+	ChunkData() : size(0), refCount(0) {};
+
+	static const unsigned maxSize = 254;
+	uint8_t size;
+	uint8_t data[maxSize];
+
+	/// served from a free-list of slab-allocated blocks, never from the heap
+	static void* operator new(size_t size);
+	static void operator delete(void* p);
+
+private:
+	friend void intrusive_ptr_add_ref(ChunkData* c);
+	friend void intrusive_ptr_release(ChunkData* c);
+	/// only ever referenced by the thread owning the connection(s)
+	unsigned refCount;
+};
+typedef boost::intrusive_ptr<ChunkData> ChunkDataPtr;
+
+inline void intrusive_ptr_add_ref(ChunkData* c)
+{
+	++c->refCount;
+}
+inline void intrusive_ptr_release(ChunkData* c)
+{
+	if (--c->refCount == 0)
+		delete c;
+}
+
+/**
+@brief a piece of the outgoing / incoming data stream, with its own number
+Chunks are pooled like their payload. They are shared between the send queue,
+the resend queue and outgoing packets by reference.
+*/
 class Chunk
 {
 public:
+	Chunk() : chunkNumber(0), refCount(0) {};
+
 	unsigned GetSize() const
 	{
-		return data.size() + headerSize;
+		return payload->size + headerSize;
 	};
-	static const unsigned maxSize = 254;
+	static const unsigned maxSize = ChunkData::maxSize;
 	static const unsigned headerSize = 5;
 	int32_t chunkNumber;
-	uint8_t chunkSize;
-	std::vector<uint8_t> data;
+	ChunkDataPtr payload;
+
+	static void* operator new(size_t size);
+	static void operator delete(void* p);
+
+private:
+	friend void intrusive_ptr_add_ref(Chunk* c);
+	friend void intrusive_ptr_release(Chunk* c);
+	unsigned refCount;
 };
-typedef boost::shared_ptr<Chunk> ChunkPtr;
+typedef boost::intrusive_ptr<Chunk> ChunkPtr;
+
+inline void intrusive_ptr_add_ref(Chunk* c)
+{
+	++c->refCount;
+}
+inline void intrusive_ptr_release(Chunk* c)
+{
+	if (--c->refCount == 0)
+		delete c;
+}
+
+/// append data to the chunk payloads, filling up the last one first
+void AppendToChunks(std::vector<ChunkDataPtr>& chunks, const unsigned char* data, unsigned length);
 
 class Packet
 {
 public:
 	static const unsigned headerSize = 5;
+	Packet();
 	Packet(const unsigned char* data, unsigned length);
 	Packet(int lastContinuous, int nak);
 
+	/// parse a datagram, re-using the memory of a previous one
+	void Unpack(const unsigned char* data, unsigned length);
+	/// empty the packet for sending, re-using the memory of a previous one
+	void Reset(int lastContinuous, int nak);
+
 	unsigned GetSize() const
 	{
-		unsigned size = headerSize + naks.size();
-		for (std::list<ChunkPtr>::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
+		unsigned size = headerSize + naks.size() + GetTrailerSize();
+		for (std::vector<ChunkPtr>::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
 			size += (*it)->GetSize();
 		return size;
 	};
+	unsigned GetTrailerSize() const
+	{
+		if (flags == 0)
+			return 0;
+		return (deflateFrom >= 0) ? 5 : 1;
+	};
 	
+	/// replaces the contents of data, whose capacity is kept
 	void Serialize(std::vector<uint8_t>& data);
 
 	int32_t lastContinuous;
 	int8_t nakType; // if < 0, we lost -x packets since lastContinuous, if >0, x = size of naks
 	std::vector<uint8_t> naks;
-	std::list<ChunkPtr> chunks;
+	std::vector<ChunkPtr> chunks;
+
+	/// bits of the optional trailer
+	enum Flags
+	{
+		/// the sender can decode compressed chunks
+		CAN_INFLATE = 1,
+		/// the sender compresses its chunks, starting with deflateFrom
+		DEFLATING = 2
+	};
+	uint8_t flags;
+	/// only sent until the other side acknowledged that chunk, -1 otherwise
+	int32_t deflateFrom;
 };
 
 /**
@@ -56,6 +155,14 @@ How Spring protocolheader looks like (size in bytes):
 4 (int):	last in order (tell the client we received all packages with packetNumber less or equal)
 1 (unsigned char): nak (we missed x packets, starting with firstUnacked)
 
+After the chunks there may be a trailer of 1 or 5 bytes (Packet::flags and
+Packet::deflateFrom). Older versions do not take it for a chunk, as it is too
+short, and ignore it; they never send one, so compression is only used when
+both sides support it.
+
+With compression, the chunk payloads starting at deflateFrom form a stream of
+frames: 1 byte type (0 = raw, 1 = deflate), 2 bytes length, then the data.
+
 */
 
 /**
@@ -72,6 +179,12 @@ public:
 	@brief Send packet to other instance
 	*/
 	virtual void SendData(boost::shared_ptr<const RawPacket> data);
+	/**
+	@brief Send data that goes to other connections, too
+	Only the chunk headers are written for this connection,
+	the payloads are shared with all of them.
+	*/
+	virtual void SendData(BroadcastBuffer& data);
 
 	virtual bool HasIncomingData() const;
 
@@ -116,10 +229,16 @@ private:
 	spring_time lastReceiveTime;
 	spring_time lastSendTime;
 	
-	typedef boost::ptr_map<int,RawPacket> packetMap;
+	typedef std::map<int, ChunkPtr> packetMap;
 	typedef std::list< boost::shared_ptr<const RawPacket> > packetList;
-	/// add header to data and send it
-	void CreateChunk(const unsigned char* data, const unsigned length, const int packetNum);
+	/// put everything from outgoingData into newChunks
+	void CreateChunks();
+	/// append data as frames to out, compressing it if worthwhile
+	void EncodeFrames(const uint8_t* data, unsigned length, std::vector<uint8_t>& out);
+	/// decode the frames in frameBuffer into reassemblyBuffer
+	bool DecodeFrames();
+	/// number the payload and queue it for sending
+	void CreateChunk(const ChunkDataPtr& payload, const int packetNum);
 	void SendIfNecessary(bool flushed);
 	/// address of the other end
 	boost::asio::ip::udp::endpoint addr;
@@ -151,12 +270,44 @@ private:
 	spring_time lastNakTime;
 	std::deque< boost::shared_ptr<const RawPacket> > msgQueue;
 
+	/// used by CreateChunks(), kept to re-use its memory
+	std::vector<ChunkDataPtr> chunkBuffer;
+
+	/// NetworkCompression config, compress what we send if the other side can
+	/// decode it, and offer CAN_INFLATE; without it compressed data is rejected
+	bool compressionWanted;
+	/// the other side told us it can decode compressed chunks
+	bool peerCanInflate;
+	/// first chunk we sent compressed, -1 while not compressing
+	int deflateFrom;
+	/// the other side knows about deflateFrom
+	bool deflateFromAcked;
+	/// first chunk the other side sent compressed, -1 while it does not
+	int inflateFrom;
+	/// got data we could not decode, see CheckTimeout()
+	bool inflateFailed;
+	boost::scoped_ptr<StreamDeflater> deflater;
+	boost::scoped_ptr<StreamInflater> inflater;
+	/// outgoing messages collected for EncodeFrames()
+	std::vector<uint8_t> rawBuffer;
+	/// output of EncodeFrames(), to be cut into chunks
+	std::vector<uint8_t> frameOutBuffer;
+	/// incoming frames, not yet complete
+	std::vector<uint8_t> frameBuffer;
+	/// message bytes that went into EncodeFrames(), and the size of the frames it made
+	unsigned compressIn, compressOut;
+	/// received chunks that still have to be split into messages
+	std::vector<uint8_t> reassemblyBuffer;
+	/// re-used for every datagram, so their memory is only allocated once
+	Packet recvPacket;
+	Packet sendPacket;
+	std::vector<uint8_t> sendBuffer;
+	uint8_t recvBuffer[UDPMaxPacketSize];
+
 	/** Our socket.
 	*/
 	boost::shared_ptr<boost::asio::ip::udp::socket> mySocket;
 	
-	RawPacket* fragmentBuffer;
-
 	// Traffic statistics and stuff //
 	
 	/// packets that are resent
@@ -69,18 +69,18 @@ void UDPListener::Update()
 
 	while ((bytes_avail = mySocket->available()) > 0)
 	{
-		std::vector<uint8_t> buffer(bytes_avail);
 		ip::udp::endpoint sender_endpoint;
 		boost::asio::ip::udp::socket::message_flags flags = 0;
 		boost::system::error_code err;
-		size_t bytesReceived = mySocket->receive_from(boost::asio::buffer(buffer), sender_endpoint, flags, err);
+		size_t bytesReceived = mySocket->receive_from(boost::asio::buffer(recvBuffer), sender_endpoint, flags, err);
 		if (CheckErrorCode(err))
 			break;
 
 		if (bytesReceived < Packet::headerSize)
 			continue;
 
-		Packet data(&buffer[0], bytesReceived);
+		Packet& data = recvPacket;
+		data.Unpack(recvBuffer, bytesReceived);
 
 		bool processed = false;
 		for (std::list< boost::weak_ptr<UDPConnection> >::iterator i = conn.begin(); i != conn.end(); ++i)
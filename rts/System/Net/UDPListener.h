@@ -8,9 +8,10 @@
 #include <list>
 #include <queue>
 
+#include "UDPConnection.h"
+
 namespace netcode
 {
-class UDPConnection;
 
 /**
 @brief Class for handling Connections on an UDPSocket
@@ -68,6 +69,10 @@ private:
 	std::list< boost::weak_ptr< UDPConnection> > conn;
 	
 	std::queue< boost::shared_ptr<UDPConnection> > waiting;
+
+	/// re-used for every datagram, see UDPConnection
+	uint8_t recvBuffer[UDPMaxPacketSize];
+	Packet recvPacket;
 };
 
 }
@@ -257,6 +257,7 @@ namespace CrashHandler {
 		std::map<std::string,uintptr_t> binPath_baseMemAddr;
 
 		logOutput.RemoveAllSubscribers();
+		logOutput.SetSynchronous();
 		{
 			LogObject log;
 			if (signal == SIGSEGV) {
@@ -817,6 +817,8 @@ volatile int gmlStartSim;
 
 int SpringApp::Sim()
 {
+	profiler.SetThreadName("Sim");
+
 	while(gmlKeepRunning && !gmlStartSim)
 		SDL_Delay(100);
 
@@ -950,6 +952,7 @@ void SpringApp::UpdateSDLKeys ()
 int SpringApp::Run(int argc, char *argv[])
 {
 	cmdline = new BaseCmd(argc, argv);
+	profiler.SetThreadName("Main");
 
 	if (!Initialize())
 		return -1;
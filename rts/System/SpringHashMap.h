@@ -0,0 +1,34 @@
+#ifndef SPRING_HASH_MAP_H
+#define SPRING_HASH_MAP_H
+
+#include <string>
+
+#ifdef _MSC_VER
+	#define SPRING_HASH_MAP stdext::hash_map
+	#include <hash_map>
+#elif __GNUG__
+/* Test for GCC >= 4.3.2 */
+	#if __GNUC__ > 4 || \
+		(__GNUC__ == 4 && (__GNUC_MINOR__ > 3 || \
+						(__GNUC_MINOR__ == 3 && \
+							__GNUC_PATCHLEVEL__ >= 2)))
+		#include <tr1/unordered_map>
+		#define SPRING_HASH_MAP std::tr1::unordered_map
+	#else
+		#define SPRING_HASH_MAP __gnu_cxx::hash_map
+		#include <ext/hash_map>
+
+		// the pre-TR1 extension does not know how to hash strings
+		namespace __gnu_cxx {
+			template<> struct hash<std::string> {
+				size_t operator() (const std::string& s) const {
+					return hash<const char*>()(s.c_str());
+				}
+			};
+		}
+	#endif
+#else
+	#error Unsupported compiler
+#endif
+
+#endif // SPRING_HASH_MAP_H
@@ -117,14 +117,17 @@ class CSyncChecker {
 				break;
 			default:
 			{
+				// hash every word of the data (this used to add the offset
+				// to the first word instead, so only that word was checked)
+				const char* c = (const char*)p;
 				unsigned i = 0;
 				for (; i < (size & ~3); i += 4) {
-					g_checksum += *(unsigned int*)(char*)p + i;
+					g_checksum += *(const unsigned int*)(c + i);
 					g_checksum ^= g_checksum << 16;
 					g_checksum += g_checksum >> 11;
 				}
 				for (; i < size; ++i) {
-					g_checksum += *(unsigned char*)p + i;
+					g_checksum += *(const unsigned char*)(c + i);
 					g_checksum ^= g_checksum << 10;
 					g_checksum += g_checksum >> 1;
 				}
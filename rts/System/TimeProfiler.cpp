@@ -5,6 +5,18 @@
 
 #include <SDL_timer.h>
 #include <cstring>
+#include <cstdio>
+#include <vector>
+#include <fstream>
+#include <boost/thread/tss.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
 
 #include "mmgr.h"
 #include "lib/gml/gml.h"
@@ -16,14 +28,13 @@ BasicTimer::BasicTimer(const char* const myname) : name(myname), starttime(SDL_G
 {
 }
 
-ScopedTimer::ScopedTimer(const char* const myname) : BasicTimer(myname)
+ScopedTimer::ScopedTimer(const char* const myname) : BasicTimer(myname), startNanos(CTimeProfiler::GetNanoTime())
 {
 }
 
 ScopedTimer::~ScopedTimer()
 {
-	const unsigned stoptime = SDL_GetTicks();
-	profiler.AddTime(name, stoptime - starttime);
+	profiler.AddTime(name, startNanos, CTimeProfiler::GetNanoTime());
 }
 
 ScopedOnceTimer::ScopedOnceTimer(const char* const myname) : BasicTimer(myname)
@@ -40,6 +51,88 @@ ScopedOnceTimer::~ScopedOnceTimer()
 	LogObject() << name << ": " << stoptime - starttime << " ms";
 }
 
+//////////////////////////////////////////////////////////////////////
+// Trace recording
+//////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	struct TraceEvent
+	{
+		/// points into CTimeProfiler::profile, or a string literal
+		const char* name;
+		boost::int64_t start;
+		/// -1 for frame markers
+		boost::int64_t end;
+		int frameNum;
+	};
+
+	/// the timeline of one thread
+	struct ThreadTrace
+	{
+		int id;
+		std::string name;
+		/// only contended while a trace is written
+		boost::mutex mutex;
+		std::vector<TraceEvent> events;
+		unsigned numDropped;
+	};
+
+	// ~6 MB per thread, that is a few minutes of a busy main thread
+	const size_t MAX_TRACE_EVENTS = 256 * 1024;
+}
+
+// threads may end before the trace is written, so the registry owns the
+// timelines and the thread local pointers don't delete anything
+static void KeepThreadTrace(ThreadTrace*) {}
+static boost::thread_specific_ptr<ThreadTrace> threadTrace(KeepThreadTrace);
+static std::vector<ThreadTrace*> threadTraces;
+static boost::mutex threadTracesMutex;
+
+static ThreadTrace& GetThreadTrace()
+{
+	ThreadTrace* tt = threadTrace.get();
+
+	if (tt == NULL) {
+		tt = new ThreadTrace();
+		tt->numDropped = 0;
+
+		boost::mutex::scoped_lock lock(threadTracesMutex);
+		tt->id = threadTraces.size();
+		threadTraces.push_back(tt);
+		threadTrace.reset(tt);
+	}
+
+	return *tt;
+}
+
+static void AddTraceEvent(const char* name, boost::int64_t start, boost::int64_t end, int frameNum)
+{
+	ThreadTrace& tt = GetThreadTrace();
+	boost::mutex::scoped_lock lock(tt.mutex);
+
+	if (tt.events.size() >= MAX_TRACE_EVENTS) {
+		tt.numDropped++;
+		return;
+	}
+
+	const TraceEvent e = {name, start, end, frameNum};
+	tt.events.push_back(e);
+}
+
+static void WriteJSONString(std::ofstream& out, const char* str)
+{
+	out << '"';
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\') {
+			out << '\\' << *str;
+		} else if ((unsigned char)*str >= 0x20) {
+			out << *str;
+		}
+	}
+	out << '"';
+}
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
@@ -49,6 +142,8 @@ CTimeProfiler::CTimeProfiler()
 {
 	currentPosition = 0;
 	lastBigUpdate = SDL_GetTicks();
+	tracing = false;
+	traceStart = 0;
 }
 
 CTimeProfiler::~CTimeProfiler()
@@ -58,6 +153,7 @@ CTimeProfiler::~CTimeProfiler()
 void CTimeProfiler::Update()
 {
 	GML_STDMUTEX_LOCK_NOPROF(time); // Update
+	boost::mutex::scoped_lock lock(profileMutex);
 
 	++currentPosition;
 	currentPosition &= TimeRecord::frames_size-1;
@@ -84,33 +180,71 @@ void CTimeProfiler::Update()
 float CTimeProfiler::GetPercent(const char *name)
 {
 	GML_STDMUTEX_LOCK_NOPROF(time); // GetTimePercent
+	boost::mutex::scoped_lock lock(profileMutex);
 
-	return profile[name].percent;
+	return GetRecord(name).percent;
 }
 
 void CTimeProfiler::AddTime(const std::string& name, unsigned time)
 {
 	GML_STDMUTEX_LOCK_NOPROF(time); // AddTime
+	boost::mutex::scoped_lock lock(profileMutex);
+
+	AddTimeRecord(GetRecord(name), time);
+}
+
+void CTimeProfiler::AddTime(const std::string& name, boost::int64_t startNanos, boost::int64_t endNanos)
+{
+	const char* recordName;
+	{
+		GML_STDMUTEX_LOCK_NOPROF(time); // AddTime
+		boost::mutex::scoped_lock lock(profileMutex);
 
-	std::map<std::string, TimeRecord>::iterator pi;
-	if ( (pi = profile.find(name)) != profile.end() ) {
-		// profile already exists
-		pi->second.total+=time;
-		pi->second.current+=time;
-		pi->second.frames[currentPosition]+=time;
-	} else {
-		// create a new profile
-		profile[name].total=time;
-		profile[name].current=time;
-		profile[name].percent=0;
-		memset(profile[name].frames, 0, TimeRecord::frames_size*sizeof(unsigned));
-		static UnsyncedRNG rand;
-		rand.Seed(SDL_GetTicks());
-		profile[name].color.x = rand.RandFloat();
-		profile[name].color.y = rand.RandFloat();
-		profile[name].color.z = rand.RandFloat();
-		profile[name].showGraph=true;
+		std::map<std::string, TimeRecord>::iterator pi = profile.find(name);
+		if (pi == profile.end()) {
+			GetRecord(name);
+			pi = profile.find(name);
+		}
+		AddTimeRecord(pi->second, (endNanos - startNanos) * 1e-6);
+
+		// map keys never change or go away, so this outlives the trace
+		recordName = pi->first.c_str();
+	}
+
+	if (tracing) {
+		AddTraceEvent(recordName, startNanos, endNanos, 0);
+	}
+}
+
+/// needs profileMutex
+CTimeProfiler::TimeRecord& CTimeProfiler::GetRecord(const std::string& name)
+{
+	std::map<std::string, TimeRecord>::iterator pi = profile.find(name);
+	if (pi != profile.end()) {
+		return pi->second;
 	}
+
+	// create a new profile
+	TimeRecord& r = profile[name];
+	r.total = 0;
+	r.current = 0;
+	r.percent = 0;
+	memset(r.frames, 0, TimeRecord::frames_size*sizeof(float));
+	static UnsyncedRNG rand;
+	rand.Seed(SDL_GetTicks());
+	r.color.x = rand.RandFloat();
+	r.color.y = rand.RandFloat();
+	r.color.z = rand.RandFloat();
+	r.showGraph = true;
+	return r;
+}
+
+/// needs profileMutex
+void CTimeProfiler::AddTimeRecord(TimeRecord& record, double time)
+{
+	record.total += time;
+	record.current += time;
+	record.frames[currentPosition] += time;
 }
 
 void CTimeProfiler::PrintProfilingInfo() const
@@ -132,3 +266,134 @@ void CTimeProfiler::PrintProfilingInfo() const
 				pi->second.percent * 100);
 	}
 }
+
+
+boost::int64_t CTimeProfiler::GetNanoTime()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	// split to not overflow the multiplication
+	const boost::int64_t secs = count.QuadPart / freq.QuadPart;
+	const boost::int64_t rest = count.QuadPart % freq.QuadPart;
+	return secs * 1000000000 + (rest * 1000000000) / freq.QuadPart;
+#elif defined(__APPLE__)
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return boost::int64_t(tv.tv_sec) * 1000000000 + boost::int64_t(tv.tv_usec) * 1000;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return boost::int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+void CTimeProfiler::SetThreadName(const std::string& name)
+{
+	ThreadTrace& tt = GetThreadTrace();
+	boost::mutex::scoped_lock lock(tt.mutex);
+
+	tt.name = name;
+}
+
+void CTimeProfiler::MarkFrame(const char* name, int frameNum)
+{
+	if (tracing) {
+		AddTraceEvent(name, GetNanoTime(), -1, frameNum);
+	}
+}
+
+
+void CTimeProfiler::StartTrace()
+{
+	boost::mutex::scoped_lock lock(threadTracesMutex);
+
+	for (size_t t = 0; t < threadTraces.size(); ++t) {
+		boost::mutex::scoped_lock tlock(threadTraces[t]->mutex);
+		threadTraces[t]->events.clear();
+		threadTraces[t]->numDropped = 0;
+	}
+
+	traceStart = GetNanoTime();
+	tracing = true;
+}
+
+bool CTimeProfiler::StopTrace(const std::string& filename)
+{
+	if (!tracing) {
+		return false;
+	}
+	tracing = false;
+
+	if (!WriteTrace(filename)) {
+		logOutput.Print("Profiler: could not write trace to %s", filename.c_str());
+		return false;
+	}
+	logOutput.Print("Profiler: trace written to %s", filename.c_str());
+	return true;
+}
+
+bool CTimeProfiler::WriteTrace(const std::string& filename) const
+{
+	std::ofstream out(filename.c_str());
+	if (!out.good()) {
+		return false;
+	}
+
+	char buf[128];
+	bool first = true;
+	out << "{\"traceEvents\":[\n";
+
+	boost::mutex::scoped_lock lock(threadTracesMutex);
+
+	for (size_t t = 0; t < threadTraces.size(); ++t) {
+		ThreadTrace& tt = *threadTraces[t];
+		boost::mutex::scoped_lock tlock(tt.mutex);
+
+		if (tt.events.empty()) {
+			continue;
+		}
+
+		std::string name = tt.name;
+		if (name.empty()) {
+			SNPRINTF(buf, sizeof(buf), "Thread %d", tt.id);
+			name = buf;
+		}
+		if (!first) {
+			out << ",\n";
+		}
+		first = false;
+		out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << tt.id << ",\"args\":{\"name\":";
+		WriteJSONString(out, name.c_str());
+		out << "}}";
+
+		if (tt.numDropped > 0) {
+			logOutput.Print("Profiler: %u events of %s not recorded (trace buffer full)", tt.numDropped, name.c_str());
+		}
+
+		for (size_t e = 0; e < tt.events.size(); ++e) {
+			const TraceEvent& ev = tt.events[e];
+			// microseconds since the trace started, at nanosecond precision
+			const double ts = (ev.start - traceStart) * 1e-3;
+
+			out << ",\n{\"name\":";
+			WriteJSONString(out, ev.name);
+			if (ev.end < 0) {
+				SNPRINTF(buf, sizeof(buf), ",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"frame\":%d}}",
+				         tt.id, ts, ev.frameNum);
+			} else {
+				SNPRINTF(buf, sizeof(buf), ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				         tt.id, ts, (ev.end - ev.start) * 1e-3);
+			}
+			out << buf;
+		}
+	}
+
+	out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	return out.good();
+}
@@ -7,6 +7,8 @@
 #include <string>
 #include <map>
 #include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "float3.h"
 
@@ -40,6 +42,9 @@ public:
 	 * @brief destroy and add time to profiler
 	 */
 	~ScopedTimer();
+
+private:
+	const boost::int64_t startNanos;
 };
 
 class ScopedOnceTimer : public BasicTimer
@@ -53,14 +58,25 @@ public:
 	~ScopedOnceTimer();
 };
 
+/**
+ * @brief collects the times measured by the ScopedTimers
+ *
+ * Besides the totals per timer name, which are always kept (and drawn by the
+ * ProfileDrawer), a trace can be recorded: while tracing, every ScopedTimer
+ * also stores its start and end time (nanoseconds) on the timeline of the
+ * thread it ran on, so nested timers show up nested. Together with the frame
+ * markers and thread names this is written as Chrome trace JSON, which can
+ * be opened in chrome://tracing and similar viewers.
+ */
 class CTimeProfiler
 {
 public:
+	/// all times in milliseconds
 	struct TimeRecord {
-		unsigned total;
-		unsigned current;
+		double total;
+		double current;
 		static const unsigned frames_size = 128;
-		unsigned frames[frames_size];
+		float frames[frames_size];
 		float percent;
 		float3 color;
 		bool showGraph;
@@ -71,16 +87,42 @@ public:
 
 	float GetPercent(const char *name);
 	void AddTime(const std::string& name, unsigned time);
+	/// adds the time between two GetNanoTime() values, and traces it
+	void AddTime(const std::string& name, boost::int64_t startNanos, boost::int64_t endNanos);
 	void Update();
 
 	void PrintProfilingInfo() const;
 
+	/// monotonic clock, for the timers
+	static boost::int64_t GetNanoTime();
+
+	/// name of the calling thread in traces; unnamed threads get a number
+	void SetThreadName(const std::string& name);
+	/// puts a marker on the calling thread's timeline if tracing
+	void MarkFrame(const char* name, int frameNum);
+
+	bool IsTracing() const { return tracing; }
+	/// drops the events of earlier traces and starts recording
+	void StartTrace();
+	/// stops recording and writes the trace, @return false on error
+	bool StopTrace(const std::string& filename);
+
 	std::map<std::string,TimeRecord> profile;
 
 private:
+	TimeRecord& GetRecord(const std::string& name);
+	void AddTimeRecord(TimeRecord& record, double time);
+	bool WriteTrace(const std::string& filename) const;
+
 	unsigned lastBigUpdate;
 	/// increases each update, from 0 to (frames_size-1)
 	unsigned currentPosition;
+
+	/// guards profile against the timers of other threads
+	boost::mutex profileMutex;
+
+	volatile bool tracing;
+	boost::int64_t traceStart;
 };
 
 extern CTimeProfiler profiler;
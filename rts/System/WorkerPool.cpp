@@ -0,0 +1,109 @@
+#include "StdAfx.h"
+// WorkerPool.cpp: implementation of the CWorkerPool class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <boost/bind.hpp>
+#include "mmgr.h"
+
+#include "WorkerPool.h"
+#include "TimeProfiler.h"
+#include "Util.h"
+
+
+CWorkerPool::CWorkerPool(const std::string& name, int numThreads)
+	: name(name)
+	, numJobs(0)
+	, nextJob(0)
+	, numDone(0)
+	, batch(0)
+	, quit(false)
+{
+	for (int i = 0; i < numThreads; ++i) {
+		threads.push_back(new boost::thread(boost::bind(&CWorkerPool::Worker, this, i + 1)));
+	}
+}
+
+CWorkerPool::~CWorkerPool()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		quit = true;
+		wakeCond.notify_all();
+	}
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i]->join();
+		delete threads[i];
+	}
+}
+
+
+void CWorkerPool::Run(const JobFunc& f, int n)
+{
+	if (threads.empty() || n <= 1) {
+		for (int i = 0; i < n; ++i) {
+			f(i);
+		}
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		func = f;
+		numJobs = n;
+		nextJob = 0;
+		numDone = 0;
+		++batch;
+		wakeCond.notify_all();
+	}
+
+	RunJobs();
+
+	boost::mutex::scoped_lock lock(mutex);
+	while (numDone < numJobs) {
+		doneCond.wait(lock);
+	}
+	// workers may still hold a copy, but none of them calls it any more
+	func = JobFunc();
+}
+
+
+void CWorkerPool::RunJobs()
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	while (nextJob < numJobs) {
+		const int job = nextJob++;
+		const JobFunc f = func;
+
+		lock.unlock();
+		f(job);
+		lock.lock();
+
+		if (++numDone == numJobs) {
+			doneCond.notify_all();
+		}
+	}
+}
+
+
+void CWorkerPool::Worker(int id)
+{
+	profiler.SetThreadName(name + " " + IntToString(id));
+
+	unsigned int lastBatch = 0;
+
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			while (!quit && batch == lastBatch) {
+				wakeCond.wait(lock);
+			}
+			if (quit) {
+				return;
+			}
+			lastBatch = batch;
+		}
+		RunJobs();
+	}
+}
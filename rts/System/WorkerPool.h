@@ -0,0 +1,60 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+// WorkerPool.h: interface for the CWorkerPool class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+
+/**
+ * @brief threads that stay around to split short, frequent jobs
+ *
+ * Run() hands out the indices of a batch of jobs to the workers and to the
+ * calling thread and returns once all of them are done, so it can be called
+ * every frame without starting any threads. Jobs must not throw, and must
+ * only write to data no other job of the batch touches.
+ */
+class CWorkerPool : public boost::noncopyable
+{
+public:
+	typedef boost::function<void(int)> JobFunc;
+
+	/// @param numThreads workers besides the thread calling Run()
+	CWorkerPool(const std::string& name, int numThreads);
+	~CWorkerPool();
+
+	/// calls func(i) for every i in [0, numJobs)
+	void Run(const JobFunc& func, int numJobs);
+
+	/// @return number of threads a batch is split over, including the caller
+	int GetNumThreads() const { return threads.size() + 1; }
+
+private:
+	void Worker(int id);
+	/// takes jobs of the current batch until there are none left
+	void RunJobs();
+
+	const std::string name;
+	std::vector<boost::thread*> threads;
+
+	boost::mutex mutex;
+	boost::condition wakeCond;
+	boost::condition doneCond;
+
+	JobFunc func;
+	int numJobs;
+	int nextJob;
+	int numDone;
+	/// counts the batches, so sleeping workers notice a new one
+	unsigned int batch;
+	bool quit;
+};
+
+#endif // WORKERPOOL_H
@@ -8,11 +8,11 @@
 namespace creg
 {
 	// Deque type (uses vector implementation)
-	template<typename T>
-	struct DeduceType < std::deque <T> > {
+	template<typename T, typename Alloc>
+	struct DeduceType < std::deque <T, Alloc> > {
 		boost::shared_ptr<IType> Get () {
 			DeduceType<T> elemtype;
-			return boost::shared_ptr<IType>(new DynamicArrayType < std::deque<T> > (elemtype.Get()));
+			return boost::shared_ptr<IType>(new DynamicArrayType < std::deque<T, Alloc> > (elemtype.Get()));
 		}
 	};
 };
@@ -3,6 +3,7 @@
 #define SERIALIZER_IMPL_H
 
 #include "ISerializer.h"
+#include "STL_Map.h"
 #include <map>
 #include <vector>
 #include <list>
@@ -73,8 +74,21 @@ namespace creg {
 		// Temporary class reference
 		struct ClassRef;
 
+		struct PtrHash {
+			size_t operator() (const void* p) const {
+				// objects are at least 4 byte aligned
+				return ((size_t)p) >> 2;
+			}
+		};
+#ifdef _MSC_VER
+		typedef SPRING_HASH_MAP <void*,std::vector<ObjectRef*> > PtrToIdMap;
+#else
+		typedef SPRING_HASH_MAP <void*,std::vector<ObjectRef*>,PtrHash> PtrToIdMap;
+#endif
+
 		std::ostream *stream;
-		std::map <void*,std::vector<ObjectRef*> > ptrToId;
+		/// looked up for every serialized pointer
+		PtrToIdMap ptrToId;
 		std::list <ObjectRef> objects;
 		std::vector <ObjectRef*> pendingObjects; // these objects still have to be saved
 
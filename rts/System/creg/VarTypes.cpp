@@ -72,6 +72,37 @@ void BasicType::Serialize (ISerializer *s, void *inst)
 	}
 }
 
+static bool IsLittleEndian()
+{
+	const int one = 1;
+	return (*(const char*)&one == 1);
+}
+
+int BasicType::GetBlitSize()
+{
+	// integers are byte swapped when loading on big endian machines
+	static const bool canBlitInts = IsLittleEndian();
+
+	switch (id) {
+	case crInt:
+	case crUInt:
+		return canBlitInts ? 4 : 0;
+	case crShort:
+	case crUShort:
+		return canBlitInts ? 2 : 0;
+	case crChar:
+	case crUChar:
+		return 1;
+	case crFloat:
+		return 4;
+	case crDouble:
+		return 8;
+	default:
+		// bools are stored as bytes, synced types carry extra state
+		return 0;
+	}
+}
+
 std::string BasicType::GetName()
 {
 	switch(id) {
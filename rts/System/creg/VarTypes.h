@@ -20,6 +20,7 @@ namespace creg
 
 		void Serialize (ISerializer *s, void *instance);
 		std::string GetName();
+		int GetBlitSize();
 
 		BasicTypeID id;
 	};
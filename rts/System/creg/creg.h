@@ -48,6 +48,8 @@ namespace creg {
 
 		virtual void Serialize (ISerializer* s, void *instance) = 0;
 		virtual std::string GetName () = 0;
+		/// size of an instance if it can be serialized as a plain memory block, 0 otherwise
+		virtual int GetBlitSize () { return 0; }
 
 		static boost::shared_ptr<IType> CreateBasicType (BasicTypeID t);
 		static boost::shared_ptr<IType> CreateStringType ();
@@ -166,6 +168,12 @@ namespace creg {
 // Container Type templates
 // -------------------------------------------------------------------
 
+	/// whether the elements of a container are stored in one block
+	template<typename T>
+	inline bool IsContiguous (const T*) { return false; }
+	template<typename T>
+	inline bool IsContiguous (const std::vector<T>*) { return true; }
+
 	// vector,deque container
 	template<typename T>
 	class DynamicArrayType : public IType
@@ -181,15 +189,18 @@ namespace creg {
 
 		void Serialize (ISerializer *s, void *inst) {
 			T& ct = *(T*)inst;
+			int size;
 			if (s->IsWriting ()) {
-				int size = (int)ct.size();
+				size = (int)ct.size();
 				s->SerializeInt (&size,sizeof(int));
-				for (int a=0;a<size;a++)
-					elemType->Serialize (s, &ct[a]);
 			} else {
-				int size;
 				s->SerializeInt (&size, sizeof(int));
 				ct.resize (size);
+			}
+			if (size > 0 && IsContiguous(&ct) && elemType->GetBlitSize() == sizeof(ElemT)) {
+				// same bytes as the loop below, written at once
+				s->Serialize (&ct[0], size * sizeof(ElemT));
+			} else {
 				for (int a=0;a<size;a++)
 					elemType->Serialize (s, &ct[a]);
 			}
@@ -219,6 +230,10 @@ namespace creg {
 		void Serialize (ISerializer *s, void *instance)
 		{
 			T* array = (T*)instance;
+			if (elemType->GetBlitSize() == sizeof(T)) {
+				s->Serialize (array, Size * sizeof(T));
+				return;
+			}
 			for (int a=0;a<Size;a++)
 				elemType->Serialize (s, &array[a]);
 		}
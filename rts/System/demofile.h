@@ -19,7 +19,7 @@ may change every Spring release without notice).
 
 /** The current demofile version. Only change on major modifications for which
 appending stuff to DemoFileHeader is not sufficient. */
-#define DEMOFILE_VERSION 4
+#define DEMOFILE_VERSION 5
 
 #pragma pack(push, 1)
 
@@ -34,10 +34,13 @@ Demo file layout is like this:
 		- Demo stream (demoStreamSize)
 		- Player statistics, one PlayerStatistic for each player
 		- Team statistics, consisting of:
-			- Array of numTeams dwords indicating the number of
-			  CTeam::Statistics for each team.
-			- Array of all CTeam::Statistics (total number of items is the
-			  sum of the elements in the array of dwords).
+			- Array of numTeams dwords indicating the size in bytes of the
+			  statistics history of each team.
+			- The history of each team, as written by
+			  CTeamStatHistory::Serialize(): the number of CTeam::Statistics,
+			  then for each of their members the values of all of them, each
+			  stored as the difference to the previous one (XOR of the bits
+			  for floats), in little endian base 128 varints.
 
 The header is designed to be extensible: it contains a version field and a
 headerSize field to support this. The version field is a major version number
@@ -101,7 +101,7 @@ int main (int argc, char* argv[])
 	if (vm.count("teamstats") || printStats)
 	{
 		const DemoFileHeader header = reader.GetFileHeader();
-		const std::vector< std::vector<TeamStatistics> > statvec = reader.GetTeamStats();
+		const std::vector<CTeamStatHistory>& statvec = reader.GetTeamStats();
 		for (unsigned teamNum = 0; teamNum < statvec.size(); ++teamNum)
 		{
 			int time = 0;
@@ -209,7 +209,7 @@ void PrintSep(std::ofstream& file, T value)
 void WriteTeamstatHistory(CDemoReader& reader, unsigned team, const std::string& file)
 {
 	const DemoFileHeader header = reader.GetFileHeader();
-	const std::vector< std::vector<TeamStatistics> >& statvec = reader.GetTeamStats();
+	const std::vector<CTeamStatHistory>& statvec = reader.GetTeamStats();
 	if (team < statvec.size())
 	{
 		int time = 0;
@@ -221,26 +221,27 @@ void WriteTeamstatHistory(CDemoReader& reader, unsigned team, const std::string&
 		    << "UnitsOutCaptured;UnitsKilled" << endl;
 		for (unsigned i = 0; i < statvec[team].size(); ++i)
 		{
+			const TeamStatistics stats = statvec[team][i];
 			PrintSep(out, time);
-			PrintSep(out, statvec[team][i].metalUsed);
-			PrintSep(out, statvec[team][i].energyUsed);
-			PrintSep(out, statvec[team][i].metalProduced);
-			PrintSep(out, statvec[team][i].energyProduced);
-			PrintSep(out, statvec[team][i].metalExcess);
-			PrintSep(out, statvec[team][i].energyExcess);
-			PrintSep(out, statvec[team][i].metalReceived);
-			PrintSep(out, statvec[team][i].energyReceived);
-			PrintSep(out, statvec[team][i].metalSent);
-			PrintSep(out, statvec[team][i].energySent);
-			PrintSep(out, statvec[team][i].damageDealt);
-			PrintSep(out, statvec[team][i].damageReceived);
-			PrintSep(out, statvec[team][i].unitsProduced);
-			PrintSep(out, statvec[team][i].unitsDied);
-			PrintSep(out, statvec[team][i].unitsReceived);
-			PrintSep(out, statvec[team][i].unitsSent);
-			PrintSep(out, statvec[team][i].unitsCaptured);
-			PrintSep(out, statvec[team][i].unitsOutCaptured);
-			PrintSep(out, statvec[team][i].unitsKilled);
+			PrintSep(out, stats.metalUsed);
+			PrintSep(out, stats.energyUsed);
+			PrintSep(out, stats.metalProduced);
+			PrintSep(out, stats.energyProduced);
+			PrintSep(out, stats.metalExcess);
+			PrintSep(out, stats.energyExcess);
+			PrintSep(out, stats.metalReceived);
+			PrintSep(out, stats.energyReceived);
+			PrintSep(out, stats.metalSent);
+			PrintSep(out, stats.energySent);
+			PrintSep(out, stats.damageDealt);
+			PrintSep(out, stats.damageReceived);
+			PrintSep(out, stats.unitsProduced);
+			PrintSep(out, stats.unitsDied);
+			PrintSep(out, stats.unitsReceived);
+			PrintSep(out, stats.unitsSent);
+			PrintSep(out, stats.unitsCaptured);
+			PrintSep(out, stats.unitsOutCaptured);
+			PrintSep(out, stats.unitsKilled);
 			out << endl;
 			time += header.teamStatPeriod;
 		}
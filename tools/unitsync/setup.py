@@ -16,6 +16,7 @@ unitsync_files = [
 	'tools/unitsync/SyncServer.cpp',
 	'tools/unitsync/unitsync.cpp',
 	'rts/Lua/LuaParser.cpp',
+	'rts/Lua/LuaMemPool.cpp',
 	'rts/Map/MapParser.cpp',
 	'rts/Rendering/Textures/Bitmap.cpp',
 	'rts/Rendering/Textures/nv_dds.cpp',
@@ -3,6 +3,9 @@
 #include "unitsync_api.h"
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <set>
@@ -11,6 +14,7 @@
 #include "LuaInclude.h"
 #include "FileSystem/ArchiveFactory.h"
 #include "FileSystem/ArchiveScanner.h"
+#include "FileSystem/CRC.h"
 #include "FileSystem/FileHandler.h"
 #include "FileSystem/VFSHandler.h"
 #include "Game/GameVersion.h"
@@ -155,6 +159,128 @@ class ScopedMapLoader {
 		CVFSHandler* oldHandler;
 };
 
+
+//////////////////////////
+//////////////////////////
+
+// Cache for data extracted from maps
+//
+// Lobbies ask for the info, minimap and infomaps of every map they list,
+// and each of those calls opens the map archive and decompresses and parses
+// the map again. The results only depend on the map archive, so they are
+// kept in small files next to the other caches, keyed by the map name and
+// the checksum of the archive and its dependencies.
+
+struct MapCacheHeader {
+	char magic[8];
+	int version;
+	unsigned int dataSize;
+	unsigned int dataCRC;
+};
+
+static const char MAP_CACHE_MAGIC[8] = "USMAPC";
+static const int MAP_CACHE_VERSION = 1;
+
+
+/**
+ * @return the cache file for key of mapName,
+ *   or an empty string if the map should not be cached
+ */
+static string GetMapCacheFile(const string& mapName, const string& key)
+{
+	// key ends up in the file name, so allow only harmless characters
+	for (size_t i = 0; i < key.size(); ++i) {
+		const char c = key[i];
+		if (!(((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '_'))) {
+			return "";
+		}
+	}
+
+	const unsigned int checksum = archiveScanner->GetArchiveCompleteChecksum(mapName);
+	if (checksum == 0) {
+		// unknown archive
+		return "";
+	}
+
+	CRC crc;
+	crc.Update(checksum);
+	crc.Update(mapName.c_str(), mapName.size() + 1);
+
+	char name[32];
+	SNPRINTF(name, sizeof(name), "%08x-", crc.GetDigest());
+	return filesystem.LocateDir("cache/unitsync/", FileSystem::WRITE | FileSystem::CREATE_DIRS) + name + key + ".bin";
+}
+
+
+static bool ReadMapCache(const string& fileName, std::vector<char>& data)
+{
+	if (fileName.empty()) {
+		return false;
+	}
+
+	std::ifstream ifs(fileName.c_str(), std::ios::in | std::ios::binary);
+	ifs.seekg(0, std::ios::end);
+	const std::streamoff fileSize = ifs.tellg();
+	ifs.seekg(0, std::ios::beg);
+
+	MapCacheHeader header;
+	if (!ifs.read((char*)&header, sizeof(header)) ||
+	    (memcmp(header.magic, MAP_CACHE_MAGIC, sizeof(header.magic)) != 0) ||
+	    (header.version != MAP_CACHE_VERSION) ||
+	    (header.dataSize == 0) ||
+	    (fileSize != (std::streamoff)(sizeof(header) + header.dataSize))) {
+		return false;
+	}
+	data.resize(header.dataSize);
+	if (!ifs.read(&data[0], header.dataSize)) {
+		return false;
+	}
+	return (CRC().Update(&data[0], data.size()).GetDigest() == header.dataCRC);
+}
+
+
+/// reads an entry written from a single object of type T
+template<typename T>
+static bool ReadMapCache(const string& fileName, T& data)
+{
+	std::vector<char> buf;
+	if (!ReadMapCache(fileName, buf) || (buf.size() != sizeof(T))) {
+		return false;
+	}
+	memcpy(&data, &buf[0], sizeof(T));
+	return true;
+}
+
+
+static void WriteMapCache(const string& fileName, const void* data, unsigned int size)
+{
+	if (fileName.empty() || (size == 0)) {
+		return;
+	}
+
+	// write to a temporary file first, so that other processes
+	// using unitsync never see a partial cache entry
+	const string tempName = fileName + ".tmp";
+	{
+		MapCacheHeader header;
+		memcpy(header.magic, MAP_CACHE_MAGIC, sizeof(header.magic));
+		header.version = MAP_CACHE_VERSION;
+		header.dataSize = size;
+		header.dataCRC = CRC().Update(data, size).GetDigest();
+
+		std::ofstream ofs(tempName.c_str(), std::ios::out | std::ios::binary);
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)data, size);
+		if (!ofs) {
+			return;
+		}
+	}
+	remove(fileName.c_str()); // rename does not replace on windows
+	if (rename(tempName.c_str(), fileName.c_str()) != 0) {
+		remove(tempName.c_str());
+	}
+}
+
 //////////////////////////
 //////////////////////////
 
@@ -592,14 +718,8 @@ static void safe_strzcpy(char* dst, std::string src, size_t max)
 }
 
 
-static int _GetMapInfoEx(const char* name, MapInfo* outInfo, int version)
+static int ReadMapInfo(const char* name, MapInfo* outInfo, int version)
 {
-	CheckInit();
-	CheckNullOrEmpty(name);
-	CheckNull(outInfo);
-
-	logOutput.Print(LOG_UNITSYNC, "get map info: %s", name);
-
 	ScopedMapLoader mapLoader(name);
 	const string mapName = archiveScanner->MapNameToMapFile(name);
 
@@ -691,6 +811,72 @@ static int _GetMapInfoEx(const char* name, MapInfo* outInfo, int version)
 }
 
 
+/// MapInfo with the strings it points to, as stored in the map cache
+struct CachedMapInfo {
+	MapInfo info;
+	char description[255];
+	char author[200];
+};
+
+
+static int _GetMapInfoEx(const char* name, MapInfo* outInfo, int version)
+{
+	CheckInit();
+	CheckNullOrEmpty(name);
+	CheckNull(outInfo);
+
+	logOutput.Print(LOG_UNITSYNC, "get map info: %s", name);
+
+	CachedMapInfo cached;
+	const string cacheFile = GetMapCacheFile(name, "mapinfo");
+
+	if (!ReadMapCache(cacheFile, cached)) {
+		// always read the author, the entry is shared by all versions
+		cached.info.description = cached.description;
+		cached.info.author = cached.author;
+
+		if (!ReadMapInfo(name, &cached.info, 1)) {
+			// errors are not cached, the map may get fixed
+			safe_strzcpy(outInfo->description, cached.description, 255);
+
+			// Fill in stuff so tasclient won't crash
+			outInfo->posCount = 0;
+			if (version >= 1) {
+				outInfo->author[0] = 0;
+			}
+			return 0;
+		}
+
+		cached.info.description = NULL;
+		cached.info.author = NULL;
+		WriteMapCache(cacheFile, &cached, sizeof(cached));
+	}
+
+	// copy member by member, old clients pass a MapInfo without the author
+	outInfo->tidalStrength   = cached.info.tidalStrength;
+	outInfo->gravity         = cached.info.gravity;
+	outInfo->maxMetal        = cached.info.maxMetal;
+	outInfo->extractorRadius = cached.info.extractorRadius;
+	outInfo->minWind         = cached.info.minWind;
+	outInfo->maxWind         = cached.info.maxWind;
+	outInfo->width           = cached.info.width;
+	outInfo->height          = cached.info.height;
+	outInfo->posCount        = std::max(0, std::min(cached.info.posCount, 16));
+	for (int i = 0; i < outInfo->posCount; ++i) {
+		outInfo->positions[i] = cached.info.positions[i];
+	}
+
+	cached.description[sizeof(cached.description) - 1] = 0;
+	safe_strzcpy(outInfo->description, cached.description, 255);
+	if (version >= 1) {
+		cached.author[sizeof(cached.author) - 1] = 0;
+		safe_strzcpy(outInfo->author, cached.author, 200);
+	}
+
+	return 1;
+}
+
+
 /**
  * @brief Retrieve map info
  * @param name name of the map, e.g. "SmallDivide.smf"
@@ -908,20 +1094,19 @@ EXPORT(unsigned int) GetMapChecksumFromName(const char* mapName)
 // Used to return the image
 static char* imgbuf[1024*1024*2];
 
+/// @return NULL if the map has no minimap or it can not be loaded
 static void* GetMinimapSM3(string mapName, int miplevel)
 {
 	MapParser mapParser(mapName);
 	const string minimapFile = mapParser.GetRoot().GetString("minimap", "");
 
 	if (minimapFile.empty()) {
-		memset(imgbuf,0,sizeof(imgbuf));
-		return imgbuf;
+		return NULL;
 	}
 
 	CBitmap bm;
 	if (!bm.Load(minimapFile)) {
-		memset(imgbuf,0,sizeof(imgbuf));
-		return imgbuf;
+		return NULL;
 	}
 
 	if (1024 >> miplevel != bm.xsize || 1024 >> miplevel != bm.ysize)
@@ -1028,6 +1213,16 @@ EXPORT(void*) GetMinimap(const char* filename, int miplevel)
 		if (miplevel < 0 || miplevel > 8)
 			throw std::out_of_range("Miplevel must be between 0 and 8 (inclusive) in GetMinimap.");
 
+		const int mipsize = 1024 >> miplevel;
+		const unsigned int size = mipsize * mipsize * sizeof(unsigned short);
+		const string cacheFile = GetMapCacheFile(filename, "minimap" + IntToString(miplevel));
+
+		std::vector<char> cached;
+		if (ReadMapCache(cacheFile, cached) && (cached.size() == size)) {
+			memcpy(imgbuf, &cached[0], size);
+			return imgbuf;
+		}
+
 		ScopedMapLoader mapLoader(filename);
 		const string mapName = archiveScanner->MapNameToMapFile(filename);
 
@@ -1039,6 +1234,15 @@ EXPORT(void*) GetMinimap(const char* filename, int miplevel)
 			ret = GetMinimapSMF(mapName, miplevel);
 		} else if (extension == "sm3") {
 			ret = GetMinimapSM3(mapName, miplevel);
+			if (ret == NULL) {
+				// black minimap, not cached so a fixed map is picked up
+				memset(imgbuf,0,sizeof(imgbuf));
+				return imgbuf;
+			}
+		}
+
+		if (ret != NULL) {
+			WriteMapCache(cacheFile, ret, size);
 		}
 
 		return ret;
@@ -1066,9 +1270,15 @@ EXPORT(int) GetInfoMapSize(const char* filename, const char* name, int* width, i
 		CheckNull(width);
 		CheckNull(height);
 
-		ScopedMapLoader mapLoader(filename);
-		CSmfMapFile file(archiveScanner->MapNameToMapFile(filename));
-		MapBitmapInfo bmInfo = file.GetInfoMapSize(name);
+		const string cacheFile = GetMapCacheFile(filename, "infosize_" + string(name));
+
+		MapBitmapInfo bmInfo;
+		if (!ReadMapCache(cacheFile, bmInfo)) {
+			ScopedMapLoader mapLoader(filename);
+			CSmfMapFile file(archiveScanner->MapNameToMapFile(filename));
+			bmInfo = file.GetInfoMapSize(name);
+			WriteMapCache(cacheFile, &bmInfo, sizeof(bmInfo));
+		}
 
 		*width = bmInfo.width;
 		*height = bmInfo.height;
@@ -1109,12 +1319,26 @@ EXPORT(int) GetInfoMap(const char* filename, const char* name, void* data, int t
 		CheckNull(data);
 
 		string n = name;
+		const string cacheFile = GetMapCacheFile(filename, "infomap_" + n + "_" + IntToString(typeHint));
+
+		std::vector<char> cached;
+		if (ReadMapCache(cacheFile, cached)) {
+			memcpy(data, &cached[0], cached.size());
+			return 1;
+		}
+
 		ScopedMapLoader mapLoader(filename);
 		CSmfMapFile file(archiveScanner->MapNameToMapFile(filename));
 		int actualType = (n == "height" ? bm_grayscale_16 : bm_grayscale_8);
 
 		if (actualType == typeHint) {
-			return file.ReadInfoMap(n, data);
+			if (!file.ReadInfoMap(n, data)) {
+				return 0;
+			}
+			const MapBitmapInfo bmInfo = file.GetInfoMapSize(name);
+			const int bytesPerPixel = (actualType == bm_grayscale_16 ? 2 : 1);
+			WriteMapCache(cacheFile, data, bmInfo.width * bmInfo.height * bytesPerPixel);
+			return 1;
 		}
 		else if (actualType == bm_grayscale_16 && typeHint == bm_grayscale_8) {
 			// convert from 16 bits per pixel to 8 bits per pixel
@@ -1135,6 +1359,7 @@ EXPORT(int) GetInfoMap(const char* filename, const char* name, void* data, int t
 				*outp = *inp >> 8;
 			}
 			delete[] temp;
+			WriteMapCache(cacheFile, data, size);
 			return 1;
 		}
 		else if (actualType == bm_grayscale_8 && typeHint == bm_grayscale_16) {